@@ -0,0 +1,155 @@
+#ifndef CMD_BIN_H
+#define CMD_BIN_H
+
+#include "stepper.h"
+#include "stepper_pvt.h"
+#include "cmd_json.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* ============================================================================
+ *  Binary Command Protocol
+ *
+ *  Each packet is COBS encoded and terminated by a 0x00 byte:
+ *
+ *    type (1) | seq (1) | payload (fixed per type) | crc16 (2)
+ *
+ *  Multi-byte fields are little endian. The CRC is util_crc16() over type,
+ *  seq and payload. The host numbers packets with seq and may pipeline
+ *  them without waiting. The controller acknowledges in batches: one ACK
+ *  covers every packet since the previous ACK and is sent when the RX ring
+ *  runs dry or after CMD_BIN_ACK_BATCH packets. Queries are answered
+ *  straight away, after any pending ACK.
+ *  Frames are COBS decoded in place in the RX ring; only a frame that
+ *  straddles the ring wrap is copied first.
+ *
+ *  PVT points stream into an attached StepperPvt. The host paces itself on
+ *  the level in PVT_STATUS, which answers PVT_QUERY and is also sent
+ *  unprompted when playback enters an underrun.
+ * ========================================================================== */
+
+#ifndef CMD_BIN_ACK_BATCH
+#define CMD_BIN_ACK_BATCH   16      /* Packets per ACK at most */
+#endif
+
+#define CMD_BIN_PAYLOAD_MAX (4 * STEPPER_GROUP_MAX)  /* Largest payload (group move) */
+
+/* Encoded size of a packet with n payload bytes, delimiter included */
+#define CMD_BIN_ENCODED_MAX(n)  ((n) + 4 + ((n) + 4) / 254 + 2)
+
+/* Encoded bytes without the delimiter: room for the largest packet */
+#ifndef CMD_BIN_FRAME_MAX
+#define CMD_BIN_FRAME_MAX   (CMD_BIN_ENCODED_MAX(CMD_BIN_PAYLOAD_MAX) - 1)
+#endif
+
+/* Host -> controller */
+#define CMD_BIN_MOVE        0x01    /* u8 axis, i32 position */
+#define CMD_BIN_VELOCITY    0x02    /* u8 axis, i32 steps/s */
+#define CMD_BIN_GROUP_MOVE  0x03    /* i32 position[group count] */
+#define CMD_BIN_QUERY       0x04    /* u8 axis */
+#define CMD_BIN_PVT_POINT   0x05    /* u32 duration_us, {i32 position, i32 velocity}[PVT axes] */
+#define CMD_BIN_PVT_RUN     0x06    /* u8 run: 1 = start playback, 0 = stop and flush */
+#define CMD_BIN_PVT_QUERY   0x07    /* (none) */
+
+/* Controller -> host */
+#define CMD_BIN_ACK         0x80    /* u8 last seq, u8 packets covered, u8 errors, u8 last error, u8 its seq */
+#define CMD_BIN_STATUS      0x84    /* u8 axis, i32 position, i32 target, u8 flags */
+#define CMD_BIN_PVT_STATUS  0x85    /* u8 state, u16 level, u16 free, u32 segments, u32 underruns, u32 underrun ticks */
+#define CMD_BIN_TELEMETRY   0x90    /* See telemetry.h */
+#define CMD_BIN_LOG         0x91    /* u32 message ID, u32 DWT timestamp, u32 args[] (logging.h) */
+
+#define CMD_BIN_STATUS_REACHED  0x01
+
+#if 4 + 8 * STEPPER_PVT_AXES > CMD_BIN_PAYLOAD_MAX
+#error "CMD_BIN_PVT_POINT does not fit CMD_BIN_PAYLOAD_MAX"
+#endif
+
+/* Error codes reported in the ACK */
+typedef enum
+{
+    CMD_BIN_OK = 0,
+    CMD_BIN_ERR_CRC,
+    CMD_BIN_ERR_FRAME,              /* Bad COBS or length */
+    CMD_BIN_ERR_TYPE,
+    CMD_BIN_ERR_ARGS,
+    CMD_BIN_ERR_BUSY,               /* Also: PVT ring full */
+    CMD_BIN_ERR_SEQ                 /* Packets missing before this one */
+} CmdBinError;
+
+typedef struct
+{
+    uint32_t packets;               /* Executed */
+    uint32_t acks;                  /* ACK packets sent */
+    uint32_t crc_errors;
+    uint32_t frame_errors;
+    uint32_t unknown;
+    uint32_t bad_args;
+    uint32_t seq_gaps;              /* Packets lost between two received */
+    uint32_t linearized;            /* Frames copied because they wrapped */
+    uint32_t overlong;              /* Frames discarded, > CMD_BIN_FRAME_MAX */
+    uint32_t decode_cycles_max;     /* Decode + CRC + dispatch, one frame */
+} CmdBinStats;
+
+typedef struct
+{
+    StepperGroup *group;
+    bool dry_run;                   /* Validate only (benchmark) */
+
+    /* PVT streaming target, NULL = PVT packets rejected */
+    StepperPvt *pvt;
+    uint32_t pvt_underruns;         /* Underruns already reported */
+
+    /* Sequence tracking */
+    bool synced;                    /* A packet was received */
+    uint8_t seq_next;
+
+    /* Pending ACK */
+    uint8_t ack_seq;
+    uint8_t ack_count;
+    uint8_t ack_errors;
+    uint8_t ack_error;
+    uint8_t ack_error_seq;
+
+    uint8_t frame[CMD_BIN_FRAME_MAX + 1];   /* Wrapped frames only */
+    bool discard;                   /* Skipping the rest of an overlong frame */
+
+    CmdBinStats stats;
+} CmdBin;
+
+void cmd_bin_init(CmdBin *c, StepperGroup *group);
+
+/* Route PVT packets to a playback instance (NULL detaches) */
+void cmd_bin_attach_pvt(CmdBin *c, StepperPvt *pvt);
+
+/*
+ * Execute every complete frame queued in the UART RX ring (main loop)
+ * and acknowledge them. Returns the number of frames consumed.
+ */
+uint32_t cmd_bin_poll(CmdBin *c);
+
+/*
+ * Decode and execute one encoded frame (no delimiter) in place
+ * - The buffer is overwritten by the decoded packet
+ */
+CmdBinError cmd_bin_execute(CmdBin *c, uint8_t *frame, size_t len);
+
+/* Send the pending ACK, if any */
+void cmd_bin_flush_ack(CmdBin *c);
+
+/* COBS encode a packet (type, seq, payload) with its CRC; returns bytes incl. delimiter */
+size_t cmd_bin_encode(uint8_t type, uint8_t seq,
+                      const uint8_t *payload, size_t len,
+                      uint8_t *out, size_t out_len);
+
+/* Debug: packet counts, errors and worst-case frame cost */
+void cmd_bin_print_stats(const CmdBin *c);
+
+/*
+ * Debug: the same move through the binary and the JSON path (dry run):
+ * wire bytes, decode cycles, commands/s the link carries at `baud` and
+ * command latency (wire time + processing)
+ */
+void cmd_bin_benchmark(CmdBin *c, CmdJson *json, uint32_t baud);
+
+#endif /* CMD_BIN_H */
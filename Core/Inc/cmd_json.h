@@ -0,0 +1,104 @@
+#ifndef CMD_JSON_H
+#define CMD_JSON_H
+
+#include "stepper.h"
+#include "jsmn.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* ============================================================================
+ *  JSON Command Interpreter
+ *
+ *  One JSON object per line on the UART:
+ *
+ *    {"cmd":"move","axis":0,"pos":1200}
+ *    {"cmd":"group_move","pos":[1200,-400]}     (or "pos":N for all axes)
+ *    {"cmd":"profile","axis":1,"vmax":40000,"amax":80000,"dmax":80000}
+ *    {"cmd":"status","axis":0}
+ *
+ *  An optional "id" is echoed in the reply. Commands are tokenized by
+ *  jsmn in place in the RX ring, incrementally: each poll scans only the
+ *  bytes that arrived since the last one, and a command runs as soon as
+ *  its closing '}' is in. Tokens are compared and converted straight from
+ *  the ring bytes. Only a command that straddles the ring wrap is copied,
+ *  into a line buffer. Replies are formatted into the TX ring.
+ *
+ *  A command that is malformed, needs more than CMD_JSON_TOKENS tokens or
+ *  runs past CMD_JSON_LINE_MAX bytes is rejected, and input is skipped up
+ *  to the next '\n', so that is where the host should resync.
+ *  Units: positions in steps, vmax in steps/s, amax / dmax in steps/s^2.
+ * ========================================================================== */
+
+#ifndef CMD_JSON_TOKENS
+#define CMD_JSON_TOKENS     32      /* jsmn tokens per command */
+#endif
+
+#ifndef CMD_JSON_LINE_MAX
+#define CMD_JSON_LINE_MAX   256     /* Longest accepted line, bytes */
+#endif
+
+typedef struct
+{
+    uint32_t commands;              /* Executed */
+    uint32_t parse_errors;          /* Malformed JSON or too many tokens */
+    uint32_t token_overflows;       /* Of those: over the token budget */
+    uint32_t unknown;               /* No such "cmd" */
+    uint32_t bad_args;              /* Missing / invalid fields */
+    uint32_t linearized;            /* Commands copied because they wrapped */
+    uint32_t overlong;              /* Commands discarded, > CMD_JSON_LINE_MAX */
+    uint32_t resumed;               /* Scans continuing a partial command */
+    uint32_t parse_cycles_max;      /* Tokenize + dispatch, one command */
+} CmdJsonStats;
+
+typedef struct CmdJson
+{
+    StepperGroup *group;            /* "axis" indexes group->steppers */
+
+    jsmntok_t tok[CMD_JSON_TOKENS];
+    const char *js;                 /* Command being executed */
+    int ntok;
+    bool dry_run;                   /* Validate only (benchmark) */
+
+    /* Command in progress, starting at the RX ring's read position */
+    jsmn_parser parser;             /* Resumable, offsets from its first byte */
+    size_t scanned;                 /* Bytes handed to the parser so far */
+    uint32_t cycles;                /* Parse cycles spent on it so far */
+    bool in_line;                   /* Continues in line[] (it wrapped) */
+
+    char line[CMD_JSON_LINE_MAX + 1];   /* Wrapped commands only */
+    bool discard;                   /* Skipping to the end of a rejected line */
+
+    CmdJsonStats stats;
+} CmdJson;
+
+/* Bind the interpreter to the axes it may command */
+void cmd_json_init(CmdJson *c, StepperGroup *group);
+
+/*
+ * Scan what arrived in the UART RX ring and execute every command that
+ * is complete (main loop). Returns the number of commands consumed
+ */
+uint32_t cmd_json_poll(CmdJson *c);
+
+/* Execute one complete command of len bytes (no terminator needed) */
+bool cmd_json_execute(CmdJson *c, const char *line, size_t len);
+
+/* Debug: command counts, errors and worst-case line cost */
+void cmd_json_print_stats(const CmdJson *c);
+
+/*
+ * Debug: commands/s and worst-case cycles for typical and adversarial
+ * lines (deep nesting, token exhaustion, long escaped strings), parsed
+ * and dispatched in dry-run mode so no axis moves
+ */
+void cmd_json_benchmark(CmdJson *c);
+
+/*
+ * Debug: parse cost of commands delivered in pseudo-random fragments
+ * of 1..max_frag bytes, resumable scan against a re-parse from the
+ * first byte on every fragment (what a non-resumable parser must do)
+ */
+void cmd_json_fragment_benchmark(size_t max_frag);
+
+#endif /* CMD_JSON_H */
@@ -0,0 +1,41 @@
+#ifndef FMT_H
+#define FMT_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ============================================================================
+ *  Formatter
+ *
+ *  Allocation-free replacement for the printf family, covering what the
+ *  firmware prints: %d %i %u %x %X %c %s %% with the '-', '0', '+' and
+ *  ' ' flags (the last two on %d / %i), a width and the 'l' length
+ *  modifier (a no-op: long is 32-bit here).
+ *  No floats, no precision, no '*'; an unknown conversion is copied as is.
+ *
+ *  Output goes to a put callback in runs (literal text, one number, one
+ *  string), so it can land straight in a ring buffer reservation.
+ * ========================================================================== */
+
+/* Receives the output in pieces; ctx is the caller's */
+typedef void (*FmtPut)(void *ctx, const char *s, size_t len);
+
+/*
+ * Format through put; put == NULL only measures.
+ * Returns the full output length.
+ */
+size_t fmt_vformat(FmtPut put, void *ctx, const char *fmt, va_list ap);
+
+/* snprintf semantics: always terminated (len > 0), returns the full length */
+int fmt_vsnprintf(char *buf, size_t len, const char *fmt, va_list ap);
+int fmt_snprintf(char *buf, size_t len, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/*
+ * Debug: cycles per call for the formats the firmware uses, against
+ * newlib's snprintf when built with FMT_COMPARE_NEWLIB (which links it)
+ */
+void fmt_benchmark(void);
+
+#endif /* FMT_H */
@@ -76,6 +76,8 @@ typedef struct {
     unsigned int pos; /* offset in the JSON string */
     unsigned int toknext; /* next token to allocate */
     int toksuper; /* superior token node, e.g parent object or array */
+    int partial; /* stream: start of a string/primitive cut by the input end, or -1 */
+    unsigned char stream; /* set by jsmn_init_stream */
 } jsmn_parser;
 
 /**
@@ -83,6 +85,17 @@ typedef struct {
  */
 void jsmn_init(jsmn_parser *parser, void* reserved);
 
+/**
+ * Create a resumable parser for one JSON value arriving in pieces.
+ * Call jsmn_parse again with the same parser, tokens and buffer start
+ * and a larger len whenever bytes are appended: scanning resumes where
+ * it stopped, also inside a string or primitive. It returns
+ * JSMN_ERROR_PART until the first top-level value is complete, then the
+ * total token count, with parser->pos just past the value (trailing
+ * bytes are left alone).
+ */
+void jsmn_init_stream(jsmn_parser *parser);
+
 /**
  * Run JSON parser. It parses a JSON data string into and array of tokens, each describing
  * a single JSON object.
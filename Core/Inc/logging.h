@@ -8,6 +8,7 @@
 
 #include <main.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -19,6 +20,167 @@
  void logging_UART_TxHalfCpltCallback(UART_HandleTypeDef *huart);
  void logging_UART_ErrorCallback(UART_HandleTypeDef *huart);
 
+/*
+ * TX ring backpressure
+ *
+ * What _write() does when a message does not fit the DMA ring:
+ * - DROP_NEWEST: the message is lost (default)
+ * - DROP_OLDEST: unsent data queued behind the DMA chunk is discarded,
+ *                unless a preempted writer still holds space in it
+ * - TRUNCATE:    the part that fits is queued
+ * - BLOCK:       wait up to the timeout for the DMA to drain; from an ISR,
+ *                with interrupts masked or on timeout it drops the newest
+ *
+ * The TX DMA channel is driven directly (not through HAL UART), with
+ * only its transfer-complete interrupt: each transfer takes everything
+ * queued, and since the first LOG_TX_MIRROR bytes of the ring are repeated
+ * after its end, a wrap does not split it. Under load the ring is sent in
+ * transfers of up to the whole backlog, one interrupt each.
+ */
+#ifndef LOG_TX_RING_SIZE
+#define LOG_TX_RING_SIZE     2048u
+#endif
+
+#ifndef LOG_TX_MIRROR
+#define LOG_TX_MIRROR        512u     /* Wrap-free DMA past the end, bytes */
+#endif
+
+#ifndef LOG_TX_DMA_MAX_LEN
+#define LOG_TX_DMA_MAX_LEN   0xFFFFu  /* DMA CNDTR limit */
+#endif
+
+typedef enum
+{
+    LOG_TX_DROP_NEWEST = 0,
+    LOG_TX_DROP_OLDEST,
+    LOG_TX_TRUNCATE,
+    LOG_TX_BLOCK
+} LogTxPolicy;
+
+typedef struct
+{
+    uint32_t bytes_written;         /* Queued into the ring */
+    uint32_t bytes_dropped;         /* Lost to any policy */
+    uint32_t messages_dropped;      /* Writes that queued nothing */
+    uint32_t messages_truncated;    /* Writes that queued part */
+    uint32_t backlog_discards;      /* DROP_OLDEST backlog flushes */
+    uint32_t block_timeouts;
+    uint32_t high_water;            /* Peak ring level, bytes */
+    uint32_t dma_restarts;          /* Transfers started on an idle UART */
+    uint32_t dma_chained;           /* Transfers started from TX complete */
+    uint32_t dma_bytes;             /* Handed to the DMA */
+    uint32_t dma_irqs;              /* TX interrupts taken */
+    uint32_t dma_errors;
+} LogTxStats;
+
+ void logging_set_tx_policy(LogTxPolicy policy, uint32_t block_timeout_ms);
+
+/*
+ * printf replacement (fmt.h subset, no heap, any context): the message is
+ * measured, a TX ring reservation of exactly its length is claimed under
+ * the policy above, and it is formatted straight into it. Before
+ * init_dma_logging() it goes out blocking in LOG_PRINTF_CHUNK pieces.
+ */
+#ifndef LOG_PRINTF_CHUNK
+#define LOG_PRINTF_CHUNK     64u
+#endif
+
+ int log_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+ int log_vprintf(const char *fmt, va_list ap);
+
+/* Queue a binary frame whole or not at all (any context, never blocks) */
+ bool logging_tx_send_frame(const void *data, size_t len);
+ const LogTxStats *logging_tx_stats(void);
+ void logging_print_tx_stats(void);
+
+/* Nothing queued or in flight, last stop bit sent (e.g. before a baud change) */
+ bool logging_tx_idle(void);
+
+/*
+ * Debug: queue `bytes` of text in 64-byte lines as fast as the ring
+ * takes them (BLOCK policy meanwhile) and report sustained bytes/s
+ * against the line rate, interrupts per KiB and bytes per transfer
+ */
+ void logging_tx_dma_benchmark(uint32_t bytes);
+
+#ifdef LOG_TX_BENCH
+/*
+ * Debug: cycles per TX ring write (plain lwrb, uncontended lwrb_mp) and
+ * per round of three nested producers: thread, PendSV and SysTick, both
+ * pended by software. LOG_TX_BENCH also hooks logging_tx_bench_isr()
+ * into PendSV_Handler and SysTick_Handler; prints the producer counters
+ * after.
+ */
+ void logging_tx_mp_benchmark(uint32_t rounds);
+ void logging_tx_bench_isr(void);
+#endif
+
+/*
+ * Deferred logging
+ *
+ * LOG_DEFER() stores a message ID, a DWT timestamp and up to LOG_ARGS_MAX
+ * raw 32-bit arguments in a lock-free multi-producer ring, safe from ISRs.
+ * The ID is the address of a static const LogMsg holding the format
+ * string, so it is fixed at link time: log_deferred_flush() formats
+ * records later (idle loop), or log_deferred_flush_binary() ships them
+ * unformatted as CMD_BIN_LOG frames (cmd_bin.h) for a host decoder that
+ * resolves IDs from the ELF (telemetry_decode.py --elf).
+ * Arguments are integers; %s only for strings with static storage.
+ */
+#define LOG_ARGS_MAX       4
+#define LOG_RING_SIZE      64      /* Records, power of two */
+
+typedef struct
+{
+    const char *fmt;
+    uint8_t nargs;
+} LogMsg;
+
+/*
+ * CMD_BIN_LOG payload: id, timestamp, args[nargs], little endian words;
+ * nargs follows from the length. The frame seq counts records shipped.
+ */
+typedef struct
+{
+    const LogMsg *msg;
+    uint32_t timestamp;
+    uint32_t arg[LOG_ARGS_MAX];
+    volatile uint32_t seq;          /* Slot state, internal */
+} LogRecord;
+
+typedef struct
+{
+    uint32_t written;
+    uint32_t dropped;               /* Ring full */
+    uint32_t flushed;
+    uint32_t tx_drops;              /* Binary frames the TX ring refused */
+} LogStats;
+
+#define LOG_NARGS_(_0, _1, _2, _3, _4, N, ...)  N
+#define LOG_NARGS(...)  LOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+
+#define LOG_DEFER(fmt, ...)                                                 \
+    do {                                                                    \
+        static const LogMsg log_msg_ = { (fmt), LOG_NARGS(__VA_ARGS__) };   \
+        log_deferred(&log_msg_, (const uint32_t[LOG_ARGS_MAX]){ __VA_ARGS__ }); \
+    } while (0)
+
+/*
+ * Migration macro for printf sites on hot / ISR paths: deferred by
+ * default, immediate log_printf with LOG_DEFERRED_DISABLE
+ */
+#ifdef LOG_DEFERRED_DISABLE
+#define LOG_PRINTF(...)      log_printf(__VA_ARGS__)
+#else
+#define LOG_PRINTF(fmt, ...) LOG_DEFER(fmt, ##__VA_ARGS__)
+#endif
+
+ bool log_deferred(const LogMsg *msg, const uint32_t *args);
+ uint32_t log_deferred_flush(uint32_t max_records);
+ uint32_t log_deferred_flush_binary(uint32_t max_records);
+ const LogStats *log_deferred_stats(void);
+ void log_deferred_benchmark(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,95 @@
+#ifndef LWRB_MP_H
+#define LWRB_MP_H
+
+#include "lwrb.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* ============================================================================
+ *  Multi-producer writes for lwrb
+ *
+ *  lwrb is single producer, single consumer: two writers advancing `w`
+ *  at the same time corrupt the ring. This layer lets any number of
+ *  producers (thread mode and interrupts of any priority) write into one
+ *  lwrb, while the consumer keeps using the plain lwrb read API.
+ *
+ *  A producer reserves space with LDREX/STREX on a single state word that
+ *  holds the reservation head and the number of open reservations, fills
+ *  its space in place and commits. Commits may come in any order; `w` is
+ *  published when the last open reservation commits, so the consumer
+ *  never sees a byte that is still being written. On one core an
+ *  interrupt's data therefore waits for the code it preempted to commit.
+ *
+ *  Producers must not call lwrb_write()/lwrb_advance() on the same ring.
+ *
+ *  Optionally the first `mirror` bytes of the ring are duplicated after
+ *  its end on commit, so a consumer such as a DMA channel can read up to
+ *  `mirror` bytes past the wrap in one linear block.
+ * ========================================================================== */
+
+#define LWRB_MP_HEAD_MASK   0x00FFFFFFu     /* Ring sizes up to 16 MiB */
+#define LWRB_MP_OPEN_SHIFT  24u             /* Up to 255 open reservations */
+
+typedef struct
+{
+    uint32_t start;                 /* Ring index of the first byte */
+    size_t len;
+    uint8_t *ptr[2];                /* Second part only across the wrap */
+    size_t part[2];
+} lwrb_mp_res_t;
+
+typedef struct
+{
+    lwrb_t *rb;
+    volatile uint32_t state;        /* Reservation head | open << LWRB_MP_OPEN_SHIFT */
+    size_t mirror;                  /* Bytes duplicated past the end, 0 = off */
+
+    /* Statistics (updated without atomics, approximate under contention) */
+    uint32_t reserved;              /* Successful reservations */
+    uint32_t full;                  /* Reservations refused for space */
+    uint32_t retries;               /* STREX failures: lost races */
+    uint32_t deferred;              /* Commits that left publishing to another */
+    uint32_t open_max;              /* Peak nesting */
+} lwrb_mp_t;
+
+/* Attach to an initialised, empty ring */
+bool lwrb_mp_init(lwrb_mp_t *mp, lwrb_t *rb);
+
+/* Mirror the first len bytes; rb's buffer must hold size + len bytes */
+bool lwrb_mp_set_mirror(lwrb_mp_t *mp, size_t len);
+
+/* Claim len bytes; false if they do not fit (nothing is claimed) */
+bool lwrb_mp_reserve(lwrb_mp_t *mp, size_t len, lwrb_mp_res_t *res);
+
+/*
+ * Release a filled reservation. Returns true if this call published
+ * data to the consumer (the caller may then kick it, e.g. start DMA).
+ */
+bool lwrb_mp_commit(lwrb_mp_t *mp, const lwrb_mp_res_t *res);
+
+/* Reserve, copy, commit; returns bytes written (len or 0) */
+size_t lwrb_mp_write(lwrb_mp_t *mp, const void *data, size_t len, bool *published);
+
+/*
+ * Optimistic in-place write: lwrb_mp_linear() returns the free space at
+ * the head up to the wrap without claiming it; lwrb_mp_reserve_at()
+ * claims len bytes there only if no producer reserved in between.
+ * The bytes are written before they are claimed, so this is only safe
+ * while no other producer can run: a producer that reserved and filled
+ * them in between would have its data overwritten.
+ */
+void *lwrb_mp_linear(lwrb_mp_t *mp, size_t *len);
+bool lwrb_mp_reserve_at(lwrb_mp_t *mp, const void *at, size_t len, lwrb_mp_res_t *res);
+
+/* Free bytes as seen by producers (open reservations count as used) */
+size_t lwrb_mp_get_free(lwrb_mp_t *mp);
+
+/*
+ * Drop committed data beyond the first `keep` unread bytes; returns the
+ * bytes dropped. Refused (0) while a reservation is open. Call with
+ * interrupts masked; the consumer must not be reading past `keep`.
+ */
+size_t lwrb_mp_rewind(lwrb_mp_t *mp, size_t keep);
+
+#endif /* LWRB_MP_H */
@@ -68,6 +68,12 @@ void Error_Handler(void);
 #define LD2_GPIO_Port GPIOA
 #define STEP1_CS_Pin GPIO_PIN_10
 #define STEP1_CS_GPIO_Port GPIOB
+#define STEP1_DIAG0_Pin GPIO_PIN_8
+#define STEP1_DIAG0_GPIO_Port GPIOC
+#define STEP1_DIAG0_EXTI_IRQn EXTI9_5_IRQn
+#define STEP2_DIAG0_Pin GPIO_PIN_9
+#define STEP2_DIAG0_GPIO_Port GPIOC
+#define STEP2_DIAG0_EXTI_IRQn EXTI9_5_IRQn
 #define DRV_EN_Pin GPIO_PIN_10
 #define DRV_EN_GPIO_Port GPIOA
 #define TMS_Pin GPIO_PIN_13
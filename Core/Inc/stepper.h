@@ -29,9 +29,45 @@ typedef enum
     STEPPER_CAP_STEP_DIR      = (1u << 0), /* STEP/DIR pulse driven */
     STEPPER_CAP_MOVE_TO       = (1u << 1), /* Driver supports absolute move */
     STEPPER_CAP_POSITION_FB   = (1u << 2), /* Driver reports position */
-    STEPPER_CAP_LIMITS        = (1u << 3)  /* Driver handles limit switches */
+    STEPPER_CAP_LIMITS        = (1u << 3), /* Driver handles limit switches */
+    STEPPER_CAP_RAMP_SCALE    = (1u << 4), /* Driver can scale its ramp limits */
+    STEPPER_CAP_VELOCITY      = (1u << 5), /* Driver supports velocity mode */
+    STEPPER_CAP_EVENTS        = (1u << 6), /* Driver raises an event IRQ line */
+    STEPPER_CAP_HOMING        = (1u << 7), /* Hardware stop + position latch */
+    STEPPER_CAP_RAMP_LIMITS   = (1u << 8), /* Driver takes absolute ramp limits */
+    STEPPER_CAP_TIMED_RAMP    = (1u << 9), /* Driver fits its ramp to a duration */
+    STEPPER_CAP_MOVE_TIME     = (1u << 10), /* Driver predicts its move duration */
+    STEPPER_CAP_PROFILE       = (1u << 11) /* Driver takes a new nominal ramp */
 } StepperCaps;
 
+/* Event bits reported by read_events() */
+typedef enum
+{
+    STEPPER_EVT_DONE          = (1u << 0), /* Target position reached */
+    STEPPER_EVT_STALL         = (1u << 1), /* StallGuard stop */
+    STEPPER_EVT_LIMIT_L       = (1u << 2), /* Left reference switch stop */
+    STEPPER_EVT_LIMIT_R       = (1u << 3)  /* Right reference switch stop */
+} StepperEvent;
+
+/* Homing reference used by home_arm() */
+typedef enum
+{
+    STEPPER_HOME_NONE = 0,                 /* Disarm stop and latch */
+    STEPPER_HOME_SW_LEFT,                  /* Left reference switch */
+    STEPPER_HOME_SW_RIGHT,                 /* Right reference switch */
+    STEPPER_HOME_STALL                     /* StallGuard stop (no switch) */
+} StepperHomeSource;
+
+/* Status bits returned by home_status() */
+#define STEPPER_HOME_STOPPED  (1u << 0)    /* Hardware stop has occurred */
+#define STEPPER_HOME_LATCHED  (1u << 1)    /* Latch position is valid */
+
+/* Ramp scale factor (Q16.16), 1.0 = driver nominal VMAX/AMAX/DMAX */
+#define STEPPER_RAMP_SCALE_ONE  (1u << 16)
+
+/* Longest gap between adaptive completion polls (keeps DWT deadlines valid) */
+#define STEPPER_POLL_MAX_US     1000000u
+
 /* ============================================================================
  *  Hardware Driver Interface
  * ========================================================================== */
@@ -59,12 +95,53 @@ typedef struct
     /* Completion check (required if STEPPER_CAP_MOVE_TO) */
     bool (*position_reached)(struct Stepper *stepper);
 
+    /* Completion check + earliest possible arrival in us (optional, adaptive polling) */
+    bool (*poll_motion)(struct Stepper *stepper, uint32_t *quiet_us);
+
+    /* Scale VMAX/AMAX/DMAX by a Q16.16 factor (required if STEPPER_CAP_RAMP_SCALE) */
+    void (*set_ramp_scale)(struct Stepper *stepper, uint32_t scale_q16);
+
+    /* Signed velocity in steps/s (required if STEPPER_CAP_VELOCITY) */
+    void (*set_velocity)(struct Stepper *stepper, int32_t steps_per_s);
+
+    /* Max velocity (0 = keep) and accel/decel in steps/s, steps/s^2
+       (required if STEPPER_CAP_RAMP_LIMITS) */
+    void (*set_ramp_limits)(struct Stepper *stepper, uint32_t v_sps, uint32_t accel_sps2);
+
+    /* Arrival in us of a move over `distance` steps from rest, with the ramp
+       no faster than nominal that lands closest to duration_us (0 = nominal);
+       load writes that ramp (required if STEPPER_CAP_TIMED_RAMP) */
+    uint32_t (*timed_ramp)(struct Stepper *stepper, uint32_t distance,
+                           uint32_t duration_us, bool load);
+
+    /* Duration in us of a move over `distance` steps from rest at the nominal
+       ramp, including any hold before the next move may start
+       (required if STEPPER_CAP_MOVE_TIME) */
+    uint32_t (*move_time)(const struct Stepper *stepper, uint32_t distance);
+
+    /* Nominal max velocity, accel and decel in steps/s, steps/s^2 (0 = keep),
+       applied from the next move (required if STEPPER_CAP_PROFILE) */
+    void (*set_profile)(struct Stepper *stepper, uint32_t v_sps,
+                        uint32_t accel_sps2, uint32_t decel_sps2);
+
+    /* Event IRQ routing (required if STEPPER_CAP_EVENTS) */
+    void (*enable_events)(struct Stepper *stepper, bool enable);
+    uint32_t (*read_events)(struct Stepper *stepper);   /* Read + clear */
+
+    /* Homing (required if STEPPER_CAP_HOMING) */
+    void (*set_position)(struct Stepper *stepper, int32_t position);
+    void (*home_arm)(struct Stepper *stepper, StepperHomeSource source);
+    uint32_t (*home_status)(struct Stepper *stepper, int32_t *latch);
+
 } StepperDriver;
 
 /* ============================================================================
  *  Stepper Instance
  * ========================================================================== */
 
+/* Bitmask of group members, bit i = steppers[i] (add order) */
+typedef uint32_t StepperMask;
+
 typedef struct Stepper
 {
     /* Identity */
@@ -86,22 +163,62 @@ typedef struct Stepper
     /* State flags */
     bool enabled;
     bool busy;
+    bool interpolated;           /* STEP/DIR pulses driven by the group */
+    bool velocity_mode;          /* Running at a commanded velocity */
 
     /* Callbacks */
     StepperDoneCallback done_cb;
 
+    /* Event IRQ path (STEPPER_CAP_EVENTS) */
+    bool events_enabled;             /* Completion comes from the event line */
+    volatile bool event_pending;     /* Latched by the IRQ, read in thread mode */
+    volatile uint32_t event_irq_cycles;  /* DWT cycle of the latching IRQ */
+    volatile uint32_t events;        /* Accumulated StepperEvent bits */
+    uint32_t event_latency_cycles;   /* IRQ entry -> callback, last */
+    uint32_t event_latency_max;
+    uint32_t done_cycles;            /* DWT cycle of the last completion */
+
+    /* Adaptive completion polling (smart drivers with events off) */
+    uint32_t poll_latency_us;        /* Max detection latency, 0 = every update */
+    uint32_t poll_due;               /* DWT cycle of the next poll */
+    bool poll_near;                  /* Arrival window: status-only polls */
+    uint32_t polls;                  /* Completion polls issued */
+
     /* Limit switch handling */
     bool limits_enabled;
     bool limit_hit;
     StepperLimitCallback limit_cb;
 
+    /* Busy and event tracking in the first group this stepper was added to */
+    StepperMask *group_busy;
+    volatile StepperMask *group_events;
+    StepperMask group_bit;
+
 } Stepper;
 
+/* Flag motion in progress and report it to the owning group */
+static inline void stepper_mark_busy(Stepper *s)
+{
+    s->busy = true;
+    if (s->group_busy)
+        *s->group_busy |= s->group_bit;
+}
+
 /* ============================================================================
  *  Stepper Group
  * ========================================================================== */
 
-#define STEPPER_GROUP_MAX  4
+#ifndef STEPPER_GROUP_MAX
+#define STEPPER_GROUP_MAX      32   /* Members per group, at most 32 */
+#endif
+
+#ifndef STEPPER_GROUP_BUS_MAX
+#define STEPPER_GROUP_BUS_MAX  8    /* Distinct SPI buses / CS ports per group */
+#endif
+
+#if STEPPER_GROUP_MAX > 32
+#error "STEPPER_GROUP_MAX must fit in StepperMask"
+#endif
 
 typedef struct
 {
@@ -111,8 +228,48 @@ typedef struct
     bool synch_cs;      // true if all CS are on the same port
     void *synch_cs_port; // port for group CS if synch_cs
     uint16_t synch_cs_mask;      // mask for group CS if synch_cs
+
+    /* Membership masks */
+    StepperMask smart_mask;      // members with STEPPER_CAP_MOVE_TO
+    StepperMask busy_mask;       // members with motion in progress
+    StepperMask interp_mask;     // STEP/DIR members driven by Bresenham
+    volatile StepperMask event_mask; // members with an event latched by the IRQ
+    bool busy_tracked;           // every member reports into busy_mask
+
+    /* Bus and CS groupings, precomputed by stepper_group_add */
+    uint8_t bus_count;
+    void *bus_handle[STEPPER_GROUP_BUS_MAX];
+    StepperMask bus_members[STEPPER_GROUP_BUS_MAX];
+    uint8_t cs_port_count;
+    void *cs_port[STEPPER_GROUP_BUS_MAX];
+    uint16_t cs_pins[STEPPER_GROUP_BUS_MAX];
+
+    /* Linear interpolation state (STEP/DIR axes, Bresenham) */
+    bool interp_active;
+    uint32_t interp_major;       // steps on the longest STEP/DIR axis
+    uint32_t interp_done;        // major steps issued so far
+    uint32_t interp_us_per_step; // major axis step period
+    uint32_t interp_accumulator;
+    uint32_t interp_delta[STEPPER_GROUP_MAX];
+    uint32_t interp_error[STEPPER_GROUP_MAX];
+
+    /* Time-synchronized move (stepper_group_move_synced) */
+    StepperMask sync_mask;       // members moving in the last synced move
+    uint32_t sync_start_cycles;  // DWT cycle at dispatch
+    uint32_t sync_duration_us;   // predicted duration of the slowest axis
+    uint32_t sync_spread_us;     // predicted arrival spread after quantization
 } StepperGroup;
 
+/* Time-aligned position capture of every group member */
+typedef struct
+{
+    int32_t position[STEPPER_GROUP_MAX];
+    uint8_t count;
+    uint32_t timestamp;      // DWT cycle midway between first and last latch
+    uint32_t skew_cycles;    // spread of the per-axis latch instants
+    uint32_t capture_cycles; // total time spent capturing
+} StepperSnapshot;
+
 /* ============================================================================
  *  Low-Level Stepper API (ISR-safe, non-blocking)
  * ========================================================================== */
@@ -143,6 +300,48 @@ uint32_t stepper_get_speed(const Stepper *stepper);
  */
 void stepper_move_to_position(Stepper *stepper, int32_t position);
 
+/*
+ * Predicted duration in us of a move from `from` to `to`, without moving
+ * - Smart drivers: the driver's model at the nominal ramp (move_time),
+ *   including any hold before the next move can start
+ * - STEP/DIR: distance * us_per_step
+ * Returns UINT32_MAX if the axis cannot complete the move
+ */
+uint32_t stepper_estimate_move_time(const Stepper *stepper, int32_t from, int32_t to);
+
+/*
+ * Run at a signed velocity (steps/s) until the next move or velocity
+ * - Requires STEPPER_CAP_VELOCITY
+ * - The driver saturates the magnitude at its speed limit
+ * - Cheap enough for jog / feed-override loops at 1 kHz and above
+ */
+void stepper_set_velocity(Stepper *stepper, int32_t steps_per_s);
+
+/*
+ * Replace the ramp limits in steps/s and steps/s^2 (accel and decel)
+ * - v_sps = 0 keeps the current max velocity (velocity mode sets its own)
+ * - Hold until stepper_move_to_position() restores the nominal ramp
+ * Returns false without STEPPER_CAP_RAMP_LIMITS
+ */
+bool stepper_set_ramp_limits(Stepper *stepper, uint32_t v_sps, uint32_t accel_sps2);
+
+/*
+ * Replace the nominal ramp: max velocity in steps/s, accel and decel in
+ * steps/s^2, 0 keeping the current value
+ * - Moves from the next one on run it, group scaling included
+ * Returns false without STEPPER_CAP_PROFILE
+ */
+bool stepper_set_profile(Stepper *stepper, uint32_t v_sps,
+                         uint32_t accel_sps2, uint32_t decel_sps2);
+
+/*
+ * Absolute move under the given ramp limits instead of the nominal ramp
+ * Returns false unless the driver has STEPPER_CAP_MOVE_TO and
+ * STEPPER_CAP_RAMP_LIMITS
+ */
+bool stepper_move_to_limited(Stepper *stepper, int32_t position,
+                             uint32_t v_sps, uint32_t accel_sps2);
+
 /*
  * Update motor state
  * - Call periodically with elapsed microseconds
@@ -155,11 +354,50 @@ bool stepper_update(Stepper *stepper, uint32_t delta_us);
  */
 int32_t stepper_get_position(Stepper *stepper);
 
+/*
+ * Redefine the current position without moving (driver-owned position)
+ */
+void stepper_set_position(Stepper *stepper, int32_t position);
+
 /*
  * Check if motion is complete
  */
 bool stepper_position_reached(Stepper *stepper);
 
+/*
+ * Route driver events (completion, stall, limits) to an interrupt line
+ * - While enabled, stepper_update no longer polls position_reached
+ */
+void stepper_enable_events(Stepper *stepper, bool enable);
+
+/*
+ * Adaptive completion polling for smart drivers with events off
+ * - Each full poll yields the earliest time the axis could arrive (from
+ *   remaining distance, current velocity and the ramp limits); no SPI
+ *   traffic until then, so cruising axes are sampled sparsely
+ * - Near arrival only the status is polled, every max_latency_us
+ * - 0 restores polling on every stepper_update
+ */
+void stepper_set_poll_latency(Stepper *stepper, uint32_t max_latency_us);
+
+/*
+ * Event interrupt entry point
+ * - Call from the EXTI handler wired to the driver's event output
+ * - Only latches the event: reading the driver would need its bus, which
+ *   the interrupted code may be in the middle of using
+ * - irq_cycles is DWT->CYCCNT captured at handler entry, used to
+ *   measure event-to-callback latency
+ */
+void stepper_handle_event_irq(Stepper *stepper, uint32_t irq_cycles);
+
+/*
+ * Read and clear a latched event, run the callbacks (thread mode)
+ * - stepper_update does this first; call it directly for axes that
+ *   are not updated, e.g. from the main loop
+ * - Returns true if an event was pending
+ */
+bool stepper_service_events(Stepper *stepper);
+
 /*
  * Register completion callback
  */
@@ -208,6 +446,7 @@ void Stepper_move(volatile Stepper *s, int32_t position);
 /*
  * Wait for motor to stop
  * timeout_ms = 0 → wait forever
+ * - Core sleeps in WFE between the completion event and HAL tick wakeups
  */
 void Stepper_awaitStop(volatile Stepper *s, uint32_t timeout_ms);
 
@@ -223,24 +462,90 @@ void Stepper_hitLimit(volatile Stepper *s, void *sw);
 
 /*
  * Wait for limit switch event
- * Returns true if limit was hit before timeout
+ * Returns true if limit was hit before timeout (HAL tick based)
  */
 bool Stepper_awaitLimit(volatile Stepper *s, uint32_t timeout_ms);
 
+/*
+ * Select the group captured by Stepper_positions()
+ */
+void Stepper_bindPositions(StepperGroup *group);
+
 /*
  * Get array of current positions for all steppers
+ * - Captures a fresh snapshot of the bound group (in add order)
+ * - Timestamp and skew of that capture are in Stepper_lastSnapshot()
  */
 int32_t *Stepper_positions(void);
+const StepperSnapshot *Stepper_lastSnapshot(void);
 
 /* ============================================================================
  *  Stepper Group API
  * ========================================================================== */
 
 void stepper_group_init(StepperGroup *group);
+
+/*
+ * Add a member; bus and CS groupings are updated incrementally
+ * Returns false if the group or its bus table (STEPPER_GROUP_BUS_MAX) is full
+ */
 bool stepper_group_add(StepperGroup *group, Stepper *stepper);
 
 void stepper_group_enable(StepperGroup *group, bool enable);
 void stepper_group_move_to(StepperGroup *group, int32_t position);
+
+/*
+ * Coordinated straight-line move to a per-axis target vector
+ * - positions[] holds one absolute target per group member (in add order)
+ * - Smart-driver axes get VMAX/AMAX/DMAX scaled by |delta_i| / |delta_max|
+ *   so every ramp is a scaled copy of the longest one
+ * - STEP/DIR axes are stepped together by Bresenham from stepper_group_update
+ * - Mixed moves (smart and STEP/DIR axes both moving) run to one duration:
+ *   the longer of the Bresenham pass and the slowest nominal ramp. The
+ *   step period is stretched to it and smart axes fit their ramp to it
+ *   (timed_ramp), so all axes arrive together
+ * Returns false if the group is empty or positions is NULL, and without
+ * motion if a mixed move has a smart axis lacking STEPPER_CAP_TIMED_RAMP
+ */
+bool stepper_group_move_to_positions(StepperGroup *group, const int32_t *positions);
 bool stepper_group_update(StepperGroup *group, uint32_t delta_us);
 
+/*
+ * Move to a target vector so every smart axis arrives at the same time
+ * - The slowest axis at its nominal ramp sets the duration; every other
+ *   axis loads the ramp its driver fits to it (timed_ramp)
+ * Returns true if the predicted arrival spread is within tolerance_us (the
+ * move is dispatched either way); false without motion if a member lacks
+ * STEPPER_CAP_TIMED_RAMP
+ */
+bool stepper_group_move_synced(StepperGroup *group,
+                               const int32_t *positions,
+                               uint32_t tolerance_us);
+
+/* Measured arrival spread of the last synced move in us, UINT32_MAX while moving */
+uint32_t stepper_group_sync_spread_us(const StepperGroup *group);
+
+/* Debug: print predicted vs. measured arrival of the last synced move */
+void stepper_group_print_sync(const StepperGroup *group);
+
+/*
+ * Predicted duration in us of a group move, without moving
+ * - from[] (NULL = current positions) and to[] hold one entry per member
+ * - The slowest member sets the duration (stepper_group_move_synced);
+ *   STEP/DIR members follow the Bresenham major axis
+ * Returns UINT32_MAX if some member cannot complete its move
+ */
+uint32_t stepper_group_estimate_move_time(StepperGroup *group,
+                                          const int32_t *from,
+                                          const int32_t *to);
+
+/*
+ * Capture XACTUAL of every member in one pipelined pass per SPI bus
+ * - Buses run in parallel, so the cost is about two frames per bus member
+ *   instead of two blocking frames per axis
+ * - STEP/DIR members report their counted position at capture time
+ * Returns false if the group is empty or snap is NULL
+ */
+bool stepper_group_snapshot(StepperGroup *group, StepperSnapshot *snap);
+
 #endif /* STEPPER_H */
@@ -18,6 +18,24 @@ void stepper_config_init(void);
 Stepper *stepper_config_get_stepper(StepperId id);
 StepperGroup *stepper_config_get_group(void);
 
+/* DIAG0 EXTI dispatch: call from the EXTI handler with DWT->CYCCNT at entry */
+void stepper_config_handle_diag(uint16_t pin, uint32_t irq_cycles);
+
+/* Service DIAG0 events latched by the EXTI handler (main loop) */
+void stepper_config_service_events(void);
+
+/* Debug: print event-to-callback latency per stepper */
+void stepper_config_print_event_latency(void);
+
+/* Debug: cycles for update / move / position on a real axis (static vs table dispatch) */
+void stepper_config_benchmark_dispatch(void);
+
+/* Debug: predicted vs. DWT-measured move time on a real axis */
+void stepper_config_check_estimate(void);
+
+/* Debug: SPI frames and bus load of polled completion, every update vs. adaptive */
+void stepper_config_benchmark_polling(uint32_t max_latency_us);
+
 /* Debug: print driver registers for a stepper (if supported) */
 void stepper_config_print_registers(Stepper *stepper);
 
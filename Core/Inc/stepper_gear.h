@@ -0,0 +1,86 @@
+#ifndef STEPPER_GEAR_H
+#define STEPPER_GEAR_H
+
+#include "stepper.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ============================================================================
+ *  Electronic Gearing
+ *
+ *  Slave axes of a group follow one master axis at a Q16.16 ratio. Each
+ *  update samples the master's XACTUAL / VACTUAL with pipelined frames and
+ *  commands every slave in position mode: XTARGET from the geared master
+ *  position, VMAX from the geared master velocity plus a catch-up margin.
+ *  Call stepper_gear_update() at a fixed rate (timer ISR or main loop).
+ *  Every update starts a new slave move, so give slaves a short TVMAX:
+ *  the ramp holds each peak for that long before it may brake.
+ * ========================================================================== */
+
+#define STEPPER_GEAR_RATIO_ONE  (1 << 16)
+
+typedef struct
+{
+    uint32_t updates;
+    uint32_t period_cycles;         /* Between the last two updates */
+    uint32_t period_cycles_max;
+    uint32_t update_cycles_max;     /* Cost of one update */
+    uint32_t samples;               /* Tracking error samples */
+    int32_t error_max;              /* Largest |XTARGET - XACTUAL| on a slave */
+    uint64_t error_abs_total;
+    uint32_t reprimes;              /* Pending VACTUAL reply taken by another frame */
+} StepperGearStats;
+
+typedef struct
+{
+    StepperGroup *group;
+    uint8_t master;                         /* Master index in the group */
+
+    int32_t ratio_q16[STEPPER_GROUP_MAX];   /* Slave ratio, 0 = not geared */
+    int32_t slave_origin[STEPPER_GROUP_MAX];
+    int32_t master_origin[STEPPER_GROUP_MAX];
+    int32_t slave_target[STEPPER_GROUP_MAX];
+    uint32_t slave_vmax[STEPPER_GROUP_MAX]; /* Last VMAX written */
+    bool slave_events[STEPPER_GROUP_MAX];   /* Event IRQ state to restore */
+
+    /* Last master sample */
+    int32_t master_x;
+    int32_t master_v;                       /* VACTUAL, signed register units */
+    bool primed;                            /* VACTUAL request in flight */
+    uint32_t master_frames;                 /* Master spi_frames after that request */
+
+    bool active;
+    bool measure;                           /* Read slave XACTUAL each update */
+    uint32_t last_cycles;
+
+    StepperGearStats stats;
+} StepperGear;
+
+/*
+ * Couple every group member except `master` at its ratio
+ * - ratios_q16[] has one Q16.16 entry per member (master entry ignored,
+ *   0 leaves a member free); negative ratios reverse the slave
+ * - Slave VMAX saturates at TMC5240_MAX_VELOCITY: past it the slave lags
+ * - Slaves start from their current position, so engaging never jumps
+ */
+void stepper_gear_start(StepperGear *gear,
+                        StepperGroup *group,
+                        uint8_t master,
+                        const int32_t *ratios_q16);
+
+/* Change one slave's ratio on the fly, re-based at the current point */
+void stepper_gear_set_ratio(StepperGear *gear, uint8_t axis, int32_t ratio_q16);
+
+/* Sample the master and command the slaves; returns false if inactive */
+bool stepper_gear_update(StepperGear *gear);
+
+/* Decouple: slaves finish on their last target as ordinary moves */
+void stepper_gear_stop(StepperGear *gear);
+
+/* Enable per-update tracking error measurement (two extra frames per slave) */
+void stepper_gear_measure(StepperGear *gear, bool enable);
+
+/* Debug: update rate, update cost and tracking error */
+void stepper_gear_print_stats(const StepperGear *gear);
+
+#endif /* STEPPER_GEAR_H */
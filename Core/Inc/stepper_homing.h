@@ -0,0 +1,73 @@
+#ifndef STEPPER_HOMING_H
+#define STEPPER_HOMING_H
+
+#include "stepper.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ============================================================================
+ *  Two-Phase Homing Engine
+ *
+ *  Per axis: fast seek with a hardware stop on the reference, back off,
+ *  slow re-approach with the position latch armed, then redefine XACTUAL
+ *  so the latched switch position becomes home_position. All group axes
+ *  run concurrently from stepper_homing_update().
+ * ========================================================================== */
+
+typedef enum
+{
+    STEPPER_HOMING_IDLE = 0,
+    STEPPER_HOMING_FAST_SEEK,
+    STEPPER_HOMING_BACKOFF,
+    STEPPER_HOMING_SLOW_SEEK,
+    STEPPER_HOMING_DONE,
+    STEPPER_HOMING_ERROR
+} StepperHomingState;
+
+typedef struct
+{
+    StepperHomeSource source;   /* Switch or StallGuard reference */
+    int32_t fast_velocity;      /* steps/s, sign points toward the switch */
+    int32_t slow_velocity;      /* steps/s, same sign as fast_velocity */
+    int32_t backoff;            /* Steps to retreat before the slow seek */
+    int32_t home_position;      /* XACTUAL value at the switch edge */
+    uint32_t timeout_ms;        /* Per phase, 0 = no timeout */
+} StepperHomingConfig;
+
+typedef struct
+{
+    Stepper *stepper;
+    const StepperHomingConfig *cfg;
+    StepperHomingState state;
+    uint32_t phase_start;       /* HAL tick at phase entry */
+    int32_t fast_latch;         /* Switch position from the fast seek */
+    int32_t latch;              /* Exact switch position from the slow seek */
+} StepperHomingAxis;
+
+typedef struct
+{
+    StepperHomingAxis axes[STEPPER_GROUP_MAX];
+    uint8_t count;
+} StepperHoming;
+
+/*
+ * Start homing every group member
+ * - cfgs[] holds one configuration per member (in add order); a NULL
+ *   entry or a driver without STEPPER_CAP_HOMING leaves that axis idle
+ */
+void stepper_homing_start(StepperHoming *homing,
+                          StepperGroup *group,
+                          const StepperHomingConfig *const *cfgs);
+
+/*
+ * Advance all axis state machines (non-blocking)
+ * - Returns true while any axis is still homing
+ */
+bool stepper_homing_update(StepperHoming *homing);
+
+/* Abort homing: stop seeking axes and disarm the hardware stop */
+void stepper_homing_abort(StepperHoming *homing);
+
+StepperHomingState stepper_homing_state(const StepperHoming *homing, uint8_t axis);
+
+#endif /* STEPPER_HOMING_H */
@@ -0,0 +1,108 @@
+#ifndef STEPPER_PLANNER_H
+#define STEPPER_PLANNER_H
+
+#include "stepper.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ============================================================================
+ *  Look-ahead Segment Planner
+ *
+ *  Queues straight-line group segments in a ring and plans junction
+ *  velocities so continuous toolpaths do not stop at every vertex.
+ *  Units: positions in steps, velocities in steps/s, accel in steps/s^2.
+ * ========================================================================== */
+
+#define STEPPER_PLANNER_SIZE  16   /* Ring depth, power of two */
+
+typedef struct
+{
+    int32_t target[STEPPER_GROUP_MAX];  /* Absolute segment end point */
+    float unit[STEPPER_GROUP_MAX];      /* Direction unit vector */
+    float length;                       /* Euclidean length */
+    float accel;                        /* Accel limit along the segment */
+    float v_nominal;                    /* Requested feed */
+    float v_entry_max;                  /* Junction + feed limit at entry */
+    float v_entry;                      /* Planned entry velocity */
+    uint8_t major;                      /* Axis with the largest travel */
+} StepperSegment;
+
+typedef enum
+{
+    STEPPER_PLAN_IDLE = 0,
+    STEPPER_PLAN_CRUISE,                /* Ramping to / holding v_nominal */
+    STEPPER_PLAN_DECEL,                 /* Ramping down to the exit velocity */
+    STEPPER_PLAN_FINAL                  /* Last segment in position mode */
+} StepperPlanPhase;
+
+typedef struct
+{
+    uint32_t appended;                  /* Segments accepted */
+    uint32_t append_cycles_last;        /* DWT cycles for the last append */
+    uint32_t append_cycles_max;
+    uint64_t append_cycles_total;
+} StepperPlannerStats;
+
+typedef struct
+{
+    StepperGroup *group;
+
+    /* Limits */
+    float axis_accel[STEPPER_GROUP_MAX];
+    float junction_deviation;           /* Steps, larger = faster corners */
+
+    /* Segment ring: tail is executing, planned is first re-plannable */
+    StepperSegment ring[STEPPER_PLANNER_SIZE];
+    uint8_t head;
+    uint8_t tail;
+    uint8_t planned;
+
+    /* End point of the newest queued segment */
+    int32_t last_target[STEPPER_GROUP_MAX];
+    float last_unit[STEPPER_GROUP_MAX];
+    float last_v_nominal;
+
+    /* Execution */
+    StepperPlanPhase phase;
+    float v_cmd;                        /* Path velocity last commanded */
+    float v_axis[STEPPER_GROUP_MAX];    /* Its per-axis components */
+
+    StepperPlannerStats stats;
+} StepperPlanner;
+
+/*
+ * Bind a planner to a group
+ * - axis_accel[] holds one acceleration limit per group member
+ * - Start position is read from the group members
+ * Returns false unless every member supports absolute moves, velocity
+ * mode and explicit ramp limits (STEPPER_CAP_MOVE_TO | _VELOCITY |
+ * _RAMP_LIMITS); STEP/DIR members cannot follow velocity segments
+ */
+bool stepper_planner_init(StepperPlanner *planner,
+                          StepperGroup *group,
+                          const float *axis_accel,
+                          float junction_deviation);
+
+/*
+ * Queue a straight segment to an absolute target vector at feed steps/s
+ * - Re-plans only the part of the ring that can still change
+ * Returns false if the ring is full or the segment has zero length
+ */
+bool stepper_planner_append(StepperPlanner *planner,
+                            const int32_t *target,
+                            float feed);
+
+/*
+ * Execute queued segments
+ * - Call periodically from the main loop
+ * - Returns true while the planner still has motion in progress
+ */
+bool stepper_planner_update(StepperPlanner *planner);
+
+/* Number of queued segments, including the executing one */
+uint8_t stepper_planner_count(const StepperPlanner *planner);
+
+/* Debug: print append cost in cycles and the sustainable segment rate */
+void stepper_planner_print_stats(const StepperPlanner *planner);
+
+#endif /* STEPPER_PLANNER_H */
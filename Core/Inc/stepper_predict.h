@@ -0,0 +1,97 @@
+#ifndef STEPPER_PREDICT_H
+#define STEPPER_PREDICT_H
+
+#include "stepper.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ============================================================================
+ *  Ramp Model Position Predictor
+ *
+ *  Mirrors the TMC5240 six-point ramp generator (RAMPMODE, XTARGET,
+ *  VMAX, AMAX, DMAX as last written, tracked by the driver's register
+ *  shadow; VSTART, A1, V1, A2, V2, D2, D1, VSTOP and TVMAX as set at
+ *  init) and extrapolates XACTUAL from the last SPI sample. Every
+ *  prediction carries an error bound; a real read happens only when that
+ *  bound exceeds the configured tolerance.
+ *  Units: positions in steps, velocities in steps/s, accel in steps/s^2.
+ * ========================================================================== */
+
+typedef struct
+{
+    uint32_t predictions;       /* Queries answered */
+    uint32_t syncs;             /* SPI re-syncs (XACTUAL + VACTUAL) */
+    uint32_t checks;            /* stepper_predict_check() samples */
+    uint32_t violations;        /* Checks where |error| > bound */
+    float error_max;            /* Largest |error| seen by a check */
+    float bound_at_error_max;
+} StepperPredictStats;
+
+typedef struct
+{
+    Stepper *stepper;
+
+    /* Configuration */
+    float tolerance;            /* Re-sync once the bound exceeds this */
+    float clock_tolerance;      /* Relative fCLK error, e.g. 0.02 */
+
+    /* Mirrored ramp parameters */
+    uint32_t gen;               /* Driver shadow generation applied */
+    uint8_t rampmode;
+    float target;
+    float vstart;
+    float a1;
+    float v1;
+    float a2;
+    float v2;
+    float amax;
+    float vmax;
+    float dmax;
+    float d2;
+    float d1;
+    float vstop;
+    float tvmax;                /* Seconds */
+
+    /* Model state */
+    float x;                    /* Predicted XACTUAL */
+    float v;                    /* Predicted VACTUAL */
+    uint32_t t_model;           /* DWT cycle the state refers to */
+    uint32_t t_sync;            /* DWT cycle XACTUAL was last sampled */
+    float travelled;            /* |distance| since the last sync */
+    float v_error;              /* Velocity uncertainty of the last sample */
+    uint32_t events;            /* Stepper event bits seen at the last sync */
+    bool valid;
+
+    StepperPredictStats stats;
+} StepperPredictor;
+
+/*
+ * Bind a predictor to a smart-driver axis and take the first sample
+ * - tolerance: steps of error accepted before a re-sync
+ * - clock_tolerance: relative error of the TMC5240 clock vs TMC5240_FCLK_HZ
+ */
+void stepper_predict_init(StepperPredictor *p,
+                          Stepper *stepper,
+                          float tolerance,
+                          float clock_tolerance);
+
+/* Read XACTUAL / VACTUAL and restart the model from the sample */
+void stepper_predict_sync(StepperPredictor *p);
+
+/*
+ * Predicted XACTUAL now
+ * - bound (optional) receives the error bound in steps
+ * - Re-syncs over SPI first if the bound would exceed the tolerance
+ */
+int32_t stepper_predict_position(StepperPredictor *p, float *bound);
+
+/*
+ * Validate the model: compare the prediction with a real XACTUAL read,
+ * record the error against the bound, then re-sync. Returns the error.
+ */
+float stepper_predict_check(StepperPredictor *p);
+
+/* Debug: print query/sync counts and the observed error vs. bound */
+void stepper_predict_print_stats(const StepperPredictor *p);
+
+#endif /* STEPPER_PREDICT_H */
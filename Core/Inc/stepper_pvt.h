@@ -0,0 +1,146 @@
+#ifndef STEPPER_PVT_H
+#define STEPPER_PVT_H
+
+#include "stepper.h"
+#include "lwrb.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ============================================================================
+ *  PVT Trajectory Playback
+ *
+ *  The host streams position-velocity-time points for the first `axes`
+ *  members of a group. Points are queued in an lwrb ring (host side is the
+ *  single producer, the playback tick the single consumer) and every tick
+ *  interpolates the current segment with a cubic Hermite in fixed point,
+ *  commanding each axis in velocity mode.
+ *  Units: positions in steps, velocities in steps/s, time in us.
+ * ========================================================================== */
+
+#ifndef STEPPER_PVT_AXES
+#define STEPPER_PVT_AXES        4           /* Axes carried per point */
+#endif
+
+#ifndef STEPPER_PVT_DEPTH
+#define STEPPER_PVT_DEPTH       64          /* Queued points */
+#endif
+
+#define STEPPER_PVT_SEGMENT_MAX_US  1000000u    /* Longest accepted segment */
+
+typedef struct
+{
+    int32_t position[STEPPER_PVT_AXES];     /* Absolute, steps */
+    int32_t velocity[STEPPER_PVT_AXES];     /* Steps/s at the point */
+    uint32_t duration_us;                   /* Time from the previous point */
+} StepperPvtPoint;
+
+typedef enum
+{
+    STEPPER_PVT_IDLE = 0,
+    STEPPER_PVT_RUNNING,
+    STEPPER_PVT_UNDERRUN                    /* Ring ran dry mid-trajectory */
+} StepperPvtState;
+
+typedef struct
+{
+    uint32_t pushed;                        /* Points accepted */
+    uint32_t rejected;                      /* Pushes refused (full / invalid) */
+    uint32_t segments;                      /* Segments played */
+    uint32_t ticks;
+    uint32_t ticks_missed;                  /* Timer ticks latched over a pending one */
+    uint32_t underruns;                     /* Entries into UNDERRUN */
+    uint32_t underrun_ticks;                /* Ticks spent waiting for data */
+    uint16_t level_min;                     /* Lowest ring level while running */
+    uint16_t level_max;
+    uint32_t tick_cycles_max;               /* Cost of one tick */
+    int32_t error_max;                      /* Largest |desired - XACTUAL| (kp > 0) */
+} StepperPvtStats;
+
+typedef struct
+{
+    StepperGroup *group;
+    uint8_t axes;
+
+    /* Point ring */
+    lwrb_t ring;
+    uint8_t ring_data[STEPPER_PVT_DEPTH * sizeof(StepperPvtPoint) + 1];
+
+    /* Producer side: end of the last accepted point, for validation */
+    int32_t push_position[STEPPER_PVT_AXES];
+
+    /* Current segment */
+    StepperPvtPoint from;
+    StepperPvtPoint to;
+    uint32_t elapsed_us;                    /* Time into the segment */
+    uint32_t last_cycles;
+
+    /* Feedback gain in 1/s applied to the position error, 0 = open loop */
+    int32_t kp;
+    uint32_t tick_us;                       /* Nominal tick period */
+
+    int32_t v_cmd[STEPPER_PVT_AXES];        /* Last velocity commanded */
+    volatile StepperPvtState state;
+    volatile bool tick_pending;             /* Latched by the timer, run in thread mode */
+
+    StepperPvtStats stats;
+} StepperPvt;
+
+/*
+ * Bind playback to the first `axes` members of a group
+ * - Members must support STEPPER_CAP_VELOCITY
+ * - The trajectory starts from the members' current positions at rest
+ * - tick_us: period stepper_pvt_tick() is called at
+ * - kp: position correction gain in 1/s (0 disables the XACTUAL reads)
+ * Returns false if the group cannot be used
+ */
+bool stepper_pvt_init(StepperPvt *pvt,
+                      StepperGroup *group,
+                      uint8_t axes,
+                      uint32_t tick_us,
+                      int32_t kp);
+
+/*
+ * Queue a point (producer side); false if the ring is full or the point
+ * is invalid: duration 0 or over STEPPER_PVT_SEGMENT_MAX_US, or a velocity
+ * or average segment speed |dp| / T above the driver limit
+ * (TMC5240_MAX_SPS) on any axis
+ */
+bool stepper_pvt_push(StepperPvt *pvt, const StepperPvtPoint *point);
+
+/* Points queued and free slots, for host flow control */
+uint16_t stepper_pvt_level(StepperPvt *pvt);
+uint16_t stepper_pvt_free(StepperPvt *pvt);
+
+/* Begin playback of the queued points */
+void stepper_pvt_start(StepperPvt *pvt);
+
+/*
+ * Advance playback (thread mode)
+ * - Issues SPI frames: the velocity commands and, with kp > 0, XACTUAL
+ *   reads, so it must not run in an interrupt that can preempt other
+ *   users of the bus
+ * - Elapsed time is taken from DWT so call jitter does not accumulate
+ * - Returns true while a trajectory is running or waiting for data
+ */
+bool stepper_pvt_tick(StepperPvt *pvt);
+
+/*
+ * Timer period callback entry point, every tick_us
+ * - Only latches the tick and wakes the main loop; stepper_pvt_service()
+ *   runs it
+ */
+void stepper_pvt_tick_irq(StepperPvt *pvt);
+
+/*
+ * Run a latched tick, if any (main loop)
+ * - Returns true while a trajectory is running or waiting for data
+ */
+bool stepper_pvt_service(StepperPvt *pvt);
+
+/* Stop all axes and drop the queued points */
+void stepper_pvt_stop(StepperPvt *pvt);
+
+/* Debug: buffer levels, underruns and tick cost */
+void stepper_pvt_print_stats(const StepperPvt *pvt);
+
+#endif /* STEPPER_PVT_H */
@@ -0,0 +1,88 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "stepper.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ============================================================================
+ *  Axis Telemetry Stream
+ *
+ *  Fixed-layout binary frames of selected per-axis fields, sent at a set
+ *  rate through the USART2 TX ring (DMA). The frames use the cmd_bin
+ *  packet format: COBS framing, a sequence number and a CRC16. The
+ *  payload is (little endian):
+ *
+ *    u32 timestamp_us | u32 axis_mask | u8 fields |
+ *    per axis in mask order, per field in bit order:
+ *      POSITION i32 | VELOCITY i32 | STALLGUARD u16 | DRV_STATUS u32 |
+ *      STATUS u8 | AGE u16
+ *
+ *  Values come from the samples the TMC5240 driver keeps of the replies
+ *  that already pass over SPI. Streaming adds no SPI reads, so a field is
+ *  only as fresh as the last read of its register; AGE reports how old.
+ *  telemetry_decode.py in the repository root decodes the stream.
+ * ========================================================================== */
+
+#define TELEMETRY_POSITION      (1u << 0)   /* XACTUAL, steps */
+#define TELEMETRY_VELOCITY      (1u << 1)   /* VACTUAL, register units */
+#define TELEMETRY_STALLGUARD    (1u << 2)   /* DRV_STATUS SG_RESULT */
+#define TELEMETRY_DRV_STATUS    (1u << 3)   /* Full DRV_STATUS word */
+#define TELEMETRY_STATUS        (1u << 4)   /* SPI status byte */
+#define TELEMETRY_AGE           (1u << 5)   /* Oldest sent field, us (saturates) */
+#define TELEMETRY_FIELDS_ALL    0x3Fu
+
+typedef struct
+{
+    uint32_t frames;                /* Sent */
+    uint32_t overruns;              /* Slots missed: tick came too late */
+    uint32_t tx_drops;              /* Frames lost to a full TX ring */
+    uint64_t elapsed_cycles;        /* Since telemetry_start */
+    uint32_t pack_cycles_max;       /* Cost of building one frame */
+} TelemetryStats;
+
+typedef struct
+{
+    StepperGroup *group;
+    uint32_t axis_mask;             /* Group members streamed */
+    uint8_t fields;
+    uint32_t rate_hz;               /* Requested */
+    uint32_t baud;                  /* Link rate at start */
+    uint16_t frame_bytes;           /* On the wire, delimiter included */
+
+    uint32_t period_cycles;
+    uint32_t next_due;              /* DWT cycle of the next frame */
+    uint32_t last_cycles;
+    uint8_t seq;
+    bool active;
+
+    TelemetryStats stats;
+} Telemetry;
+
+/*
+ * Start streaming `fields` of the group members in axis_mask at rate_hz
+ * - Only smart-driver members can be streamed
+ * - baud > 0 switches USART2 first; TELEMETRY_BAUD_MAX picks PCLK1 / 8
+ * Returns false if the selection is empty or the frame too large
+ */
+#define TELEMETRY_BAUD_MAX  UINT32_MAX
+
+bool telemetry_start(Telemetry *t,
+                     StepperGroup *group,
+                     uint32_t axis_mask,
+                     uint8_t fields,
+                     uint32_t rate_hz,
+                     uint32_t baud);
+
+/*
+ * Send a frame if one is due; call from the main loop or a timer at least
+ * at rate_hz. Returns true if a frame was queued.
+ */
+bool telemetry_tick(Telemetry *t);
+
+void telemetry_stop(Telemetry *t);
+
+/* Debug: achieved vs requested rate, link capacity, overruns and drops */
+void telemetry_print_stats(const Telemetry *t);
+
+#endif /* TELEMETRY_H */
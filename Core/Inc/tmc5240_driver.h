@@ -7,6 +7,87 @@
 #include "tmc5240_hw_abstraction.h"
 #include <stdint.h>
 
+/* ============================================================================
+ *  Ramp Generator Units
+ * ========================================================================== */
+
+/* Internal clock driving the ramp generator */
+#define TMC5240_FCLK_HZ  12500000u
+
+/* steps/s -> VMAX register units (v * 2^24 / fCLK) */
+static inline uint32_t tmc5240_vmax_from_sps(float sps)
+{
+    return (uint32_t)(sps * (16777216.0f / (float)TMC5240_FCLK_HZ) + 0.5f);
+}
+
+/* Fastest speed VMAX can hold, in steps/s (about 6.25 M) */
+#define TMC5240_MAX_SPS  ((float)TMC5240_MAX_VELOCITY * ((float)TMC5240_FCLK_HZ / 16777216.0f))
+
+/* steps/s^2 -> AMAX/DMAX register units (a * 2^41 / fCLK^2) */
+static inline uint32_t tmc5240_amax_from_sps2(float sps2)
+{
+    uint32_t a = (uint32_t)(sps2 * (2199023255552.0f /
+                 ((float)TMC5240_FCLK_HZ * (float)TMC5240_FCLK_HZ)) + 0.5f);
+    return a ? a : 1u;
+}
+
+/* VMAX / VACTUAL register units -> steps/s */
+static inline float tmc5240_sps_from_vmax(int32_t vmax)
+{
+    return (float)vmax * ((float)TMC5240_FCLK_HZ / 16777216.0f);
+}
+
+/* AMAX/DMAX register units -> steps/s^2 */
+static inline float tmc5240_sps2_from_amax(uint32_t amax)
+{
+    return (float)amax * ((float)TMC5240_FCLK_HZ * (float)TMC5240_FCLK_HZ /
+                          2199023255552.0f);
+}
+
+/*
+ * Full position-mode ramp in register units: VSTART -> A1 -> V1 -> A2 ->
+ * V2 -> AMAX -> VMAX, then DMAX -> V2 -> D2 -> V1 -> D1 -> VSTOP.
+ * V1 = 0 disables the A1/D1 phase, V2 = 0 the A2/D2 phase. TVMAX and
+ * TZEROWAIT are in units of 512 clocks.
+ */
+typedef struct
+{
+    uint32_t vstart;
+    uint32_t a1;
+    uint32_t v1;
+    uint32_t a2;
+    uint32_t v2;
+    uint32_t amax;
+    uint32_t vmax;
+    uint32_t dmax;
+    uint32_t d2;
+    uint32_t d1;
+    uint32_t vstop;
+    uint32_t tvmax;
+    uint32_t tzerowait;
+} TMC5240_Ramp;
+
+/* Reset values used when the context leaves a field at 0 */
+#define TMC5240_D1_DEFAULT     10u
+#define TMC5240_D2_DEFAULT     10u
+#define TMC5240_VSTOP_DEFAULT  10u
+#define TMC5240_TVMAX_DEFAULT  0x0F8Du
+
+/*
+ * Last XACTUAL / VACTUAL / DRV_STATUS values that went over the bus in
+ * reply to reads issued for other purposes. Kept by the SPI hooks at no
+ * extra SPI cost; the stamps are DWT cycles (0 = never seen).
+ */
+typedef struct
+{
+    int32_t xactual;
+    int32_t vactual;         /* Sign-extended from 24 bits */
+    uint32_t drv_status;
+    uint32_t xactual_stamp;
+    uint32_t vactual_stamp;
+    uint32_t drv_status_stamp;
+} TMC5240_Sample;
+
 /* ============================================================================
  *  TMC5240 Driver Context (per motor)
  * ========================================================================== */
@@ -24,13 +105,52 @@ typedef struct
     GPIO_TypeDef *enable_port;
     uint16_t enable_pin;
 
+    /* DIAG0 interrupt output (NULL if not wired) */
+    GPIO_TypeDef *diag0_port;
+    uint16_t diag0_pin;
+
     /* Motion parameters */
     uint32_t vmax;
     uint32_t amax;
     uint32_t dmax;
 
+    /* Remaining ramp registers (0 = *_DEFAULT where one exists) */
+    uint32_t vstart;
+    uint32_t a1;
+    uint32_t v1;
+    uint32_t a2;
+    uint32_t v2;
+    uint32_t d2;
+    uint32_t d1;
+    uint32_t vstop;
+    uint32_t tvmax;
+    uint32_t tzerowait;
+
     /* Cached state */
     int32_t last_target;
+    uint32_t ramp_scale;   /* Q16.16 factor last applied to vmax/amax/dmax */
+    uint8_t rampmode;      /* Last RAMPMODE written */
+    uint32_t gconf;        /* GCONF value applied when enabled */
+    uint8_t home_source;   /* StepperHomeSource currently armed */
+
+    /* Shadow of the last ramp registers written (stepper_predict) */
+    uint32_t shadow_gen;     /* Bumped on every ramp register write */
+    uint32_t shadow_stamp;   /* DWT cycle of the last ramp register write */
+    uint8_t shadow_rampmode;
+    int32_t shadow_xtarget;
+    uint32_t shadow_vmax;
+    uint32_t shadow_amax;
+    uint32_t shadow_dmax;
+    bool shadow_xactual;     /* XACTUAL was rewritten since the last sync */
+
+    /* SPI traffic (bus utilization) */
+    uint8_t spi_status;      /* Status byte of the last frame */
+    uint32_t spi_status_stamp;
+    uint8_t spi_read_addr;   /* Register the next reply answers */
+    bool spi_read_pending;   /* Last frame was a read request */
+    TMC5240_Sample sample;
+    uint32_t spi_frames;     /* Frames issued */
+    uint32_t spi_cycles;     /* DWT cycles spent in blocking frames */
 
 } TMC5240_Context;
 
@@ -38,9 +158,55 @@ typedef struct
  *  Public Driver Descriptor
  * ========================================================================== */
 
+#define TMC5240_DRIVER_CAPS  (STEPPER_CAP_MOVE_TO     | \
+                              STEPPER_CAP_POSITION_FB | \
+                              STEPPER_CAP_RAMP_SCALE  | \
+                              STEPPER_CAP_VELOCITY    | \
+                              STEPPER_CAP_RAMP_LIMITS | \
+                              STEPPER_CAP_TIMED_RAMP  | \
+                              STEPPER_CAP_MOVE_TIME   | \
+                              STEPPER_CAP_PROFILE     | \
+                              STEPPER_CAP_EVENTS      | \
+                              STEPPER_CAP_HOMING)
+
 /* Exposed driver instance */
 extern const StepperDriver TMC5240_Driver;
 
+/*
+ * Build-time binding (STEPPER_STATIC_TMC5240): every stepper uses this
+ * driver, so stepper.c folds capability checks to TMC5240_DRIVER_CAPS and
+ * calls the hot ops directly instead of through TMC5240_Driver.
+ */
+#ifdef STEPPER_STATIC_TMC5240
+void tmc5240_move_to(Stepper *s, int32_t pos);
+void tmc5240_set_velocity(Stepper *s, int32_t steps_per_s);
+void tmc5240_set_ramp_scale(Stepper *s, uint32_t scale_q16);
+int32_t tmc5240_get_position(Stepper *s);
+bool tmc5240_position_reached(Stepper *s);
+bool tmc5240_poll_motion(Stepper *s, uint32_t *quiet_us);
+uint32_t tmc5240_read_events(Stepper *s);
+
+#define STEPPER_STATIC_DRIVER             TMC5240_Driver
+#define STEPPER_STATIC_CAPS               TMC5240_DRIVER_CAPS
+#define STEPPER_STATIC_MOVE_TO            tmc5240_move_to
+#define STEPPER_STATIC_SET_VELOCITY       tmc5240_set_velocity
+#define STEPPER_STATIC_SET_RAMP_SCALE     tmc5240_set_ramp_scale
+#define STEPPER_STATIC_GET_POSITION       tmc5240_get_position
+#define STEPPER_STATIC_POSITION_REACHED   tmc5240_position_reached
+#define STEPPER_STATIC_POLL_MOTION        tmc5240_poll_motion
+#define STEPPER_STATIC_READ_EVENTS        tmc5240_read_events
+#endif
+
+/* Ramp a position-mode move issued now will run with (nominal, unscaled) */
+void tmc5240_ramp_nominal(const TMC5240_Context *ctx, TMC5240_Ramp *ramp);
+
+/*
+ * Duration in us of a position-mode move of `distance` steps from rest,
+ * including the TZEROWAIT hold before the next move may start. Integer
+ * model of the full ramp; UINT32_MAX if the ramp cannot complete.
+ */
+uint32_t tmc5240_ramp_time_us(const TMC5240_Ramp *ramp, uint32_t distance);
+
 /* Utility / debug */
 void tmc5240_driver_print_registers(const TMC5240_Context *ctx);
 
@@ -52,6 +218,23 @@ bool tmc5240_readWriteUART(uint16_t icID, uint8_t *data,
                            size_t writeLength, size_t readLength);
 void tmc5240_fast_writeSPI(uint16_t icID, uint8_t *data, size_t len);
 
+/*
+ * One raw SPI datagram (read request or write)
+ * - Returns the data shifted out in this frame, which answers the previous
+ *   read request to this IC; chaining frames pipelines reads so N registers
+ *   cost N + 1 frames instead of 2N
+ */
+int32_t tmc5240_frame(TMC5240_Context *ctx, uint8_t address, int32_t value, bool write);
+
+/*
+ * Pipelined read of one register across several ICs
+ * - Frames on different SPI buses overlap; same-bus ICs are serialized
+ * - latched_at[] (optional) receives the DWT cycle at which each IC
+ *   sampled the register (CS release of the request frame)
+ */
+void tmc5240_read_batch(TMC5240_Context *const *ctxs, uint8_t count,
+                        uint8_t address, int32_t *values, uint32_t *latched_at);
+
 TMC5240BusType tmc5240_getBusType(uint16_t icID);
 uint8_t tmc5240_getNodeAddress(uint16_t icID);
 
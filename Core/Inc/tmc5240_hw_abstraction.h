@@ -12,7 +12,9 @@
 //constants
 
 #define TMC5240_REGISTER_COUNT   128
-#define TMC5240_MOTORS           2
+#ifndef TMC5240_MOTORS
+#define TMC5240_MOTORS           32
+#endif
 #define TMC5240_WRITE_BIT            0x80
 #define TMC5240_ADDRESS_MASK         0x7F
 #define TMC5240_MAX_VELOCITY     8388096
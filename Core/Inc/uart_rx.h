@@ -0,0 +1,99 @@
+#ifndef UART_RX_H
+#define UART_RX_H
+
+#include "main.h"
+#include "lwrb.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* ============================================================================
+ *  UART Reception
+ *
+ *  The RX DMA channel runs in circular mode over a small buffer for the
+ *  whole session. ReceiveToIdle reports the DMA write position on the
+ *  half-transfer, transfer-complete and idle-line events; every event
+ *  copies the bytes since the previous one into an lwrb ring, so a burst
+ *  of any length costs at most three interrupts per buffer lap plus one at
+ *  its end. The main loop consumes the ring.
+ * ========================================================================== */
+
+#ifndef UART_RX_DMA_SIZE
+#define UART_RX_DMA_SIZE        256     /* DMA buffer, bytes */
+#endif
+
+#ifndef UART_RX_RING_SIZE
+#define UART_RX_RING_SIZE       1024    /* Consumer ring, bytes */
+#endif
+
+typedef struct
+{
+    uint32_t bytes;                 /* Copied into the ring */
+    uint32_t dropped;               /* Lost to a full ring */
+    uint32_t events_idle;
+    uint32_t events_half;
+    uint32_t events_full;
+    uint32_t errors;                /* UART errors (overrun, framing, noise) */
+    uint32_t overruns;              /* Of which ORE: DMA did not keep up */
+    uint32_t restarts;              /* Reception restarted after an error */
+    uint32_t level_max;             /* Peak ring level, bytes */
+    uint32_t event_cycles_max;      /* Cost of one event callback */
+} UartRxStats;
+
+/* Called from the event ISR after new bytes reach the ring */
+typedef void (*UartRxNotify)(size_t available);
+
+/* Start continuous reception on `huart` (RX DMA must be circular) */
+bool uart_rx_init(UART_HandleTypeDef *huart);
+
+/* Optional ISR-context notification, NULL to disable */
+void uart_rx_set_notify(UartRxNotify fn);
+
+/* Consumer side (single consumer, main loop) */
+size_t uart_rx_available(void);
+size_t uart_rx_read(void *buf, size_t len);
+
+/*
+ * Zero-copy access for parsers working in place
+ * - uart_rx_linear: oldest queued bytes up to the ring wrap (or the DMA
+ *   side's next write), valid until uart_rx_skip() releases them
+ * - uart_rx_peek: copy out from `skip` bytes in without consuming
+ */
+size_t uart_rx_linear(const uint8_t **data);
+size_t uart_rx_peek(size_t skip, void *buf, size_t len);
+void uart_rx_skip(size_t len);
+
+/*
+ * Take one '\n' terminated line, NUL terminated, without the "\r\n"
+ * - Returns its length, 0 if no complete line is queued
+ * - Lines longer than len - 1 are truncated, the rest is discarded
+ * - A full ring with no terminator is returned as one line
+ */
+size_t uart_rx_read_line(char *buf, size_t len);
+
+/*
+ * Change the baud rate (TX and RX share the UART)
+ * - Waits up to 100 ms for a TX transfer to finish first
+ * - Switches to 8x oversampling above PCLK / 16
+ */
+bool uart_rx_set_baudrate(uint32_t baud);
+
+/* HAL callback hooks, routed from main.c */
+void uart_rx_event_callback(UART_HandleTypeDef *huart, uint16_t pos);
+void uart_rx_error_callback(UART_HandleTypeDef *huart);
+
+/* Debug: throughput since the previous call, loss and event counts */
+const UartRxStats *uart_rx_stats(void);
+void uart_rx_print_stats(void);
+
+/*
+ * Debug: reception at each rate of bauds[]. Each step announces
+ * "UART RX sweep: <baud> baud, <window_ms> ms" at the current rate, then
+ * switches. It drains the ring as a parser would for window_ms while the
+ * host streams (uart_sweep.py), then prints uart_rx_print_stats() from
+ * zeroed counters. The starting rate is restored at the end. Text log
+ * builds only: the host reads the announcements as plain lines.
+ */
+void uart_rx_benchmark_sweep(const uint32_t *bauds, size_t count, uint32_t window_ms);
+
+#endif /* UART_RX_H */
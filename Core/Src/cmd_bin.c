@@ -0,0 +1,521 @@
+/*
+ * cmd_bin.c — COBS framed binary commands over the UART RX ring
+ *
+ * COBS decoding never writes ahead of where it reads, so a frame is
+ * decoded over its own bytes in the RX ring; those bytes belong to the
+ * consumer until uart_rx_skip() releases them. Payloads are read with
+ * explicit little-endian loads, so packets need no alignment.
+ */
+
+#include "cmd_bin.h"
+#include "uart_rx.h"
+#include "logging.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define CMD_BIN_HEADER      2       /* type + seq */
+#define CMD_BIN_CRC         2
+#define CMD_BIN_PACKET_MAX  (CMD_BIN_HEADER + CMD_BIN_PAYLOAD_MAX + CMD_BIN_CRC)
+
+/* ============================================================================
+ *  Encoding Helpers
+ * ========================================================================== */
+
+static inline int32_t bin_get_i32(const uint8_t *p)
+{
+    return (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                     ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static inline void bin_put_i32(uint8_t *p, int32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)((uint32_t)v >> 8);
+    p[2] = (uint8_t)((uint32_t)v >> 16);
+    p[3] = (uint8_t)((uint32_t)v >> 24);
+}
+
+/* In-place COBS decode; returns the decoded length, 0 if malformed */
+static size_t bin_cobs_decode(uint8_t *buf, size_t len)
+{
+    size_t r = 0, w = 0;
+
+    while (r < len) {
+        uint8_t code = buf[r++];
+
+        if (code == 0 || r + code - 1u > len)
+            return 0;
+        for (uint8_t i = 1; i < code; i++)
+            buf[w++] = buf[r++];
+        if (code != 0xFF && r < len)
+            buf[w++] = 0;
+    }
+    return w;
+}
+
+/* COBS encode plus delimiter; out needs len + len / 254 + 2 bytes */
+static size_t bin_cobs_encode(const uint8_t *src, size_t len, uint8_t *out)
+{
+    size_t code_at = 0, w = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] == 0) {
+            out[code_at] = code;
+            code_at = w++;
+            code = 1;
+            continue;
+        }
+        out[w++] = src[i];
+        if (++code == 0xFF) {
+            out[code_at] = code;
+            code_at = w++;
+            code = 1;
+        }
+    }
+    out[code_at] = code;
+    out[w++] = 0;
+    return w;
+}
+
+/* ============================================================================
+ *  Replies
+ * ========================================================================== */
+
+/*
+ * Encoded on the stack, then queued whole: the TX ring has other producers
+ * (log_printf from interrupts), so nothing may be written into it before
+ * the bytes are claimed
+ */
+static void bin_send(const CmdBin *c, uint8_t type, uint8_t seq,
+                     const uint8_t *payload, size_t len)
+{
+    uint8_t out[CMD_BIN_PACKET_MAX + CMD_BIN_PACKET_MAX / 254 + 2];
+
+    if (c->dry_run)
+        return;
+
+    size_t n = cmd_bin_encode(type, seq, payload, len, out, sizeof(out));
+    if (n)
+        logging_tx_send_frame(out, n);
+}
+
+static void bin_ack_error(CmdBin *c, CmdBinError err, uint8_t seq)
+{
+    c->ack_errors++;
+    c->ack_error = (uint8_t)err;
+    c->ack_error_seq = seq;
+}
+
+/* ============================================================================
+ *  Commands
+ * ========================================================================== */
+
+static Stepper *bin_axis(const CmdBin *c, uint8_t axis)
+{
+    return (axis < c->group->count) ? c->group->steppers[axis] : NULL;
+}
+
+static inline void bin_put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+/* Playback state and ring level, after any pending ACK */
+static void bin_pvt_status(CmdBin *c, uint8_t seq)
+{
+    StepperPvt *pvt = c->pvt;
+    uint8_t reply[17];
+
+    reply[0] = (uint8_t)pvt->state;
+    bin_put_u16(&reply[1], stepper_pvt_level(pvt));
+    bin_put_u16(&reply[3], stepper_pvt_free(pvt));
+    bin_put_i32(&reply[5], (int32_t)pvt->stats.segments);
+    bin_put_i32(&reply[9], (int32_t)pvt->stats.underruns);
+    bin_put_i32(&reply[13], (int32_t)pvt->stats.underrun_ticks);
+
+    cmd_bin_flush_ack(c);
+    bin_send(c, CMD_BIN_PVT_STATUS, seq, reply, sizeof(reply));
+}
+
+static CmdBinError bin_pvt_point(CmdBin *c, const uint8_t *p, size_t len)
+{
+    StepperPvtPoint point;
+
+    if (!c->pvt || len != 4u + 8u * c->pvt->axes)
+        return CMD_BIN_ERR_ARGS;
+
+    memset(&point, 0, sizeof(point));
+    point.duration_us = (uint32_t)bin_get_i32(p);
+    for (uint8_t i = 0; i < c->pvt->axes; i++) {
+        point.position[i] = bin_get_i32(p + 4u + 8u * i);
+        point.velocity[i] = bin_get_i32(p + 8u + 8u * i);
+    }
+
+    if (c->dry_run)
+        return CMD_BIN_OK;
+    if (stepper_pvt_free(c->pvt) == 0)
+        return CMD_BIN_ERR_BUSY;
+    return stepper_pvt_push(c->pvt, &point) ? CMD_BIN_OK : CMD_BIN_ERR_ARGS;
+}
+
+static CmdBinError bin_dispatch(CmdBin *c, uint8_t type, uint8_t seq,
+                                const uint8_t *p, size_t len)
+{
+    Stepper *s;
+
+    switch (type) {
+    case CMD_BIN_MOVE:
+        if (len != 5 || !(s = bin_axis(c, p[0])))
+            return CMD_BIN_ERR_ARGS;
+        if (!c->dry_run)
+            stepper_move_to_position(s, bin_get_i32(p + 1));
+        return CMD_BIN_OK;
+
+    case CMD_BIN_VELOCITY:
+        if (len != 5 || !(s = bin_axis(c, p[0])) ||
+            !s->driver || !(s->driver->caps & STEPPER_CAP_VELOCITY))
+            return CMD_BIN_ERR_ARGS;
+        if (!c->dry_run)
+            stepper_set_velocity(s, bin_get_i32(p + 1));
+        return CMD_BIN_OK;
+
+    case CMD_BIN_GROUP_MOVE: {
+        int32_t positions[STEPPER_GROUP_MAX];
+
+        if (len != 4u * c->group->count)
+            return CMD_BIN_ERR_ARGS;
+        for (uint8_t i = 0; i < c->group->count; i++)
+            positions[i] = bin_get_i32(p + 4u * i);
+        if (!c->dry_run && !stepper_group_move_to_positions(c->group, positions))
+            return CMD_BIN_ERR_ARGS;
+        return CMD_BIN_OK;
+    }
+
+    case CMD_BIN_QUERY: {
+        uint8_t reply[10];
+
+        if (len != 1 || !(s = bin_axis(c, p[0])))
+            return CMD_BIN_ERR_ARGS;
+        if (c->dry_run)
+            return CMD_BIN_OK;
+
+        reply[0] = p[0];
+        bin_put_i32(&reply[1], stepper_get_position(s));
+        bin_put_i32(&reply[5], s->target_position);
+        reply[9] = stepper_position_reached(s) ? CMD_BIN_STATUS_REACHED : 0;
+
+        /* Keep replies in order: everything up to the query is acknowledged first */
+        cmd_bin_flush_ack(c);
+        bin_send(c, CMD_BIN_STATUS, seq, reply, sizeof(reply));
+        return CMD_BIN_OK;
+    }
+
+    case CMD_BIN_PVT_POINT:
+        return bin_pvt_point(c, p, len);
+
+    case CMD_BIN_PVT_RUN:
+        if (!c->pvt || len != 1 || p[0] > 1)
+            return CMD_BIN_ERR_ARGS;
+        if (!c->dry_run) {
+            if (p[0])
+                stepper_pvt_start(c->pvt);
+            else
+                stepper_pvt_stop(c->pvt);
+        }
+        return CMD_BIN_OK;
+
+    case CMD_BIN_PVT_QUERY:
+        if (!c->pvt || len != 0)
+            return CMD_BIN_ERR_ARGS;
+        if (!c->dry_run)
+            bin_pvt_status(c, seq);
+        return CMD_BIN_OK;
+
+    default:
+        return CMD_BIN_ERR_TYPE;
+    }
+}
+
+/* ============================================================================
+ *  Public API
+ * ========================================================================== */
+
+void cmd_bin_init(CmdBin *c, StepperGroup *group)
+{
+    if (!c)
+        return;
+
+    memset(c, 0, sizeof(*c));
+    c->group = group;
+}
+
+void cmd_bin_attach_pvt(CmdBin *c, StepperPvt *pvt)
+{
+    if (!c)
+        return;
+
+    c->pvt = pvt;
+    c->pvt_underruns = pvt ? pvt->stats.underruns : 0;
+}
+
+size_t cmd_bin_encode(uint8_t type, uint8_t seq,
+                      const uint8_t *payload, size_t len,
+                      uint8_t *out, size_t out_len)
+{
+    uint8_t pkt[CMD_BIN_PACKET_MAX];
+    size_t n = CMD_BIN_HEADER + len + CMD_BIN_CRC;
+
+    if (n > sizeof(pkt) || out_len < n + n / 254 + 2)
+        return 0;
+
+    pkt[0] = type;
+    pkt[1] = seq;
+    if (len)
+        memcpy(&pkt[CMD_BIN_HEADER], payload, len);
+
+    uint16_t crc = util_crc16(pkt, (uint32_t)(CMD_BIN_HEADER + len));
+    pkt[n - 2] = (uint8_t)crc;
+    pkt[n - 1] = (uint8_t)(crc >> 8);
+
+    return bin_cobs_encode(pkt, n, out);
+}
+
+CmdBinError cmd_bin_execute(CmdBin *c, uint8_t *frame, size_t len)
+{
+    if (!c || !c->group || !frame)
+        return CMD_BIN_ERR_FRAME;
+
+    uint32_t start = DWT->CYCCNT;
+    CmdBinError err;
+    size_t n = bin_cobs_decode(frame, len);
+
+    if (n < CMD_BIN_HEADER + CMD_BIN_CRC) {
+        c->stats.frame_errors++;
+        bin_ack_error(c, CMD_BIN_ERR_FRAME, c->seq_next);
+        return CMD_BIN_ERR_FRAME;
+    }
+
+    uint16_t crc = (uint16_t)(frame[n - 2] | (frame[n - 1] << 8));
+    if (util_crc16(frame, (uint32_t)(n - CMD_BIN_CRC)) != crc) {
+        /* The seq byte cannot be trusted: report the one expected */
+        c->stats.crc_errors++;
+        bin_ack_error(c, CMD_BIN_ERR_CRC, c->seq_next);
+        return CMD_BIN_ERR_CRC;
+    }
+
+    uint8_t type = frame[0];
+    uint8_t seq = frame[1];
+
+    if (c->synced && seq != c->seq_next) {
+        c->stats.seq_gaps += (uint8_t)(seq - c->seq_next);
+        bin_ack_error(c, CMD_BIN_ERR_SEQ, seq);
+    }
+    c->synced = true;
+    c->seq_next = (uint8_t)(seq + 1u);
+
+    c->ack_seq = seq;
+    c->ack_count++;
+    err = bin_dispatch(c, type, seq, &frame[CMD_BIN_HEADER], n - CMD_BIN_HEADER - CMD_BIN_CRC);
+
+    switch (err) {
+    case CMD_BIN_OK:        c->stats.packets++;  break;
+    case CMD_BIN_ERR_TYPE:  c->stats.unknown++;  break;
+    default:                c->stats.bad_args++; break;
+    }
+    if (err != CMD_BIN_OK)
+        bin_ack_error(c, err, seq);
+
+    uint32_t cycles = DWT->CYCCNT - start;
+    if (cycles > c->stats.decode_cycles_max)
+        c->stats.decode_cycles_max = cycles;
+
+    return err;
+}
+
+void cmd_bin_flush_ack(CmdBin *c)
+{
+    if (!c || (c->ack_count == 0 && c->ack_errors == 0))
+        return;
+
+    uint8_t ack[5] = {
+        c->ack_seq, c->ack_count, c->ack_errors, c->ack_error, c->ack_error_seq
+    };
+
+    bin_send(c, CMD_BIN_ACK, c->ack_seq, ack, sizeof(ack));
+    if (!c->dry_run)
+        c->stats.acks++;
+
+    c->ack_count = 0;
+    c->ack_errors = 0;
+    c->ack_error = CMD_BIN_OK;
+}
+
+uint32_t cmd_bin_poll(CmdBin *c)
+{
+    uint32_t frames = 0;
+    size_t avail;
+
+    if (!c)
+        return 0;
+
+    while ((avail = uart_rx_available()) > 0) {
+        const uint8_t *data;
+        size_t len = uart_rx_linear(&data);
+        const uint8_t *z = memchr(data, 0, len);
+
+        if (c->discard) {
+            /* Tail of an overlong frame */
+            uart_rx_skip(z ? (size_t)(z - data) + 1 : len);
+            c->discard = (z == NULL);
+            continue;
+        }
+
+        if (z) {
+            size_t n = (size_t)(z - data);
+
+            if (n > CMD_BIN_FRAME_MAX) {
+                c->stats.overlong++;
+            } else if (n > 0) {
+                /* Decoded over its own bytes: they are still ours until the skip */
+                cmd_bin_execute(c, (uint8_t *)data, n);
+                frames++;
+            }
+            uart_rx_skip(n + 1);
+        } else if (len > CMD_BIN_FRAME_MAX) {
+            c->stats.overlong++;
+            c->discard = true;
+            uart_rx_skip(len);
+        } else if (avail > len) {
+            /* The frame continues at the start of the ring; len fits, so want > len */
+            size_t want = (avail < sizeof(c->frame)) ? avail : sizeof(c->frame);
+            uart_rx_peek(0, c->frame, want);
+            z = memchr(c->frame + len, 0, want - len);
+
+            if (z) {
+                size_t n = (size_t)(z - c->frame);
+
+                c->stats.linearized++;
+                cmd_bin_execute(c, c->frame, n);
+                uart_rx_skip(n + 1);
+                frames++;
+            } else if (want > CMD_BIN_FRAME_MAX) {
+                c->stats.overlong++;
+                c->discard = true;
+                uart_rx_skip(want);
+            } else {
+                break;
+            }
+        } else {
+            break;      /* Incomplete frame, wait for more bytes */
+        }
+
+        if (c->ack_count >= CMD_BIN_ACK_BATCH)
+            cmd_bin_flush_ack(c);
+    }
+
+    /* Ring drained: acknowledge the batch */
+    cmd_bin_flush_ack(c);
+
+    /* Tell the host about a PVT underrun without waiting for a query */
+    if (c->pvt && c->pvt->stats.underruns != c->pvt_underruns) {
+        c->pvt_underruns = c->pvt->stats.underruns;
+        bin_pvt_status(c, c->ack_seq);
+    }
+    return frames;
+}
+
+void cmd_bin_print_stats(const CmdBin *c)
+{
+    if (!c)
+        return;
+
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+    log_printf("Bin cmd: %lu ok in %lu ACKs, %lu CRC, %lu frame, %lu unknown, %lu bad args, %lu seq lost\r\n",
+               (unsigned long)c->stats.packets,
+               (unsigned long)c->stats.acks,
+               (unsigned long)c->stats.crc_errors,
+               (unsigned long)c->stats.frame_errors,
+               (unsigned long)c->stats.unknown,
+               (unsigned long)c->stats.bad_args,
+               (unsigned long)c->stats.seq_gaps);
+    log_printf("Bin cmd: %lu wrapped frames copied, %lu overlong dropped, frame max %lu us\r\n",
+               (unsigned long)c->stats.linearized,
+               (unsigned long)c->stats.overlong,
+               (unsigned long)(c->stats.decode_cycles_max / cycles_per_us));
+}
+
+/* Average / worst cycles of one dry-run command */
+static void bin_bench_report(const char *name, size_t wire, uint32_t avg,
+                             uint32_t worst, uint32_t baud)
+{
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+    uint32_t wire_us = (uint32_t)((uint64_t)wire * 10u * 1000000u / baud);
+    uint32_t link_rate = (uint32_t)(baud / 10u / wire);
+    uint32_t cpu_rate = avg ? SystemCoreClock / avg : 0;
+
+    log_printf("Cmd bench %-6s %3u B: avg %5lu worst %5lu cycles, %6lu cmd/s CPU, "
+               "%5lu cmd/s link, latency %lu us\r\n",
+               name,
+               (unsigned)wire,
+               (unsigned long)avg,
+               (unsigned long)worst,
+               (unsigned long)cpu_rate,
+               (unsigned long)link_rate,
+               (unsigned long)(wire_us + avg / cycles_per_us));
+}
+
+void cmd_bin_benchmark(CmdBin *c, CmdJson *json, uint32_t baud)
+{
+    static const char line[] = "{\"cmd\":\"move\",\"axis\":0,\"pos\":-123456,\"id\":17}";
+    const uint32_t runs = 32;
+    uint8_t payload[5] = { 0 };
+    uint8_t frame[CMD_BIN_FRAME_MAX + 1];
+    uint8_t work[CMD_BIN_FRAME_MAX + 1];
+    uint32_t total, worst;
+
+    if (!c || !c->group || !json || !json->group || baud == 0)
+        return;
+
+    bin_put_i32(&payload[1], -123456);
+    size_t n = cmd_bin_encode(CMD_BIN_MOVE, 17, payload, sizeof(payload), frame, sizeof(frame));
+    if (n == 0)
+        return;
+
+    CmdBin saved = *c;
+    c->dry_run = true;
+
+    total = worst = 0;
+    for (uint32_t r = 0; r < runs; r++) {
+        memcpy(work, frame, n);             /* Decoding is destructive */
+        c->synced = false;
+        uint32_t start = DWT->CYCCNT;
+        cmd_bin_execute(c, work, n - 1);
+        uint32_t cycles = DWT->CYCCNT - start;
+        total += cycles;
+        if (cycles > worst)
+            worst = cycles;
+    }
+    *c = saved;
+    bin_bench_report("binary", n, total / runs, worst, baud);
+
+    CmdJsonStats json_saved = json->stats;
+    json->dry_run = true;
+
+    total = worst = 0;
+    for (uint32_t r = 0; r < runs; r++) {
+        uint32_t start = DWT->CYCCNT;
+        cmd_json_execute(json, line, sizeof(line) - 1);
+        uint32_t cycles = DWT->CYCCNT - start;
+        total += cycles;
+        if (cycles > worst)
+            worst = cycles;
+    }
+    json->dry_run = false;
+    json->stats = json_saved;
+    bin_bench_report("JSON", sizeof(line), total / runs, worst, baud);
+}
@@ -0,0 +1,595 @@
+/*
+ * cmd_json.c — JSON commands over the UART RX ring
+ *
+ * jsmn only records token offsets, so a command can be tokenized where it
+ * sits in the RX ring. The ring bytes stay valid until uart_rx_skip()
+ * releases them, which happens after the command has run. Keys are
+ * matched with memcmp against the table, integers are converted from the
+ * token span, and nothing is NUL terminated.
+ *
+ * The parser is resumable: each poll continues the scan where the last
+ * one stopped, so a command trickling in over many RX events costs one
+ * pass over its bytes instead of a re-parse per event. Offsets are
+ * relative to the command's first byte, so when it turns out to straddle
+ * the ring wrap the scanned prefix is copied to the line buffer once and
+ * the scan carries on there.
+ */
+
+#include "cmd_json.h"
+#include "uart_rx.h"
+#include "logging.h"
+#include "fmt.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef const char *(*CmdJsonHandler)(CmdJson *c, char *extra, size_t extra_len);
+
+typedef struct
+{
+    const char *name;
+    uint8_t len;
+    CmdJsonHandler fn;
+} CmdJsonEntry;
+
+/* ============================================================================
+ *  Token Helpers
+ * ========================================================================== */
+
+static inline bool cmd_tok_eq(const CmdJson *c, int i, const char *s, size_t len)
+{
+    const jsmntok_t *t = &c->tok[i];
+    return (size_t)(t->end - t->start) == len && memcmp(c->js + t->start, s, len) == 0;
+}
+
+/* Index of the token after value i and all of its children */
+static int cmd_skip(const CmdJson *c, int i)
+{
+    int end = c->tok[i].end;
+
+    for (i++; i < c->ntok && c->tok[i].start < end; i++) {
+    }
+    return i;
+}
+
+/* Value token of a top-level key, -1 if absent */
+static int cmd_field(const CmdJson *c, const char *key)
+{
+    size_t len = strlen(key);
+    int i = 1;
+
+    for (int n = 0; n < c->tok[0].size && i + 1 < c->ntok; n++) {
+        if (c->tok[i].type == JSMN_STRING && cmd_tok_eq(c, i, key, len))
+            return i + 1;
+        i = cmd_skip(c, i + 1);
+    }
+    return -1;
+}
+
+/* Decimal integer straight from the token span */
+static bool cmd_int(const CmdJson *c, int i, int32_t *out)
+{
+    if (i < 0 || i >= c->ntok || c->tok[i].type != JSMN_PRIMITIVE)
+        return false;
+
+    const char *p = c->js + c->tok[i].start;
+    const char *e = c->js + c->tok[i].end;
+    bool neg = (p < e && *p == '-');
+    int64_t v = 0;
+
+    if (neg)
+        p++;
+    if (p == e)
+        return false;
+
+    for (; p < e; p++) {
+        if (*p < '0' || *p > '9')
+            return false;
+        v = v * 10 + (*p - '0');
+        if (v > (int64_t)INT32_MAX + 1)
+            return false;
+    }
+
+    v = neg ? -v : v;
+    if (v > INT32_MAX)
+        return false;
+
+    *out = (int32_t)v;
+    return true;
+}
+
+static Stepper *cmd_axis(const CmdJson *c)
+{
+    int32_t axis;
+
+    if (!cmd_int(c, cmd_field(c, "axis"), &axis))
+        return NULL;
+    if (axis < 0 || axis >= c->group->count)
+        return NULL;
+    return c->group->steppers[axis];
+}
+
+/* ============================================================================
+ *  Replies
+ * ========================================================================== */
+
+/* Formatted straight into a TX ring reservation, wrap included */
+static void cmd_reply(const CmdJson *c, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (c->dry_run)
+        return;
+
+    va_start(ap, fmt);
+    log_vprintf(fmt, ap);
+    va_end(ap);
+}
+
+static void cmd_reply_id(const CmdJson *c, char *id, size_t len)
+{
+    int32_t v;
+
+    id[0] = '\0';
+    if (cmd_int(c, cmd_field(c, "id"), &v))
+        fmt_snprintf(id, len, "\"id\":%ld,", (long)v);
+}
+
+/* ============================================================================
+ *  Commands
+ * ========================================================================== */
+
+static const char *cmd_move(CmdJson *c, char *extra, size_t extra_len)
+{
+    Stepper *s = cmd_axis(c);
+    int32_t pos;
+
+    (void)extra;
+    (void)extra_len;
+
+    if (!s || !cmd_int(c, cmd_field(c, "pos"), &pos))
+        return "args";
+
+    if (!c->dry_run)
+        stepper_move_to_position(s, pos);
+    return NULL;
+}
+
+static const char *cmd_group_move(CmdJson *c, char *extra, size_t extra_len)
+{
+    int32_t positions[STEPPER_GROUP_MAX];
+    int i = cmd_field(c, "pos");
+
+    (void)extra;
+    (void)extra_len;
+
+    if (i < 0)
+        return "args";
+
+    /* Scalar: every axis to the same position */
+    if (c->tok[i].type == JSMN_PRIMITIVE) {
+        if (!cmd_int(c, i, &positions[0]))
+            return "args";
+        if (!c->dry_run)
+            stepper_group_move_to(c->group, positions[0]);
+        return NULL;
+    }
+
+    if (c->tok[i].type != JSMN_ARRAY || c->tok[i].size != c->group->count)
+        return "args";
+
+    int e = i + 1;
+    for (uint8_t n = 0; n < c->group->count; n++) {
+        if (!cmd_int(c, e, &positions[n]))
+            return "args";
+        e = cmd_skip(c, e);
+    }
+
+    if (!c->dry_run && !stepper_group_move_to_positions(c->group, positions))
+        return "args";
+    return NULL;
+}
+
+static const char *cmd_profile(CmdJson *c, char *extra, size_t extra_len)
+{
+    Stepper *s = cmd_axis(c);
+    int32_t vmax = 0, amax = 0, dmax = 0;
+    bool any = false;
+
+    (void)extra;
+    (void)extra_len;
+
+    if (!s || !s->driver || !(s->driver->caps & STEPPER_CAP_PROFILE))
+        return "args";
+
+    int iv = cmd_field(c, "vmax");
+    int ia = cmd_field(c, "amax");
+    int id = cmd_field(c, "dmax");
+
+    if ((iv >= 0 && (!cmd_int(c, iv, &vmax) || vmax <= 0)) ||
+        (ia >= 0 && (!cmd_int(c, ia, &amax) || amax <= 0)) ||
+        (id >= 0 && (!cmd_int(c, id, &dmax) || dmax <= 0)))
+        return "args";
+
+    any = (iv >= 0) || (ia >= 0) || (id >= 0);
+    if (!any)
+        return "args";
+    if (c->dry_run)
+        return NULL;
+
+    stepper_set_profile(s, (uint32_t)vmax, (uint32_t)amax, (uint32_t)dmax);
+    return NULL;
+}
+
+static const char *cmd_status(CmdJson *c, char *extra, size_t extra_len)
+{
+    Stepper *s = cmd_axis(c);
+
+    if (!s)
+        return "args";
+    if (c->dry_run)
+        return NULL;
+
+    int32_t pos = stepper_get_position(s);
+    bool reached = stepper_position_reached(s);
+
+    fmt_snprintf(extra, extra_len, ",\"pos\":%ld,\"target\":%ld,\"moving\":%s",
+                 (long)pos, (long)s->target_position, reached ? "false" : "true");
+    return NULL;
+}
+
+static const CmdJsonEntry cmd_table[] = {
+    { "move",       4,  cmd_move },
+    { "group_move", 10, cmd_group_move },
+    { "profile",    7,  cmd_profile },
+    { "status",     6,  cmd_status },
+};
+
+/* ============================================================================
+ *  Dispatch
+ * ========================================================================== */
+
+/* Run the command tokenized in c->tok and reply; cycles spent so far */
+static bool cmd_json_dispatch(CmdJson *c, uint32_t cycles)
+{
+    uint32_t start = DWT->CYCCNT;
+    const char *err = NULL;
+    char extra[64] = "";
+    char id[24] = "";
+
+    if (c->ntok < 1 || c->tok[0].type != JSMN_OBJECT) {
+        c->ntok = 0;
+        c->stats.parse_errors++;
+        err = "parse";
+    } else {
+        int i = cmd_field(c, "cmd");
+        const CmdJsonEntry *e = NULL;
+
+        if (i >= 0 && c->tok[i].type == JSMN_STRING) {
+            for (size_t n = 0; n < sizeof(cmd_table) / sizeof(cmd_table[0]); n++) {
+                if (cmd_tok_eq(c, i, cmd_table[n].name, cmd_table[n].len)) {
+                    e = &cmd_table[n];
+                    break;
+                }
+            }
+        }
+
+        if (!e) {
+            c->stats.unknown++;
+            err = "cmd";
+        } else if ((err = e->fn(c, extra, sizeof(extra))) != NULL) {
+            c->stats.bad_args++;
+        } else {
+            c->stats.commands++;
+        }
+        cmd_reply_id(c, id, sizeof(id));
+    }
+
+    cycles += DWT->CYCCNT - start;
+    if (cycles > c->stats.parse_cycles_max)
+        c->stats.parse_cycles_max = cycles;
+
+    if (err)
+        cmd_reply(c, "{%s\"ok\":false,\"err\":\"%s\"}\r\n", id, err);
+    else
+        cmd_reply(c, "{%s\"ok\":true%s}\r\n", id, extra);
+
+    return err == NULL;
+}
+
+/* Forget the command in progress; the next one starts at the ring's r */
+static void cmd_json_restart(CmdJson *c)
+{
+    jsmn_init_stream(&c->parser);
+    c->scanned = 0;
+    c->cycles = 0;
+    c->in_line = false;
+}
+
+/*
+ * Continue the scan over the first len bytes of a command at base
+ * (len only grows between calls). Returns the token count once the
+ * top-level value is complete, else a jsmn error; c->parser.pos is
+ * where the scan stopped.
+ */
+static int cmd_json_scan(CmdJson *c, const char *base, size_t len)
+{
+    uint32_t start = DWT->CYCCNT;
+    int r;
+
+    if (c->scanned > 0)
+        c->stats.resumed++;
+
+    c->js = base;
+    r = jsmn_parse(&c->parser, base, len, c->tok, CMD_JSON_TOKENS, NULL);
+    c->scanned = len;
+    c->cycles += DWT->CYCCNT - start;
+    return r;
+}
+
+/* ============================================================================
+ *  Public API
+ * ========================================================================== */
+
+void cmd_json_init(CmdJson *c, StepperGroup *group)
+{
+    if (!c)
+        return;
+
+    memset(c, 0, sizeof(*c));
+    c->group = group;
+    jsmn_init_stream(&c->parser);
+}
+
+bool cmd_json_execute(CmdJson *c, const char *line, size_t len)
+{
+    if (!c || !c->group || !line)
+        return false;
+
+    uint32_t start = DWT->CYCCNT;
+    jsmn_parser p;
+
+    c->js = line;
+    jsmn_init(&p, NULL);
+    c->ntok = jsmn_parse(&p, line, len, c->tok, CMD_JSON_TOKENS, NULL);
+    return cmd_json_dispatch(c, DWT->CYCCNT - start);
+}
+
+uint32_t cmd_json_poll(CmdJson *c)
+{
+    uint32_t lines = 0;
+    size_t avail;
+
+    if (!c)
+        return 0;
+
+    while ((avail = uart_rx_available()) > 0) {
+        const uint8_t *data;
+        size_t len = uart_rx_linear(&data);
+
+        if (c->discard) {
+            /* Rest of a rejected command, up to the end of its line */
+            const uint8_t *nl = memchr(data, '\n', len);
+
+            uart_rx_skip(nl ? (size_t)(nl - data) + 1 : len);
+            c->discard = (nl == NULL);
+            continue;
+        }
+
+        const char *base;
+        size_t have;
+
+        if (!c->in_line && (len > c->scanned || avail == len)) {
+            base = (const char *)data;
+            have = (len < CMD_JSON_LINE_MAX) ? len : CMD_JSON_LINE_MAX;
+        } else {
+            /* The command continues at the start of the ring */
+            if (!c->in_line) {
+                memcpy(c->line, data, c->scanned);
+                c->in_line = true;
+                c->stats.linearized++;
+            }
+            have = (avail < CMD_JSON_LINE_MAX) ? avail : CMD_JSON_LINE_MAX;
+            if (have > c->scanned)
+                uart_rx_peek(c->scanned, c->line + c->scanned, have - c->scanned);
+            base = c->line;
+        }
+
+        if (have <= c->scanned) {
+            if (c->scanned < CMD_JSON_LINE_MAX)
+                break;      /* Nothing new, wait for more bytes */
+
+            c->stats.overlong++;
+            uart_rx_skip(c->scanned);
+            cmd_json_restart(c);
+            c->discard = true;
+            continue;
+        }
+
+        int r = cmd_json_scan(c, base, have);
+
+        if (r == JSMN_ERROR_PART) {
+            if (c->parser.toknext == 0 && c->parser.partial < 0) {
+                /* Only whitespace (line terminators) so far */
+                uart_rx_skip(c->parser.pos);
+                cmd_json_restart(c);
+            }
+            continue;
+        }
+
+        if (r < 0) {
+            /* Malformed, or over the token budget: reject, resync at '\n' */
+            if (r == JSMN_ERROR_NOMEM)
+                c->stats.token_overflows++;
+            c->ntok = 0;
+            cmd_json_dispatch(c, c->cycles);
+            uart_rx_skip(c->parser.pos);
+            cmd_json_restart(c);
+            c->discard = true;
+            lines++;
+            continue;
+        }
+
+        c->ntok = r;
+        cmd_json_dispatch(c, c->cycles);
+        uart_rx_skip(c->parser.pos);
+        cmd_json_restart(c);
+        lines++;
+    }
+
+    return lines;
+}
+
+void cmd_json_print_stats(const CmdJson *c)
+{
+    if (!c)
+        return;
+
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+    log_printf("JSON cmd: %lu ok, %lu parse errors, %lu unknown, %lu bad args\r\n",
+               (unsigned long)c->stats.commands,
+               (unsigned long)c->stats.parse_errors,
+               (unsigned long)c->stats.unknown,
+               (unsigned long)c->stats.bad_args);
+    log_printf("JSON cmd: %lu over token budget, %lu resumed scans\r\n",
+               (unsigned long)c->stats.token_overflows,
+               (unsigned long)c->stats.resumed);
+    log_printf("JSON cmd: %lu wrapped copied, %lu overlong dropped, command max %lu us\r\n",
+               (unsigned long)c->stats.linearized,
+               (unsigned long)c->stats.overlong,
+               (unsigned long)(c->stats.parse_cycles_max / cycles_per_us));
+}
+
+void cmd_json_benchmark(CmdJson *c)
+{
+    static const char *const cases[] = {
+        "{\"cmd\":\"move\",\"axis\":0,\"pos\":-123456,\"id\":17}",
+        "{\"cmd\":\"group_move\",\"pos\":[1200,-400],\"id\":18}",
+        "{\"cmd\":\"profile\",\"axis\":1,\"vmax\":40000,\"amax\":80000,\"dmax\":80000}",
+        "{\"cmd\":\"status\",\"axis\":0}",
+        /* Adversarial */
+        "{\"pad\":\"\\u0041\\u0042\\\"\\\\\\/\\b\\f\\n\\r\\t\\u0043\\u0044\\u0045\\u0046\\u0047\\u0048\\u0049"
+            "\\u004a\\u004b\\u004c\\u004d\\u004e\\u004f\\u0050\\u0051\\u0052\\u0053\\u0054\",\"cmd\":\"status\",\"axis\":0}",
+        "{\"x\":[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31,32]}",
+        "{\"cmd\":\"move\",\"axis\":0,\"pos\":99999999999999999999}",
+        "{\"cmd\":\"status\",\"axis\":0,\"a\":{\"b\":{\"c\":{\"d\":{\"e\":{\"f\":{\"g\":1}}}}}}}",
+        "{\"cmd\":\"move\",\"axis\":0,\"pos\":1",
+    };
+    static const char *const names[] = {
+        "move", "group_move", "profile", "status",
+        "escapes", "token flood", "int overflow", "nesting", "truncated",
+    };
+    const uint32_t runs = 32;
+    char deep[2 * CMD_JSON_TOKENS + 8];
+    CmdJsonStats saved;
+
+    if (!c || !c->group)
+        return;
+
+    saved = c->stats;
+    c->dry_run = true;
+
+    for (size_t k = 0; k <= sizeof(cases) / sizeof(cases[0]); k++) {
+        const char *line = (k < sizeof(cases) / sizeof(cases[0])) ? cases[k] : deep;
+        uint32_t total = 0, worst = 0;
+
+        if (k == sizeof(cases) / sizeof(cases[0])) {
+            /* Nesting deeper than the token pool */
+            size_t d = CMD_JSON_TOKENS + 2;
+            memset(deep, '[', d);
+            memset(deep + d, ']', d);
+            deep[2 * d] = '\0';
+        }
+
+        size_t len = strlen(line);
+        for (uint32_t r = 0; r < runs; r++) {
+            uint32_t start = DWT->CYCCNT;
+            cmd_json_execute(c, line, len);
+            uint32_t cycles = DWT->CYCCNT - start;
+            total += cycles;
+            if (cycles > worst)
+                worst = cycles;
+        }
+
+        uint32_t avg = total / runs;
+        log_printf("JSON bench %-13s %3u B: avg %5lu cycles (%6lu cmd/s), worst %5lu cycles\r\n",
+                   (k < sizeof(names) / sizeof(names[0])) ? names[k] : "deep array",
+                   (unsigned)len,
+                   (unsigned long)avg,
+                   (unsigned long)(avg ? SystemCoreClock / avg : 0),
+                   (unsigned long)worst);
+    }
+
+    c->dry_run = false;
+    c->stats = saved;
+}
+
+void cmd_json_fragment_benchmark(size_t max_frag)
+{
+    static const char *const cases[] = {
+        "{\"cmd\":\"move\",\"axis\":0,\"pos\":-123456,\"id\":17}",
+        "{\"cmd\":\"group_move\",\"pos\":[1200,-400],\"id\":18}",
+        "{\"cmd\":\"profile\",\"axis\":1,\"vmax\":40000,\"amax\":80000,\"dmax\":80000}",
+        "{\"pad\":\"\\u0041\\u0042\\\"\\\\\\/\\b\\f\\n\\r\\t\\u0043\\u0044\\u0045\\u0046\\u0047\\u0048\\u0049"
+            "\\u004a\\u004b\\u004c\\u004d\\u004e\\u004f\\u0050\\u0051\\u0052\\u0053\\u0054\",\"cmd\":\"status\",\"axis\":0}",
+    };
+    static const char *const names[] = { "move", "group_move", "profile", "escapes" };
+    static jsmntok_t tok[CMD_JSON_TOKENS];  /* A command in progress keeps its own */
+    const uint32_t runs = 16;
+    uint32_t seed = 0x2545F491u;
+
+    if (max_frag == 0)
+        return;
+
+    for (size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+        const char *js = cases[k];
+        size_t len = strlen(js);
+        uint32_t stream = 0, reparse = 0, frags = 0;
+        int whole, ntok = 0;
+        jsmn_parser p;
+
+        jsmn_init(&p, NULL);
+        whole = jsmn_parse(&p, js, len, tok, CMD_JSON_TOKENS, NULL);
+
+        for (uint32_t r = 0; r < runs; r++) {
+            uint32_t run_seed = seed;
+            size_t have = 0;
+            int res = JSMN_ERROR_PART;
+
+            /* Resumable: each fragment is scanned once */
+            jsmn_init_stream(&p);
+            uint32_t start = DWT->CYCCNT;
+            while (have < len && res == JSMN_ERROR_PART) {
+                seed = seed * 1664525u + 1013904223u;
+                have += 1u + (seed >> 16) % max_frag;
+                if (have > len)
+                    have = len;
+                res = jsmn_parse(&p, js, have, tok, CMD_JSON_TOKENS, NULL);
+                frags++;
+            }
+            stream += DWT->CYCCNT - start;
+            ntok = res;
+
+            /* Same fragments, parsed again from the first byte each time */
+            seed = run_seed;
+            have = 0;
+            start = DWT->CYCCNT;
+            while (have < len) {
+                seed = seed * 1664525u + 1013904223u;
+                have += 1u + (seed >> 16) % max_frag;
+                if (have > len)
+                    have = len;
+                jsmn_init(&p, NULL);
+                jsmn_parse(&p, js, have, tok, CMD_JSON_TOKENS, NULL);
+            }
+            reparse += DWT->CYCCNT - start;
+        }
+
+        log_printf("JSON frag %-10s %3u B, %2lu frags: resumable %5lu cycles, re-parse %6lu cycles%s\r\n",
+                   names[k], (unsigned)len, (unsigned long)(frags / runs),
+                   (unsigned long)(stream / runs), (unsigned long)(reparse / runs),
+                   (ntok == whole) ? "" : " (token MISMATCH)");
+    }
+}
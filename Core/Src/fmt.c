@@ -0,0 +1,277 @@
+/*
+ * fmt.c — allocation-free printf subset
+ *
+ * One pass over the format: literal runs are handed to put() whole,
+ * numbers are converted right to left into a 12-byte stack buffer, and
+ * padding comes from a constant string, so a call touches no heap and
+ * its cost depends only on the output length.
+ */
+
+#include "fmt.h"
+#include "logging.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef FMT_COMPARE_NEWLIB
+#include <stdio.h>
+#endif
+
+#define FMT_NUM_MAX     12      /* "-2147483648" + spare */
+
+static const char fmt_spaces[] = "                ";
+static const char fmt_zeros[]  = "0000000000000000";
+
+/* ============================================================================
+ *  Internal Helpers
+ * ========================================================================== */
+
+typedef struct
+{
+    FmtPut put;
+    void *ctx;
+    size_t len;
+} FmtOut;
+
+static void fmt_emit(FmtOut *o, const char *s, size_t n)
+{
+    if (n == 0)
+        return;
+    if (o->put)
+        o->put(o->ctx, s, n);
+    o->len += n;
+}
+
+static void fmt_pad(FmtOut *o, const char *fill, size_t n)
+{
+    while (n > 0) {
+        size_t chunk = (n < sizeof(fmt_spaces) - 1) ? n : sizeof(fmt_spaces) - 1;
+        fmt_emit(o, fill, chunk);
+        n -= chunk;
+    }
+}
+
+/* Digits of v into the end of buf; returns the first digit */
+static char *fmt_utoa(char *end, uint32_t v, uint32_t base, bool upper)
+{
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char *p = end;
+
+    do {
+        *--p = digits[v % base];
+        v /= base;
+    } while (v);
+    return p;
+}
+
+/* Emit a field of n bytes (sign separate) padded to width */
+static void fmt_field(FmtOut *o, const char *s, size_t n, char sign,
+                      size_t width, bool left, bool zero)
+{
+    size_t total = n + (sign ? 1u : 0u);
+    size_t pad = (width > total) ? width - total : 0;
+
+    if (!left && !zero)
+        fmt_pad(o, fmt_spaces, pad);
+    if (sign)
+        fmt_emit(o, &sign, 1);
+    if (!left && zero)
+        fmt_pad(o, fmt_zeros, pad);
+    fmt_emit(o, s, n);
+    if (left)
+        fmt_pad(o, fmt_spaces, pad);
+}
+
+typedef struct
+{
+    char *buf;
+    size_t size;
+    size_t pos;
+} FmtBuf;
+
+static void fmt_put_buf(void *ctx, const char *s, size_t len)
+{
+    FmtBuf *b = (FmtBuf *)ctx;
+
+    if (b->pos + 1u < b->size) {
+        size_t room = b->size - 1u - b->pos;
+        memcpy(b->buf + b->pos, s, (len < room) ? len : room);
+    }
+    b->pos += len;
+}
+
+/* ============================================================================
+ *  Public API
+ * ========================================================================== */
+
+size_t fmt_vformat(FmtPut put, void *ctx, const char *fmt, va_list ap)
+{
+    FmtOut o = { put, ctx, 0 };
+    char num[FMT_NUM_MAX];
+
+    if (!fmt)
+        return 0;
+
+    while (*fmt) {
+        /* Literal run up to the next conversion */
+        const char *lit = fmt;
+        while (*fmt && *fmt != '%')
+            fmt++;
+        fmt_emit(&o, lit, (size_t)(fmt - lit));
+        if (!*fmt)
+            break;
+
+        const char *spec = fmt++;
+        bool left = false, zero = false, is_long = false;
+        char pos_sign = 0;
+        size_t width = 0;
+
+        for (;; fmt++) {
+            if (*fmt == '-')
+                left = true;
+            else if (*fmt == '0')
+                zero = true;
+            else if (*fmt == '+')
+                pos_sign = '+';
+            else if (*fmt == ' ')
+                pos_sign = pos_sign ? pos_sign : ' ';
+            else
+                break;
+        }
+        while (*fmt >= '0' && *fmt <= '9')
+            width = width * 10u + (size_t)(*fmt++ - '0');
+        while (*fmt == 'l' || *fmt == 'z' || *fmt == 'h')
+            is_long |= (*fmt++ != 'h');     /* 32-bit on target either way */
+
+        char *end = num + sizeof(num);
+        char *p;
+        char sign = 0;
+
+        switch (*fmt) {
+        case 'd':
+        case 'i': {
+            int32_t v = is_long ? (int32_t)va_arg(ap, long) : va_arg(ap, int);
+            uint32_t u = (uint32_t)v;
+            sign = pos_sign;
+            if (v < 0) {
+                sign = '-';
+                u = 0u - u;
+            }
+            p = fmt_utoa(end, u, 10, false);
+            fmt_field(&o, p, (size_t)(end - p), sign, width, left, zero);
+            break;
+        }
+        case 'u':
+            p = fmt_utoa(end, is_long ? (uint32_t)va_arg(ap, unsigned long) : va_arg(ap, unsigned), 10, false);
+            fmt_field(&o, p, (size_t)(end - p), 0, width, left, zero);
+            break;
+        case 'x':
+        case 'X':
+            p = fmt_utoa(end, is_long ? (uint32_t)va_arg(ap, unsigned long) : va_arg(ap, unsigned),
+                         16, *fmt == 'X');
+            fmt_field(&o, p, (size_t)(end - p), 0, width, left, zero);
+            break;
+        case 'c':
+            num[0] = (char)va_arg(ap, int);
+            fmt_field(&o, num, 1, 0, width, left, false);
+            break;
+        case 's': {
+            const char *s = va_arg(ap, const char *);
+            if (!s)
+                s = "(null)";
+            fmt_field(&o, s, strlen(s), 0, width, left, false);
+            break;
+        }
+        case '%':
+            fmt_emit(&o, "%", 1);
+            break;
+        default:
+            /* Unsupported: copy the spec so the mistake shows */
+            if (!*fmt) {
+                fmt_emit(&o, spec, (size_t)(fmt - spec));
+                return o.len;
+            }
+            fmt_emit(&o, spec, (size_t)(fmt + 1 - spec));
+            break;
+        }
+        fmt++;
+    }
+
+    return o.len;
+}
+
+int fmt_vsnprintf(char *buf, size_t len, const char *fmt, va_list ap)
+{
+    FmtBuf b = { buf, len, 0 };
+    size_t n = fmt_vformat(fmt_put_buf, &b, fmt, ap);
+
+    if (buf && len > 0)
+        buf[(n < len) ? n : len - 1u] = '\0';
+    return (int)n;
+}
+
+int fmt_snprintf(char *buf, size_t len, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = fmt_vsnprintf(buf, len, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+void fmt_benchmark(void)
+{
+    static const char *const formats[] = {
+        "Axis %lu: pos %ld target %ld\r\n",
+        "DRV_STATUS 0x%08lX\r\n",
+        "%-14s %u\r\n",
+    };
+    const uint32_t runs = 16;
+    char buf[64];
+    uint32_t start, cycles[3];
+    volatile int sink = 0;
+
+    for (uint8_t f = 0; f < 3; f++) {
+        start = DWT->CYCCNT;
+        for (uint32_t i = 0; i < runs; i++) {
+            if (f == 0)
+                sink += fmt_snprintf(buf, sizeof(buf), formats[0], (unsigned long)i, -123456L, 7890123L);
+            else if (f == 1)
+                sink += fmt_snprintf(buf, sizeof(buf), formats[1], (unsigned long)(0xDEAD0000u + i));
+            else
+                sink += fmt_snprintf(buf, sizeof(buf), formats[2], "GCONF", (unsigned)i);
+        }
+        cycles[f] = (DWT->CYCCNT - start) / runs;
+    }
+
+#ifdef FMT_COMPARE_NEWLIB
+    uint32_t newlib[3];
+
+    for (uint8_t f = 0; f < 3; f++) {
+        start = DWT->CYCCNT;
+        for (uint32_t i = 0; i < runs; i++) {
+            if (f == 0)
+                sink += snprintf(buf, sizeof(buf), formats[0], (unsigned long)i, -123456L, 7890123L);
+            else if (f == 1)
+                sink += snprintf(buf, sizeof(buf), formats[1], (unsigned long)(0xDEAD0000u + i));
+            else
+                sink += snprintf(buf, sizeof(buf), formats[2], "GCONF", (unsigned)i);
+        }
+        newlib[f] = (DWT->CYCCNT - start) / runs;
+    }
+#endif
+
+    for (uint8_t f = 0; f < 3; f++) {
+        fmt_snprintf(buf, sizeof(buf), "%s", formats[f]);
+        buf[strcspn(buf, "\r\n")] = '\0';
+#ifdef FMT_COMPARE_NEWLIB
+        log_printf("Fmt bench \"%s\": %lu cycles, newlib %lu cycles\r\n",
+                   buf, (unsigned long)cycles[f], (unsigned long)newlib[f]);
+#else
+        log_printf("Fmt bench \"%s\": %lu cycles\r\n", buf, (unsigned long)cycles[f]);
+#endif
+    }
+    (void)sink;
+}
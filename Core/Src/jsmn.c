@@ -61,7 +61,9 @@ static jsmnerr_t jsmn_parse_primitive(jsmn_parser *parser, const char *js,
     jsmntok_t *token;
     int start;
 
-    start = parser->pos;
+    /* Resuming a primitive cut by the end of the previous input */
+    start = (parser->partial >= 0) ? parser->partial : (int)parser->pos;
+    parser->partial = -1;
 
     for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
         switch (js[parser->pos]) {
@@ -78,6 +80,11 @@ static jsmnerr_t jsmn_parse_primitive(jsmn_parser *parser, const char *js,
             return JSMN_ERROR_INVAL;
         }
     }
+    if (parser->stream) {
+        /* More digits may follow: continue from here next time */
+        parser->partial = start;
+        return JSMN_ERROR_PART;
+    }
 #ifdef JSMN_STRICT
     /* In strict mode primitive must be followed by a comma/object/array */
     parser->pos = start;
@@ -108,12 +115,18 @@ found:
 static jsmnerr_t jsmn_parse_string(jsmn_parser *parser, const char *js,
         size_t len, jsmntok_t *tokens, size_t num_tokens) {
     jsmntok_t *token;
+    int start;
+    unsigned int esc;
 
-    int start = parser->pos;
-
-    parser->pos++;
+    if (parser->partial >= 0) {
+        /* Resuming a string cut by the end of the previous input */
+        start = parser->partial;
+        parser->partial = -1;
+    } else {
+        start = parser->pos;
+        parser->pos++;  /* Skip starting quote */
+    }
 
-    /* Skip starting quote */
     for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
         char c = js[parser->pos];
 
@@ -135,8 +148,12 @@ static jsmnerr_t jsmn_parse_string(jsmn_parser *parser, const char *js,
         }
 
         /* Backslash: Quoted symbol expected */
+        if (c == '\\' && parser->stream && parser->pos + 1 >= len) {
+            break;      /* Escape cut off: rescan it next time */
+        }
         if (c == '\\' && parser->pos + 1 < len) {
             int i;
+            esc = parser->pos;
             parser->pos++;
             switch (js[parser->pos]) {
                 /* Allowed escaped symbols */
@@ -156,6 +173,10 @@ static jsmnerr_t jsmn_parse_string(jsmn_parser *parser, const char *js,
                         }
                         parser->pos++;
                     }
+                    if (i < 4 && parser->stream) {
+                        parser->pos = esc;
+                        goto partial;
+                    }
                     parser->pos--;
                     break;
                 /* Unexpected symbol */
@@ -165,6 +186,11 @@ static jsmnerr_t jsmn_parse_string(jsmn_parser *parser, const char *js,
             }
         }
     }
+partial:
+    if (parser->stream) {
+        parser->partial = start;
+        return JSMN_ERROR_PART;
+    }
     parser->pos = start;
     return JSMN_ERROR_PART;
 }
@@ -183,7 +209,8 @@ jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
         char c;
         jsmntype_t type;
 
-        c = js[parser->pos];
+        /* A resumed string/primitive is dispatched on its first character */
+        c = (parser->partial >= 0) ? js[parser->partial] : js[parser->pos];
         switch (c) {
             case '{': case '[':
                 count++;
@@ -248,6 +275,10 @@ jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
                     }
                 }
 #endif
+                if (parser->stream && parser->toksuper == -1) {
+                    parser->pos++;
+                    return (jsmnerr_t)parser->toknext;
+                }
                 break;
             case '\"':
                 r = jsmn_parse_string(parser, js, len, tokens, num_tokens);
@@ -255,6 +286,10 @@ jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
                 count++;
                 if (parser->toksuper != -1 && tokens != NULL)
                     tokens[parser->toksuper].size++;
+                else if (parser->stream) {
+                    parser->pos++;
+                    return (jsmnerr_t)parser->toknext;
+                }
                 break;
             case '\t' : case '\r' : case '\n' : case ' ':
                 break;
@@ -262,6 +297,11 @@ jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
                 parser->toksuper = parser->toknext - 1;
                 break;
             case ',':
+                if (parser->toksuper == -1) {
+                    /* No enclosing container */
+                    if (parser->stream) return JSMN_ERROR_INVAL;
+                    break;
+                }
                 if (tokens != NULL &&
                         tokens[parser->toksuper].type != JSMN_ARRAY &&
                         tokens[parser->toksuper].type != JSMN_OBJECT) {
@@ -301,6 +341,10 @@ jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
                 count++;
                 if (parser->toksuper != -1 && tokens != NULL)
                     tokens[parser->toksuper].size++;
+                else if (parser->stream) {
+                    parser->pos++;
+                    return (jsmnerr_t)parser->toknext;
+                }
                 break;
 
 #ifdef JSMN_STRICT
@@ -311,6 +355,11 @@ jsmnerr_t jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
         }
     }
 
+    if (parser->stream) {
+        /* The value is not complete yet */
+        return JSMN_ERROR_PART;
+    }
+
     for (i = parser->toknext - 1; i >= 0; i--) {
         /* Unmatched opened object or array */
         if (tokens[i].start != -1 && tokens[i].end == -1) {
@@ -329,4 +378,14 @@ void jsmn_init(jsmn_parser *parser, void* reserved) {
     parser->pos = 0;
     parser->toknext = 0;
     parser->toksuper = -1;
+    parser->partial = -1;
+    parser->stream = 0;
+}
+
+/**
+ * Creates a resumable parser for a single value arriving in pieces.
+ */
+void jsmn_init_stream(jsmn_parser *parser) {
+    jsmn_init(parser, NULL);
+    parser->stream = 1;
 }
@@ -1,6 +1,9 @@
 #include "main.h"
 #include "logging.h"
 #include "lwrb.h"
+#include "lwrb_mp.h"
+#include "fmt.h"
+#include "cmd_bin.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -11,11 +14,15 @@ static bool bInit_dma = false;
 volatile bool bPrintfTransferComplete = false;
 
 static uint8_t usart_start_tx_dma_transfer(void);
+static void usart_tx_dma_cplt(DMA_HandleTypeDef *hdma);
+static void usart_tx_dma_error(DMA_HandleTypeDef *hdma);
 
-/* Ring buffer for TX data */
+/* Ring buffer for TX data; written through usart_tx_mp only. The first
+   LOG_TX_MIRROR bytes are repeated past the end for wrap-free DMA. */
 lwrb_t usart_tx_buff;
-uint8_t usart_tx_buff_data[2048];
+uint8_t usart_tx_buff_data[LOG_TX_RING_SIZE + LOG_TX_MIRROR];
 volatile size_t usart_tx_dma_current_len;
+static lwrb_mp_t usart_tx_mp;
 
 
 #ifdef __GNUC__
@@ -27,16 +34,121 @@ volatile size_t usart_tx_dma_current_len;
 #endif /* __GNUC__ */
 
 
+/*
+ * TX ring backpressure
+ *
+ * When a message does not fit the ring the policy decides what is lost.
+ * DROP_OLDEST cannot take bytes out from under the DMA, so it discards
+ * the whole unsent backlog behind the chunk in flight; a message larger
+ * than the ring is cut to what fits under every policy except
+ * DROP_NEWEST. Must be called with interrupts masked.
+ */
+static LogTxPolicy tx_policy = LOG_TX_DROP_NEWEST;
+static uint32_t tx_block_timeout_ms;
+static LogTxStats tx_stats;
+
+static void usart_tx_discard_backlog(void)
+{
+	/* Pull the write head back to the end of the chunk in flight; not
+	   possible while a preempted producer still fills its reservation */
+	size_t dropped = lwrb_mp_rewind(&usart_tx_mp, usart_tx_dma_current_len);
+
+	if (dropped == 0)
+		return;
+
+	tx_stats.bytes_dropped += dropped;
+	tx_stats.backlog_discards++;
+}
+
+static bool usart_tx_may_block(void)
+{
+	return __get_IPSR() == 0 && __get_PRIMASK() == 0 && tx_block_timeout_ms != 0;
+}
+
+/* Bytes of a `count` byte message to queue under the current policy */
+static size_t usart_tx_make_room(size_t count)
+{
+	size_t free = lwrb_mp_get_free(&usart_tx_mp);
+
+	if (free >= count)
+		return count;
+
+	switch (tx_policy) {
+	case LOG_TX_BLOCK:
+		if (usart_tx_may_block()) {
+			uint32_t start = HAL_GetTick();
+
+			usart_start_tx_dma_transfer();
+			while ((free = lwrb_mp_get_free(&usart_tx_mp)) < count &&
+			       HAL_GetTick() - start < tx_block_timeout_ms) {
+			}
+			if (free >= count)
+				return count;
+			tx_stats.block_timeouts++;
+		}
+		return 0;                   /* Timed out or in ISR: drop newest */
+
+	case LOG_TX_DROP_OLDEST: {
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		usart_tx_discard_backlog();
+		free = lwrb_mp_get_free(&usart_tx_mp);
+		__set_PRIMASK(primask);
+		return (free < count) ? free : count;
+	}
+
+	case LOG_TX_TRUNCATE:
+		return free;
+
+	case LOG_TX_DROP_NEWEST:
+	default:
+		return 0;
+	}
+}
+
+/* Account for a committed write and start the DMA if it was published */
+static void usart_tx_committed(size_t len, bool published)
+{
+	tx_stats.bytes_written += len;
+
+	size_t level = lwrb_get_full(&usart_tx_buff);
+	if (level > tx_stats.high_water)
+		tx_stats.high_water = level;
+
+	if (published)
+		usart_start_tx_dma_transfer();
+}
+
+/* Account for the part of a `count` byte message that was not queued */
+static void usart_tx_lost(size_t count, size_t len)
+{
+	if (len >= count)
+		return;
+
+	tx_stats.bytes_dropped += count - len;
+	if (len == 0)
+		tx_stats.messages_dropped++;
+	else
+		tx_stats.messages_truncated++;
+}
+
 #ifdef __GNUC__
+/* Safe from thread mode and any interrupt priority: see lwrb_mp.h */
 int _write(int fd, const void *buf, size_t count){
 	UNUSED(fd);
 	uint8_t * src = (uint8_t *)buf;
 	if(bInit_dma)
 	{
-	    if (lwrb_get_free(&usart_tx_buff) >= count) {
-	        lwrb_write(&usart_tx_buff, buf, count);
-	        usart_start_tx_dma_transfer();
-	    }
+		size_t len = usart_tx_make_room(count);
+		bool published = false;
+
+		/* Another producer may take the room first: then it is a drop */
+		if (len > 0)
+			len = lwrb_mp_write(&usart_tx_mp, buf, len, &published);
+
+		usart_tx_lost(count, len);
+		if (len > 0)
+			usart_tx_committed(len, published);
 	}
 	else
 	{
@@ -59,10 +171,115 @@ PUTCHAR_PROTOTYPE
 }
 #endif
 
+/* Formatter output into a ring reservation, cut at its length */
+typedef struct
+{
+	lwrb_mp_res_t *res;
+	size_t pos;
+} UsartTxFill;
+
+static void usart_tx_put_res(void *ctx, const char *s, size_t len)
+{
+	UsartTxFill *f = (UsartTxFill *)ctx;
+	const lwrb_mp_res_t *res = f->res;
+
+	while (len > 0 && f->pos < res->len) {
+		bool first = f->pos < res->part[0];
+		size_t off = first ? f->pos : f->pos - res->part[0];
+		size_t room = (first ? res->part[0] : res->part[1]) - off;
+		size_t n = (len < room) ? len : room;
+
+		memcpy((first ? res->ptr[0] : res->ptr[1]) + off, s, n);
+		f->pos += n;
+		s += n;
+		len -= n;
+	}
+}
+
+/* Before the DMA ring exists: blocking, in chunks */
+typedef struct
+{
+	char buf[LOG_PRINTF_CHUNK];
+	size_t n;
+} UsartTxChunk;
+
+static void usart_tx_put_chunk(void *ctx, const char *s, size_t len)
+{
+	UsartTxChunk *c = (UsartTxChunk *)ctx;
+
+	while (len > 0) {
+		size_t n = sizeof(c->buf) - c->n;
+		if (n > len)
+			n = len;
+		memcpy(c->buf + c->n, s, n);
+		c->n += n;
+		s += n;
+		len -= n;
+		if (c->n == sizeof(c->buf)) {
+			_write(1, c->buf, c->n);
+			c->n = 0;
+		}
+	}
+}
+
+int log_vprintf(const char *fmt, va_list ap)
+{
+	va_list measure;
+	size_t count;
+
+	if (!bInit_dma) {
+		UsartTxChunk chunk;
+
+		chunk.n = 0;
+		count = fmt_vformat(usart_tx_put_chunk, &chunk, fmt, ap);
+		if (chunk.n > 0)
+			_write(1, chunk.buf, chunk.n);
+		return (int)count;
+	}
+
+	/* Measure, claim exactly that, then format into the claim */
+	va_copy(measure, ap);
+	count = fmt_vformat(NULL, NULL, fmt, measure);
+	va_end(measure);
+
+	lwrb_mp_res_t res;
+	size_t len = usart_tx_make_room(count);
+
+	if (len > 0 && !lwrb_mp_reserve(&usart_tx_mp, len, &res))
+		len = 0;
+	usart_tx_lost(count, len);
+
+	if (len > 0) {
+		UsartTxFill fill = { &res, 0 };
+
+		fmt_vformat(usart_tx_put_res, &fill, fmt, ap);
+		usart_tx_committed(len, lwrb_mp_commit(&usart_tx_mp, &res));
+	}
+	return (int)count;
+}
+
+int log_printf(const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = log_vprintf(fmt, ap);
+	va_end(ap);
+	return n;
+}
+
 void init_dma_logging()
 {
     /* Initialize ringbuff */
-    lwrb_init(&usart_tx_buff, usart_tx_buff_data, sizeof(usart_tx_buff_data));
+    lwrb_init(&usart_tx_buff, usart_tx_buff_data, LOG_TX_RING_SIZE);
+    lwrb_mp_init(&usart_tx_mp, &usart_tx_buff);
+    lwrb_mp_set_mirror(&usart_tx_mp, LOG_TX_MIRROR);
+
+    /* The channel is driven directly: completion only, no HT, no UART TC */
+    DEBUG_UART.hdmatx->XferCpltCallback = usart_tx_dma_cplt;
+    DEBUG_UART.hdmatx->XferHalfCpltCallback = NULL;
+    DEBUG_UART.hdmatx->XferErrorCallback = usart_tx_dma_error;
 
     bInit_dma = true;
 	bPrintfTransferComplete = true;
@@ -72,22 +289,297 @@ bool is_using_dma(){
 	return bInit_dma;
 }
 
+/* Queued bytes from r in one linear block; it runs on into the mirror */
+static size_t usart_tx_dma_block(void)
+{
+	size_t full = lwrb_get_full(&usart_tx_buff);
+	size_t linear = LOG_TX_RING_SIZE + LOG_TX_MIRROR - usart_tx_buff.r;
+
+	return (full < linear) ? full : linear;
+}
+
+/* Send everything queued in one transfer; re-entered from the DMA TC IRQ */
 static uint8_t usart_start_tx_dma_transfer(void) {
-    if (usart_tx_dma_current_len == 0 && (usart_tx_dma_current_len = lwrb_get_linear_block_read_length(&usart_tx_buff)) > 0) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
 
-        /* Limit maximal size to transmit at a time */
-        if (usart_tx_dma_current_len > 32) {
-            usart_tx_dma_current_len = 32;
+    if (usart_tx_dma_current_len == 0 && (usart_tx_dma_current_len = usart_tx_dma_block()) > 0) {
+
+        if (usart_tx_dma_current_len > LOG_TX_DMA_MAX_LEN) {
+            usart_tx_dma_current_len = LOG_TX_DMA_MAX_LEN;
         }
+        if (bPrintfTransferComplete)
+            tx_stats.dma_restarts++;        /* Ring had drained */
+        else
+            tx_stats.dma_chained++;
     	bPrintfTransferComplete = false;
-		if(HAL_UART_Transmit_DMA(&DEBUG_UART, (uint8_t*)lwrb_get_linear_block_read_address(&usart_tx_buff), usart_tx_dma_current_len)!= HAL_OK)
+		tx_stats.dma_bytes += usart_tx_dma_current_len;
+		SET_BIT(DEBUG_UART.Instance->CR3, USART_CR3_DMAT);   /* HAL_UART_Init() may have cleared it */
+		if(HAL_DMA_Start_IT(DEBUG_UART.hdmatx, (uint32_t)(uintptr_t)lwrb_get_linear_block_read_address(&usart_tx_buff),
+		                    (uint32_t)(uintptr_t)&DEBUG_UART.Instance->TDR, usart_tx_dma_current_len) != HAL_OK)
 		{
 			Error_Handler();
 		}
     }
+
+    __set_PRIMASK(primask);
     return 1;
 }
 
+void logging_set_tx_policy(LogTxPolicy policy, uint32_t block_timeout_ms)
+{
+	tx_policy = policy;
+	tx_block_timeout_ms = block_timeout_ms;
+}
+
+/* One reservation for the whole frame: it cannot be cut by the policy or
+   lose its room to a preempting producer between check and write */
+bool logging_tx_send_frame(const void *data, size_t len)
+{
+	bool published = false;
+
+	if (!bInit_dma || !data || len == 0)
+		return false;
+
+	if (lwrb_mp_write(&usart_tx_mp, data, len, &published) != len) {
+		usart_tx_lost(len, 0);
+		return false;
+	}
+
+	usart_tx_committed(len, published);
+	return true;
+}
+
+const LogTxStats *logging_tx_stats(void)
+{
+	return &tx_stats;
+}
+
+void logging_print_tx_stats(void)
+{
+	/* Snapshot first: the report itself goes through the ring */
+	LogTxStats st = tx_stats;
+
+	log_printf("Log TX: %lu bytes queued, %lu dropped (%lu msgs dropped, %lu truncated, %lu backlog discards)\r\n",
+	           (unsigned long)st.bytes_written,
+	           (unsigned long)st.bytes_dropped,
+	           (unsigned long)st.messages_dropped,
+	           (unsigned long)st.messages_truncated,
+	           (unsigned long)st.backlog_discards);
+	log_printf("Log TX: high water %lu of %lu bytes, DMA %lu restarts + %lu chained, %lu block timeouts\r\n",
+	           (unsigned long)st.high_water,
+	           (unsigned long)(LOG_TX_RING_SIZE - 1),
+	           (unsigned long)st.dma_restarts,
+	           (unsigned long)st.dma_chained,
+	           (unsigned long)st.block_timeouts);
+	log_printf("Log TX: DMA %lu bytes, %lu IRQs, %lu errors\r\n",
+	           (unsigned long)st.dma_bytes,
+	           (unsigned long)st.dma_irqs,
+	           (unsigned long)st.dma_errors);
+	log_printf("Log TX: %lu reservations, %lu refused, %lu lost races, %lu deferred publishes, nesting max %lu\r\n",
+	           (unsigned long)usart_tx_mp.reserved,
+	           (unsigned long)usart_tx_mp.full,
+	           (unsigned long)usart_tx_mp.retries,
+	           (unsigned long)usart_tx_mp.deferred,
+	           (unsigned long)usart_tx_mp.open_max);
+}
+
+#define TX_BENCH_LINE       64u
+
+void logging_tx_dma_benchmark(uint32_t bytes)
+{
+	char line[TX_BENCH_LINE];
+	LogTxPolicy policy = tx_policy;
+	uint32_t timeout = tx_block_timeout_ms;
+	uint32_t lines = bytes / TX_BENCH_LINE;
+
+	if (!bInit_dma || lines == 0)
+		return;
+
+	while (!logging_tx_idle()) {
+	}
+	logging_set_tx_policy(LOG_TX_BLOCK, 1000);
+
+	LogTxStats before = tx_stats;
+	uint32_t start = HAL_GetTick();
+
+	for (uint32_t i = 0; i < lines; i++) {
+		memset(line, '-', sizeof(line));
+		int n = fmt_snprintf(line, sizeof(line), "dma bench %08lu ", (unsigned long)i);
+		line[n] = '-';
+		line[TX_BENCH_LINE - 2] = '\r';
+		line[TX_BENCH_LINE - 1] = '\n';
+		_write(1, line, TX_BENCH_LINE);
+	}
+	while (!logging_tx_idle()) {
+	}
+
+	uint32_t elapsed_ms = HAL_GetTick() - start;
+	logging_set_tx_policy(policy, timeout);
+
+	uint32_t sent = tx_stats.dma_bytes - before.dma_bytes;
+	uint32_t irqs = tx_stats.dma_irqs - before.dma_irqs;
+	uint32_t transfers = (tx_stats.dma_restarts - before.dma_restarts) +
+	                     (tx_stats.dma_chained - before.dma_chained);
+	uint32_t line_rate = DEBUG_UART.Init.BaudRate / 10u;
+
+	if (elapsed_ms == 0 || sent == 0 || transfers == 0)
+		return;
+
+	uint32_t rate = (uint32_t)((uint64_t)sent * 1000u / elapsed_ms);
+	uint32_t irqs_per_kib = (uint32_t)((uint64_t)irqs * 1024000u / sent);  /* x1000 */
+
+	log_printf("Log DMA bench: %lu bytes in %lu ms, %lu B/s of %lu B/s line rate (%lu%%)\r\n",
+	           (unsigned long)sent,
+	           (unsigned long)elapsed_ms,
+	           (unsigned long)rate,
+	           (unsigned long)line_rate,
+	           (unsigned long)((uint64_t)rate * 100u / line_rate));
+	log_printf("Log DMA bench: %lu transfers, %lu IRQs, %lu.%03lu IRQs/KiB, %lu bytes/transfer, %lu dropped\r\n",
+	           (unsigned long)transfers,
+	           (unsigned long)irqs,
+	           (unsigned long)(irqs_per_kib / 1000u),
+	           (unsigned long)(irqs_per_kib % 1000u),
+	           (unsigned long)(sent / transfers),
+	           (unsigned long)(tx_stats.bytes_dropped - before.bytes_dropped));
+}
+
+#ifdef LOG_TX_BENCH
+/*
+ * Producer contention benchmark
+ *
+ * Each round the thread reserves a message and, with it still open, pends
+ * PendSV; PendSV reserves its own and pends SysTick, which preempts it and
+ * writes a third. The commits therefore come innermost first and only the
+ * thread's publishes all three.
+ */
+#define TX_BENCH_MSG_LEN    16u
+#define TX_BENCH_ROOM       (4u * TX_BENCH_MSG_LEN)
+
+static volatile bool tx_bench_active;
+static volatile uint32_t tx_bench_round;
+static volatile uint32_t tx_bench_isr_writes;
+static volatile uint32_t tx_bench_isr_refused;
+
+static void tx_bench_fill(const lwrb_mp_res_t *res, char tag, uint32_t round)
+{
+	char msg[TX_BENCH_MSG_LEN + 1];
+
+	fmt_snprintf(msg, sizeof(msg), "mp %c %08lu\r\n", tag, (unsigned long)round);
+	memcpy(res->ptr[0], msg, res->part[0]);
+	if (res->part[1] > 0)
+		memcpy(res->ptr[1], msg + res->part[0], res->part[1]);
+}
+
+void logging_tx_bench_isr(void)
+{
+	lwrb_mp_res_t res;
+
+	if (!tx_bench_active)
+		return;
+
+	if (__get_IPSR() == (PendSV_IRQn + 16)) {
+		if (!lwrb_mp_reserve(&usart_tx_mp, TX_BENCH_MSG_LEN, &res)) {
+			tx_bench_isr_refused++;
+			return;
+		}
+		SCB->ICSR = SCB_ICSR_PENDSTSET_Msk;     /* Nest SysTick inside */
+		__DSB();
+		__ISB();
+		tx_bench_fill(&res, 'P', tx_bench_round);
+		if (lwrb_mp_commit(&usart_tx_mp, &res))
+			usart_start_tx_dma_transfer();
+		tx_bench_isr_writes++;
+	} else {
+		char msg[TX_BENCH_MSG_LEN + 1];
+		bool published = false;
+
+		fmt_snprintf(msg, sizeof(msg), "mp S %08lu\r\n", (unsigned long)tx_bench_round);
+		if (lwrb_mp_write(&usart_tx_mp, msg, TX_BENCH_MSG_LEN, &published) == 0) {
+			tx_bench_isr_refused++;
+			return;
+		}
+		if (published)
+			usart_start_tx_dma_transfer();
+		tx_bench_isr_writes++;
+	}
+}
+
+void logging_tx_mp_benchmark(uint32_t rounds)
+{
+	uint8_t scratch_data[TX_BENCH_ROOM];
+	lwrb_t scratch;
+	lwrb_mp_res_t res;
+	uint32_t start, plain = 0, single = 0, nested = 0, refused = 0;
+	char msg[TX_BENCH_MSG_LEN + 1];
+
+	if (!bInit_dma || rounds == 0)
+		return;
+
+	lwrb_init(&scratch, scratch_data, sizeof(scratch_data));
+	fmt_snprintf(msg, sizeof(msg), "mp T %08lu\r\n", 0ul);
+
+	uint32_t prio_pendsv = NVIC_GetPriority(PendSV_IRQn);
+	uint32_t prio_systick = NVIC_GetPriority(SysTick_IRQn);
+	NVIC_SetPriority(PendSV_IRQn, (1u << __NVIC_PRIO_BITS) - 1u);
+	NVIC_SetPriority(SysTick_IRQn, (1u << __NVIC_PRIO_BITS) - 2u);
+	tx_bench_isr_writes = 0;
+	tx_bench_isr_refused = 0;
+
+	for (uint32_t i = 0; i < rounds; i++) {
+		/* Let the DMA drain so the ring never refuses for space */
+		while (lwrb_mp_get_free(&usart_tx_mp) < TX_BENCH_ROOM) {
+		}
+
+		/* Baseline: single-producer lwrb into a scratch ring */
+		lwrb_reset(&scratch);
+		start = DWT->CYCCNT;
+		lwrb_write(&scratch, msg, TX_BENCH_MSG_LEN);
+		plain += DWT->CYCCNT - start;
+
+		/* Uncontended reservation */
+		bool published = false;
+		start = DWT->CYCCNT;
+		lwrb_mp_write(&usart_tx_mp, msg, TX_BENCH_MSG_LEN, &published);
+		single += DWT->CYCCNT - start;
+		if (published)
+			usart_start_tx_dma_transfer();
+
+		/* Nested: thread, PendSV and SysTick with out-of-order commits */
+		tx_bench_round = i;
+		tx_bench_active = true;
+		start = DWT->CYCCNT;
+		if (lwrb_mp_reserve(&usart_tx_mp, TX_BENCH_MSG_LEN, &res)) {
+			SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+			__DSB();
+			__ISB();
+			tx_bench_fill(&res, 'T', i);
+			published = lwrb_mp_commit(&usart_tx_mp, &res);
+			nested += DWT->CYCCNT - start;
+			if (published)
+				usart_start_tx_dma_transfer();
+		} else {
+			refused++;
+		}
+		tx_bench_active = false;
+	}
+
+	NVIC_SetPriority(PendSV_IRQn, prio_pendsv);
+	NVIC_SetPriority(SysTick_IRQn, prio_systick);
+
+	log_printf("Log MP bench: %lu rounds, lwrb_write %lu cycles, lwrb_mp_write %lu cycles, nested round (3 writes) %lu cycles\r\n",
+	           (unsigned long)rounds,
+	           (unsigned long)(plain / rounds),
+	           (unsigned long)(single / rounds),
+	           (unsigned long)(nested / rounds));
+	log_printf("Log MP bench: %lu ISR writes, %lu ISR + %lu thread refused\r\n",
+	           (unsigned long)tx_bench_isr_writes,
+	           (unsigned long)tx_bench_isr_refused,
+	           (unsigned long)refused);
+	logging_print_tx_stats();
+}
+#endif /* LOG_TX_BENCH */
+
 void logging_UART_TxHalfCpltCallback(UART_HandleTypeDef *huart)
 {
 
@@ -100,10 +592,172 @@ void logging_UART_ErrorCallback(UART_HandleTypeDef *huart)
 }
 
 
+/* TX completion comes from the DMA channel (usart_tx_dma_cplt), not HAL UART */
 void logging_UART_TxCpltCallback(UART_HandleTypeDef *huart)
 {
-	bPrintfTransferComplete = true;
+
+}
+
+/* The one interrupt per transfer: release the bytes and chain the next block */
+static void usart_tx_dma_cplt(DMA_HandleTypeDef *hdma)
+{
+    tx_stats.dma_irqs++;
     lwrb_skip(&usart_tx_buff, usart_tx_dma_current_len);/* Data sent, ignore these */
     usart_tx_dma_current_len = 0;
     usart_start_tx_dma_transfer();          /* Try to send more data */
+    if (usart_tx_dma_current_len == 0)
+        bPrintfTransferComplete = true;     /* Nothing left, DMA idle */
+}
+
+/* Bus error: the chunk is lost, carry on with the rest */
+static void usart_tx_dma_error(DMA_HandleTypeDef *hdma)
+{
+    tx_stats.dma_errors++;
+    usart_tx_dma_cplt(hdma);
+}
+
+bool logging_tx_idle(void)
+{
+	if (!bInit_dma)
+		return __HAL_UART_GET_FLAG(&DEBUG_UART, UART_FLAG_TC);
+	return bPrintfTransferComplete && __HAL_UART_GET_FLAG(&DEBUG_UART, UART_FLAG_TC);
+}
+
+/*
+ * Deferred logging ring (multi-producer, single consumer)
+ *
+ * Producers claim a slot by advancing log_head with LDREX/STREX, fill it
+ * and publish it by writing seq = position + 1. The consumer only takes
+ * the slot at log_tail once its seq says it is complete, so an ISR that
+ * preempts a half-written record never exposes it.
+ */
+#define LOG_RING_MASK  (LOG_RING_SIZE - 1u)
+
+static LogRecord log_ring[LOG_RING_SIZE];
+static volatile uint32_t log_head;
+static volatile uint32_t log_tail;
+static LogStats log_stats;
+
+bool log_deferred(const LogMsg *msg, const uint32_t *args)
+{
+	uint32_t pos;
+
+	do {
+		pos = __LDREXW(&log_head);
+		if (pos - log_tail >= LOG_RING_SIZE) {
+			__CLREX();
+			log_stats.dropped++;
+			return false;
+		}
+	} while (__STREXW(pos + 1u, &log_head));
+
+	LogRecord *r = &log_ring[pos & LOG_RING_MASK];
+	r->msg = msg;
+	r->timestamp = DWT->CYCCNT;
+	for (uint8_t i = 0; i < msg->nargs; i++)
+		r->arg[i] = args[i];
+
+	__DMB();
+	r->seq = pos + 1u;
+	log_stats.written++;
+	return true;
+}
+
+/* Copy out the oldest complete record; false if none is ready */
+static bool log_deferred_take(LogRecord *out)
+{
+	uint32_t tail = log_tail;
+	LogRecord *r = &log_ring[tail & LOG_RING_MASK];
+
+	if (r->seq != tail + 1u)
+		return false;
+
+	__DMB();
+	*out = *r;
+	__DMB();
+	log_tail = tail + 1u;
+	log_stats.flushed++;
+	return true;
+}
+
+/* Format pending records with log_printf (idle loop); 0 = all */
+uint32_t log_deferred_flush(uint32_t max_records)
+{
+	LogRecord r;
+	uint32_t n = 0;
+
+	while ((max_records == 0 || n < max_records) && log_deferred_take(&r)) {
+		log_printf(r.msg->fmt, r.arg[0], r.arg[1], r.arg[2], r.arg[3]);
+		n++;
+	}
+	return n;
+}
+
+static uint8_t *log_put_u32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+	return p + 4;
+}
+
+/*
+ * Ship pending records unformatted, one CMD_BIN_LOG frame each, for a
+ * host-side decoder; 0 = all. Stops at the first frame the TX ring
+ * refuses so the rest stay queued.
+ */
+uint32_t log_deferred_flush_binary(uint32_t max_records)
+{
+	static uint8_t seq;
+	LogRecord r;
+	uint32_t n = 0;
+	uint8_t payload[4u * (2u + LOG_ARGS_MAX)];
+	uint8_t frame[CMD_BIN_ENCODED_MAX(sizeof(payload))];
+
+	while ((max_records == 0 || n < max_records) && log_deferred_take(&r)) {
+		uint8_t *p = payload;
+
+		p = log_put_u32(p, (uint32_t)(uintptr_t)r.msg);
+		p = log_put_u32(p, r.timestamp);
+		for (uint8_t i = 0; i < r.msg->nargs; i++)
+			p = log_put_u32(p, r.arg[i]);
+
+		size_t len = cmd_bin_encode(CMD_BIN_LOG, seq++, payload, (size_t)(p - payload),
+		                            frame, sizeof(frame));
+		n++;
+		if (len == 0 || !logging_tx_send_frame(frame, len)) {
+			log_stats.tx_drops++;
+			break;
+		}
+	}
+	return n;
+}
+
+const LogStats *log_deferred_stats(void)
+{
+	return &log_stats;
+}
+
+/* Cycles per log call: deferred record vs. log_printf into the TX ring */
+void log_deferred_benchmark(void)
+{
+	const uint32_t runs = 16;
+	uint32_t start;
+
+	log_deferred_flush(0);
+
+	start = DWT->CYCCNT;
+	for (uint32_t i = 0; i < runs; i++)
+		LOG_DEFER("bench %lu %lu\r\n", i, start);
+	uint32_t deferred = (DWT->CYCCNT - start) / runs;
+
+	start = DWT->CYCCNT;
+	for (uint32_t i = 0; i < runs; i++)
+		log_printf("bench %lu %lu\r\n", (unsigned long)i, (unsigned long)start);
+	uint32_t direct = (DWT->CYCCNT - start) / runs;
+
+	log_deferred_flush(0);
+	log_printf("Log bench: deferred %lu cycles/call, log_printf %lu cycles/call\r\n",
+	           (unsigned long)deferred, (unsigned long)direct);
 }
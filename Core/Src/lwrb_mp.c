@@ -0,0 +1,265 @@
+/*
+ * lwrb_mp.c — lock-free multi-producer reservations on an lwrb ring
+ *
+ * state = head | open << LWRB_MP_OPEN_SHIFT. Reserving moves the head and
+ * counts the reservation open in one STREX; committing counts it closed.
+ * The commit that closes the last open reservation publishes the head as
+ * lwrb's `w`. Publishing is itself a LDREX/STREX on `w` that re-reads the
+ * state inside the exclusive window: a preemption (or another core
+ * storing `w`) fails the STREX, so a stale head can never overwrite a
+ * newer one.
+ *
+ * Mirrored bytes are copied before the commit, so they are published
+ * together with the originals.
+ */
+
+#include "lwrb_mp.h"
+#include "main.h"
+
+#include <string.h>
+
+#define MP_HEAD(s)          ((s) & LWRB_MP_HEAD_MASK)
+#define MP_OPEN(s)          ((s) >> LWRB_MP_OPEN_SHIFT)
+#define MP_STATE(head, open) ((uint32_t)(head) | ((uint32_t)(open) << LWRB_MP_OPEN_SHIFT))
+#define MP_OPEN_MAX         (0xFFFFFFFFu >> LWRB_MP_OPEN_SHIFT)
+
+/* ============================================================================
+ *  Internal Helpers
+ * ========================================================================== */
+
+/* Free space behind `head`: the consumer only ever makes it larger */
+static size_t mp_free(const lwrb_t *rb, uint32_t head)
+{
+    size_t r = *(volatile const size_t *)&rb->r;
+    size_t used = (head >= r) ? head - r : rb->size - (r - head);
+
+    return rb->size - 1u - used;
+}
+
+static void mp_fill(const lwrb_t *rb, uint32_t start, size_t len, lwrb_mp_res_t *res)
+{
+    size_t first = rb->size - start;
+
+    if (first > len)
+        first = len;
+
+    res->start = start;
+    res->len = len;
+    res->ptr[0] = &rb->buff[start];
+    res->part[0] = first;
+    res->ptr[1] = rb->buff;
+    res->part[1] = len - first;
+}
+
+static void mp_mirror(const lwrb_mp_t *mp, const lwrb_mp_res_t *res)
+{
+    lwrb_t *rb = mp->rb;
+
+    for (uint8_t k = 0; k < 2; k++) {
+        size_t idx = (k == 0) ? res->start : 0;
+        size_t n = res->part[k];
+
+        if (n == 0 || idx >= mp->mirror)
+            continue;
+        if (n > mp->mirror - idx)
+            n = mp->mirror - idx;
+        memcpy(&rb->buff[rb->size + idx], &rb->buff[idx], n);
+    }
+}
+
+/* Claim len bytes at the head; at >= 0 additionally requires head == at */
+static bool mp_claim(lwrb_mp_t *mp, size_t len, int32_t at, lwrb_mp_res_t *res)
+{
+    lwrb_t *rb = mp->rb;
+    uint32_t s, head, open, next;
+
+    for (;;) {
+        s = __LDREXW(&mp->state);
+        head = MP_HEAD(s);
+        open = MP_OPEN(s);
+
+        if ((at >= 0 && head != (uint32_t)at) ||
+            open == MP_OPEN_MAX || mp_free(rb, head) < len) {
+            __CLREX();
+            if (at < 0)
+                mp->full++;
+            return false;
+        }
+
+        next = head + len;
+        if (next >= rb->size)
+            next -= rb->size;
+
+        if (__STREXW(MP_STATE(next, open + 1u), &mp->state) == 0)
+            break;
+        mp->retries++;
+    }
+
+    mp->reserved++;
+    if (open + 1u > mp->open_max)
+        mp->open_max = open + 1u;
+
+    mp_fill(rb, head, len, res);
+    return true;
+}
+
+/* Move `w` up to the head if nothing is open; true if this call moved it */
+static bool mp_publish(lwrb_mp_t *mp)
+{
+    volatile uint32_t *w = (volatile uint32_t *)&mp->rb->w;
+
+    for (;;) {
+        uint32_t cur = __LDREXW(w);
+        uint32_t s = mp->state;
+
+        /* A later producer is open (it publishes) or already published */
+        if (MP_OPEN(s) != 0 || MP_HEAD(s) == cur) {
+            __CLREX();
+            return false;
+        }
+        if (__STREXW(MP_HEAD(s), w) == 0)
+            return true;
+        mp->retries++;
+    }
+}
+
+/* ============================================================================
+ *  Public API
+ * ========================================================================== */
+
+bool lwrb_mp_init(lwrb_mp_t *mp, lwrb_t *rb)
+{
+    if (!mp || !rb || !lwrb_is_ready(rb) || rb->size > LWRB_MP_HEAD_MASK)
+        return false;
+
+    mp->rb = rb;
+    mp->state = MP_STATE(rb->w, 0);
+    mp->mirror = 0;
+    mp->reserved = 0;
+    mp->full = 0;
+    mp->retries = 0;
+    mp->deferred = 0;
+    mp->open_max = 0;
+    return true;
+}
+
+bool lwrb_mp_set_mirror(lwrb_mp_t *mp, size_t len)
+{
+    if (!mp || !mp->rb || len > mp->rb->size)
+        return false;
+
+    mp->mirror = len;
+    return true;
+}
+
+bool lwrb_mp_reserve(lwrb_mp_t *mp, size_t len, lwrb_mp_res_t *res)
+{
+    if (!mp || !mp->rb || !res || len == 0)
+        return false;
+
+    return mp_claim(mp, len, -1, res);
+}
+
+bool lwrb_mp_commit(lwrb_mp_t *mp, const lwrb_mp_res_t *res)
+{
+    uint32_t s, open;
+
+    if (!mp || !res || res->len == 0)
+        return false;
+
+    if (mp->mirror)
+        mp_mirror(mp, res);
+
+    __DMB();                        /* Payload before the close */
+
+    for (;;) {
+        s = __LDREXW(&mp->state);
+        open = MP_OPEN(s) - 1u;
+        if (__STREXW(MP_STATE(MP_HEAD(s), open), &mp->state) == 0)
+            break;
+        mp->retries++;
+    }
+
+    if (open != 0) {
+        mp->deferred++;
+        return false;
+    }
+    return mp_publish(mp);
+}
+
+size_t lwrb_mp_write(lwrb_mp_t *mp, const void *data, size_t len, bool *published)
+{
+    lwrb_mp_res_t res;
+    bool pub;
+
+    if (!data || !lwrb_mp_reserve(mp, len, &res))
+        return 0;
+
+    memcpy(res.ptr[0], data, res.part[0]);
+    if (res.part[1] > 0)
+        memcpy(res.ptr[1], (const uint8_t *)data + res.part[0], res.part[1]);
+
+    pub = lwrb_mp_commit(mp, &res);
+    if (published)
+        *published = pub;
+    return len;
+}
+
+void *lwrb_mp_linear(lwrb_mp_t *mp, size_t *len)
+{
+    if (!mp || !mp->rb || !len)
+        return NULL;
+
+    lwrb_t *rb = mp->rb;
+    uint32_t head = MP_HEAD(mp->state);
+    size_t free = mp_free(rb, head);
+    size_t linear = rb->size - head;
+
+    *len = (linear < free) ? linear : free;
+    return &rb->buff[head];
+}
+
+bool lwrb_mp_reserve_at(lwrb_mp_t *mp, const void *at, size_t len, lwrb_mp_res_t *res)
+{
+    if (!mp || !mp->rb || !at || !res || len == 0)
+        return false;
+
+    const uint8_t *p = (const uint8_t *)at;
+    if (p < mp->rb->buff || p >= mp->rb->buff + mp->rb->size)
+        return false;
+
+    return mp_claim(mp, len, (int32_t)(p - mp->rb->buff), res);
+}
+
+size_t lwrb_mp_get_free(lwrb_mp_t *mp)
+{
+    if (!mp || !mp->rb)
+        return 0;
+
+    return mp_free(mp->rb, MP_HEAD(mp->state));
+}
+
+size_t lwrb_mp_rewind(lwrb_mp_t *mp, size_t keep)
+{
+    if (!mp || !mp->rb)
+        return 0;
+
+    lwrb_t *rb = mp->rb;
+    uint32_t s = mp->state;
+
+    if (MP_OPEN(s) != 0)
+        return 0;
+
+    size_t used = rb->size - 1u - mp_free(rb, MP_HEAD(s));
+    if (used <= keep)
+        return 0;
+
+    size_t head = rb->r + keep;
+    if (head >= rb->size)
+        head -= rb->size;
+
+    /* w first: it never runs ahead of the head the producers see */
+    rb->w = head;
+    mp->state = MP_STATE(head, 0);
+    return used - keep;
+}
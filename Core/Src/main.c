@@ -22,8 +22,13 @@
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include "logging.h"
+#include "uart_rx.h"
+#include "cmd_json.h"
+#include "cmd_bin.h"
+#include "telemetry.h"
 #include "stepper.h"
 #include "stepper_config.h"
+#include "stepper_pvt.h"
 #include <stdio.h>
 #include <stdbool.h>
 #include <util.h>
@@ -38,7 +43,8 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
-
+#define HEARTBEAT_MS    100     /* LED toggle and deferred log flush */
+#define PVT_TICK_US     1000    /* PVT ticks are latched by the 1 ms HAL tick */
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -61,6 +67,14 @@ DMA_HandleTypeDef hdma_usart2_tx;
 /* USER CODE BEGIN PV */
 
 static bool motorEnabled = false;
+static CmdJson cmd_json;
+static CmdBin cmd_bin;
+#ifdef CMD_BINARY
+static StepperPvt pvt;
+#endif
+#ifdef TELEMETRY_RATE_HZ
+static Telemetry telemetry;
+#endif
 
 /* USER CODE END PV */
 
@@ -86,6 +100,13 @@ static void MX_SPI2_Init(void);
 
   StepperGroup *z_axis = NULL;
 
+/* RX event ISR: wake the main loop from WFE to parse the new bytes */
+static void main_rx_notify(size_t available)
+{
+  (void)available;
+  __SEV();
+}
+
 /* USER CODE END 0 */
 
 /**
@@ -126,12 +147,14 @@ int main(void)
   /* USER CODE BEGIN 2 */
   DWT_Init();
   init_dma_logging();
-  printf("\033c");
-  printf("Duvitech Stepper Demo\r\n\r\n");
-  printf("CPU Clock Frequency: %lu MHz\r\n", HAL_RCC_GetSysClockFreq() / 1000000);
+  uart_rx_init(&huart2);
+  uart_rx_set_notify(main_rx_notify);
+  log_printf("\033c");
+  log_printf("Duvitech Stepper Demo\r\n\r\n");
+  log_printf("CPU Clock Frequency: %lu MHz\r\n", HAL_RCC_GetSysClockFreq() / 1000000);
 
   /* Initialize stepper motors using the abstracted API */
-  printf("Initializing steppers via stepper API...\r\n");
+  log_printf("Initializing steppers via stepper API...\r\n");
   stepper_config_init();
 
   /* Print register configurations using stepper API */
@@ -148,8 +171,28 @@ int main(void)
   stepper_enable(s1, true);
 
   motorEnabled = true;
+  cmd_json_init(&cmd_json, z_axis);
+  cmd_bin_init(&cmd_bin, z_axis);
+#ifdef CMD_BINARY
+  if (stepper_pvt_init(&pvt, z_axis,
+                       (z_axis->count < STEPPER_PVT_AXES) ? z_axis->count : STEPPER_PVT_AXES,
+                       PVT_TICK_US, 0))
+    cmd_bin_attach_pvt(&cmd_bin, &pvt);
+#endif
+#ifdef TELEMETRY_RATE_HZ
+  telemetry_start(&telemetry, z_axis, z_axis->smart_mask,
+                  TELEMETRY_POSITION | TELEMETRY_VELOCITY | TELEMETRY_AGE,
+                  TELEMETRY_RATE_HZ, TELEMETRY_BAUD_MAX);
+#endif
+
+#ifdef UART_RX_SWEEP
+  /* Needs the host side streaming: python3 uart_sweep.py <port> */
+  static const uint32_t sweep_bauds[] = { 115200, 460800, 921600, 2000000, 4000000, 8000000, 10000000 };
+  uart_rx_benchmark_sweep(sweep_bauds, sizeof(sweep_bauds) / sizeof(sweep_bauds[0]), UART_RX_SWEEP_MS);
+#endif
 
-  printf("Entering Main LOOP.\r\n\r\n");
+  log_printf("Entering Main LOOP.\r\n\r\n");
+  uint32_t heartbeat_tick = HAL_GetTick();
   /* USER CODE END 2 */
 
   /* Infinite loop */
@@ -159,8 +202,28 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
-    HAL_Delay(100);
-    HAL_GPIO_TogglePin(LD2_GPIO_Port, LD2_Pin);
+    /* Events, commands and telemetry are served on every pass; only the
+       heartbeat runs on the 100 ms tick */
+    if (HAL_GetTick() - heartbeat_tick >= HEARTBEAT_MS)
+    {
+      heartbeat_tick += HEARTBEAT_MS;
+      HAL_GPIO_TogglePin(LD2_GPIO_Port, LD2_Pin);
+      log_deferred_flush(0);
+    }
+    stepper_config_service_events();
+#ifdef CMD_BINARY
+    stepper_pvt_service(&pvt);
+    cmd_bin_poll(&cmd_bin);
+#else
+    cmd_json_poll(&cmd_json);
+#endif
+#ifdef TELEMETRY_RATE_HZ
+    /* Frames are due on DWT, not on an interrupt: keep spinning */
+    telemetry_tick(&telemetry);
+#else
+    /* Sleep until RX data, DIAG0 or the 1 ms tick */
+    __WFE();
+#endif
   }
   /* USER CODE END 3 */
 }
@@ -493,7 +556,16 @@ static void MX_GPIO_Init(void)
   GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
   HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
+  /*Configure GPIO pins : STEP1_DIAG0_Pin STEP2_DIAG0_Pin */
+  GPIO_InitStruct.Pin = STEP1_DIAG0_Pin|STEP2_DIAG0_Pin;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
+  GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+  HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
+
   /* EXTI interrupt init*/
+  HAL_NVIC_SetPriority(EXTI9_5_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
+
   HAL_NVIC_SetPriority(EXTI15_10_IRQn, 0, 0);
   HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
 
@@ -508,6 +580,23 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 
 }
 
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+	if(huart->Instance == USART2)
+	{
+		uart_rx_event_callback(huart, Size);
+	}
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+	if(huart->Instance == USART2)
+	{
+		logging_UART_ErrorCallback(huart);
+		uart_rx_error_callback(huart);
+	}
+}
+
 void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
 {
 	if(huart->Instance == USART2)
@@ -518,6 +607,14 @@ void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
 
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 {
+  /* TMC5240 DIAG0: latched here, read over SPI from the main loop */
+  if(GPIO_Pin == STEP1_DIAG0_Pin || GPIO_Pin == STEP2_DIAG0_Pin)
+  {
+    stepper_config_handle_diag(GPIO_Pin, DWT->CYCCNT);
+    __SEV();
+    return;
+  }
+
   if(GPIO_Pin == B1_Pin)
   {
     if(motorEnabled)
@@ -527,7 +624,7 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
       if(curr_pos < 2000) curr_pos = 0;
 #if 1
       stepper_group_move_to(z_axis, curr_pos + 2000);
-      printf("Stepper group: all moving +2000 "); 
+      LOG_PRINTF("Stepper group: all moving +2000 ");
       
       /* Simulate group move to apprximate timing*/
       /*
@@ -536,14 +633,14 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
       stepper_move_to_position(s1, curr_pos + 2000);
       uint32_t s1_complete_time = DWT->CYCCNT;
 
-      printf("Stepper group: all moving +2000 steps synchronously\r\n"); 
+      log_printf("Stepper group: all moving +2000 steps synchronously\r\n"); 
       
       uint32_t delay_ticks = (s1_complete_time > s0_complete_time) ? 
                           (s1_complete_time - s0_complete_time) : 
                           (s0_complete_time - s1_complete_time);
       uint32_t cycles_per_us = SystemCoreClock / 1000000;
       uint32_t delay_us = delay_ticks / cycles_per_us;
-      printf("Both motors completed. Delay between start: %lu us\r\n", delay_us);  // 64 uS
+      log_printf("Both motors completed. Delay between start: %lu us\r\n", delay_us);  // 64 uS
       */
 
 #else
@@ -568,7 +665,7 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
       tmc5240_fast_writeSPI(((TMC5240_Context *)s1->hw_context)->icID, &data[0], 5);  
       uint32_t s1_complete_time = DWT->CYCCNT;
 
-      printf("Stepper group: all moving +2000 steps synchronously\r\n");
+      log_printf("Stepper group: all moving +2000 steps synchronously\r\n");
       
       
       uint32_t delay_ticks = (s1_complete_time > s0_complete_time) ? 
@@ -576,7 +673,7 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
                           (s0_complete_time - s1_complete_time);
       uint32_t cycles_per_us = SystemCoreClock / 1000000;
       uint32_t delay_us = delay_ticks / cycles_per_us;
-      printf("Both motors completed. Delay between start: %lu us\r\n", delay_us);  // 31 uS std read/write 22 uS with fast write
+      log_printf("Both motors completed. Delay between start: %lu us\r\n", delay_us);  // 31 uS std read/write 22 uS with fast write
 
 #endif
     }
@@ -604,7 +701,13 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
     HAL_IncTick();
   }
   /* USER CODE BEGIN Callback 1 */
-
+#ifdef CMD_BINARY
+  /* SPI work is left to the main loop (stepper_pvt_service) */
+  if (htim->Instance == TIM17)
+  {
+    stepper_pvt_tick_irq(&pvt);
+  }
+#endif
   /* USER CODE END Callback 1 */
 }
 
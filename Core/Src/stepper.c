@@ -1,16 +1,136 @@
 #include "stepper.h"
 #include "tmc5240_driver.h" // For TMC5240_Context, GPIO_PIN_RESET/SET
+#include "logging.h"
 #include <stdio.h>
 
 /* ============================================================================
  *  Internal Helpers
  * ========================================================================== */
 
+/*
+ * Driver dispatch. A driver header can bind itself at build time by
+ * defining STEPPER_STATIC_CAPS and the STEPPER_STATIC_* hot ops; capability
+ * checks then fold to constants and the hot ops become direct calls. The
+ * StepperDriver table is used for everything else.
+ */
+#ifdef STEPPER_STATIC_CAPS
+
+static inline bool stepper_driver_has(const Stepper *s, uint32_t cap)
+{
+    (void)s;
+    return (STEPPER_STATIC_CAPS & cap) != 0;
+}
+
+#define STEPPER_HAS_OP(s, op)            true
+#define STEPPER_MOVE_TO(s, pos)          STEPPER_STATIC_MOVE_TO((s), (pos))
+#define STEPPER_SET_VELOCITY(s, v)       STEPPER_STATIC_SET_VELOCITY((s), (v))
+#define STEPPER_SET_RAMP_SCALE(s, q)     STEPPER_STATIC_SET_RAMP_SCALE((s), (q))
+#define STEPPER_GET_POSITION(s)          STEPPER_STATIC_GET_POSITION(s)
+#define STEPPER_POSITION_REACHED(s)      STEPPER_STATIC_POSITION_REACHED(s)
+#define STEPPER_POLL_MOTION(s, q)        STEPPER_STATIC_POLL_MOTION((s), (q))
+#define STEPPER_READ_EVENTS(s)           STEPPER_STATIC_READ_EVENTS(s)
+
+#else
+
 static inline bool stepper_driver_has(const Stepper *s, uint32_t cap)
 {
     return (s->driver && (s->driver->caps & cap));
 }
 
+#define STEPPER_HAS_OP(s, op)            ((s)->driver->op != NULL)
+#define STEPPER_MOVE_TO(s, pos)          (s)->driver->move_to((s), (pos))
+#define STEPPER_SET_VELOCITY(s, v)       (s)->driver->set_velocity((s), (v))
+#define STEPPER_SET_RAMP_SCALE(s, q)     (s)->driver->set_ramp_scale((s), (q))
+#define STEPPER_GET_POSITION(s)          (s)->driver->get_position(s)
+#define STEPPER_POSITION_REACHED(s)      (s)->driver->position_reached(s)
+#define STEPPER_POLL_MOTION(s, q)        (s)->driver->poll_motion((s), (q))
+#define STEPPER_READ_EVENTS(s)           (s)->driver->read_events(s)
+
+#endif
+
+/*
+ * Wake any Stepper_await* sleeping in WFE. The event register latches, so
+ * a wakeup raised between the waiter's flag check and its WFE is not lost.
+ */
+static inline void stepper_signal(void)
+{
+    __SEV();
+}
+
+static inline void stepper_finish(Stepper *s)
+{
+    s->done_cycles = DWT->CYCCNT;
+    s->busy = false;
+    s->interpolated = false;
+    if (s->done_cb)
+        s->done_cb(s);
+    stepper_signal();
+}
+
+/* Best known current position without assuming position feedback */
+static int32_t stepper_current_position(Stepper *s)
+{
+    if (stepper_driver_has(s, STEPPER_CAP_POSITION_FB))
+        return stepper_get_position(s);
+
+    if (!s->busy)
+        return s->target_position;
+
+    return s->direction ? s->target_position - s->steps_remaining
+                        : s->target_position + s->steps_remaining;
+}
+
+/* Schedule the next completion poll immediately (new motion command) */
+static inline void stepper_poll_now(Stepper *s)
+{
+    s->poll_due = DWT->CYCCNT;
+    s->poll_near = false;
+}
+
+/*
+ * Adaptive completion polling. A full poll also returns the earliest time
+ * the axis could arrive; nothing is read until then. Inside the latency
+ * window only the status byte is polled, once per poll_latency_us.
+ */
+static bool stepper_poll_adaptive(Stepper *s)
+{
+    uint32_t now = DWT->CYCCNT;
+
+    if ((int32_t)(now - s->poll_due) < 0)
+        return s->busy;
+
+    uint32_t wait_us = s->poll_latency_us;
+    bool reached;
+
+    s->polls++;
+    if (s->poll_near && STEPPER_HAS_OP(s, position_reached)) {
+        reached = STEPPER_POSITION_REACHED(s);
+    } else {
+        uint32_t quiet_us = 0;
+        reached = STEPPER_POLL_MOTION(s, &quiet_us);
+        if (quiet_us > STEPPER_POLL_MAX_US)
+            quiet_us = STEPPER_POLL_MAX_US;
+        if (quiet_us > wait_us)
+            wait_us = quiet_us;
+        else
+            s->poll_near = true;
+    }
+
+    if (reached) {
+        stepper_finish(s);
+        return false;
+    }
+
+    s->poll_due = now + wait_us * (SystemCoreClock / 1000000);
+    return s->busy;
+}
+
+static inline void stepper_set_ramp_scale(Stepper *s, uint32_t scale_q16)
+{
+    if (stepper_driver_has(s, STEPPER_CAP_RAMP_SCALE) && STEPPER_HAS_OP(s, set_ramp_scale))
+        STEPPER_SET_RAMP_SCALE(s, scale_q16);
+}
+
 /* ============================================================================
  *  Low-Level Stepper API
  * ========================================================================== */
@@ -23,6 +143,12 @@ void stepper_init(Stepper *s,
     if (!s || !driver)
         return;
 
+#ifdef STEPPER_STATIC_CAPS
+    /* The build is bound to one driver */
+    if (driver != &STEPPER_STATIC_DRIVER)
+        return;
+#endif
+
     s->stepper_id = stepper_id;
     s->driver = driver;
     s->hw_context = hw_context;
@@ -36,13 +162,32 @@ void stepper_init(Stepper *s,
 
     s->enabled = false;
     s->busy = false;
+    s->interpolated = false;
+    s->velocity_mode = false;
 
     s->done_cb = NULL;
 
+    s->events_enabled = false;
+    s->event_pending = false;
+    s->event_irq_cycles = 0;
+    s->events = 0;
+    s->event_latency_cycles = 0;
+    s->event_latency_max = 0;
+    s->done_cycles = 0;
+
+    s->poll_latency_us = 0;
+    s->poll_due = 0;
+    s->poll_near = false;
+    s->polls = 0;
+
     s->limits_enabled = false;
     s->limit_hit = false;
     s->limit_cb = NULL;
 
+    s->group_busy = NULL;
+    s->group_events = NULL;
+    s->group_bit = 0;
+
     if (driver->init)
         driver->init(s);
 }
@@ -71,10 +216,21 @@ uint32_t stepper_get_speed(const Stepper *s)
 
 int32_t stepper_get_position(Stepper *s)
 {
-    if (!s || !s->driver || !s->driver->get_position)
+    if (!s || !s->driver || !STEPPER_HAS_OP(s, get_position))
         return 0;
 
-    return s->driver->get_position(s);
+    return STEPPER_GET_POSITION(s);
+}
+
+void stepper_set_position(Stepper *s, int32_t position)
+{
+    if (!s || !stepper_driver_has(s, STEPPER_CAP_HOMING) || !s->driver->set_position)
+        return;
+
+    s->driver->set_position(s, position);
+    s->target_position = position;
+    s->busy = false;
+    s->velocity_mode = false;
 }
 
 bool stepper_position_reached(Stepper *s)
@@ -84,14 +240,80 @@ bool stepper_position_reached(Stepper *s)
 
     if (stepper_driver_has(s, STEPPER_CAP_MOVE_TO))
     {
-        if (s->driver->position_reached)
-            return s->driver->position_reached(s);
+        if (STEPPER_HAS_OP(s, position_reached))
+            return STEPPER_POSITION_REACHED(s);
         return true;
     }
 
     return (s->steps_remaining == 0);
 }
 
+void stepper_enable_events(Stepper *s, bool enable)
+{
+    if (!s || !stepper_driver_has(s, STEPPER_CAP_EVENTS) || !s->driver->enable_events)
+        return;
+
+    s->driver->enable_events(s, enable);
+    s->events = 0;
+    s->event_pending = false;
+    s->events_enabled = enable;
+}
+
+void stepper_set_poll_latency(Stepper *s, uint32_t max_latency_us)
+{
+    if (!s)
+        return;
+
+    s->poll_latency_us = max_latency_us;
+    stepper_poll_now(s);
+}
+
+void stepper_handle_event_irq(Stepper *s, uint32_t irq_cycles)
+{
+    if (!s || !s->events_enabled)
+        return;
+
+    /* Keep the first stamp until the event is serviced */
+    if (!s->event_pending)
+    {
+        s->event_irq_cycles = irq_cycles;
+        s->event_pending = true;
+    }
+
+    /* Idle members are only visited by stepper_group_update when flagged */
+    if (s->group_events)
+        *s->group_events |= s->group_bit;
+}
+
+bool stepper_service_events(Stepper *s)
+{
+    if (!s || !s->event_pending)
+        return false;
+
+    /* Cleared first: an edge during the read latches again */
+    s->event_pending = false;
+    if (!STEPPER_HAS_OP(s, read_events))
+        return true;
+
+    uint32_t ev = STEPPER_READ_EVENTS(s);
+    if (!ev)
+        return true;
+
+    s->events |= ev;
+
+    s->event_latency_cycles = DWT->CYCCNT - s->event_irq_cycles;
+    if (s->event_latency_cycles > s->event_latency_max)
+        s->event_latency_max = s->event_latency_cycles;
+
+    /* sw carries the StepperEvent bits that stopped the motor */
+    if (ev & (STEPPER_EVT_STALL | STEPPER_EVT_LIMIT_L | STEPPER_EVT_LIMIT_R))
+        Stepper_hitLimit(s, (void *)(uintptr_t)ev);
+
+    if ((ev & STEPPER_EVT_DONE) && s->busy && !s->velocity_mode)
+        stepper_finish(s);
+    return true;
+}
+
 void stepper_set_done_callback(Stepper *s, StepperDoneCallback cb)
 {
     if (!s)
@@ -100,27 +322,49 @@ void stepper_set_done_callback(Stepper *s, StepperDoneCallback cb)
     s->done_cb = cb;
 }
 
+/* Smart-driver move; v_sps = 0 runs the nominal ramp */
+static void stepper_move_smart(Stepper *s, int32_t position,
+                               uint32_t v_sps, uint32_t accel_sps2)
+{
+    s->target_position = position;
+    stepper_mark_busy(s);
+    s->interpolated = false;
+    s->velocity_mode = false;
+    s->limit_hit = false;
+    stepper_poll_now(s);
+
+    if (v_sps)
+        s->driver->set_ramp_limits(s, v_sps, accel_sps2);
+    else
+        stepper_set_ramp_scale(s, STEPPER_RAMP_SCALE_ONE);  /* Undo group scaling */
+    STEPPER_MOVE_TO(s, position);
+}
+
 void stepper_move_to_position(Stepper *s, int32_t position)
 {
     if (!s || !s->driver)
         return;
 
-    s->target_position = position;
-    s->busy = true;
-    s->limit_hit = false;
-
     /* Smart driver path */
     if (stepper_driver_has(s, STEPPER_CAP_MOVE_TO))
     {
-        s->driver->move_to(s, position);
+        stepper_move_smart(s, position, 0, 0);
         return;
     }
 
+    /* Same position source as stepper_group_move_to_positions */
+    int32_t current = stepper_current_position(s);
+
+    s->target_position = position;
+    stepper_mark_busy(s);
+    s->interpolated = false;
+    s->velocity_mode = false;
+    s->limit_hit = false;
+
     /* STEP/DIR fallback */
     if (!stepper_driver_has(s, STEPPER_CAP_STEP_DIR))
         return;
 
-    int32_t current = stepper_get_position(s);
     int32_t delta = position - current;
 
     s->direction = (delta >= 0);
@@ -130,20 +374,99 @@ void stepper_move_to_position(Stepper *s, int32_t position)
         s->driver->set_dir(s, s->direction);
 }
 
+uint32_t stepper_estimate_move_time(const Stepper *s, int32_t from, int32_t to)
+{
+    if (!s || !s->driver)
+        return UINT32_MAX;
+
+    uint32_t distance = (to >= from) ? (uint32_t)to - (uint32_t)from : (uint32_t)from - (uint32_t)to;
+
+    if (stepper_driver_has(s, STEPPER_CAP_MOVE_TIME) && s->driver->move_time)
+        return s->driver->move_time(s, distance);
+
+    if (!stepper_driver_has(s, STEPPER_CAP_STEP_DIR))
+        return UINT32_MAX;
+
+    uint64_t us = (uint64_t)distance * s->us_per_step;
+    return (us >= UINT32_MAX) ? UINT32_MAX : (uint32_t)us;
+}
+
+bool stepper_set_ramp_limits(Stepper *s, uint32_t v_sps, uint32_t accel_sps2)
+{
+    if (!s || !stepper_driver_has(s, STEPPER_CAP_RAMP_LIMITS) || !s->driver->set_ramp_limits)
+        return false;
+
+    s->driver->set_ramp_limits(s, v_sps, accel_sps2);
+    return true;
+}
+
+bool stepper_set_profile(Stepper *s, uint32_t v_sps,
+                         uint32_t accel_sps2, uint32_t decel_sps2)
+{
+    if (!s || !stepper_driver_has(s, STEPPER_CAP_PROFILE) || !s->driver->set_profile)
+        return false;
+
+    s->driver->set_profile(s, v_sps, accel_sps2, decel_sps2);
+    return true;
+}
+
+bool stepper_move_to_limited(Stepper *s, int32_t position,
+                             uint32_t v_sps, uint32_t accel_sps2)
+{
+    if (!s || !stepper_driver_has(s, STEPPER_CAP_MOVE_TO) ||
+        !stepper_driver_has(s, STEPPER_CAP_RAMP_LIMITS) || !s->driver->set_ramp_limits ||
+        v_sps == 0)
+        return false;
+
+    stepper_move_smart(s, position, v_sps, accel_sps2);
+    return true;
+}
+
+void stepper_set_velocity(Stepper *s, int32_t steps_per_s)
+{
+    if (!s || !stepper_driver_has(s, STEPPER_CAP_VELOCITY) || !STEPPER_HAS_OP(s, set_velocity))
+        return;
+
+    s->velocity_mode = true;
+    s->interpolated = false;
+    s->busy = false;
+    if (steps_per_s != 0)
+        stepper_mark_busy(s);
+    s->limit_hit = false;
+
+    STEPPER_SET_VELOCITY(s, steps_per_s);
+}
+
 bool stepper_update(Stepper *s, uint32_t delta_us)
 {
-    if (!s || !s->enabled || !s->busy)
+    if (!s)
         return false;
 
+    /* Stall / limit events matter in every state */
+    stepper_service_events(s);
+
+    if (!s->enabled || !s->busy)
+        return false;
+
+    /* No completion to poll for while running at a velocity */
+    if (s->velocity_mode)
+        return s->busy;
+
+    /* Completion is delivered by stepper_service_events */
+    if (s->events_enabled)
+        return s->busy;
+
     /* Smart driver completion */
     if (stepper_driver_has(s, STEPPER_CAP_MOVE_TO))
     {
-        if (s->driver->position_reached &&
-            s->driver->position_reached(s))
+        if (s->poll_latency_us && STEPPER_HAS_OP(s, poll_motion))
+            return stepper_poll_adaptive(s);
+
+        s->polls++;
+        if (STEPPER_HAS_OP(s, position_reached) &&
+            STEPPER_POSITION_REACHED(s))
         {
-            s->busy = false;
-            if (s->done_cb)
-                s->done_cb(s);
+            stepper_finish(s);
         }
         return s->busy;
     }
@@ -152,6 +475,10 @@ bool stepper_update(Stepper *s, uint32_t delta_us)
     if (!stepper_driver_has(s, STEPPER_CAP_STEP_DIR))
         return false;
 
+    /* Pulses come from stepper_group_update while interpolating */
+    if (s->interpolated)
+        return s->busy;
+
     s->us_accumulator += delta_us;
 
     if (s->us_accumulator < s->us_per_step)
@@ -166,11 +493,7 @@ bool stepper_update(Stepper *s, uint32_t delta_us)
     }
 
     if (s->steps_remaining == 0)
-    {
-        s->busy = false;
-        if (s->done_cb)
-            s->done_cb(s);
-    }
+        stepper_finish(s);
 
     return s->busy;
 }
@@ -235,16 +558,27 @@ void Stepper_move(volatile Stepper *s, int32_t position)
 
 void Stepper_awaitStop(volatile Stepper *s, uint32_t timeout_ms)
 {
-    //uint32_t start = 0; // HAL_GetTick();
-    
-    //while (s->busy) {
-    //    stepper_update((Stepper*)s, 1000); // Update with 1ms delta
-    //    
-    //    if (timeout_ms && (HAL_GetTick() - start) >= timeout_ms)
-    //        break;
-    //        
-    //    // HAL_Delay(1);
-    //}
+    if (!s)
+        return;
+
+    uint32_t start = HAL_GetTick();
+    uint32_t last = start;
+
+    while (s->busy)
+    {
+        /* Completion is polled, or a latched event serviced, per wakeup */
+        uint32_t now = HAL_GetTick();
+        stepper_update((Stepper *)s, (now - last) * 1000u);
+        last = now;
+        if (!s->busy)
+            break;
+
+        if (timeout_ms && (HAL_GetTick() - start) >= timeout_ms)
+            break;
+
+        /* Sleep until the completion event or the next tick interrupt */
+        __WFE();
+    }
 }
 
 void Stepper_enableLimits(volatile Stepper *s)
@@ -266,6 +600,8 @@ void Stepper_hitLimit(volatile Stepper *s, void *sw)
 
     if (s->limit_cb)
         s->limit_cb((Stepper *)s, sw);
+
+    stepper_signal();
 }
 
 bool Stepper_awaitLimit(volatile Stepper *s, uint32_t timeout_ms)
@@ -273,29 +609,59 @@ bool Stepper_awaitLimit(volatile Stepper *s, uint32_t timeout_ms)
     if (!s)
         return false;
 
-    uint32_t elapsed = 0;
+    uint32_t start = HAL_GetTick();
 
     while (!s->limit_hit)
     {
-        if (timeout_ms && elapsed >= timeout_ms)
+        if (stepper_service_events((Stepper *)s) && s->limit_hit)
+            break;
+
+        if (timeout_ms && (HAL_GetTick() - start) >= timeout_ms)
             return false;
-        elapsed++;
+
+        /* Sleep until the limit event or the next tick interrupt */
+        __WFE();
     }
 
     return true;
 }
 
+static StepperGroup *positions_group;
+static StepperSnapshot positions_snapshot;
+
+void Stepper_bindPositions(StepperGroup *group)
+{
+    positions_group = group;
+}
+
 int32_t *Stepper_positions(void)
 {
-    /* Application-defined global storage */
-    static int32_t positions[STEPPER_GROUP_MAX];
-    return positions;
+    stepper_group_snapshot(positions_group, &positions_snapshot);
+    return positions_snapshot.position;
+}
+
+const StepperSnapshot *Stepper_lastSnapshot(void)
+{
+    return &positions_snapshot;
 }
 
 /* ============================================================================
  *  Stepper Group API
  * ========================================================================== */
 
+static inline StepperMask stepper_mask_all(uint8_t count)
+{
+    return (count >= 32) ? 0xFFFFFFFFu : ((1u << count) - 1u);
+}
+
+/* Index of the lowest set bit, which is then cleared */
+static inline uint8_t stepper_mask_pop(StepperMask *mask)
+{
+    uint8_t i = (uint8_t)__builtin_ctz(*mask);
+    *mask &= *mask - 1u;
+    return i;
+}
+
 void stepper_group_init(StepperGroup *group)
 {
     if (!group)
@@ -303,6 +669,24 @@ void stepper_group_init(StepperGroup *group)
 
     group->count = 0;
     group->synch_capable = false;
+    group->synch_cs = false;
+    group->synch_cs_port = NULL;
+    group->synch_cs_mask = 0;
+    group->interp_active = false;
+
+    group->smart_mask = 0;
+    group->busy_mask = 0;
+    group->interp_mask = 0;
+    group->event_mask = 0;
+    group->busy_tracked = true;
+
+    group->bus_count = 0;
+    group->cs_port_count = 0;
+
+    group->sync_mask = 0;
+    group->sync_start_cycles = 0;
+    group->sync_duration_us = 0;
+    group->sync_spread_us = 0;
 }
 
 bool stepper_group_add(StepperGroup *group, Stepper *stepper)
@@ -313,43 +697,66 @@ bool stepper_group_add(StepperGroup *group, Stepper *stepper)
     if (group->count >= STEPPER_GROUP_MAX)
         return false;
 
+    uint8_t index = group->count;
+    StepperMask bit = 1u << index;
+    TMC5240_Context *ctx = (TMC5240_Context *)stepper->hw_context;
+    uint8_t bus = 0;
+    uint8_t port = 0;
+
+    // Find (or reserve) the bus and CS port slots before committing
+    if (ctx) {
+        while (bus < group->bus_count && group->bus_handle[bus] != ctx->hspi)
+            bus++;
+        while (port < group->cs_port_count && group->cs_port[port] != ctx->cs_port)
+            port++;
+        if (bus >= STEPPER_GROUP_BUS_MAX || port >= STEPPER_GROUP_BUS_MAX)
+            return false;
+    }
 
     group->steppers[group->count++] = stepper;
 
-    // Check if all steppers are on unique SPI busses for synch_capable
-    bool all_unique = true;
-    void *bus_list[STEPPER_GROUP_MAX] = {0};
-    for (uint8_t i = 0; i < group->count; i++) {
-        Stepper *s = group->steppers[i];
-        if (!s || !s->hw_context) continue;
-        void *hspi = ((TMC5240_Context *)s->hw_context)->hspi;
-        for (uint8_t j = 0; j < i; j++) {
-            if (bus_list[j] == hspi) {
-                all_unique = false;
-                break;
-            }
-        }
-        bus_list[i] = hspi;
-        if (!all_unique) break;
+    if (stepper_driver_has(stepper, STEPPER_CAP_MOVE_TO))
+        group->smart_mask |= bit;
+
+    // The first group owns the member's busy and event reporting
+    if (!stepper->group_busy) {
+        stepper->group_busy = &group->busy_mask;
+        stepper->group_events = &group->event_mask;
+        stepper->group_bit = bit;
+        if (stepper->busy)
+            group->busy_mask |= bit;
+        if (stepper->event_pending)
+            group->event_mask |= bit;
+    } else if (stepper->group_busy != &group->busy_mask) {
+        group->busy_tracked = false;
     }
-    group->synch_capable = all_unique && group->count > 1;
 
-    // Check if all CS are on the same port and build mask
-    group->synch_cs = true;
-    group->synch_cs_port = NULL;
-    group->synch_cs_mask = 0;
-    for (uint8_t i = 0; i < group->count; i++) {
-        Stepper *s = group->steppers[i];
-        if (!s || !s->hw_context) continue;
-        TMC5240_Context *ctx = (TMC5240_Context *)s->hw_context;
-        if (group->synch_cs_port == NULL) {
-            group->synch_cs_port = ctx->cs_port;
-        } else if (group->synch_cs_port != ctx->cs_port) {
-            group->synch_cs = false;
+    if (ctx) {
+        if (bus == group->bus_count) {
+            group->bus_handle[bus] = ctx->hspi;
+            group->bus_members[bus] = 0;
+            group->bus_count++;
         }
-        group->synch_cs_mask |= ctx->cs_pin;
+        group->bus_members[bus] |= bit;
+
+        if (port == group->cs_port_count) {
+            group->cs_port[port] = ctx->cs_port;
+            group->cs_pins[port] = 0;
+            group->cs_port_count++;
+        }
+        group->cs_pins[port] |= ctx->cs_pin;
     }
-    if (group->count < 2) group->synch_cs = false;
+
+    // synch_capable: every SPI member sits alone on its bus
+    uint8_t spi_members = 0;
+    for (uint8_t b = 0; b < group->bus_count; b++)
+        spi_members += (uint8_t)__builtin_popcount(group->bus_members[b]);
+    group->synch_capable = (spi_members == group->bus_count) && group->count > 1;
+
+    // synch_cs: all CS lines on one port, toggled with a single write
+    group->synch_cs = (group->cs_port_count == 1) && group->count > 1;
+    group->synch_cs_port = group->cs_port_count ? group->cs_port[0] : NULL;
+    group->synch_cs_mask = group->cs_port_count ? group->cs_pins[0] : 0;
     return true;
 }
 
@@ -362,58 +769,370 @@ void stepper_group_enable(StepperGroup *group, bool enable)
         stepper_enable(group->steppers[i], enable);
 }
 
+/* Drive every member CS line low (GPIO_PIN_RESET) or high (GPIO_PIN_SET) */
+static void stepper_group_cs_write(StepperGroup *group, GPIO_PinState state)
+{
+    // One write per GPIO port
+    for (uint8_t p = 0; p < group->cs_port_count; p++)
+        HAL_GPIO_WritePin(group->cs_port[p], group->cs_pins[p], state);
+}
+
+/*
+ * Latch XTARGET on every axis with one shared CS window. Returns the SPI
+ * time between the last write and CS release in microseconds.
+ */
+static uint32_t stepper_group_sync_targets(StepperGroup *group, const int32_t *positions)
+{
+    stepper_group_cs_write(group, GPIO_PIN_RESET);
+
+    // Write to all SPI busses (move command, cs_override = true)
+    for (uint8_t i = 0; i < group->count; i++) {
+        Stepper *s = group->steppers[i];
+        if (!s || !s->hw_context) continue;
+        TMC5240_Context *ctx = (TMC5240_Context *)s->hw_context;
+        ctx->rampmode = TMC5240_MODE_POSITION;
+        tmc5240_writeRegister(ctx->icID, TMC5240_RAMPMODE, TMC5240_MODE_POSITION, true);
+        tmc5240_writeRegister(ctx->icID, TMC5240_XTARGET, positions[i], true);
+        s->target_position = positions[i];
+        stepper_mark_busy(s);
+        stepper_poll_now(s);
+        s->velocity_mode = false;
+        s->limit_hit = false;
+    }
+
+    uint32_t start_time = DWT->CYCCNT;
+
+    stepper_group_cs_write(group, GPIO_PIN_SET);
+
+    uint32_t end_time = DWT->CYCCNT;
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+    return (unsigned long)(end_time - start_time) / cycles_per_us;
+}
+
 void stepper_group_move_to(StepperGroup *group, int32_t position)
 {
     if (!group)
         return;
 
     if (group->synch_capable) {
+        int32_t positions[STEPPER_GROUP_MAX];
+        for (uint8_t i = 0; i < group->count; i++) {
+            positions[i] = position;
+            /* Undo any scaling left over from a coordinated group move */
+            stepper_set_ramp_scale(group->steppers[i], STEPPER_RAMP_SCALE_ONE);
+        }
+
         // Simultaneous: set all CS low
-        printf("synchronous move to %ld\r\n", (long)position);
-        if (group->synch_cs && group->synch_cs_port && group->synch_cs_mask) {
-            HAL_GPIO_WritePin(group->synch_cs_port, group->synch_cs_mask, GPIO_PIN_RESET);
-        } else {
-            for (uint8_t i = 0; i < group->count; i++) {
-                Stepper *s = group->steppers[i];
-                if (!s || !s->hw_context) continue;
-                TMC5240_Context *ctx = (TMC5240_Context *)s->hw_context;
-                HAL_GPIO_WritePin(ctx->cs_port, ctx->cs_pin, GPIO_PIN_RESET);
-            }
+        LOG_PRINTF("synchronous move to %ld\r\n", position);
+        uint32_t delay_us = stepper_group_sync_targets(group, positions);
+
+        LOG_PRINTF("Stepper group move SPI time: %lu uS\r\n", delay_us);
+
+    } else {
+        // Fallback: sequential
+        LOG_PRINTF("sequential move to %ld\r\n", position);
+        for (uint8_t i = 0; i < group->count; i++)
+            stepper_move_to_position(group->steppers[i], position);
+    }
+}
+
+/* Start a smart-driver move with whatever ramp registers are loaded */
+static void stepper_group_start_axis(Stepper *s, int32_t position)
+{
+    s->target_position = position;
+    stepper_mark_busy(s);
+    s->interpolated = false;
+    s->velocity_mode = false;
+    s->limit_hit = false;
+    stepper_poll_now(s);
+    STEPPER_MOVE_TO(s, position);
+}
+
+bool stepper_group_move_to_positions(StepperGroup *group, const int32_t *positions)
+{
+    if (!group || !positions || group->count == 0)
+        return false;
+
+    uint32_t delta[STEPPER_GROUP_MAX];
+    uint32_t major = 0;
+    uint32_t major_sd = 0;
+    Stepper *major_sd_axis = NULL;
+
+    for (uint8_t i = 0; i < group->count; i++) {
+        Stepper *s = group->steppers[i];
+        int32_t d = positions[i] - stepper_current_position(s);
+        delta[i] = (d >= 0) ? (uint32_t)d : (uint32_t)-d;
+        if (delta[i] > major)
+            major = delta[i];
+
+        if (!stepper_driver_has(s, STEPPER_CAP_MOVE_TO) && delta[i] > major_sd) {
+            major_sd = delta[i];
+            major_sd_axis = s;
+        }
+    }
+
+    if (major == 0)
+        return true;
+
+    /*
+     * Mixed move: STEP/DIR axes step at a fixed period, smart axes run a
+     * ramp. Both are stretched to the longer of the Bresenham pass and the
+     * slowest nominal ramp, so every axis arrives together. Smart members
+     * fit their ramp to that duration (timed_ramp) or the move is refused.
+     */
+    uint32_t us_per_step = major_sd_axis ? major_sd_axis->us_per_step : 0;
+    uint64_t duration = (uint64_t)major_sd * us_per_step;
+    bool mixed = false;
+
+    for (uint8_t i = 0; major_sd && i < group->count; i++) {
+        Stepper *s = group->steppers[i];
+        if (!stepper_driver_has(s, STEPPER_CAP_MOVE_TO) || delta[i] == 0)
+            continue;
+        if (!stepper_driver_has(s, STEPPER_CAP_TIMED_RAMP) || !s->driver->timed_ramp)
+            return false;
+
+        uint32_t t = s->driver->timed_ramp(s, delta[i], 0, false);
+        if (t > duration)
+            duration = t;
+        mixed = true;
+    }
+
+    if (mixed) {
+        /* Whole step periods; the smart ramps fit the rounded duration */
+        us_per_step = (uint32_t)((duration + major_sd - 1) / major_sd);
+        duration = (uint64_t)us_per_step * major_sd;
+        if (duration > UINT32_MAX)
+            duration = UINT32_MAX;
+
+        for (uint8_t i = 0; i < group->count; i++) {
+            Stepper *s = group->steppers[i];
+            if (stepper_driver_has(s, STEPPER_CAP_MOVE_TO) && delta[i])
+                s->driver->timed_ramp(s, delta[i], (uint32_t)duration, true);
         }
-        // Write to all SPI busses (move command, cs_override = true)
+    } else {
+        /* Smart drivers: scale each ramp so all axes trace the same profile */
         for (uint8_t i = 0; i < group->count; i++) {
             Stepper *s = group->steppers[i];
-            if (!s || !s->hw_context) continue;
-            TMC5240_Context *ctx = (TMC5240_Context *)s->hw_context;
-            tmc5240_writeRegister(ctx->icID, TMC5240_RAMPMODE, TMC5240_MODE_POSITION, true);
-            tmc5240_writeRegister(ctx->icID, TMC5240_XTARGET, position, true);
+            /* An axis that holds its position keeps its ramp */
+            if (!stepper_driver_has(s, STEPPER_CAP_MOVE_TO) || delta[i] == 0)
+                continue;
+            uint32_t scale = (uint32_t)(((uint64_t)delta[i] << 16) / major);
+            stepper_set_ramp_scale(s, scale ? scale : 1u);
+        }
+    }
+
+    if (group->smart_mask == stepper_mask_all(group->count) && group->synch_capable) {
+        stepper_group_sync_targets(group, positions);
+        return true;
+    }
+
+    /* STEP/DIR: set up Bresenham against the longest STEP/DIR axis */
+    group->interp_active = false;
+    group->interp_mask = 0;
+    group->interp_major = major_sd;
+    group->interp_done = 0;
+    group->interp_us_per_step = us_per_step;
+    group->interp_accumulator = 0;
+
+    for (uint8_t i = 0; i < group->count; i++) {
+        Stepper *s = group->steppers[i];
+
+        if (stepper_driver_has(s, STEPPER_CAP_MOVE_TO)) {
+            stepper_group_start_axis(s, positions[i]);
+            continue;
         }
 
-        uint32_t start_time = DWT->CYCCNT;
-
-        // Set all CS high
-        if (group->synch_cs && group->synch_cs_port && group->synch_cs_mask) {
-            HAL_GPIO_WritePin(group->synch_cs_port, group->synch_cs_mask, GPIO_PIN_SET);
-        } else {
-            for (uint8_t i = 0; i < group->count; i++) {
-                Stepper *s = group->steppers[i];
-                if (!s || !s->hw_context) continue;
-                TMC5240_Context *ctx = (TMC5240_Context *)s->hw_context;
-                HAL_GPIO_WritePin(ctx->cs_port, ctx->cs_pin, GPIO_PIN_SET);
-            }
+        stepper_move_to_position(s, positions[i]);
+        group->interp_delta[i] = delta[i];
+        group->interp_error[i] = 0;   // last minor step lands on the last major tick
+        if (major_sd && s->busy && delta[i]) {
+            s->interpolated = true;
+            group->interp_mask |= 1u << i;
+            group->interp_active = true;
         }
+    }
+
+    return true;
+}
+
+bool stepper_group_move_synced(StepperGroup *group,
+                               const int32_t *positions,
+                               uint32_t tolerance_us)
+{
+    if (!group || !positions || group->count == 0)
+        return false;
+
+    if (group->smart_mask != stepper_mask_all(group->count))
+        return false;
+
+    uint32_t distance[STEPPER_GROUP_MAX];
+    uint32_t arrival[STEPPER_GROUP_MAX];
+    uint32_t duration = 0;
+
+    /* The slowest axis at its nominal ramp sets the move duration */
+    for (uint8_t i = 0; i < group->count; i++) {
+        Stepper *s = group->steppers[i];
+        if (!stepper_driver_has(s, STEPPER_CAP_TIMED_RAMP) || !s->driver->timed_ramp)
+            return false;
+
+        int32_t d = positions[i] - stepper_get_position(s);
+        distance[i] = (d >= 0) ? (uint32_t)d : (uint32_t)-d;
+        arrival[i] = s->driver->timed_ramp(s, distance[i], 0, false);
+        if (arrival[i] > duration)
+            duration = arrival[i];
+    }
+
+    uint32_t t_min = duration;
+    uint32_t t_max = 0;
+    group->sync_mask = 0;
 
-        uint32_t end_time = DWT->CYCCNT;
-        uint32_t cycles_per_us = SystemCoreClock / 1000000;
-        uint32_t delay_us = (unsigned long)(end_time - start_time) / cycles_per_us;
+    /* Every other axis slows its ramp to arrive with it */
+    for (uint8_t i = 0; i < group->count; i++) {
+        if (distance[i] == 0)
+            continue;
+
+        Stepper *s = group->steppers[i];
+        uint32_t t = s->driver->timed_ramp(s, distance[i], duration, true);
 
-        printf("Stepper group move SPI time: %lu uS\r\n", delay_us);
+        if (t < t_min) t_min = t;
+        if (t > t_max) t_max = t;
+        group->sync_mask |= 1u << i;
+    }
+
+    group->sync_duration_us = duration;
+    group->sync_spread_us = group->sync_mask ? t_max - t_min : 0;
 
+    group->sync_start_cycles = DWT->CYCCNT;
+    if (group->synch_capable) {
+        stepper_group_sync_targets(group, positions);
     } else {
-        // Fallback: sequential
-        printf("sequential move to %ld\r\n", (long)position);
         for (uint8_t i = 0; i < group->count; i++)
-            stepper_move_to_position(group->steppers[i], position);
+            stepper_group_start_axis(group->steppers[i], positions[i]);
+    }
+
+    return group->sync_spread_us <= tolerance_us;
+}
+
+uint32_t stepper_group_sync_spread_us(const StepperGroup *group)
+{
+    if (!group || !group->sync_mask)
+        return 0;
+
+    StepperMask pending = group->sync_mask;
+    uint32_t first = 0;
+    uint32_t last = 0;
+    bool seen = false;
+
+    while (pending) {
+        const Stepper *s = group->steppers[stepper_mask_pop(&pending)];
+        if (s->busy)
+            return UINT32_MAX;
+
+        uint32_t t = s->done_cycles - group->sync_start_cycles;
+        if (!seen || t < first) first = t;
+        if (!seen || t > last) last = t;
+        seen = true;
+    }
+
+    return (last - first) / (SystemCoreClock / 1000000);
+}
+
+void stepper_group_print_sync(const StepperGroup *group)
+{
+    if (!group || !group->sync_mask)
+        return;
+
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+    StepperMask pending = group->sync_mask;
+
+    log_printf("Synced move: predicted %lu us, spread %lu us\r\n",
+               (unsigned long)group->sync_duration_us,
+               (unsigned long)group->sync_spread_us);
+
+    while (pending) {
+        uint8_t i = stepper_mask_pop(&pending);
+        const Stepper *s = group->steppers[i];
+        if (s->busy)
+            continue;
+        log_printf("  axis %u arrived at %lu us\r\n", i,
+                   (unsigned long)((s->done_cycles - group->sync_start_cycles) / cycles_per_us));
+    }
+
+    uint32_t spread = stepper_group_sync_spread_us(group);
+    if (spread != UINT32_MAX)
+        log_printf("Synced move: measured spread %lu us\r\n", (unsigned long)spread);
+}
+
+uint32_t stepper_group_estimate_move_time(StepperGroup *group,
+                                          const int32_t *from,
+                                          const int32_t *to)
+{
+    if (!group || !to)
+        return UINT32_MAX;
+
+    uint32_t duration = 0;
+    uint32_t major_sd = 0;
+    const Stepper *major_sd_axis = NULL;
+
+    for (uint8_t i = 0; i < group->count; i++) {
+        Stepper *s = group->steppers[i];
+        int32_t start = from ? from[i] : stepper_get_position(s);
+
+        if (stepper_driver_has(s, STEPPER_CAP_MOVE_TO)) {
+            uint32_t t = stepper_estimate_move_time(s, start, to[i]);
+            if (t > duration)
+                duration = t;
+            continue;
+        }
+
+        /* STEP/DIR members are paced by the longest one */
+        uint32_t d = (to[i] >= start) ? (uint32_t)to[i] - (uint32_t)start : (uint32_t)start - (uint32_t)to[i];
+        if (d > major_sd) {
+            major_sd = d;
+            major_sd_axis = s;
+        }
+    }
+
+    if (major_sd_axis) {
+        uint32_t t = stepper_estimate_move_time(major_sd_axis, 0, (int32_t)major_sd);
+        if (t > duration)
+            duration = t;
+    }
+
+    return duration;
+}
+
+/* Issue one Bresenham tick: the major axis always steps, minors on overflow */
+static void stepper_group_interp_tick(StepperGroup *group)
+{
+    StepperMask pending = group->interp_mask;
+
+    while (pending) {
+        uint8_t i = stepper_mask_pop(&pending);
+        Stepper *s = group->steppers[i];
+
+        if (!s->interpolated || s->steps_remaining == 0) {
+            group->interp_mask &= ~(1u << i);
+            continue;
+        }
+
+        group->interp_error[i] += group->interp_delta[i];
+        if (group->interp_error[i] < group->interp_major)
+            continue;
+
+        group->interp_error[i] -= group->interp_major;
+        s->driver->step_pulse(s);
+        if (--s->steps_remaining == 0) {
+            stepper_finish(s);
+            group->interp_mask &= ~(1u << i);
+        }
+    }
+
+    if (++group->interp_done >= group->interp_major) {
+        /* Members still counting down finish at their own rate */
+        while (group->interp_mask)
+            group->steppers[stepper_mask_pop(&group->interp_mask)]->interpolated = false;
+        group->interp_active = false;
     }
 }
 
@@ -424,8 +1143,104 @@ bool stepper_group_update(StepperGroup *group, uint32_t delta_us)
 
     bool any_busy = false;
 
-    for (uint8_t i = 0; i < group->count; i++)
-        any_busy |= stepper_update(group->steppers[i], delta_us);
+    if (group->interp_active) {
+        group->interp_accumulator += delta_us;
+        if (group->interp_accumulator >= group->interp_us_per_step) {
+            group->interp_accumulator -= group->interp_us_per_step;
+            stepper_group_interp_tick(group);
+        }
+        any_busy = group->interp_active;
+    }
+
+    /*
+     * Only members with motion in progress are visited when tracked, plus
+     * idle ones with an event latched: a stall or limit must still be
+     * serviced while the axis is at rest
+     */
+    StepperMask pending = stepper_mask_all(group->count);
+
+    if (group->busy_tracked) {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        StepperMask events = group->event_mask;
+        group->event_mask = 0;
+        __set_PRIMASK(primask);
+
+        pending = group->busy_mask | events;
+    }
+
+    StepperMask busy = 0;
+    StepperMask idle = 0;
+
+    while (pending) {
+        uint8_t i = stepper_mask_pop(&pending);
+        if (stepper_update(group->steppers[i], delta_us))
+            busy |= 1u << i;
+        else
+            idle |= 1u << i;
+    }
+
+    /* A done callback may have restarted a member scanned before it */
+    StepperMask check = idle;
+    while (check) {
+        uint8_t i = stepper_mask_pop(&check);
+        if (group->steppers[i]->busy)
+            idle &= ~(1u << i);
+    }
+
+    group->busy_mask = (group->busy_mask & ~idle) | busy;
+    return any_busy || group->busy_mask != 0;
+}
+
+bool stepper_group_snapshot(StepperGroup *group, StepperSnapshot *snap)
+{
+    if (!group || !snap || group->count == 0)
+        return false;
+
+    TMC5240_Context *ctxs[STEPPER_GROUP_MAX];
+    uint8_t slot[STEPPER_GROUP_MAX];
+    int32_t values[STEPPER_GROUP_MAX];
+    uint32_t latched[STEPPER_GROUP_MAX];
+    uint8_t n = 0;
+
+    uint32_t start = DWT->CYCCNT;
+
+    for (uint8_t i = 0; i < group->count; i++) {
+        Stepper *s = group->steppers[i];
+        if (s && s->hw_context && stepper_driver_has(s, STEPPER_CAP_POSITION_FB)) {
+            ctxs[n] = (TMC5240_Context *)s->hw_context;
+            slot[n++] = i;
+        }
+    }
 
-    return any_busy;
+    uint32_t first = 0;
+    uint32_t last = 0;
+
+    if (n) {
+        tmc5240_read_batch(ctxs, n, TMC5240_XACTUAL, values, latched);
+        first = last = latched[0];
+    }
+
+    for (uint8_t k = 0; k < n; k++) {
+        snap->position[slot[k]] = values[k];
+        if ((int32_t)(latched[k] - first) < 0) first = latched[k];
+        if ((int32_t)(latched[k] - last) > 0) last = latched[k];
+    }
+
+    /* Counted positions are exact at any instant inside the capture */
+    for (uint8_t i = 0; i < group->count; i++) {
+        Stepper *s = group->steppers[i];
+        if (!s || !s->hw_context || !stepper_driver_has(s, STEPPER_CAP_POSITION_FB))
+            snap->position[i] = s ? stepper_current_position(s) : 0;
+    }
+
+    uint32_t end = DWT->CYCCNT;
+    if (!n)
+        first = last = end;
+
+    snap->count = group->count;
+    snap->timestamp = first + (last - first) / 2;
+    snap->skew_cycles = last - first;
+    snap->capture_cycles = end - start;
+    return true;
 }
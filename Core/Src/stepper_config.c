@@ -5,6 +5,7 @@
 #include "stepper_config.h"
 #include "stepper.h"
 #include "tmc5240_driver.h"
+#include "logging.h"
 
 #include <stdio.h>
 
@@ -27,6 +28,8 @@ static TMC5240_Context tmc5240_ctx[STEPPER_COUNT] =
         .cs_pin  = STEP1_CS_Pin,
         .enable_port = DRV_EN_GPIO_Port,
         .enable_pin  = DRV_EN_Pin,
+        .diag0_port = STEP1_DIAG0_GPIO_Port,
+        .diag0_pin  = STEP1_DIAG0_Pin,
         .vmax = 0x2710,
         .amax = 0x0F8D,
         .dmax = 0x0F8D
@@ -38,6 +41,8 @@ static TMC5240_Context tmc5240_ctx[STEPPER_COUNT] =
         .cs_pin  = STEP2_CS_Pin,
         .enable_port = DRV_EN_GPIO_Port,
         .enable_pin  = DRV_EN_Pin,
+        .diag0_port = STEP2_DIAG0_GPIO_Port,
+        .diag0_pin  = STEP2_DIAG0_Pin,
         .vmax = 0x2710,
         .amax = 0x0F8D,
         .dmax = 0x0F8D
@@ -82,7 +87,7 @@ static const StepperConfigEntry STEPPER_MAP[] =
 
 void stepper_config_init(void)
 {
-    printf("Initializing stepper configuration...\r\n");
+    log_printf("Initializing stepper configuration...\r\n");
 
     stepper_group_init(&stepper_group);
 
@@ -99,10 +104,16 @@ void stepper_config_init(void)
         /* Don't enable here - let main do it after printing registers */
         /* stepper_enable(s, true); */
 
+        /* Completion / stall / limits via DIAG0 instead of SPI polling */
+        if (tmc5240_ctx[cfg->id].diag0_port)
+            stepper_enable_events(s, true);
+
         stepper_group_add(&stepper_group, s);
 
-        printf("Stepper %lu configured\r\n", (unsigned long)cfg->id);
+        log_printf("Stepper %lu configured\r\n", (unsigned long)cfg->id);
     }
+
+    Stepper_bindPositions(&stepper_group);
 }
 
 Stepper *stepper_config_get_stepper(StepperId id)
@@ -118,6 +129,157 @@ StepperGroup *stepper_config_get_group(void)
     return &stepper_group;
 }
 
+void stepper_config_handle_diag(uint16_t pin, uint32_t irq_cycles)
+{
+    for (uint32_t i = 0; i < STEPPER_COUNT; i++)
+    {
+        if (tmc5240_ctx[i].diag0_port && tmc5240_ctx[i].diag0_pin == pin)
+            stepper_handle_event_irq(&steppers[i], irq_cycles);
+    }
+}
+
+void stepper_config_service_events(void)
+{
+    for (uint32_t i = 0; i < STEPPER_COUNT; i++)
+        stepper_service_events(&steppers[i]);
+}
+
+void stepper_config_print_event_latency(void)
+{
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+    for (uint32_t i = 0; i < STEPPER_COUNT; i++)
+    {
+        const Stepper *s = &steppers[i];
+        log_printf("Stepper %lu event latency: %lu cycles (max %lu, %lu us)\r\n",
+                   (unsigned long)i,
+                   (unsigned long)s->event_latency_cycles,
+                   (unsigned long)s->event_latency_max,
+                   (unsigned long)(s->event_latency_max / cycles_per_us));
+    }
+}
+
+/* Cycle cost of the hot calls on a real axis; build with and without
+ * STEPPER_STATIC_TMC5240 to compare static and table dispatch. */
+void stepper_config_benchmark_dispatch(void)
+{
+    Stepper *s = &steppers[STEPPER_0];
+    const uint32_t runs = 100;
+    uint32_t start;
+
+#ifdef STEPPER_STATIC_CAPS
+    const char *mode = "static";
+#else
+    const char *mode = "table";
+#endif
+
+    int32_t pos = stepper_get_position(s);
+
+    start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < runs; i++)
+        pos = stepper_get_position(s);
+    uint32_t pos_cycles = (DWT->CYCCNT - start) / runs;
+
+    start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < runs; i++)
+        stepper_move_to_position(s, pos);
+    uint32_t move_cycles = (DWT->CYCCNT - start) / runs;
+
+    /* Polled completion check: events off so update reaches the driver */
+    bool events = s->events_enabled;
+    s->events_enabled = false;
+    start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < runs; i++)
+    {
+        stepper_mark_busy(s);
+        stepper_update(s, 0);
+    }
+    uint32_t update_cycles = (DWT->CYCCNT - start) / runs;
+    s->events_enabled = events;
+
+    log_printf("Dispatch (%s): update %lu, move %lu, position %lu cycles\r\n",
+               mode,
+               (unsigned long)update_cycles,
+               (unsigned long)move_cycles,
+               (unsigned long)pos_cycles);
+}
+
+/* Predicted vs. measured duration of real moves on STEPPER_0, there and back */
+void stepper_config_check_estimate(void)
+{
+    static const int32_t distances[] = { 50, 400, 3200, 12800 };
+    Stepper *s = &steppers[STEPPER_0];
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+    for (uint32_t k = 0; k < sizeof(distances) / sizeof(distances[0]); k++)
+    {
+        int32_t from = stepper_get_position(s);
+        int32_t to = from + distances[k];
+        uint32_t estimate = stepper_estimate_move_time(s, from, to);
+
+        uint32_t start = DWT->CYCCNT;
+        stepper_move_to_position(s, to);
+        Stepper_awaitStop(s, 10000);
+        uint32_t end = s->events_enabled ? s->done_cycles : DWT->CYCCNT;
+        uint32_t measured = (end - start) / cycles_per_us;
+
+        log_printf("Estimate %6ld steps: predicted %lu us, measured %lu us (%+ld us)\r\n",
+                   (long)distances[k],
+                   (unsigned long)estimate,
+                   (unsigned long)measured,
+                   (long)((int32_t)measured - (int32_t)estimate));
+
+        stepper_move_to_position(s, from);
+        Stepper_awaitStop(s, 10000);
+    }
+}
+
+/* SPI load of polled completion on STEPPER_0: every update vs. adaptive */
+void stepper_config_benchmark_polling(uint32_t max_latency_us)
+{
+    Stepper *s = &steppers[STEPPER_0];
+    TMC5240_Context *ctx = (TMC5240_Context *)s->hw_context;
+    const uint32_t latency[2] = { 0, max_latency_us };
+    const int32_t distance = 12800;
+    bool events = s->events_enabled;
+
+    stepper_enable_events(s, false);
+
+    for (uint32_t k = 0; k < 2; k++)
+    {
+        int32_t from = stepper_get_position(s);
+
+        stepper_set_poll_latency(s, latency[k]);
+
+        uint32_t frames = ctx->spi_frames;
+        uint32_t spi = ctx->spi_cycles;
+        uint32_t polls = s->polls;
+        uint32_t start = DWT->CYCCNT;
+
+        stepper_move_to_position(s, from + distance);
+        while (stepper_update(s, 0))
+            ;
+
+        uint32_t wall = DWT->CYCCNT - start;
+        spi = ctx->spi_cycles - spi;
+
+        log_printf("Polling (%s, %lu us): %lu polls, %lu frames, bus %lu.%lu %%, done after %lu us\r\n",
+                   latency[k] ? "adaptive" : "every update",
+                   (unsigned long)latency[k],
+                   (unsigned long)(s->polls - polls),
+                   (unsigned long)(ctx->spi_frames - frames),
+                   (unsigned long)((uint64_t)spi * 100u / wall),
+                   (unsigned long)((uint64_t)spi * 1000u / wall % 10u),
+                   (unsigned long)(wall / (SystemCoreClock / 1000000)));
+
+        stepper_move_to_position(s, from);
+        while (stepper_update(s, 0))
+            ;
+    }
+
+    stepper_set_poll_latency(s, 0);
+    stepper_enable_events(s, events);
+}
 
 // tmc5240_driver_print_registers()
 
@@ -130,14 +292,14 @@ void stepper_config_print_registers(Stepper *stepper)
     uint16_t icID = ctx->icID;
     int32_t value;
 
-    printf("\r\nStepper %u Configuration:\r\n", stepper->stepper_id);
+    log_printf("\r\nStepper %u Configuration:\r\n", stepper->stepper_id);
 
     /* Helper to read, print and add a small CS spacing delay to avoid
      * SPI timing issues when querying multiple registers quickly. */
 #define READ_PRINT(reg, label)                         \
     do {                                              \
         value = tmc5240_readRegister(icID, (reg), false);    \
-        printf("  %-14s 0x%08lX\r\n", (label), (unsigned long)value); \
+        log_printf("  %-14s 0x%08lX\r\n", (label), (unsigned long)value); \
         for (volatile int _d = 0; _d < 50; _d++);     \
     } while (0)
 
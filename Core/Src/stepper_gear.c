@@ -0,0 +1,248 @@
+/*
+ * stepper_gear.c — slave axes following a master axis at a fixed ratio
+ *
+ * The master is sampled with two chained read frames per update: the first
+ * requests XACTUAL and returns the VACTUAL requested at the end of the
+ * previous update, the second requests VACTUAL and returns the fresh
+ * XACTUAL. Position is current, velocity is one period old, and a full
+ * sample costs two frames instead of four. Any other frame to the master
+ * between updates (event service, telemetry, status polls) takes that
+ * pending reply, so the VACTUAL request is then reissued first.
+ *
+ * Slaves stay in position mode. XTARGET is the geared master position, so
+ * a slave can never run past it; VMAX is the geared master speed plus a
+ * margin so the ramp generator can close any lag.
+ */
+
+#include "stepper_gear.h"
+#include "tmc5240_driver.h"
+#include "logging.h"
+
+#include <stdio.h>
+
+#define GEAR_VMAX_MARGIN_SHIFT  3       /* VMAX + 1/8 to catch up */
+#define GEAR_VMAX_MIN           16      /* Register units, keeps a stopped master's slaves settling */
+
+/* ============================================================================
+ *  Internal Helpers
+ * ========================================================================== */
+
+static inline TMC5240_Context *gear_ctx(const StepperGear *g, uint8_t axis)
+{
+    return (TMC5240_Context *)g->group->steppers[axis]->hw_context;
+}
+
+static inline int32_t gear_scale(int32_t value, int32_t ratio_q16)
+{
+    return (int32_t)(((int64_t)value * ratio_q16) >> 16);
+}
+
+/* Master XACTUAL / VACTUAL with one frame pair */
+static void gear_sample_master(StepperGear *g)
+{
+    TMC5240_Context *ctx = gear_ctx(g, g->master);
+
+    if (!g->primed || ctx->spi_frames != g->master_frames) {
+        if (g->primed)
+            g->stats.reprimes++;
+        tmc5240_frame(ctx, TMC5240_VACTUAL, 0, false);
+        g->primed = true;
+    }
+
+    int32_t v = tmc5240_frame(ctx, TMC5240_XACTUAL, 0, false);
+    g->master_x = tmc5240_frame(ctx, TMC5240_VACTUAL, 0, false);
+    g->master_frames = ctx->spi_frames;
+
+    /* VACTUAL is 24-bit signed */
+    g->master_v = (int32_t)((uint32_t)v << 8) >> 8;
+}
+
+static void gear_command_slave(StepperGear *g, uint8_t i)
+{
+    TMC5240_Context *ctx = gear_ctx(g, i);
+    int32_t ratio = g->ratio_q16[i];
+    uint32_t speed = (uint32_t)((g->master_v < 0) ? -g->master_v : g->master_v);
+    uint32_t mag = (ratio < 0) ? 0u - (uint32_t)ratio : (uint32_t)ratio;
+    uint64_t geared = ((uint64_t)speed * mag) >> 16;
+
+    geared += (geared >> GEAR_VMAX_MARGIN_SHIFT) + GEAR_VMAX_MIN;
+
+    /* Large ratios can ask for more than VMAX holds; the slave then lags */
+    uint32_t vmax = (geared > TMC5240_MAX_VELOCITY) ? TMC5240_MAX_VELOCITY : (uint32_t)geared;
+
+    g->slave_target[i] = g->slave_origin[i] +
+                         gear_scale(g->master_x - g->master_origin[i], ratio);
+
+    if (vmax != g->slave_vmax[i]) {
+        tmc5240_frame(ctx, TMC5240_VMAX, (int32_t)vmax, true);
+        g->slave_vmax[i] = vmax;
+    }
+    tmc5240_frame(ctx, TMC5240_XTARGET, g->slave_target[i], true);
+    g->group->steppers[i]->target_position = g->slave_target[i];
+}
+
+static void gear_measure_slave(StepperGear *g, uint8_t i)
+{
+    TMC5240_Context *ctx = gear_ctx(g, i);
+
+    tmc5240_frame(ctx, TMC5240_XACTUAL, 0, false);
+    int32_t x = tmc5240_frame(ctx, TMC5240_XACTUAL, 0, false);
+    int32_t err = g->slave_target[i] - x;
+
+    if (err < 0)
+        err = -err;
+    if (err > g->stats.error_max)
+        g->stats.error_max = err;
+    g->stats.error_abs_total += (uint32_t)err;
+    g->stats.samples++;
+}
+
+/* ============================================================================
+ *  Public API
+ * ========================================================================== */
+
+void stepper_gear_start(StepperGear *g,
+                        StepperGroup *group,
+                        uint8_t master,
+                        const int32_t *ratios_q16)
+{
+    if (!g || !group || !ratios_q16 || master >= group->count)
+        return;
+
+    if (!(group->smart_mask & (1u << master)))
+        return;
+
+    g->group = group;
+    g->master = master;
+    g->primed = false;
+    g->measure = false;
+
+    g->stats.updates = 0;
+    g->stats.period_cycles = 0;
+    g->stats.period_cycles_max = 0;
+    g->stats.update_cycles_max = 0;
+    g->stats.samples = 0;
+    g->stats.error_max = 0;
+    g->stats.error_abs_total = 0;
+    g->stats.reprimes = 0;
+
+    int32_t master_x = stepper_get_position(group->steppers[master]);
+    g->master_x = master_x;
+    g->master_v = 0;
+
+    for (uint8_t i = 0; i < group->count; i++) {
+        Stepper *s = group->steppers[i];
+
+        g->ratio_q16[i] = 0;
+        if (i == master || ratios_q16[i] == 0 || !(group->smart_mask & (1u << i)))
+            continue;
+
+        g->ratio_q16[i] = ratios_q16[i];
+        g->slave_origin[i] = stepper_get_position(s);
+        g->master_origin[i] = master_x;
+        g->slave_target[i] = g->slave_origin[i];
+        g->slave_vmax[i] = 0;
+
+        /* Every target update would otherwise raise a completion IRQ */
+        g->slave_events[i] = s->events_enabled;
+        stepper_enable_events(s, false);
+
+        /* Position mode at the nominal ramp, parked on its origin */
+        stepper_move_to_position(s, g->slave_origin[i]);
+        ((TMC5240_Context *)s->hw_context)->ramp_scale = 0;
+    }
+
+    g->last_cycles = DWT->CYCCNT;
+    g->active = true;
+}
+
+void stepper_gear_set_ratio(StepperGear *g, uint8_t axis, int32_t ratio_q16)
+{
+    if (!g || !g->active || axis >= g->group->count || axis == g->master)
+        return;
+
+    if (g->ratio_q16[axis] == 0)
+        return;
+
+    /* Continue from the last commanded point so the change is bumpless */
+    g->slave_origin[axis] = g->slave_target[axis];
+    g->master_origin[axis] = g->master_x;
+    g->ratio_q16[axis] = ratio_q16;
+}
+
+bool stepper_gear_update(StepperGear *g)
+{
+    if (!g || !g->active)
+        return false;
+
+    uint32_t start = DWT->CYCCNT;
+
+    g->stats.period_cycles = start - g->last_cycles;
+    if (g->stats.updates && g->stats.period_cycles > g->stats.period_cycles_max)
+        g->stats.period_cycles_max = g->stats.period_cycles;
+    g->last_cycles = start;
+
+    gear_sample_master(g);
+
+    for (uint8_t i = 0; i < g->group->count; i++) {
+        if (g->ratio_q16[i] == 0)
+            continue;
+        gear_command_slave(g, i);
+        if (g->measure)
+            gear_measure_slave(g, i);
+    }
+
+    uint32_t cycles = DWT->CYCCNT - start;
+    if (cycles > g->stats.update_cycles_max)
+        g->stats.update_cycles_max = cycles;
+    g->stats.updates++;
+
+    return true;
+}
+
+void stepper_gear_stop(StepperGear *g)
+{
+    if (!g || !g->active)
+        return;
+
+    g->active = false;
+
+    for (uint8_t i = 0; i < g->group->count; i++) {
+        if (g->ratio_q16[i] == 0)
+            continue;
+
+        Stepper *s = g->group->steppers[i];
+        stepper_move_to_position(s, g->slave_target[i]);
+        stepper_enable_events(s, g->slave_events[i]);
+        g->ratio_q16[i] = 0;
+    }
+}
+
+void stepper_gear_measure(StepperGear *g, bool enable)
+{
+    if (g)
+        g->measure = enable;
+}
+
+void stepper_gear_print_stats(const StepperGear *g)
+{
+    if (!g || g->stats.updates == 0)
+        return;
+
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+    uint32_t period_us = g->stats.period_cycles / cycles_per_us;
+
+    log_printf("Gear: %lu updates, period %lu us (%lu Hz, max %lu us), update max %lu us, %lu re-primes\r\n",
+               (unsigned long)g->stats.updates,
+               (unsigned long)period_us,
+               (unsigned long)(period_us ? 1000000u / period_us : 0),
+               (unsigned long)(g->stats.period_cycles_max / cycles_per_us),
+               (unsigned long)(g->stats.update_cycles_max / cycles_per_us),
+               (unsigned long)g->stats.reprimes);
+
+    if (g->stats.samples)
+        log_printf("Gear: tracking error max %ld steps, mean %lu.%02lu steps\r\n",
+                   (long)g->stats.error_max,
+                   (unsigned long)(g->stats.error_abs_total / g->stats.samples),
+                   (unsigned long)((g->stats.error_abs_total * 100u / g->stats.samples) % 100u));
+}
@@ -0,0 +1,195 @@
+/*
+ * stepper_homing.c — non-blocking two-phase homing over a stepper group
+ *
+ * The fast seek relies on the driver's hardware stop (SWMODE stop_l/r or
+ * SG_STOP), so overshoot depends on the mechanics and the ramp, not on how
+ * often this state machine runs. The exact reference comes from the
+ * position latch (XLATCH) captured on the slow re-approach.
+ */
+
+#include "stepper_homing.h"
+#include "main.h"
+
+#define HOMING_STOP_EVENTS  (STEPPER_EVT_STALL | STEPPER_EVT_LIMIT_L | STEPPER_EVT_LIMIT_R)
+
+/* ============================================================================
+ *  Internal Helpers
+ * ========================================================================== */
+
+static void homing_enter(StepperHomingAxis *a, StepperHomingState state)
+{
+    a->state = state;
+    a->phase_start = HAL_GetTick();
+}
+
+static bool homing_timed_out(const StepperHomingAxis *a)
+{
+    return a->cfg->timeout_ms &&
+           (HAL_GetTick() - a->phase_start) >= a->cfg->timeout_ms;
+}
+
+/* Arm the reference and start seeking at the given velocity */
+static void homing_seek(StepperHomingAxis *a, int32_t velocity, StepperHomingState state)
+{
+    Stepper *s = a->stepper;
+
+    s->events &= ~HOMING_STOP_EVENTS;
+    s->limit_hit = false;
+    s->driver->home_arm(s, a->cfg->source);
+    stepper_set_velocity(s, velocity);
+    homing_enter(a, state);
+}
+
+/* Halt the seek and release the hardware stop so the axis can move again */
+static void homing_release(StepperHomingAxis *a)
+{
+    Stepper *s = a->stepper;
+
+    stepper_set_velocity(s, 0);
+    s->driver->home_arm(s, STEPPER_HOME_NONE);
+}
+
+/* Hardware stop seen either by the event IRQ or in RAMP_STAT */
+static uint32_t homing_status(StepperHomingAxis *a, int32_t *latch)
+{
+    Stepper *s = a->stepper;
+    uint32_t st = s->driver->home_status(s, latch);
+
+    if (s->events & HOMING_STOP_EVENTS)
+        st |= STEPPER_HOME_STOPPED;
+    return st;
+}
+
+static void homing_fail(StepperHomingAxis *a)
+{
+    homing_release(a);
+    homing_enter(a, STEPPER_HOMING_ERROR);
+}
+
+static void homing_step(StepperHomingAxis *a)
+{
+    Stepper *s = a->stepper;
+    const StepperHomingConfig *cfg = a->cfg;
+    int32_t latch = 0;
+    uint32_t st;
+
+    switch (a->state)
+    {
+    case STEPPER_HOMING_FAST_SEEK:
+        st = homing_status(a, &latch);
+        if (!(st & STEPPER_HOME_STOPPED)) {
+            if (homing_timed_out(a))
+                homing_fail(a);
+            break;
+        }
+
+        a->fast_latch = (st & STEPPER_HOME_LATCHED) ? latch : stepper_get_position(s);
+        homing_release(a);
+        stepper_move_to_position(s, (cfg->fast_velocity > 0) ?
+                                    a->fast_latch - cfg->backoff :
+                                    a->fast_latch + cfg->backoff);
+        homing_enter(a, STEPPER_HOMING_BACKOFF);
+        break;
+
+    case STEPPER_HOMING_BACKOFF:
+        if (stepper_update(s, 0)) {
+            if (homing_timed_out(a))
+                homing_fail(a);
+            break;
+        }
+        homing_seek(a, cfg->slow_velocity, STEPPER_HOMING_SLOW_SEEK);
+        break;
+
+    case STEPPER_HOMING_SLOW_SEEK:
+        st = homing_status(a, &latch);
+        if ((st & (STEPPER_HOME_STOPPED | STEPPER_HOME_LATCHED)) !=
+            (STEPPER_HOME_STOPPED | STEPPER_HOME_LATCHED)) {
+            if (homing_timed_out(a))
+                homing_fail(a);
+            break;
+        }
+
+        a->latch = latch;
+        homing_release(a);
+
+        /* Shift the coordinate system so the switch edge is home_position */
+        stepper_set_position(s, stepper_get_position(s) - latch + cfg->home_position);
+        homing_enter(a, STEPPER_HOMING_DONE);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* ============================================================================
+ *  Public API
+ * ========================================================================== */
+
+void stepper_homing_start(StepperHoming *h,
+                          StepperGroup *group,
+                          const StepperHomingConfig *const *cfgs)
+{
+    if (!h || !group || !cfgs)
+        return;
+
+    h->count = group->count;
+
+    for (uint8_t i = 0; i < group->count; i++) {
+        StepperHomingAxis *a = &h->axes[i];
+        Stepper *s = group->steppers[i];
+
+        a->stepper = s;
+        a->cfg = cfgs[i];
+        a->fast_latch = 0;
+        a->latch = 0;
+        a->state = STEPPER_HOMING_IDLE;
+
+        if (!a->cfg || !s || !s->driver || !(s->driver->caps & STEPPER_CAP_HOMING))
+            continue;
+
+        homing_seek(a, a->cfg->fast_velocity, STEPPER_HOMING_FAST_SEEK);
+    }
+}
+
+bool stepper_homing_update(StepperHoming *h)
+{
+    if (!h)
+        return false;
+
+    bool active = false;
+
+    for (uint8_t i = 0; i < h->count; i++) {
+        StepperHomingAxis *a = &h->axes[i];
+
+        homing_step(a);
+        active |= (a->state == STEPPER_HOMING_FAST_SEEK ||
+                   a->state == STEPPER_HOMING_BACKOFF ||
+                   a->state == STEPPER_HOMING_SLOW_SEEK);
+    }
+
+    return active;
+}
+
+void stepper_homing_abort(StepperHoming *h)
+{
+    if (!h)
+        return;
+
+    for (uint8_t i = 0; i < h->count; i++) {
+        StepperHomingAxis *a = &h->axes[i];
+
+        if (a->state == STEPPER_HOMING_FAST_SEEK ||
+            a->state == STEPPER_HOMING_BACKOFF ||
+            a->state == STEPPER_HOMING_SLOW_SEEK)
+            homing_fail(a);
+    }
+}
+
+StepperHomingState stepper_homing_state(const StepperHoming *h, uint8_t axis)
+{
+    if (!h || axis >= h->count)
+        return STEPPER_HOMING_IDLE;
+
+    return h->axes[axis].state;
+}
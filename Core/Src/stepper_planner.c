@@ -0,0 +1,384 @@
+/*
+ * stepper_planner.c — look-ahead junction-velocity planner for group paths
+ *
+ * Segments are planned GRBL-style: a reverse pass from the newest segment
+ * (which must be able to stop) and a forward pass limited by acceleration.
+ * Only the part of the ring after the `planned` index is revisited on each
+ * append, so the cost per segment stays bounded.
+ *
+ * Execution hands each segment to the drivers' ramp generators in
+ * velocity mode; the last queued segment runs in position mode so the path
+ * ends on the exact target. Every member therefore needs velocity mode,
+ * absolute moves and explicit ramp limits (PLANNER_CAPS).
+ */
+
+#include "stepper_planner.h"
+#include "logging.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#define PLANNER_MASK   (STEPPER_PLANNER_SIZE - 1u)
+#define PLANNER_V_MIN  50.0f    /* Creep speed so a segment always completes */
+#define PLANNER_CAPS   (STEPPER_CAP_MOVE_TO | STEPPER_CAP_VELOCITY | STEPPER_CAP_RAMP_LIMITS)
+
+/* ============================================================================
+ *  Internal Helpers
+ * ========================================================================== */
+
+static inline uint8_t planner_next(uint8_t i)
+{
+    return (uint8_t)((i + 1u) & PLANNER_MASK);
+}
+
+static inline uint8_t planner_prev(uint8_t i)
+{
+    return (uint8_t)((i - 1u) & PLANNER_MASK);
+}
+
+/* Largest acceleration along direction u[] that respects every axis limit */
+static float planner_accel_limit(const StepperPlanner *p, const float *u)
+{
+    float a = INFINITY;
+
+    for (uint8_t i = 0; i < p->group->count; i++) {
+        float c = fabsf(u[i]);
+        if (c > 1e-6f && p->axis_accel[i] / c < a)
+            a = p->axis_accel[i] / c;
+    }
+    return a;
+}
+
+/* Junction deviation: max corner speed from the angle between segments */
+static float planner_junction_velocity(const StepperPlanner *p, const float *u)
+{
+    float cos_theta = 0.0f;
+    float ju[STEPPER_GROUP_MAX];
+    float ju_len = 0.0f;
+
+    for (uint8_t i = 0; i < p->group->count; i++) {
+        cos_theta -= p->last_unit[i] * u[i];
+        ju[i] = u[i] - p->last_unit[i];
+        ju_len += ju[i] * ju[i];
+    }
+
+    if (cos_theta < -0.999999f)
+        return INFINITY;                /* Straight continuation */
+    if (cos_theta > 0.999999f || ju_len < 1e-12f)
+        return 0.0f;                    /* Full reversal */
+
+    ju_len = sqrtf(ju_len);
+    for (uint8_t i = 0; i < p->group->count; i++)
+        ju[i] /= ju_len;
+
+    float a = planner_accel_limit(p, ju);
+    float sin_half = sqrtf(0.5f * (1.0f - cos_theta));
+    return sqrtf(a * p->junction_deviation * sin_half / (1.0f - sin_half));
+}
+
+static void planner_recalculate(StepperPlanner *p)
+{
+    uint8_t newest = planner_prev(p->head);
+    uint8_t first = p->planned;
+
+    /* The executing segment's entry is already committed */
+    if (p->phase != STEPPER_PLAN_IDLE && first == p->tail)
+        first = planner_next(p->tail);
+    if (first == p->head)
+        return;
+
+    /* Reverse pass: every segment must be able to slow for its successor */
+    float next_entry = 0.0f;
+    uint8_t i = newest;
+    for (;;) {
+        StepperSegment *b = &p->ring[i];
+        float v = sqrtf(next_entry * next_entry + 2.0f * b->accel * b->length);
+        b->v_entry = (v < b->v_entry_max) ? v : b->v_entry_max;
+        next_entry = b->v_entry;
+        if (i == first)
+            break;
+        i = planner_prev(i);
+    }
+
+    /* Forward pass: entries are limited by what the previous one can reach */
+    i = (p->phase != STEPPER_PLAN_IDLE) ? p->tail : first;
+    while (i != newest) {
+        StepperSegment *b = &p->ring[i];
+        uint8_t n = planner_next(i);
+        StepperSegment *nb = &p->ring[n];
+        float v = sqrtf(b->v_entry * b->v_entry + 2.0f * b->accel * b->length);
+
+        /* Accel-limited or at its junction cap: can never change again */
+        if (v <= nb->v_entry) {
+            nb->v_entry = v;
+            p->planned = n;
+        } else if (nb->v_entry >= nb->v_entry_max) {
+            p->planned = n;
+        }
+        i = n;
+    }
+}
+
+/* Limits in whole steps/s and steps/s^2, never 0 (0 keeps the driver's) */
+static uint32_t planner_limit(float x)
+{
+    return (x >= 1.0f) ? (uint32_t)lroundf(x) : 1u;
+}
+
+/*
+ * Axis accels for seg. Speed changes along the path run at seg->accel.
+ * Turning onto its direction (what the axis velocities must change by at
+ * the current path speed) runs at the axis limits, the slowest axis
+ * setting the pace so all of them finish the turn together.
+ */
+static void planner_axis_accels(const StepperPlanner *p, const StepperSegment *seg, float *a)
+{
+    float turn[STEPPER_GROUP_MAX];
+    float t = 0.0f;
+
+    for (uint8_t i = 0; i < p->group->count; i++) {
+        turn[i] = fabsf(p->v_cmd * seg->unit[i] - p->v_axis[i]);
+        if (turn[i] > t * p->axis_accel[i])
+            t = turn[i] / p->axis_accel[i];
+    }
+
+    for (uint8_t i = 0; i < p->group->count; i++) {
+        a[i] = seg->accel * fabsf(seg->unit[i]);
+        if (t > 0.0f && turn[i] / t > a[i])
+            a[i] = turn[i] / t;
+    }
+}
+
+static void planner_command(StepperPlanner *p, const StepperSegment *seg, float v)
+{
+    float a[STEPPER_GROUP_MAX];
+
+    if (v < PLANNER_V_MIN)
+        v = PLANNER_V_MIN;
+
+    planner_axis_accels(p, seg, a);
+    p->v_cmd = v;
+
+    for (uint8_t i = 0; i < p->group->count; i++) {
+        Stepper *s = p->group->steppers[i];
+
+        p->v_axis[i] = v * seg->unit[i];
+        stepper_set_ramp_limits(s, 0, planner_limit(a[i]));
+        stepper_set_velocity(s, (int32_t)lroundf(p->v_axis[i]));
+    }
+}
+
+static void planner_start_segment(StepperPlanner *p)
+{
+    StepperSegment *seg = &p->ring[p->tail];
+
+    if (planner_next(p->tail) != p->head) {
+        p->phase = STEPPER_PLAN_CRUISE;
+        planner_command(p, seg, seg->v_nominal);
+        return;
+    }
+
+    /* Last queued segment: scaled position-mode ramps land on the target */
+    float a[STEPPER_GROUP_MAX];
+
+    p->phase = STEPPER_PLAN_FINAL;
+    planner_axis_accels(p, seg, a);
+
+    for (uint8_t i = 0; i < p->group->count; i++)
+        stepper_move_to_limited(p->group->steppers[i], seg->target[i],
+                                planner_limit(seg->v_nominal * fabsf(seg->unit[i])),
+                                planner_limit(a[i]));
+}
+
+/* ============================================================================
+ *  Public API
+ * ========================================================================== */
+
+bool stepper_planner_init(StepperPlanner *p,
+                          StepperGroup *group,
+                          const float *axis_accel,
+                          float junction_deviation)
+{
+    if (!p || !group || !axis_accel || group->count == 0)
+        return false;
+
+    for (uint8_t i = 0; i < group->count; i++) {
+        const Stepper *s = group->steppers[i];
+        if (!s->driver || (s->driver->caps & PLANNER_CAPS) != PLANNER_CAPS)
+            return false;
+    }
+
+    p->group = group;
+    p->junction_deviation = junction_deviation;
+    p->head = 0;
+    p->tail = 0;
+    p->planned = 0;
+    p->phase = STEPPER_PLAN_IDLE;
+    p->v_cmd = 0.0f;
+    p->last_v_nominal = 0.0f;
+
+    for (uint8_t i = 0; i < STEPPER_GROUP_MAX; i++) {
+        p->v_axis[i] = 0.0f;
+        p->axis_accel[i] = (i < group->count) ? axis_accel[i] : 0.0f;
+        p->last_unit[i] = 0.0f;
+        p->last_target[i] = (i < group->count) ?
+            stepper_get_position(group->steppers[i]) : 0;
+    }
+
+    p->stats.appended = 0;
+    p->stats.append_cycles_last = 0;
+    p->stats.append_cycles_max = 0;
+    p->stats.append_cycles_total = 0;
+    return true;
+}
+
+uint8_t stepper_planner_count(const StepperPlanner *p)
+{
+    return p ? (uint8_t)((p->head - p->tail) & PLANNER_MASK) : 0;
+}
+
+bool stepper_planner_append(StepperPlanner *p, const int32_t *target, float feed)
+{
+    if (!p || !p->group || !target || feed <= 0.0f)
+        return false;
+
+    uint32_t start = DWT->CYCCNT;
+
+    if (stepper_planner_count(p) >= STEPPER_PLANNER_SIZE - 1u)
+        return false;
+
+    StepperSegment *seg = &p->ring[p->head];
+    float len = 0.0f;
+    uint32_t major_d = 0;
+
+    seg->major = 0;
+    for (uint8_t i = 0; i < p->group->count; i++) {
+        int32_t d = target[i] - p->last_target[i];
+        uint32_t ad = (d >= 0) ? (uint32_t)d : (uint32_t)-d;
+        seg->target[i] = target[i];
+        seg->unit[i] = (float)d;
+        len += (float)d * (float)d;
+        if (ad > major_d) {
+            major_d = ad;
+            seg->major = i;
+        }
+    }
+
+    if (major_d == 0)
+        return false;
+
+    len = sqrtf(len);
+    for (uint8_t i = 0; i < p->group->count; i++)
+        seg->unit[i] /= len;
+
+    seg->length = len;
+    seg->accel = planner_accel_limit(p, seg->unit);
+    seg->v_nominal = feed;
+    seg->v_entry = 0.0f;
+
+    /* Start from rest when nothing is queued or the last move is stopping */
+    if (p->head == p->tail || p->phase == STEPPER_PLAN_FINAL) {
+        seg->v_entry_max = 0.0f;
+        if (p->head == p->tail)
+            p->planned = p->head;
+    } else {
+        float v = planner_junction_velocity(p, seg->unit);
+        if (v > feed) v = feed;
+        if (v > p->last_v_nominal) v = p->last_v_nominal;
+        seg->v_entry_max = v;
+    }
+
+    for (uint8_t i = 0; i < p->group->count; i++) {
+        p->last_target[i] = target[i];
+        p->last_unit[i] = seg->unit[i];
+    }
+    p->last_v_nominal = feed;
+    p->head = planner_next(p->head);
+
+    planner_recalculate(p);
+
+    uint32_t cycles = DWT->CYCCNT - start;
+    p->stats.appended++;
+    p->stats.append_cycles_last = cycles;
+    p->stats.append_cycles_total += cycles;
+    if (cycles > p->stats.append_cycles_max)
+        p->stats.append_cycles_max = cycles;
+
+    return true;
+}
+
+bool stepper_planner_update(StepperPlanner *p)
+{
+    if (!p || !p->group)
+        return false;
+
+    if (p->phase == STEPPER_PLAN_IDLE) {
+        if (p->head == p->tail)
+            return false;
+        planner_start_segment(p);
+        return true;
+    }
+
+    StepperSegment *seg = &p->ring[p->tail];
+
+    if (p->phase == STEPPER_PLAN_FINAL) {
+        if (stepper_group_update(p->group, 0))
+            return true;
+
+        if (p->planned == p->tail)
+            p->planned = planner_next(p->tail);
+        p->tail = planner_next(p->tail);
+        p->phase = STEPPER_PLAN_IDLE;
+
+        /* Stopped on the target: the next segment starts from rest */
+        p->v_cmd = 0.0f;
+        for (uint8_t i = 0; i < p->group->count; i++)
+            p->v_axis[i] = 0.0f;
+        return p->head != p->tail;
+    }
+
+    /* Progress is tracked on the axis with the largest travel */
+    Stepper *m = p->group->steppers[seg->major];
+    int32_t pos = stepper_get_position(m);
+    float u = seg->unit[seg->major];
+    int32_t rem = (u > 0.0f) ? seg->target[seg->major] - pos
+                             : pos - seg->target[seg->major];
+
+    if (rem <= 0) {
+        if (p->planned == p->tail)
+            p->planned = planner_next(p->tail);
+        p->tail = planner_next(p->tail);
+        planner_start_segment(p);
+        return true;
+    }
+
+    if (p->phase == STEPPER_PLAN_CRUISE) {
+        float exit = p->ring[planner_next(p->tail)].v_entry;
+        float dist = (float)rem / fabsf(u);
+
+        if (p->v_cmd > exit &&
+            p->v_cmd * p->v_cmd - exit * exit >= 2.0f * seg->accel * dist) {
+            p->phase = STEPPER_PLAN_DECEL;
+            planner_command(p, seg, exit);
+        }
+    }
+
+    return true;
+}
+
+void stepper_planner_print_stats(const StepperPlanner *p)
+{
+    if (!p || p->stats.appended == 0)
+        return;
+
+    uint32_t avg = (uint32_t)(p->stats.append_cycles_total / p->stats.appended);
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+    log_printf("Planner: %lu segments, append avg %lu cycles (%lu us), max %lu cycles\r\n",
+               (unsigned long)p->stats.appended,
+               (unsigned long)avg,
+               (unsigned long)(avg / cycles_per_us),
+               (unsigned long)p->stats.append_cycles_max);
+    log_printf("Planner: sustainable rate %lu segments/s\r\n",
+               (unsigned long)(avg ? SystemCoreClock / avg : 0));
+}
@@ -0,0 +1,451 @@
+/*
+ * stepper_predict.c — TMC5240 ramp model for SPI-free position estimates
+ *
+ * The model integrates the six-point ramp piecewise in closed form, with
+ * the bands of tmc5240_ramp_time_us(): position mode starts at VSTART,
+ * accelerates through A1 / A2 / AMAX toward VMAX, holds a lower peak for
+ * TVMAX, brakes through DMAX / D2 / D1 and stops from VSTOP on XTARGET.
+ * Velocity mode ramps with AMAX toward +/-VMAX and HOLD keeps the current
+ * velocity. Commands are picked up from the driver's register shadow at
+ * the time they were written.
+ *
+ * The TMC5240 has no readable AACTUAL, so the acceleration comes from the
+ * model phase; the sampled VACTUAL seeds the velocity.
+ */
+
+#include "stepper_predict.h"
+#include "tmc5240_driver.h"
+#include "logging.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#define PREDICT_STOP_EVENTS  (STEPPER_EVT_STALL | STEPPER_EVT_LIMIT_L | STEPPER_EVT_LIMIT_R)
+#define PREDICT_MAX_PHASES   12           /* Ramp phases integrated per query */
+#define PREDICT_MAX_AGE      0x40000000u  /* DWT cycles before a forced sync */
+
+/* ============================================================================
+ *  Internal Helpers
+ * ========================================================================== */
+
+static inline float predict_seconds(uint32_t cycles)
+{
+    return (float)cycles / (float)SystemCoreClock;
+}
+
+static void predict_load(StepperPredictor *p, const TMC5240_Context *ctx)
+{
+    TMC5240_Ramp r;
+
+    /* Ramp as configured at init, AMAX / DMAX / VMAX as last written */
+    tmc5240_ramp_nominal(ctx, &r);
+
+    p->gen = ctx->shadow_gen;
+    p->rampmode = ctx->shadow_rampmode;
+    p->target = (float)ctx->shadow_xtarget;
+    p->vstart = tmc5240_sps_from_vmax((int32_t)r.vstart);
+    p->a1 = tmc5240_sps2_from_amax(r.a1);
+    p->v1 = tmc5240_sps_from_vmax((int32_t)r.v1);
+    p->a2 = tmc5240_sps2_from_amax(r.a2);
+    p->v2 = tmc5240_sps_from_vmax((int32_t)r.v2);
+    p->vmax = tmc5240_sps_from_vmax((int32_t)ctx->shadow_vmax);
+    p->amax = tmc5240_sps2_from_amax(ctx->shadow_amax);
+    p->dmax = tmc5240_sps2_from_amax(ctx->shadow_dmax);
+    p->d2 = tmc5240_sps2_from_amax(r.d2);
+    p->d1 = tmc5240_sps2_from_amax(r.d1);
+    p->vstop = tmc5240_sps_from_vmax((int32_t)r.vstop);
+    p->tvmax = (float)r.tvmax * 512.0f / (float)TMC5240_FCLK_HZ;
+}
+
+/* Acceleration at speed v: A1 below V1, A2 below V2, AMAX above */
+static float predict_accel(const StepperPredictor *p, float v, float *top)
+{
+    if (v < p->v1) {
+        *top = p->v1;
+        return p->a1;
+    }
+    if (v < p->v2) {
+        *top = p->v2;
+        return p->a2;
+    }
+    *top = p->vmax;
+    return p->amax;
+}
+
+/* Deceleration at speed v: DMAX above V1 and V2, D2 down to V1, D1 below */
+static float predict_decel(const StepperPredictor *p, float v, float *bottom)
+{
+    float d;
+    float b;
+
+    if (v > p->v2 && v > p->v1) {
+        b = fmaxf(p->v1, p->v2);
+        d = p->dmax;
+    } else if (v > p->v1) {
+        b = p->v1;
+        d = p->d2;
+    } else {
+        b = 0.0f;
+        d = p->d1;
+    }
+    *bottom = fmaxf(b, p->vstop);
+    return d;
+}
+
+/* Distance to brake from v down to VSTOP */
+static float predict_brake(const StepperPredictor *p, float v)
+{
+    float dist = 0.0f;
+
+    while (v > p->vstop) {
+        float b;
+        float d = predict_decel(p, v, &b);
+
+        if (d <= 0.0f)
+            return INFINITY;
+        dist += (v * v - b * b) / (2.0f * d);
+        v = b;
+    }
+    return dist;
+}
+
+/* Constant acceleration a for h seconds */
+static void predict_integrate(StepperPredictor *p, float a, float h)
+{
+    float dx = p->v * h + 0.5f * a * h * h;
+
+    p->x += dx;
+    p->v += a * h;
+    p->travelled += fabsf(dx);
+}
+
+/*
+ * One phase of a position-mode move: acceleration a for t seconds, ending
+ * at v_end. Returns false once the model is at rest on the target or the
+ * ramp cannot move.
+ */
+static bool predict_position_phase(StepperPredictor *p, float *a, float *t, float *v_end, bool *lands)
+{
+    float r = p->target - p->x;
+    float dir = (r >= 0.0f) ? 1.0f : -1.0f;
+    float R = fabsf(r);
+    float u = p->v * dir;           /* Speed toward the target */
+    float edge;
+    float d;
+
+    *lands = false;
+
+    if (R < 0.5f && (u * u < p->dmax || fabsf(u) <= p->vstop)) {
+        p->x = p->target;           /* Stopped on target */
+        p->v = 0.0f;
+        return false;
+    }
+
+    if (u < 0.0f) {
+        /* Moving away: brake, the stop from VSTOP is immediate */
+        d = predict_decel(p, -u, &edge);
+        if (d <= 0.0f)
+            return false;
+        *a = dir * d;
+        *t = (-u - edge) / d;
+        *v_end = (edge > p->vstop) ? -dir * edge : 0.0f;
+        return true;
+    }
+
+    if (u == 0.0f && p->vstart > 0.0f) {
+        *a = 0.0f;                  /* Start at VSTART */
+        *t = 0.0f;
+        *v_end = dir * fminf(p->vstart, p->vmax);
+        return true;
+    }
+
+    float brake = predict_brake(p, u);
+
+    if (brake >= 0.9995f * R) {
+        /* Braking onto the target, at the rate that ends on it */
+        if (R < 0.5f) {
+            p->x = p->target;
+            p->v = 0.0f;
+            return false;
+        }
+        d = predict_decel(p, u, &edge) * (brake / R);
+        *a = -dir * d;
+        *t = (u - edge) / d;
+        *v_end = dir * edge;
+        *lands = (edge <= p->vstop);
+        return true;
+    }
+
+    if (u > p->vmax) {
+        d = predict_decel(p, u, &edge);     /* VMAX was lowered */
+        if (d <= 0.0f)
+            return false;
+        edge = fmaxf(edge, p->vmax);
+        *a = -dir * d;
+        *t = (u - edge) / d;
+        *v_end = dir * edge;
+        return true;
+    }
+
+    if (u < p->vmax - 1e-3f) {
+        /*
+         * Accelerate to the band edge or the peak w, whichever comes
+         * first: reaching w, holding it TVMAX and braking from it covers
+         * exactly what is left. Within one band both rates are fixed.
+         */
+        float top;
+        float bottom;
+        float acc = predict_accel(p, u, &top);
+
+        if (top > p->vmax)
+            top = p->vmax;
+        d = predict_decel(p, top, &bottom);
+        if (acc <= 0.0f || d <= 0.0f)
+            return false;
+
+        float A = 0.5f / acc + 0.5f / d;
+        float K = R + u * u * 0.5f / acc - predict_brake(p, bottom) + bottom * bottom * 0.5f / d;
+        float w = (K > 0.0f) ? 2.0f * K / (p->tvmax + sqrtf(p->tvmax * p->tvmax + 4.0f * A * K)) : 0.0f;
+
+        if (w > u * 1.0001f + 1e-3f) {
+            if (w > top)
+                w = top;
+            *a = dir * acc;
+            *t = (w - u) / acc;
+            *v_end = dir * w;
+            return true;
+        }
+    }
+
+    if (u <= 0.0f)
+        return false;               /* VMAX = 0: held */
+
+    /* At the peak or VMAX: cruise to the braking point */
+    *a = 0.0f;
+    *t = (R - brake) / u;
+    *v_end = p->v;
+    return true;
+}
+
+static void predict_advance(StepperPredictor *p, float dt)
+{
+    for (uint8_t n = 0; n < PREDICT_MAX_PHASES && dt > 0.0f; n++) {
+        float a;
+        float t;
+        float v_end;
+        bool lands = false;
+
+        if (p->rampmode == TMC5240_MODE_HOLD || p->amax <= 0.0f) {
+            break;
+        } else if (p->rampmode != TMC5240_MODE_POSITION) {
+            /* Velocity mode: AMAX in both directions */
+            float vt = (p->rampmode == TMC5240_MODE_VELNEG) ? -p->vmax : p->vmax;
+            float dv = vt - p->v;
+
+            if (fabsf(dv) < 1e-3f) {
+                p->v = vt;
+                break;
+            }
+            a = (dv > 0.0f) ? p->amax : -p->amax;
+            t = fabsf(dv) / p->amax;
+            v_end = vt;
+        } else if (!predict_position_phase(p, &a, &t, &v_end, &lands)) {
+            break;
+        }
+
+        if (t > dt) {
+            predict_integrate(p, a, dt);
+            return;
+        }
+        if (t > 0.0f)
+            predict_integrate(p, a, t);
+        p->v = v_end;
+        if (lands) {
+            p->x = p->target;       /* Stopped from VSTOP on target */
+            p->v = 0.0f;
+        }
+        dt -= t;
+    }
+
+    /* Remaining time at constant velocity */
+    if (dt > 0.0f)
+        predict_integrate(p, 0.0f, dt);
+}
+
+/* Bring the model to `now`, applying commands at their write time */
+static void predict_catch_up(StepperPredictor *p, const TMC5240_Context *ctx, uint32_t now)
+{
+    if (ctx->shadow_gen != p->gen) {
+        if ((int32_t)(ctx->shadow_stamp - p->t_model) > 0) {
+            predict_advance(p, predict_seconds(ctx->shadow_stamp - p->t_model));
+            p->t_model = ctx->shadow_stamp;
+        }
+        predict_load(p, ctx);
+    }
+
+    if ((int32_t)(now - p->t_model) > 0) {
+        predict_advance(p, predict_seconds(now - p->t_model));
+        p->t_model = now;
+    }
+}
+
+/*
+ * Error bound: one step of quantization, the clock tolerance applied to
+ * the distance covered, and the sampled velocity error integrated since
+ * the sync.
+ */
+static float predict_bound(const StepperPredictor *p, uint32_t now)
+{
+    return 1.0f + p->clock_tolerance * p->travelled +
+           p->v_error * predict_seconds(now - p->t_sync);
+}
+
+/* Hardware stops and XACTUAL rewrites are not part of the model */
+static bool predict_stale(const StepperPredictor *p, const TMC5240_Context *ctx, uint32_t now)
+{
+    return !p->valid ||
+           ctx->shadow_xactual ||
+           (p->stepper->events & PREDICT_STOP_EVENTS & ~p->events) ||
+           (now - p->t_sync) > PREDICT_MAX_AGE;
+}
+
+/* ============================================================================
+ *  Public API
+ * ========================================================================== */
+
+void stepper_predict_init(StepperPredictor *p,
+                          Stepper *stepper,
+                          float tolerance,
+                          float clock_tolerance)
+{
+    if (!p || !stepper || !stepper->hw_context)
+        return;
+
+    p->stepper = stepper;
+    p->tolerance = tolerance;
+    p->clock_tolerance = clock_tolerance;
+    p->valid = false;
+
+    p->stats.predictions = 0;
+    p->stats.syncs = 0;
+    p->stats.checks = 0;
+    p->stats.violations = 0;
+    p->stats.error_max = 0.0f;
+    p->stats.bound_at_error_max = 0.0f;
+
+    stepper_predict_sync(p);
+}
+
+void stepper_predict_sync(StepperPredictor *p)
+{
+    if (!p || !p->stepper || !p->stepper->hw_context)
+        return;
+
+    TMC5240_Context *ctx = (TMC5240_Context *)p->stepper->hw_context;
+    int32_t vact;
+    int32_t xact;
+    uint32_t t_v;
+    uint32_t t_x;
+
+    tmc5240_read_batch(&ctx, 1, TMC5240_VACTUAL, &vact, &t_v);
+    tmc5240_read_batch(&ctx, 1, TMC5240_XACTUAL, &xact, &t_x);
+
+    /* VACTUAL is 24-bit signed */
+    vact = (int32_t)((uint32_t)vact << 8) >> 8;
+
+    predict_load(p, ctx);
+    ctx->shadow_xactual = false;
+
+    p->x = (float)xact;
+    p->v = tmc5240_sps_from_vmax(vact);
+    p->t_model = t_x;
+    p->t_sync = t_x;
+    p->travelled = 0.0f;
+
+    /* VACTUAL was latched one read earlier, plus one LSB of quantization */
+    float rate = fmaxf(fmaxf(fmaxf(p->a1, p->a2), p->amax), fmaxf(fmaxf(p->dmax, p->d2), p->d1));
+    p->v_error = rate * predict_seconds(t_x - t_v) +
+                 tmc5240_sps_from_vmax(1);
+
+    p->events = p->stepper->events;
+    p->valid = true;
+    p->stats.syncs++;
+}
+
+int32_t stepper_predict_position(StepperPredictor *p, float *bound)
+{
+    if (!p || !p->stepper || !p->stepper->hw_context)
+        return 0;
+
+    TMC5240_Context *ctx = (TMC5240_Context *)p->stepper->hw_context;
+    uint32_t now = DWT->CYCCNT;
+    float b = 0.0f;
+    bool resync = predict_stale(p, ctx, now);
+
+    if (!resync) {
+        predict_catch_up(p, ctx, now);
+        b = predict_bound(p, now);
+        resync = (b > p->tolerance);
+    }
+
+    if (resync) {
+        stepper_predict_sync(p);
+        b = predict_bound(p, p->t_sync);
+    }
+
+    p->stats.predictions++;
+    if (bound)
+        *bound = b;
+
+    return (int32_t)lroundf(p->x);
+}
+
+float stepper_predict_check(StepperPredictor *p)
+{
+    if (!p || !p->stepper || !p->stepper->hw_context)
+        return 0.0f;
+
+    TMC5240_Context *ctx = (TMC5240_Context *)p->stepper->hw_context;
+    int32_t xact;
+    uint32_t t_x;
+
+    if (predict_stale(p, ctx, DWT->CYCCNT)) {
+        stepper_predict_sync(p);
+        return 0.0f;
+    }
+
+    tmc5240_read_batch(&ctx, 1, TMC5240_XACTUAL, &xact, &t_x);
+    predict_catch_up(p, ctx, t_x);
+
+    float err = (float)xact - p->x;
+    float b = predict_bound(p, t_x);
+
+    p->stats.checks++;
+    if (fabsf(err) > b)
+        p->stats.violations++;
+    if (fabsf(err) > p->stats.error_max) {
+        p->stats.error_max = fabsf(err);
+        p->stats.bound_at_error_max = b;
+    }
+
+    stepper_predict_sync(p);
+    return err;
+}
+
+void stepper_predict_print_stats(const StepperPredictor *p)
+{
+    if (!p || !p->stepper)
+        return;
+
+    log_printf("Predictor %u: %lu queries, %lu syncs (%lu queries/sync)\r\n",
+               p->stepper->stepper_id,
+               (unsigned long)p->stats.predictions,
+               (unsigned long)p->stats.syncs,
+               (unsigned long)(p->stats.syncs ? p->stats.predictions / p->stats.syncs : 0));
+    log_printf("Predictor %u: %lu checks, %lu bound violations, max error %ld steps (bound %ld)\r\n",
+               p->stepper->stepper_id,
+               (unsigned long)p->stats.checks,
+               (unsigned long)p->stats.violations,
+               (long)lroundf(p->stats.error_max),
+               (long)lroundf(p->stats.bound_at_error_max));
+}
@@ -0,0 +1,366 @@
+/*
+ * stepper_pvt.c — cubic Hermite PVT playback in velocity mode
+ *
+ * With s = t / T in Q16 and dp = p1 - p0 the segment is
+ *
+ *   p(s) = p0 + h01(s) dp + T (h10(s) v0 + h11(s) v1)
+ *   v(s) = 6 (s - s^2) dp / T + (3s^2 - 4s + 1) v0 + (3s^2 - 2s) v1
+ *
+ * Every tick commands v() at the middle of the next tick as feed-forward;
+ * with kp > 0 the error between p() and XACTUAL is added back as
+ * kp * error.
+ *
+ * Points are checked when pushed, so playback needs no overflow checks:
+ * T <= 2^20 us and |v|, |dp| / T <= PVT_V_LIMIT < 2^23 steps/s bound
+ * v * T * 2^16 by 2^59 and the Hermite terms by 2^56.
+ */
+
+#include "stepper_pvt.h"
+#include "tmc5240_driver.h"
+#include "main.h"
+#include "logging.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define PVT_ONE        (1 << 16)   /* s = 1.0 in Q16 */
+/* Fastest accepted point or segment velocity, steps/s: VMAX register limit */
+#define PVT_V_LIMIT    ((int64_t)TMC5240_MAX_SPS)
+
+/* ============================================================================
+ *  Internal Helpers
+ * ========================================================================== */
+
+/* Segment parameter s = elapsed / T in Q16 */
+static inline int32_t pvt_param(uint32_t elapsed_us, uint32_t duration_us)
+{
+    if (elapsed_us >= duration_us)
+        return PVT_ONE;
+    return (int32_t)(((uint64_t)elapsed_us << 16) / duration_us);
+}
+
+/* T * v in Q16 steps */
+static inline int64_t pvt_span_q16(int32_t v, uint32_t duration_us)
+{
+    return ((int64_t)v * duration_us * PVT_ONE) / 1000000;
+}
+
+/* Interpolated position of one axis, Q16 steps */
+static int64_t pvt_position_q16(const StepperPvt *pvt, uint8_t axis, int32_t s)
+{
+    int64_t s2 = ((int64_t)s * s) >> 16;
+    int64_t s3 = (s2 * s) >> 16;
+    int64_t h01 = 3 * s2 - 2 * s3;
+    int64_t h10 = s3 - 2 * s2 + s;
+    int64_t h11 = s3 - s2;
+    int32_t p0 = pvt->from.position[axis];
+    int64_t dp = (int64_t)pvt->to.position[axis] - p0;
+    uint32_t T = pvt->to.duration_us;
+
+    return ((int64_t)p0 << 16) + h01 * dp +
+           ((h10 * pvt_span_q16(pvt->from.velocity[axis], T) +
+             h11 * pvt_span_q16(pvt->to.velocity[axis], T)) >> 16);
+}
+
+/* Interpolated velocity of one axis, steps/s */
+static int64_t pvt_velocity(const StepperPvt *pvt, uint8_t axis, int32_t s)
+{
+    int64_t s2 = ((int64_t)s * s) >> 16;
+    int64_t dp = (int64_t)pvt->to.position[axis] - pvt->from.position[axis];
+    int64_t v_avg = dp * 1000000 / pvt->to.duration_us;
+    int64_t v = (6 * (s - s2) * v_avg +
+                 (3 * s2 - 4 * s + PVT_ONE) * pvt->from.velocity[axis] +
+                 (3 * s2 - 2 * s) * pvt->to.velocity[axis]) >> 16;
+
+    return v;
+}
+
+static void pvt_command(StepperPvt *pvt, uint8_t axis, int64_t v)
+{
+    /* Curve overshoot and kp can exceed the limit: the driver saturates */
+    if (v > INT32_MAX)
+        v = INT32_MAX;
+    if (v < -INT32_MAX)
+        v = -INT32_MAX;
+
+    if ((int32_t)v == pvt->v_cmd[axis])
+        return;
+
+    pvt->v_cmd[axis] = (int32_t)v;
+    stepper_set_velocity(pvt->group->steppers[axis], (int32_t)v);
+}
+
+static void pvt_halt(StepperPvt *pvt)
+{
+    for (uint8_t i = 0; i < pvt->axes; i++)
+        pvt_command(pvt, i, 0);
+}
+
+/*
+ * A point is playable if its segment from the previously accepted point
+ * fits STEPPER_PVT_SEGMENT_MAX_US and neither its velocities nor the
+ * segment's average speed exceed PVT_V_LIMIT on any axis
+ */
+static bool pvt_point_valid(const StepperPvt *pvt, const StepperPvtPoint *point)
+{
+    uint32_t T = point->duration_us;
+
+    if (T == 0 || T > STEPPER_PVT_SEGMENT_MAX_US)
+        return false;
+
+    for (uint8_t i = 0; i < pvt->axes; i++) {
+        int64_t v = point->velocity[i];
+        int64_t dp = (int64_t)point->position[i] - pvt->push_position[i];
+
+        if (v > PVT_V_LIMIT || v < -PVT_V_LIMIT)
+            return false;
+        if (dp < 0)
+            dp = -dp;
+        if (dp * 1000000 > PVT_V_LIMIT * T)
+            return false;
+    }
+    return true;
+}
+
+/* Load the next point as the segment end; false if the ring is empty */
+static bool pvt_next_segment(StepperPvt *pvt)
+{
+    StepperPvtPoint next;
+
+    if (lwrb_read(&pvt->ring, &next, sizeof(next)) != sizeof(next))
+        return false;
+
+    pvt->from = pvt->to;
+    pvt->to = next;
+    pvt->stats.segments++;
+    return true;
+}
+
+static void pvt_track_level(StepperPvt *pvt)
+{
+    uint16_t level = stepper_pvt_level(pvt);
+
+    if (level < pvt->stats.level_min)
+        pvt->stats.level_min = level;
+    if (level > pvt->stats.level_max)
+        pvt->stats.level_max = level;
+}
+
+/* Advance the segment clock by the DWT time since the last tick */
+static void pvt_advance_clock(StepperPvt *pvt)
+{
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+    uint32_t us = (DWT->CYCCNT - pvt->last_cycles) / cycles_per_us;
+
+    /* Keep the sub-microsecond remainder for the next tick */
+    pvt->last_cycles += us * cycles_per_us;
+    pvt->elapsed_us += us;
+}
+
+/* ============================================================================
+ *  Public API
+ * ========================================================================== */
+
+bool stepper_pvt_init(StepperPvt *pvt,
+                      StepperGroup *group,
+                      uint8_t axes,
+                      uint32_t tick_us,
+                      int32_t kp)
+{
+    if (!pvt || !group || axes == 0 || axes > STEPPER_PVT_AXES || axes > group->count)
+        return false;
+
+    for (uint8_t i = 0; i < axes; i++) {
+        Stepper *s = group->steppers[i];
+        if (!s->driver || !(s->driver->caps & STEPPER_CAP_VELOCITY))
+            return false;
+    }
+
+    memset(pvt, 0, sizeof(*pvt));
+    pvt->group = group;
+    pvt->axes = axes;
+    pvt->tick_us = tick_us;
+    pvt->kp = kp;
+    pvt->state = STEPPER_PVT_IDLE;
+
+    lwrb_init(&pvt->ring, pvt->ring_data, sizeof(pvt->ring_data));
+
+    /* Trajectory starts at rest on the current positions */
+    for (uint8_t i = 0; i < axes; i++)
+        pvt->to.position[i] = stepper_get_position(group->steppers[i]);
+    pvt->to.duration_us = 1;
+    pvt->from = pvt->to;
+    memcpy(pvt->push_position, pvt->to.position, sizeof(pvt->push_position));
+
+    return true;
+}
+
+bool stepper_pvt_push(StepperPvt *pvt, const StepperPvtPoint *point)
+{
+    if (!pvt || !point)
+        return false;
+
+    if (!pvt_point_valid(pvt, point) || lwrb_get_free(&pvt->ring) < sizeof(*point)) {
+        pvt->stats.rejected++;
+        return false;
+    }
+
+    lwrb_write(&pvt->ring, point, sizeof(*point));
+    memcpy(pvt->push_position, point->position, sizeof(pvt->push_position));
+    pvt->stats.pushed++;
+    return true;
+}
+
+uint16_t stepper_pvt_level(StepperPvt *pvt)
+{
+    return pvt ? (uint16_t)(lwrb_get_full(&pvt->ring) / sizeof(StepperPvtPoint)) : 0;
+}
+
+uint16_t stepper_pvt_free(StepperPvt *pvt)
+{
+    return pvt ? (uint16_t)(lwrb_get_free(&pvt->ring) / sizeof(StepperPvtPoint)) : 0;
+}
+
+void stepper_pvt_start(StepperPvt *pvt)
+{
+    if (!pvt || !pvt->group || pvt->state != STEPPER_PVT_IDLE)
+        return;
+
+    /* The end of the previous trajectory is the start of this one */
+    pvt->from = pvt->to;
+    pvt->elapsed_us = pvt->to.duration_us;
+    pvt->stats.level_min = UINT16_MAX;
+    pvt->last_cycles = DWT->CYCCNT;
+    pvt->tick_pending = false;
+    pvt->state = STEPPER_PVT_RUNNING;
+}
+
+bool stepper_pvt_tick(StepperPvt *pvt)
+{
+    if (!pvt || pvt->state == STEPPER_PVT_IDLE)
+        return false;
+
+    uint32_t start = DWT->CYCCNT;
+
+    pvt->stats.ticks++;
+    pvt_advance_clock(pvt);
+    pvt_track_level(pvt);
+
+    while (pvt->elapsed_us >= pvt->to.duration_us) {
+        uint32_t overrun = pvt->elapsed_us - pvt->to.duration_us;
+
+        if (!pvt_next_segment(pvt)) {
+            bool at_rest = true;
+            for (uint8_t i = 0; i < pvt->axes; i++)
+                at_rest = at_rest && (pvt->to.velocity[i] == 0);
+
+            pvt_halt(pvt);
+            pvt->elapsed_us = pvt->to.duration_us;
+
+            if (at_rest) {
+                /* Last point was a stop: the trajectory is complete */
+                pvt->state = STEPPER_PVT_IDLE;
+                return false;
+            }
+
+            /* Ran dry while moving: hold and resume when data arrives */
+            if (pvt->state != STEPPER_PVT_UNDERRUN)
+                pvt->stats.underruns++;
+            pvt->state = STEPPER_PVT_UNDERRUN;
+            pvt->stats.underrun_ticks++;
+            return true;
+        }
+
+        /* Time spent waiting is not part of the new segment */
+        pvt->elapsed_us = (pvt->state == STEPPER_PVT_UNDERRUN) ? 0 : overrun;
+        pvt->state = STEPPER_PVT_RUNNING;
+    }
+
+    int32_t s_now = pvt_param(pvt->elapsed_us, pvt->to.duration_us);
+    int32_t s_mid = pvt_param(pvt->elapsed_us + pvt->tick_us / 2, pvt->to.duration_us);
+
+    for (uint8_t i = 0; i < pvt->axes; i++) {
+        int64_t v = pvt_velocity(pvt, i, s_mid);
+
+        if (pvt->kp) {
+            int32_t desired = (int32_t)((pvt_position_q16(pvt, i, s_now) + PVT_ONE / 2) >> 16);
+            int32_t err = desired - stepper_get_position(pvt->group->steppers[i]);
+            int32_t abs_err = (err < 0) ? -err : err;
+
+            if (abs_err > pvt->stats.error_max)
+                pvt->stats.error_max = abs_err;
+            v += (int64_t)err * pvt->kp;
+        }
+        pvt_command(pvt, i, v);
+    }
+
+    uint32_t cycles = DWT->CYCCNT - start;
+    if (cycles > pvt->stats.tick_cycles_max)
+        pvt->stats.tick_cycles_max = cycles;
+
+    return true;
+}
+
+void stepper_pvt_tick_irq(StepperPvt *pvt)
+{
+    if (!pvt || pvt->state == STEPPER_PVT_IDLE)
+        return;
+
+    if (pvt->tick_pending)
+        pvt->stats.ticks_missed++;
+    pvt->tick_pending = true;
+    __SEV();
+}
+
+bool stepper_pvt_service(StepperPvt *pvt)
+{
+    if (!pvt)
+        return false;
+
+    if (pvt->tick_pending) {
+        pvt->tick_pending = false;
+        return stepper_pvt_tick(pvt);
+    }
+    return pvt->state != STEPPER_PVT_IDLE;
+}
+
+void stepper_pvt_stop(StepperPvt *pvt)
+{
+    if (!pvt || !pvt->group)
+        return;
+
+    pvt->state = STEPPER_PVT_IDLE;
+    pvt_halt(pvt);
+    lwrb_reset(&pvt->ring);
+
+    /* Restart from wherever the axes come to rest */
+    for (uint8_t i = 0; i < pvt->axes; i++) {
+        pvt->to.position[i] = stepper_get_position(pvt->group->steppers[i]);
+        pvt->to.velocity[i] = 0;
+    }
+    memcpy(pvt->push_position, pvt->to.position, sizeof(pvt->push_position));
+}
+
+void stepper_pvt_print_stats(const StepperPvt *pvt)
+{
+    if (!pvt || pvt->stats.ticks == 0)
+        return;
+
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+    log_printf("PVT: %lu points (%lu rejected), %lu segments, %lu ticks (%lu missed), tick max %lu us\r\n",
+               (unsigned long)pvt->stats.pushed,
+               (unsigned long)pvt->stats.rejected,
+               (unsigned long)pvt->stats.segments,
+               (unsigned long)pvt->stats.ticks,
+               (unsigned long)pvt->stats.ticks_missed,
+               (unsigned long)(pvt->stats.tick_cycles_max / cycles_per_us));
+    log_printf("PVT: ring level min %u max %u of %u, %lu underruns (%lu ticks starved)\r\n",
+               (pvt->stats.level_min == UINT16_MAX) ? 0u : pvt->stats.level_min,
+               pvt->stats.level_max,
+               (unsigned)STEPPER_PVT_DEPTH,
+               (unsigned long)pvt->stats.underruns,
+               (unsigned long)pvt->stats.underrun_ticks);
+    if (pvt->kp)
+        log_printf("PVT: max tracking error %ld steps\r\n", (long)pvt->stats.error_max);
+}
@@ -0,0 +1,223 @@
+/*
+ * telemetry.c — fixed-rate binary axis telemetry over the TX ring
+ *
+ * Frames are scheduled on DWT: each tick that finds the deadline passed
+ * sends one frame and moves the deadline on by whole periods, counting
+ * any it skipped as overruns. A frame that does not fit the TX ring is
+ * dropped rather than queued partially, so the host never sees a torn
+ * frame from this side.
+ */
+
+#include "telemetry.h"
+#include "tmc5240_driver.h"
+#include "cmd_bin.h"
+#include "uart_rx.h"
+#include "logging.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TELEMETRY_HEADER    9       /* timestamp, axis mask, fields */
+#define TELEMETRY_AGE_MAX   0xFFFFu
+
+/* ============================================================================
+ *  Internal Helpers
+ * ========================================================================== */
+
+static uint8_t telemetry_axis_bytes(uint8_t fields)
+{
+    uint8_t n = 0;
+
+    if (fields & TELEMETRY_POSITION)   n += 4;
+    if (fields & TELEMETRY_VELOCITY)   n += 4;
+    if (fields & TELEMETRY_STALLGUARD) n += 2;
+    if (fields & TELEMETRY_DRV_STATUS) n += 4;
+    if (fields & TELEMETRY_STATUS)     n += 1;
+    if (fields & TELEMETRY_AGE)        n += 2;
+    return n;
+}
+
+static uint8_t *telemetry_put(uint8_t *p, uint32_t v, uint8_t bytes)
+{
+    for (uint8_t i = 0; i < bytes; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+    return p + bytes;
+}
+
+/* Age in us of the oldest stamp among the fields sent */
+static uint16_t telemetry_age_us(const TMC5240_Context *ctx, uint8_t fields,
+                                 uint32_t now, uint32_t cycles_per_us)
+{
+    uint32_t oldest = 0;
+    uint32_t stamps[3];
+    uint8_t n = 0;
+
+    if (fields & TELEMETRY_POSITION)
+        stamps[n++] = ctx->sample.xactual_stamp;
+    if (fields & TELEMETRY_VELOCITY)
+        stamps[n++] = ctx->sample.vactual_stamp;
+    if (fields & (TELEMETRY_STALLGUARD | TELEMETRY_DRV_STATUS))
+        stamps[n++] = ctx->sample.drv_status_stamp;
+
+    for (uint8_t i = 0; i < n; i++) {
+        if (stamps[i] == 0)
+            return TELEMETRY_AGE_MAX;   /* Never read */
+        uint32_t age = now - stamps[i];
+        if (age > oldest)
+            oldest = age;
+    }
+
+    oldest /= cycles_per_us;
+    return (oldest > TELEMETRY_AGE_MAX) ? TELEMETRY_AGE_MAX : (uint16_t)oldest;
+}
+
+static size_t telemetry_pack(const Telemetry *t, uint8_t *payload, uint32_t now)
+{
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+    uint8_t *p = payload;
+
+    /* Time since start: unlike DWT it does not wrap every 2^32 cycles */
+    p = telemetry_put(p, (uint32_t)(t->stats.elapsed_cycles / cycles_per_us), 4);
+    p = telemetry_put(p, t->axis_mask, 4);
+    *p++ = t->fields;
+
+    for (uint8_t i = 0; i < t->group->count; i++) {
+        if (!(t->axis_mask & (1u << i)))
+            continue;
+
+        const TMC5240_Context *ctx = (const TMC5240_Context *)t->group->steppers[i]->hw_context;
+
+        if (t->fields & TELEMETRY_POSITION)
+            p = telemetry_put(p, (uint32_t)ctx->sample.xactual, 4);
+        if (t->fields & TELEMETRY_VELOCITY)
+            p = telemetry_put(p, (uint32_t)ctx->sample.vactual, 4);
+        if (t->fields & TELEMETRY_STALLGUARD)
+            p = telemetry_put(p, ctx->sample.drv_status & TMC5240_SG_RESULT_MASK, 2);
+        if (t->fields & TELEMETRY_DRV_STATUS)
+            p = telemetry_put(p, ctx->sample.drv_status, 4);
+        if (t->fields & TELEMETRY_STATUS)
+            *p++ = ctx->spi_status;
+        if (t->fields & TELEMETRY_AGE)
+            p = telemetry_put(p, telemetry_age_us(ctx, t->fields, now, cycles_per_us), 2);
+    }
+
+    return (size_t)(p - payload);
+}
+
+/* ============================================================================
+ *  Public API
+ * ========================================================================== */
+
+bool telemetry_start(Telemetry *t,
+                     StepperGroup *group,
+                     uint32_t axis_mask,
+                     uint8_t fields,
+                     uint32_t rate_hz,
+                     uint32_t baud)
+{
+    if (!t || !group || rate_hz == 0)
+        return false;
+
+    fields &= TELEMETRY_FIELDS_ALL;
+    axis_mask &= group->smart_mask;
+    if (!fields || !axis_mask)
+        return false;
+
+    uint32_t axes = 0;
+    for (uint8_t i = 0; i < group->count; i++)
+        axes += (axis_mask >> i) & 1u;
+
+    uint32_t payload = TELEMETRY_HEADER + axes * telemetry_axis_bytes(fields);
+    if (payload > CMD_BIN_PAYLOAD_MAX)
+        return false;
+
+    if (baud == TELEMETRY_BAUD_MAX)
+        baud = HAL_RCC_GetPCLK1Freq() / 8;
+    if (baud && !uart_rx_set_baudrate(baud))
+        return false;
+
+    memset(t, 0, sizeof(*t));
+    t->group = group;
+    t->axis_mask = axis_mask;
+    t->fields = fields;
+    t->rate_hz = rate_hz;
+    t->baud = baud ? baud : huart2.Init.BaudRate;
+    t->frame_bytes = (uint16_t)CMD_BIN_ENCODED_MAX(payload);
+    t->period_cycles = SystemCoreClock / rate_hz;
+    t->last_cycles = DWT->CYCCNT;
+    t->next_due = t->last_cycles;
+    t->active = true;
+
+    return true;
+}
+
+bool telemetry_tick(Telemetry *t)
+{
+    if (!t || !t->active)
+        return false;
+
+    uint32_t now = DWT->CYCCNT;
+
+    t->stats.elapsed_cycles += now - t->last_cycles;
+    t->last_cycles = now;
+
+    if ((int32_t)(now - t->next_due) < 0)
+        return false;
+
+    /* Whole periods that went by without a tick are lost slots */
+    uint32_t missed = (now - t->next_due) / t->period_cycles;
+    t->stats.overruns += missed;
+    t->next_due += (missed + 1u) * t->period_cycles;
+
+    uint8_t payload[CMD_BIN_PAYLOAD_MAX];
+    uint8_t frame[CMD_BIN_ENCODED_MAX(CMD_BIN_PAYLOAD_MAX)];
+
+    size_t len = telemetry_pack(t, payload, now);
+    size_t n = cmd_bin_encode(CMD_BIN_TELEMETRY, t->seq++, payload, len, frame, sizeof(frame));
+
+    uint32_t cycles = DWT->CYCCNT - now;
+    if (cycles > t->stats.pack_cycles_max)
+        t->stats.pack_cycles_max = cycles;
+
+    if (n == 0 || !logging_tx_send_frame(frame, n)) {
+        t->stats.tx_drops++;
+        return false;
+    }
+
+    t->stats.frames++;
+    return true;
+}
+
+void telemetry_stop(Telemetry *t)
+{
+    if (t)
+        t->active = false;
+}
+
+void telemetry_print_stats(const Telemetry *t)
+{
+    if (!t || !t->group)
+        return;
+
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+    uint64_t elapsed_us = t->stats.elapsed_cycles / cycles_per_us;
+
+    if (elapsed_us == 0)
+        return;
+
+    uint32_t achieved_mhz = (uint32_t)((uint64_t)t->stats.frames * 1000000000ull / elapsed_us);
+    uint32_t link_hz = t->baud / 10u / t->frame_bytes;
+
+    log_printf("Telemetry: %lu.%03lu Hz of %lu Hz requested, %u B/frame, link max %lu Hz @ %lu baud\r\n",
+               (unsigned long)(achieved_mhz / 1000u),
+               (unsigned long)(achieved_mhz % 1000u),
+               (unsigned long)t->rate_hz,
+               (unsigned)t->frame_bytes,
+               (unsigned long)link_hz,
+               (unsigned long)t->baud);
+    log_printf("Telemetry: %lu frames, %lu overruns, %lu TX drops, pack max %lu us\r\n",
+               (unsigned long)t->stats.frames,
+               (unsigned long)t->stats.overruns,
+               (unsigned long)t->stats.tx_drops,
+               (unsigned long)(t->stats.pack_cycles_max / cycles_per_us));
+}
@@ -7,6 +7,7 @@
 *******************************************************************************/
 
 #include "tmc5240.h"
+#include "logging.h"
 
 #include <stdio.h>
 
@@ -51,7 +52,7 @@ int32_t tmc5240_readRegister(uint16_t icID, uint8_t address, bool cs_override)
     }
     else if (bus == IC_BUS_UART)
     {
-        printf("UART read not implemented\r\n");
+        log_printf("UART read not implemented\r\n");
     }
     return -1;
 }
@@ -66,7 +67,7 @@ void tmc5240_writeRegister(uint16_t icID, uint8_t address, int32_t value, bool c
     }
     else if (bus == IC_BUS_UART)
     {
-        printf("UART write not implemented\r\n");
+        log_printf("UART write not implemented\r\n");
     }
 }
 
@@ -161,7 +162,8 @@ void tmc5240_rotateMotor(uint16_t icID, int32_t velocity)
         return;
 
     tmc5240_writeRegister(icID, TMC5240_VMAX, (velocity < 0) ? -velocity : velocity, false);
-    tmc5240_fieldWrite(icID, TMC5240_RAMPMODE_FIELD, (velocity >= 0) ? TMC5240_MODE_VELPOS : TMC5240_MODE_VELNEG);
+    // RAMPMODE holds only the mode bits, so skip the read-modify-write
+    tmc5240_writeRegister(icID, TMC5240_RAMPMODE, (velocity >= 0) ? TMC5240_MODE_VELPOS : TMC5240_MODE_VELNEG, false);
 }
 
 static uint8_t CRC8(uint8_t *data, uint32_t bytes)
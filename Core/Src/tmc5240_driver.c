@@ -1,12 +1,21 @@
 #include "tmc5240_driver.h"
 #include "util.h"
+#include "logging.h"
 #include <stdio.h>
+#include <math.h>
 
 /* --------------------------------------------------------------------------
  * Driver registry (IC ID → context)
  * -------------------------------------------------------------------------- */
 
-#define TMC5240_MAX_IC  4
+#define TMC5240_MAX_IC  TMC5240_MOTORS
+
+/* Hot ops get external linkage when stepper.c binds this driver at build time */
+#ifdef STEPPER_STATIC_TMC5240
+#define TMC5240_HOT_OP
+#else
+#define TMC5240_HOT_OP static
+#endif
 
 static TMC5240_Context *tmc_ctx_table[TMC5240_MAX_IC] = {0};
 
@@ -21,13 +30,84 @@ static inline TMC5240_Context *ctx_from_id(uint16_t icID)
  * Trinamic HAL required callbacks
  * -------------------------------------------------------------------------- */
 
+/*
+ * Mirror writes to the ramp registers so the position predictor can follow
+ * the ramp generator without reading it back.
+ */
+static void tmc5240_shadow_write(TMC5240_Context *ctx, const uint8_t *data, size_t len)
+{
+    if (len < 5 || !(data[0] & TMC5240_WRITE_BIT))
+        return;
+
+    int32_t value = ((int32_t)data[1] << 24) | ((int32_t)data[2] << 16) |
+                    ((int32_t)data[3] <<  8) | ((int32_t)data[4]);
+
+    switch (data[0] & TMC5240_ADDRESS_MASK)
+    {
+    case TMC5240_RAMPMODE: ctx->shadow_rampmode = (uint8_t)value; break;
+    case TMC5240_XTARGET:  ctx->shadow_xtarget = value;           break;
+    case TMC5240_VMAX:     ctx->shadow_vmax = (uint32_t)value;    break;
+    case TMC5240_AMAX:     ctx->shadow_amax = (uint32_t)value;    break;
+    case TMC5240_DMAX:     ctx->shadow_dmax = (uint32_t)value;    break;
+    case TMC5240_XACTUAL:  ctx->shadow_xactual = true;            break;
+    default:
+        return;
+    }
+
+    ctx->shadow_stamp = DWT->CYCCNT;
+    ctx->shadow_gen++;
+}
+
+/*
+ * Every reply answers the read request of the previous frame to the same
+ * IC; keep the registers telemetry wants whenever they pass by.
+ */
+static void tmc5240_sample_reply(TMC5240_Context *ctx, const uint8_t *tx, const uint8_t *rx, size_t len)
+{
+    if (len < 5)
+        return;
+
+    uint32_t now = DWT->CYCCNT;
+    int32_t value = ((int32_t)rx[1] << 24) | ((int32_t)rx[2] << 16) |
+                    ((int32_t)rx[3] <<  8) | ((int32_t)rx[4]);
+
+    if (ctx->spi_read_pending)
+    {
+        switch (ctx->spi_read_addr)
+        {
+        case TMC5240_XACTUAL:
+            ctx->sample.xactual = value;
+            ctx->sample.xactual_stamp = now;
+            break;
+        case TMC5240_VACTUAL:
+            ctx->sample.vactual = (int32_t)((uint32_t)value << 8) >> 8;
+            ctx->sample.vactual_stamp = now;
+            break;
+        case TMC5240_DRVSTATUS:
+            ctx->sample.drv_status = (uint32_t)value;
+            ctx->sample.drv_status_stamp = now;
+            break;
+        default:
+            break;
+        }
+    }
+
+    ctx->spi_read_pending = !(tx[0] & TMC5240_WRITE_BIT);
+    ctx->spi_read_addr = tx[0] & TMC5240_ADDRESS_MASK;
+    ctx->spi_status = rx[0];
+    ctx->spi_status_stamp = now;
+}
+
 void tmc5240_readWriteSPI(uint16_t icID, uint8_t *data, size_t len, bool cs_override)
 {
     TMC5240_Context *ctx = ctx_from_id(icID);
     if (!ctx || !ctx->hspi)
         return;
 
+    tmc5240_shadow_write(ctx, data, len);
+
     uint8_t rx[5] = {0};
+    uint32_t start = DWT->CYCCNT;
 
     if (!cs_override)
     {
@@ -43,6 +123,10 @@ void tmc5240_readWriteSPI(uint16_t icID, uint8_t *data, size_t len, bool cs_over
         HAL_GPIO_WritePin(ctx->cs_port, ctx->cs_pin, GPIO_PIN_SET);
     }
 
+    ctx->spi_frames++;
+    ctx->spi_cycles += DWT->CYCCNT - start;
+    tmc5240_sample_reply(ctx, data, rx, len);
+
     for (size_t i = 0; i < len; i++)
         data[i] = rx[i];
 }
@@ -55,11 +139,114 @@ void tmc5240_fast_writeSPI(uint16_t icID, uint8_t *data, size_t len)
 
     uint8_t rx[5] = {0};
 
+    tmc5240_shadow_write(ctx, data, len);
+    uint32_t start = DWT->CYCCNT;
     HAL_GPIO_WritePin(ctx->cs_port, ctx->cs_pin, GPIO_PIN_RESET);
 
     HAL_SPI_TransmitReceive(ctx->hspi, data, rx, len, HAL_MAX_DELAY);
 
     HAL_GPIO_WritePin(ctx->cs_port, ctx->cs_pin, GPIO_PIN_SET);
+
+    ctx->spi_frames++;
+    ctx->spi_cycles += DWT->CYCCNT - start;
+    tmc5240_sample_reply(ctx, data, rx, len);
+}
+
+/*
+ * Read one register from several ICs with the buses running in parallel.
+ * Each wave starts at most one frame per SPI bus (interrupt mode) and waits
+ * for all of them; the request wave for every IC precedes every reply wave,
+ * so the latch instants (CS rising edge of the request) stay clustered.
+ */
+void tmc5240_read_batch(TMC5240_Context *const *ctxs, uint8_t count,
+                        uint8_t address, int32_t *values, uint32_t *latched_at)
+{
+    uint8_t tx[TMC5240_MAX_IC][5];
+    uint8_t rx[TMC5240_MAX_IC][5];
+
+    if (!ctxs || !values || count > TMC5240_MAX_IC)
+        return;
+
+    for (uint8_t pass = 0; pass < 2; pass++)
+    {
+        uint32_t remaining = (count >= 32) ? 0xFFFFFFFFu : (1u << count) - 1u;
+
+        while (remaining)
+        {
+            uint32_t wave = 0;
+            SPI_HandleTypeDef *taken[TMC5240_MAX_IC];
+            uint8_t taken_count = 0;
+
+            for (uint8_t i = 0; i < count; i++)
+            {
+                if (!(remaining & (1u << i)))
+                    continue;
+
+                /* One frame per bus per wave */
+                uint8_t t = 0;
+                while (t < taken_count && taken[t] != ctxs[i]->hspi)
+                    t++;
+                if (t < taken_count)
+                    continue;
+                taken[taken_count++] = ctxs[i]->hspi;
+
+                for (uint8_t b = 0; b < 5; b++)
+                    tx[i][b] = 0;
+                tx[i][0] = address & TMC5240_ADDRESS_MASK;
+
+                HAL_GPIO_WritePin(ctxs[i]->cs_port, ctxs[i]->cs_pin, GPIO_PIN_RESET);
+                for (volatile int d = 0; d < 20; d++);
+
+                if (HAL_SPI_TransmitReceive_IT(ctxs[i]->hspi, tx[i], rx[i], 5) != HAL_OK)
+                    HAL_SPI_TransmitReceive(ctxs[i]->hspi, tx[i], rx[i], 5, HAL_MAX_DELAY);
+
+                ctxs[i]->spi_frames++;
+                wave |= 1u << i;
+            }
+
+            /* Release each CS as soon as its frame completes */
+            uint32_t busy = wave;
+            while (busy)
+            {
+                for (uint8_t i = 0; i < count; i++)
+                {
+                    if (!(busy & (1u << i)) ||
+                        HAL_SPI_GetState(ctxs[i]->hspi) != HAL_SPI_STATE_READY)
+                        continue;
+
+                    HAL_GPIO_WritePin(ctxs[i]->cs_port, ctxs[i]->cs_pin, GPIO_PIN_SET);
+                    if (pass == 0 && latched_at)
+                        latched_at[i] = DWT->CYCCNT;
+                    busy &= ~(1u << i);
+                }
+            }
+
+            remaining &= ~wave;
+        }
+
+        for (uint8_t i = 0; i < count; i++)
+            tmc5240_sample_reply(ctxs[i], tx[i], rx[i], 5);
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+        values[i] = ((int32_t)rx[i][1] << 24) | ((int32_t)rx[i][2] << 16) |
+                    ((int32_t)rx[i][3] <<  8) | ((int32_t)rx[i][4]);
+}
+
+int32_t tmc5240_frame(TMC5240_Context *ctx, uint8_t address, int32_t value, bool write)
+{
+    uint8_t data[5];
+
+    data[0] = write ? (address | TMC5240_WRITE_BIT) : (address & TMC5240_ADDRESS_MASK);
+    data[1] = 0xFF & (value >> 24);
+    data[2] = 0xFF & (value >> 16);
+    data[3] = 0xFF & (value >> 8);
+    data[4] = 0xFF & (value >> 0);
+
+    tmc5240_readWriteSPI(ctx->icID, data, sizeof(data), false);
+
+    return ((int32_t)data[1] << 24) | ((int32_t)data[2] << 16) |
+           ((int32_t)data[3] <<  8) | ((int32_t)data[4]);
 }
 
 bool tmc5240_readWriteUART(uint16_t icID,
@@ -96,7 +283,8 @@ static void tmc5240_init(Stepper *s)
     tmc_ctx_table[ctx->icID] = ctx;
 
     /* Core driver configuration - matches working main.c */
-    tmc5240_writeRegister(ctx->icID, TMC5240_GCONF, 0x00000008, false);
+    ctx->gconf = 0x00000008;
+    tmc5240_writeRegister(ctx->icID, TMC5240_GCONF, ctx->gconf, false);
     tmc5240_writeRegister(ctx->icID, TMC5240_DRV_CONF, 0x00000020, false);
     tmc5240_writeRegister(ctx->icID, TMC5240_GLOBAL_SCALER, 0x00000000, false);
     
@@ -107,12 +295,28 @@ static void tmc5240_init(Stepper *s)
     /* Chopper configuration - CRITICAL: use full value from working code */
     tmc5240_writeRegister(ctx->icID, TMC5240_CHOPCONF, 0x10410153, false);
     /* Motion parameters */
+    ctx->ramp_scale = STEPPER_RAMP_SCALE_ONE;
     tmc5240_writeRegister(ctx->icID, TMC5240_AMAX, ctx->amax, false);
     tmc5240_writeRegister(ctx->icID, TMC5240_DMAX, ctx->dmax, false);
     tmc5240_writeRegister(ctx->icID, TMC5240_VMAX, ctx->vmax, false);
-    tmc5240_writeRegister(ctx->icID, TMC5240_TVMAX, 0x00000F8D, false);
+
+    if (!ctx->d1)    ctx->d1 = TMC5240_D1_DEFAULT;
+    if (!ctx->d2)    ctx->d2 = TMC5240_D2_DEFAULT;
+    if (!ctx->vstop) ctx->vstop = TMC5240_VSTOP_DEFAULT;
+    if (!ctx->tvmax) ctx->tvmax = TMC5240_TVMAX_DEFAULT;
+    tmc5240_writeRegister(ctx->icID, TMC5240_VSTART, ctx->vstart, false);
+    tmc5240_writeRegister(ctx->icID, TMC5240_A1, ctx->a1, false);
+    tmc5240_writeRegister(ctx->icID, TMC5240_V1, ctx->v1, false);
+    tmc5240_writeRegister(ctx->icID, TMC5240_A2, ctx->a2, false);
+    tmc5240_writeRegister(ctx->icID, TMC5240_V2, ctx->v2, false);
+    tmc5240_writeRegister(ctx->icID, TMC5240_D2, ctx->d2, false);
+    tmc5240_writeRegister(ctx->icID, TMC5240_D1, ctx->d1, false);
+    tmc5240_writeRegister(ctx->icID, TMC5240_VSTOP, ctx->vstop, false);
+    tmc5240_writeRegister(ctx->icID, TMC5240_TZEROWAIT, ctx->tzerowait, false);
+    tmc5240_writeRegister(ctx->icID, TMC5240_TVMAX, ctx->tvmax, false);
 
     /* Position mode */
+    ctx->rampmode = TMC5240_MODE_POSITION;
     tmc5240_writeRegister(ctx->icID, TMC5240_RAMPMODE, TMC5240_MODE_POSITION, false);
     
     /* Reset position */
@@ -127,15 +331,71 @@ static void tmc5240_enable(Stepper *s, bool en)
     HAL_GPIO_WritePin(ctx->enable_port, ctx->enable_pin, en ? GPIO_PIN_RESET : GPIO_PIN_SET);
     tmc5240_writeRegister(ctx->icID,
                           TMC5240_GCONF,
-                          en ? 0x00000008 : 0x00000000, false);
+                          en ? ctx->gconf : 0x00000000, false);
+}
+
+/*
+ * With the internal ramp generator (SD_MODE=0) DIAG0 is the interrupt
+ * output: the RAMP_STAT event flags are ORed onto it. Push-pull makes it
+ * active high so the EXTI line triggers on the rising edge; diag0_stall
+ * adds StallGuard to the same line.
+ */
+#define TMC5240_GCONF_DIAG0_EVENTS  (TMC5240_DIAG0_INT_PUSHPULL_MASK | \
+                                     TMC5240_DIAG0_STALL_STEP_MASK)
+
+#define TMC5240_RAMPSTAT_EVENTS     (TMC5240_RS_EV_POSREACHED | \
+                                     TMC5240_RS_EV_STOP_SG    | \
+                                     TMC5240_RS_EV_STOPL      | \
+                                     TMC5240_RS_EV_STOPR)
+
+static void tmc5240_enable_events(Stepper *s, bool enable)
+{
+    TMC5240_Context *ctx = s->hw_context;
+
+    if (enable)
+        ctx->gconf |= TMC5240_GCONF_DIAG0_EVENTS;
+    else
+        ctx->gconf &= ~TMC5240_GCONF_DIAG0_EVENTS;
+
+    /* Drop stale events so the line starts inactive */
+    tmc5240_writeRegister(ctx->icID, TMC5240_RAMPSTAT, TMC5240_RAMPSTAT_EVENTS, false);
+
+    /* A disabled driver picks up ctx->gconf in tmc5240_enable */
+    if (s->enabled)
+        tmc5240_writeRegister(ctx->icID, TMC5240_GCONF, ctx->gconf, false);
+}
+
+TMC5240_HOT_OP uint32_t tmc5240_read_events(Stepper *s)
+{
+    TMC5240_Context *ctx = s->hw_context;
+    uint32_t st = tmc5240_readRegister(ctx->icID, TMC5240_RAMPSTAT, false);
+    uint32_t pending = st & TMC5240_RAMPSTAT_EVENTS;
+    uint32_t ev = 0;
+
+    if (!pending)
+        return 0;
+
+    /* Event flags are write-1-to-clear; this also releases DIAG0 */
+    tmc5240_writeRegister(ctx->icID, TMC5240_RAMPSTAT, pending, false);
+
+    if (pending & TMC5240_RS_EV_POSREACHED) ev |= STEPPER_EVT_DONE;
+    if (pending & TMC5240_RS_EV_STOP_SG)    ev |= STEPPER_EVT_STALL;
+    if (pending & TMC5240_RS_EV_STOPL)      ev |= STEPPER_EVT_LIMIT_L;
+    if (pending & TMC5240_RS_EV_STOPR)      ev |= STEPPER_EVT_LIMIT_R;
+
+    return ev;
+}
+
+static void tmc5240_set_rampmode(TMC5240_Context *ctx, uint8_t mode)
+{
+    ctx->rampmode = mode;
+    tmc5240_writeRegister(ctx->icID, TMC5240_RAMPMODE, mode, false);
 }
 
 static void tmc5240_set_dir(Stepper *s, bool dir)
 {
     TMC5240_Context *ctx = s->hw_context;
-    tmc5240_writeRegister(ctx->icID,
-        TMC5240_RAMPMODE,
-        dir ? TMC5240_MODE_VELPOS : TMC5240_MODE_VELNEG, false);
+    tmc5240_set_rampmode(ctx, dir ? TMC5240_MODE_VELPOS : TMC5240_MODE_VELNEG);
 }
 
 static void tmc5240_step_pulse(Stepper *s)
@@ -144,24 +404,404 @@ static void tmc5240_step_pulse(Stepper *s)
     /* No-op: internal ramp generator */
 }
 
-static void tmc5240_move_to(Stepper *s, int32_t pos)
+TMC5240_HOT_OP void tmc5240_move_to(Stepper *s, int32_t pos)
 {
     TMC5240_Context *ctx = s->hw_context;
-    tmc5240_writeRegister(ctx->icID, TMC5240_RAMPMODE, TMC5240_MODE_POSITION, false);
+    tmc5240_set_rampmode(ctx, TMC5240_MODE_POSITION);
     tmc5240_writeRegister(ctx->icID, TMC5240_XTARGET, pos, false);
 }
 
-static int32_t tmc5240_get_position(Stepper *s)
+/* VMAX for a speed in steps/s, saturated at the register limit */
+static inline uint32_t tmc5240_vmax_clamped(uint32_t sps)
+{
+    if ((float)sps >= TMC5240_MAX_SPS)
+        return TMC5240_MAX_VELOCITY;
+    return tmc5240_vmax_from_sps((float)sps);
+}
+
+/*
+ * Velocity mode: VMAX carries the magnitude, RAMPMODE the sign. RAMPMODE
+ * is only rewritten when the sign (or position mode) changes, so steady
+ * velocity streaming costs a single VMAX frame. The magnitude saturates
+ * at TMC5240_MAX_SPS, so callers may pass any int32_t.
+ */
+TMC5240_HOT_OP void tmc5240_set_velocity(Stepper *s, int32_t steps_per_s)
 {
     TMC5240_Context *ctx = s->hw_context;
-    return tmc5240_readRegister(ctx->icID, TMC5240_XACTUAL, false);
+    uint8_t mode;
+
+    if (steps_per_s > 0)
+        mode = TMC5240_MODE_VELPOS;
+    else if (steps_per_s < 0)
+        mode = TMC5240_MODE_VELNEG;
+    else if (ctx->rampmode == TMC5240_MODE_VELPOS || ctx->rampmode == TMC5240_MODE_VELNEG)
+        mode = ctx->rampmode;      /* Stop: ramp down in the current direction */
+    else
+        mode = TMC5240_MODE_VELPOS;
+
+    /* Negate in unsigned: -INT32_MIN overflows int32_t */
+    uint32_t mag = (steps_per_s < 0) ? 0u - (uint32_t)steps_per_s : (uint32_t)steps_per_s;
+
+    /* VMAX no longer holds the nominal ramp; force a rewrite on next move */
+    ctx->ramp_scale = 0;
+    tmc5240_writeRegister(ctx->icID, TMC5240_VMAX, tmc5240_vmax_clamped(mag), false);
+
+    if (ctx->rampmode != mode)
+        tmc5240_set_rampmode(ctx, mode);
+}
+
+static uint32_t tmc5240_scale(uint32_t value, uint32_t scale_q16)
+{
+    uint32_t v = (uint32_t)(((uint64_t)value * scale_q16) >> 16);
+    return (v == 0 && value != 0) ? 1u : v;
+}
+
+TMC5240_HOT_OP void tmc5240_set_ramp_scale(Stepper *s, uint32_t scale_q16)
+{
+    TMC5240_Context *ctx = s->hw_context;
+
+    if (ctx->ramp_scale == scale_q16)
+        return;
+
+    ctx->ramp_scale = scale_q16;
+    tmc5240_writeRegister(ctx->icID, TMC5240_AMAX, tmc5240_scale(ctx->amax, scale_q16), false);
+    tmc5240_writeRegister(ctx->icID, TMC5240_DMAX, tmc5240_scale(ctx->dmax, scale_q16), false);
+    tmc5240_writeRegister(ctx->icID, TMC5240_VMAX, tmc5240_scale(ctx->vmax, scale_q16), false);
+}
+
+/* Explicit limits leave ramp_scale: the next scaled move rewrites all three */
+static void tmc5240_set_ramp_limits(Stepper *s, uint32_t v_sps, uint32_t accel_sps2)
+{
+    TMC5240_Context *ctx = s->hw_context;
+    uint32_t a = tmc5240_amax_from_sps2((float)accel_sps2);
+
+    ctx->ramp_scale = 0;
+    if (ctx->shadow_amax != a)
+        tmc5240_writeRegister(ctx->icID, TMC5240_AMAX, a, false);
+    if (ctx->shadow_dmax != a)
+        tmc5240_writeRegister(ctx->icID, TMC5240_DMAX, a, false);
+    if (v_sps)
+        tmc5240_writeRegister(ctx->icID, TMC5240_VMAX, tmc5240_vmax_clamped(v_sps), false);
+}
+
+/* Ramp registers fitted to a duration */
+typedef struct
+{
+    uint32_t vmax;
+    uint32_t amax;
+    uint32_t dmax;
+    uint32_t time_us;
+} TMC5240_TimedRamp;
+
+static inline uint32_t tmc5240_timed_scale(uint32_t value, float k)
+{
+    uint32_t v = (uint32_t)(k * (float)value + 0.5f);
+    return v ? v : 1u;
+}
+
+/* Arrival time of the axis ramp with VMAX/AMAX/DMAX replaced */
+static uint32_t tmc5240_timed_time_us(const TMC5240_Ramp *nominal, uint32_t vmax,
+                                      uint32_t amax, uint32_t dmax, uint32_t distance)
+{
+    TMC5240_Ramp r = *nominal;
+
+    r.vmax = vmax;
+    r.amax = amax;
+    r.dmax = dmax;
+    return tmc5240_ramp_time_us(&r, distance);
+}
+
+/*
+ * Find the axis ramp whose quantized duration is closest to duration_us.
+ * Ramp time falls monotonically with a uniform scale k of the nominal
+ * registers, so k is bisected first. VMAX has coarse LSBs on slow axes,
+ * so for each VMAX near the result (and for nominal VMAX, which turns short
+ * moves into triangles) the AMAX register is bisected over integers, DMAX
+ * keeping its nominal ratio, to cancel the rounding.
+ */
+static void tmc5240_timed_solve(const TMC5240_Ramp *nominal, uint32_t distance,
+                                uint32_t duration_us, TMC5240_TimedRamp *r)
+{
+    float lo = 0.0f;
+    float hi = 1.0f;
+
+    for (uint8_t n = 0; n < 24; n++) {
+        float k = 0.5f * (lo + hi);
+        uint32_t t = tmc5240_timed_time_us(nominal,
+                                           tmc5240_timed_scale(nominal->vmax, k),
+                                           tmc5240_timed_scale(nominal->amax, k),
+                                           tmc5240_timed_scale(nominal->dmax, k),
+                                           distance);
+        if (t > duration_us)
+            lo = k;
+        else
+            hi = k;
+    }
+
+    uint32_t v0 = tmc5240_timed_scale(nominal->vmax, hi);
+    uint32_t best = UINT32_MAX;
+
+    /* VMAX near the scaled value, plus nominal VMAX for a pure triangle */
+    for (int32_t dv = -2; dv <= 3; dv++) {
+        int32_t v = (dv == 3) ? (int32_t)nominal->vmax : (int32_t)v0 + dv;
+        if (v < 1 || (uint32_t)v > nominal->vmax)
+            continue;
+
+        /* Largest AMAX whose ramp still takes at least duration_us */
+        uint32_t a_lo = 1;
+        uint32_t a_hi = nominal->amax;
+        while (a_lo < a_hi) {
+            uint32_t a = a_lo + (a_hi - a_lo + 1) / 2;
+            uint32_t d = (uint32_t)(((uint64_t)a * nominal->dmax + nominal->amax / 2) / nominal->amax);
+            if (tmc5240_timed_time_us(nominal, (uint32_t)v, a, d ? d : 1u, distance) >= duration_us)
+                a_lo = a;
+            else
+                a_hi = a - 1;
+        }
+
+        /* It or the next step up lands closest */
+        for (uint32_t a = a_lo; a <= a_lo + 1 && a <= nominal->amax; a++) {
+            uint32_t d = (uint32_t)(((uint64_t)a * nominal->dmax + nominal->amax / 2) / nominal->amax);
+            d = d ? d : 1u;
+            uint32_t t = tmc5240_timed_time_us(nominal, (uint32_t)v, a, d, distance);
+            uint32_t err = (t > duration_us) ? t - duration_us : duration_us - t;
+            if (err < best) {
+                best = err;
+                r->vmax = (uint32_t)v;
+                r->amax = a;
+                r->dmax = d;
+                r->time_us = t;
+            }
+        }
+    }
 }
 
-static bool tmc5240_position_reached(Stepper *s)
+/*
+ * Synced group moves: the nominal ramp, or the one fitted to duration_us.
+ * Arrival, not readiness for the next move, so TZEROWAIT is left out.
+ */
+static uint32_t tmc5240_timed_ramp(Stepper *s, uint32_t distance,
+                                   uint32_t duration_us, bool load)
+{
+    TMC5240_Context *ctx = s->hw_context;
+    TMC5240_Ramp nominal;
+
+    tmc5240_ramp_nominal(ctx, &nominal);
+    nominal.tzerowait = 0;
+
+    TMC5240_TimedRamp r = {
+        .vmax = ctx->vmax,
+        .amax = ctx->amax,
+        .dmax = ctx->dmax,
+        .time_us = tmc5240_ramp_time_us(&nominal, distance),
+    };
+    if (r.time_us < duration_us)
+        tmc5240_timed_solve(&nominal, distance, duration_us, &r);
+
+    if (load) {
+        ctx->ramp_scale = 0;
+        tmc5240_writeRegister(ctx->icID, TMC5240_AMAX, r.amax, false);
+        tmc5240_writeRegister(ctx->icID, TMC5240_DMAX, r.dmax, false);
+        tmc5240_writeRegister(ctx->icID, TMC5240_VMAX, r.vmax, false);
+    }
+    return r.time_us;
+}
+
+/* Full ramp model at the nominal registers, TZEROWAIT included */
+static uint32_t tmc5240_move_time(const Stepper *s, uint32_t distance)
+{
+    TMC5240_Ramp ramp;
+
+    tmc5240_ramp_nominal(s->hw_context, &ramp);
+    return tmc5240_ramp_time_us(&ramp, distance);
+}
+
+/* New nominal ramp; ramp_scale is dropped so the next move rewrites it */
+static void tmc5240_set_profile(Stepper *s, uint32_t v_sps,
+                                uint32_t accel_sps2, uint32_t decel_sps2)
+{
+    TMC5240_Context *ctx = s->hw_context;
+
+    if (v_sps)
+        ctx->vmax = tmc5240_vmax_clamped(v_sps);
+    if (accel_sps2)
+        ctx->amax = tmc5240_amax_from_sps2((float)accel_sps2);
+    if (decel_sps2)
+        ctx->dmax = tmc5240_amax_from_sps2((float)decel_sps2);
+
+    ctx->ramp_scale = 0;
+}
+
+/* XACTUAL may only be rewritten while the ramp generator is held */
+static void tmc5240_set_position(Stepper *s, int32_t pos)
+{
+    TMC5240_Context *ctx = s->hw_context;
+
+    tmc5240_set_rampmode(ctx, TMC5240_MODE_HOLD);
+    tmc5240_writeRegister(ctx->icID, TMC5240_XACTUAL, pos, false);
+    tmc5240_writeRegister(ctx->icID, TMC5240_XTARGET, pos, false);
+    tmc5240_set_rampmode(ctx, TMC5240_MODE_POSITION);
+}
+
+/*
+ * Arm a hard stop on the reference source and latch XACTUAL into XLATCH on
+ * the switch's active edge. StallGuard stops need TCOOLTHRS programmed so
+ * SG is valid at the seek velocity; they have no latch, XACTUAL at the
+ * stop is used instead.
+ */
+static void tmc5240_home_arm(Stepper *s, StepperHomeSource source)
+{
+    TMC5240_Context *ctx = s->hw_context;
+    uint32_t swmode = 0;
+
+    switch (source)
+    {
+    case STEPPER_HOME_SW_LEFT:
+        swmode = TMC5240_SW_STOPL_ENABLE | TMC5240_SW_LATCH_L_ACT;
+        break;
+    case STEPPER_HOME_SW_RIGHT:
+        swmode = TMC5240_SW_STOPR_ENABLE | TMC5240_SW_LATCH_R_ACT;
+        break;
+    case STEPPER_HOME_STALL:
+        swmode = TMC5240_SW_SG_STOP;
+        break;
+    default:
+        break;
+    }
+
+    ctx->home_source = source;
+    tmc5240_writeRegister(ctx->icID, TMC5240_SWMODE, swmode, false);
+
+    /* Clear stale stop events and latch flags (write-1-to-clear) */
+    tmc5240_writeRegister(ctx->icID, TMC5240_RAMPSTAT,
+                          TMC5240_RS_EV_STOPL | TMC5240_RS_EV_STOPR |
+                          TMC5240_RS_EV_STOP_SG |
+                          TMC5240_RS_LATCHL | TMC5240_RS_LATCHR, false);
+}
+
+static uint32_t tmc5240_home_status(Stepper *s, int32_t *latch)
 {
     TMC5240_Context *ctx = s->hw_context;
     uint32_t st = tmc5240_readRegister(ctx->icID, TMC5240_RAMPSTAT, false);
-    return (st & TMC5240_POSITION_REACHED_MASK) != 0;
+    uint32_t result = 0;
+
+    if ((st & (TMC5240_RS_EV_STOPL | TMC5240_RS_EV_STOPR | TMC5240_RS_EV_STOP_SG)) ||
+        ((st & TMC5240_RS_VZERO) && (st & (TMC5240_RS_STOPL | TMC5240_RS_STOPR))))
+        result |= STEPPER_HOME_STOPPED;
+
+    if (ctx->home_source == STEPPER_HOME_STALL)
+    {
+        if (result & STEPPER_HOME_STOPPED)
+        {
+            result |= STEPPER_HOME_LATCHED;
+            if (latch)
+                *latch = tmc5240_readRegister(ctx->icID, TMC5240_XACTUAL, false);
+        }
+    }
+    else if (st & (TMC5240_RS_LATCHL | TMC5240_RS_LATCHR))
+    {
+        result |= STEPPER_HOME_LATCHED;
+        if (latch)
+            *latch = tmc5240_readRegister(ctx->icID, TMC5240_XLATCH, false);
+    }
+
+    return result;
+}
+
+TMC5240_HOT_OP int32_t tmc5240_get_position(Stepper *s)
+{
+    TMC5240_Context *ctx = s->hw_context;
+    return tmc5240_readRegister(ctx->icID, TMC5240_XACTUAL, false);
+}
+
+/*
+ * Every reply starts with the SPI status byte, which carries
+ * position_reached, so a single frame answers the completion check. The
+ * RAMPSTAT request it leaves pending is discarded by the next read.
+ */
+TMC5240_HOT_OP bool tmc5240_position_reached(Stepper *s)
+{
+    TMC5240_Context *ctx = s->hw_context;
+
+    tmc5240_frame(ctx, TMC5240_RAMPSTAT, 0, false);
+    return (ctx->spi_status & TMC5240_SPI_STATUS_POSITION_REACHED_MASK) != 0;
+}
+
+/*
+ * Lower bound on the time to cover `remaining` steps from |VACTUAL|. The
+ * six-point ramp accelerates at A1 or A2 below V1 / V2 and may start at
+ * VSTART, so no single band can be trusted: the speed jumps to VSTART at
+ * once, rises at the steepest of A1, A2, AMAX, DMAX, D2 and D1 to the
+ * fastest of VMAX, VSTART and VSTOP, and never slows down. The real ramp
+ * is slower in every phase, so completion cannot happen before this.
+ */
+static uint32_t tmc5240_arrival_bound_us(const TMC5240_Context *ctx,
+                                         uint32_t remaining, int32_t vactual)
+{
+    TMC5240_Ramp n;
+    uint32_t a_reg = ctx->shadow_amax;
+    uint32_t v_reg = ctx->shadow_vmax;
+
+    tmc5240_ramp_nominal(ctx, &n);
+    if (n.a1 > a_reg) a_reg = n.a1;
+    if (n.a2 > a_reg) a_reg = n.a2;
+    if (ctx->shadow_dmax > a_reg) a_reg = ctx->shadow_dmax;
+    if (n.d2 > a_reg) a_reg = n.d2;
+    if (n.d1 > a_reg) a_reg = n.d1;
+    if (n.vstart > v_reg) v_reg = n.vstart;
+    if (n.vstop > v_reg) v_reg = n.vstop;
+
+    float v0 = fabsf(tmc5240_sps_from_vmax(vactual));
+    float vs = tmc5240_sps_from_vmax((int32_t)n.vstart);
+    float vm = tmc5240_sps_from_vmax((int32_t)v_reg);
+    float a = tmc5240_sps2_from_amax(a_reg);
+    float r = (float)remaining;
+    float t;
+
+    if (vs > v0)
+        v0 = vs;
+
+    if (v0 >= vm || a <= 0.0f) {
+        float v = (v0 > vm) ? v0 : vm;
+        if (v <= 0.0f)
+            return 0;
+        t = r / v;
+    } else {
+        float d_acc = (vm * vm - v0 * v0) / (2.0f * a);
+        if (d_acc >= r)
+            t = (sqrtf(v0 * v0 + 2.0f * a * r) - v0) / a;
+        else
+            t = (vm - v0) / a + (r - d_acc) / vm;
+    }
+
+    return (t >= 4000.0f) ? 4000000000u : (uint32_t)(t * 1e6f);
+}
+
+/*
+ * Completion check plus arrival bound in three chained frames: the
+ * XACTUAL request, the VACTUAL request (returns XACTUAL) and a RAMPSTAT
+ * request (returns VACTUAL and a fresh status byte).
+ */
+TMC5240_HOT_OP bool tmc5240_poll_motion(Stepper *s, uint32_t *quiet_us)
+{
+    TMC5240_Context *ctx = s->hw_context;
+
+    tmc5240_frame(ctx, TMC5240_XACTUAL, 0, false);
+    int32_t x = tmc5240_frame(ctx, TMC5240_VACTUAL, 0, false);
+    int32_t v = tmc5240_frame(ctx, TMC5240_RAMPSTAT, 0, false);
+
+    if (ctx->spi_status & TMC5240_SPI_STATUS_POSITION_REACHED_MASK)
+        return true;
+
+    /* VACTUAL is 24-bit signed */
+    v = (int32_t)((uint32_t)v << 8) >> 8;
+
+    int32_t d = ctx->shadow_xtarget - x;
+    uint32_t remaining = (d >= 0) ? (uint32_t)d : (uint32_t)-d;
+
+    if (quiet_us)
+        *quiet_us = tmc5240_arrival_bound_us(ctx, remaining, v);
+    return false;
 }
 
 /* --------------------------------------------------------------------------
@@ -169,8 +809,7 @@ static bool tmc5240_position_reached(Stepper *s)
  * -------------------------------------------------------------------------- */
 
 const StepperDriver TMC5240_Driver = {
-    .caps = STEPPER_CAP_MOVE_TO | 
-            STEPPER_CAP_POSITION_FB,
+    .caps             = TMC5240_DRIVER_CAPS,
     .init             = tmc5240_init,
     .set_enable       = tmc5240_enable,
     .set_dir          = tmc5240_set_dir,
@@ -178,8 +817,202 @@ const StepperDriver TMC5240_Driver = {
     .move_to          = tmc5240_move_to,
     .get_position     = tmc5240_get_position,
     .position_reached = tmc5240_position_reached,
+    .poll_motion      = tmc5240_poll_motion,
+    .set_ramp_scale   = tmc5240_set_ramp_scale,
+    .set_velocity     = tmc5240_set_velocity,
+    .set_ramp_limits  = tmc5240_set_ramp_limits,
+    .timed_ramp       = tmc5240_timed_ramp,
+    .move_time        = tmc5240_move_time,
+    .set_profile      = tmc5240_set_profile,
+    .enable_events    = tmc5240_enable_events,
+    .read_events      = tmc5240_read_events,
+    .set_position     = tmc5240_set_position,
+    .home_arm         = tmc5240_home_arm,
+    .home_status      = tmc5240_home_status,
 };
 
+/* --------------------------------------------------------------------------
+ * Ramp timing model
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Integer form of the full ramp, in ramp generator clocks and 1/256 steps.
+ * With v in VMAX units and a in AMAX units:
+ *   time to change speed by dv at a    = dv * 2^17 / a        clocks
+ *   distance to go from v0 to v1 at a  = (v1^2 - v0^2) / a    1/256 steps
+ *   time to cover x (1/256 steps) at v = x * 2^16 / v         clocks
+ * TVMAX forces a constant-velocity plateau of at least TVMAX between
+ * acceleration and deceleration, so a short move peaks below VMAX and
+ * still cruises for TVMAX.
+ */
+typedef struct
+{
+    uint64_t clocks;
+    uint64_t dist_q8;
+} TMC5240_RampSpan;
+
+static bool tmc5240_ramp_phase(TMC5240_RampSpan *span, uint32_t v0, uint32_t v1, uint32_t a)
+{
+    uint32_t dv = (v1 > v0) ? v1 - v0 : v0 - v1;
+
+    if (dv == 0)
+        return true;
+    if (a == 0)
+        return false;
+
+    uint64_t lo = (v1 > v0) ? v0 : v1;
+    uint64_t hi = (v1 > v0) ? v1 : v0;
+
+    span->clocks += ((uint64_t)dv << 17) / a;
+    span->dist_q8 += (hi * hi - lo * lo) / a;
+    return true;
+}
+
+/* VSTART up to vp through the A1 / A2 / AMAX bands */
+static bool tmc5240_ramp_up(const TMC5240_Ramp *r, uint32_t vp, TMC5240_RampSpan *span)
+{
+    uint32_t v = r->vstart;
+
+    while (v < vp) {
+        uint32_t a = r->amax;
+        uint32_t end = vp;
+
+        if (v < r->v1) {
+            a = r->a1;
+            end = r->v1;
+        } else if (v < r->v2) {
+            a = r->a2;
+            end = r->v2;
+        }
+        if (end > vp)
+            end = vp;
+        if (!tmc5240_ramp_phase(span, v, end, a))
+            return false;
+        v = end;
+    }
+    return true;
+}
+
+/* vp down to VSTOP through the DMAX / D2 / D1 bands */
+static bool tmc5240_ramp_down(const TMC5240_Ramp *r, uint32_t vp, TMC5240_RampSpan *span)
+{
+    uint32_t v = vp;
+
+    while (v > r->vstop) {
+        uint32_t d = r->d1;
+        uint32_t end = r->vstop;
+
+        if (v > r->v2 && v > r->v1) {
+            d = r->dmax;
+            end = (r->v2 > r->v1) ? r->v2 : r->v1;
+        } else if (v > r->v1) {
+            d = r->d2;
+            end = r->v1;
+        }
+        if (end < r->vstop)
+            end = r->vstop;
+        if (!tmc5240_ramp_phase(span, v, end, d))
+            return false;
+        v = end;
+    }
+    return true;
+}
+
+/* Acceleration to vp, the TVMAX plateau and deceleration from vp */
+static bool tmc5240_ramp_span(const TMC5240_Ramp *r, uint32_t vp, TMC5240_RampSpan *span)
+{
+    span->clocks = 0;
+    span->dist_q8 = 0;
+
+    if (!tmc5240_ramp_up(r, vp, span) || !tmc5240_ramp_down(r, vp, span))
+        return false;
+
+    span->clocks += (uint64_t)r->tvmax * 512u;
+    span->dist_q8 += ((uint64_t)vp * r->tvmax) >> 7;
+    return true;
+}
+
+void tmc5240_ramp_nominal(const TMC5240_Context *ctx, TMC5240_Ramp *ramp)
+{
+    if (!ctx || !ramp)
+        return;
+
+    ramp->vstart = ctx->vstart;
+    ramp->a1 = ctx->a1;
+    ramp->v1 = ctx->v1;
+    ramp->a2 = ctx->a2;
+    ramp->v2 = ctx->v2;
+    ramp->amax = ctx->amax;
+    ramp->vmax = ctx->vmax;
+    ramp->dmax = ctx->dmax;
+    ramp->d2 = ctx->d2 ? ctx->d2 : TMC5240_D2_DEFAULT;
+    ramp->d1 = ctx->d1 ? ctx->d1 : TMC5240_D1_DEFAULT;
+    ramp->vstop = ctx->vstop ? ctx->vstop : TMC5240_VSTOP_DEFAULT;
+    ramp->tvmax = ctx->tvmax ? ctx->tvmax : TMC5240_TVMAX_DEFAULT;
+    ramp->tzerowait = ctx->tzerowait;
+}
+
+uint32_t tmc5240_ramp_time_us(const TMC5240_Ramp *r, uint32_t distance)
+{
+    if (!r)
+        return UINT32_MAX;
+    if (distance == 0)
+        return 0;
+    if (r->vmax == 0)
+        return UINT32_MAX;
+
+    uint64_t d_q8 = (uint64_t)distance << 8;
+    uint32_t v_lo = (r->vstart > r->vstop) ? r->vstart : r->vstop;
+    uint64_t clocks;
+    TMC5240_RampSpan span;
+
+    if (v_lo > r->vmax)
+        v_lo = r->vmax;
+
+    if (!tmc5240_ramp_span(r, r->vmax, &span))
+        return UINT32_MAX;
+
+    if (span.dist_q8 <= d_q8) {
+        /* Trapezoid: cruise at VMAX for at least TVMAX */
+        clocks = span.clocks + ((d_q8 - span.dist_q8) << 16) / r->vmax;
+    } else {
+        /* VMAX not reached: highest peak whose ramps + TVMAX plateau fit */
+        uint32_t lo = v_lo;
+        uint32_t hi = r->vmax;
+
+        if (!tmc5240_ramp_span(r, lo, &span))
+            return UINT32_MAX;
+
+        if (span.dist_q8 > d_q8) {
+            /* Too short for any ramp: creep at the start/stop speed */
+            if (lo == 0)
+                return UINT32_MAX;
+            clocks = (d_q8 << 16) / lo;
+        } else {
+            while (hi - lo > 1) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                TMC5240_RampSpan probe;
+
+                if (tmc5240_ramp_span(r, mid, &probe) && probe.dist_q8 <= d_q8)
+                    lo = mid;
+                else
+                    hi = mid;
+            }
+            if (lo == 0)
+                return UINT32_MAX;
+            tmc5240_ramp_span(r, lo, &span);
+            clocks = span.clocks + ((d_q8 - span.dist_q8) << 16) / lo;
+        }
+    }
+
+    clocks += (uint64_t)r->tzerowait * 512u;
+    if (clocks > UINT64_MAX / 1000000u)
+        return UINT32_MAX;
+
+    uint64_t us = clocks * 1000000u / TMC5240_FCLK_HZ;
+    return (us >= UINT32_MAX) ? UINT32_MAX : (uint32_t)us;
+}
+
 /* --------------------------------------------------------------------------
  * Debug helpers
  * -------------------------------------------------------------------------- */
@@ -189,9 +1022,9 @@ void tmc5240_driver_print_registers(const TMC5240_Context *ctx)
     if (!ctx)
         return;
 
-    printf("\nTMC5240[%u] registers:\n", ctx->icID);
+    log_printf("\nTMC5240[%u] registers:\n", ctx->icID);
 
-#define R(r) printf("  %-12s 0x%08lX\n", #r, \
+#define R(r) log_printf("  %-12s 0x%08lX\n", #r, \
     (unsigned long)tmc5240_readRegister(ctx->icID, r, false))
 
     R(TMC5240_GCONF);
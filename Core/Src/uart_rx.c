@@ -0,0 +1,295 @@
+/*
+ * uart_rx.c — circular DMA reception with idle-line delivery
+ *
+ * HAL reports the DMA write position (0..UART_RX_DMA_SIZE) with every RX
+ * event. The bytes between the previous position and this one are new;
+ * a position behind the previous one means the DMA wrapped, and the
+ * transfer-complete event reports the end of the buffer.
+ */
+
+#include "uart_rx.h"
+#include "logging.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define UART_RX_BAUD_TIMEOUT_MS     100
+
+/* ============================================================================
+ *  State
+ * ========================================================================== */
+
+static UART_HandleTypeDef *rx_uart;
+static uint8_t rx_dma_buf[UART_RX_DMA_SIZE];
+static volatile size_t rx_dma_pos;          /* Last position consumed from rx_dma_buf */
+
+static lwrb_t rx_ring;
+static uint8_t rx_ring_data[UART_RX_RING_SIZE + 1];
+
+static UartRxNotify rx_notify;
+static UartRxStats rx_stats;
+
+/* Throughput window for uart_rx_print_stats() */
+static uint32_t rx_window_bytes;
+static uint32_t rx_window_tick;
+
+/* ============================================================================
+ *  Internal Helpers
+ * ========================================================================== */
+
+static bool uart_rx_start(void)
+{
+    rx_dma_pos = 0;
+    if (HAL_UARTEx_ReceiveToIdle_DMA(rx_uart, rx_dma_buf, sizeof(rx_dma_buf)) != HAL_OK)
+        return false;
+    return true;
+}
+
+/* Move len bytes of the DMA buffer into the ring (event ISR) */
+static void uart_rx_push(const uint8_t *data, size_t len)
+{
+    size_t free = lwrb_get_free(&rx_ring);
+    size_t n = (len < free) ? len : free;
+
+    if (n > 0)
+        lwrb_write(&rx_ring, data, n);
+
+    rx_stats.bytes += n;
+    rx_stats.dropped += len - n;
+}
+
+/* ============================================================================
+ *  Public API
+ * ========================================================================== */
+
+bool uart_rx_init(UART_HandleTypeDef *huart)
+{
+    if (!huart || !huart->hdmarx || huart->hdmarx->Init.Mode != DMA_CIRCULAR)
+        return false;
+
+    rx_uart = huart;
+    memset(&rx_stats, 0, sizeof(rx_stats));
+    lwrb_init(&rx_ring, rx_ring_data, sizeof(rx_ring_data));
+
+    rx_window_bytes = 0;
+    rx_window_tick = HAL_GetTick();
+
+    return uart_rx_start();
+}
+
+void uart_rx_set_notify(UartRxNotify fn)
+{
+    rx_notify = fn;
+}
+
+size_t uart_rx_available(void)
+{
+    return lwrb_get_full(&rx_ring);
+}
+
+size_t uart_rx_read(void *buf, size_t len)
+{
+    if (!buf)
+        return 0;
+    return lwrb_read(&rx_ring, buf, len);
+}
+
+size_t uart_rx_linear(const uint8_t **data)
+{
+    if (!data)
+        return 0;
+    *data = (const uint8_t *)lwrb_get_linear_block_read_address(&rx_ring);
+    return lwrb_get_linear_block_read_length(&rx_ring);
+}
+
+size_t uart_rx_peek(size_t skip, void *buf, size_t len)
+{
+    if (!buf)
+        return 0;
+    return lwrb_peek(&rx_ring, skip, buf, len);
+}
+
+void uart_rx_skip(size_t len)
+{
+    lwrb_skip(&rx_ring, len);
+}
+
+size_t uart_rx_read_line(char *buf, size_t len)
+{
+    size_t full = lwrb_get_full(&rx_ring);
+    size_t end = 0;
+    uint8_t c = 0;
+
+    if (!buf || len == 0)
+        return 0;
+
+    /* Look for the terminator without consuming anything */
+    while (end < full) {
+        lwrb_peek(&rx_ring, end, &c, 1);
+        end++;
+        if (c == '\n')
+            break;
+    }
+    if (end == 0)
+        return 0;
+
+    /* A full ring without a terminator would never drain: hand it out */
+    if (c != '\n' && lwrb_get_free(&rx_ring) != 0)
+        return 0;
+
+    size_t line = (c == '\n') ? end - 1 : end;
+    size_t n = (line < len - 1) ? line : len - 1;
+    lwrb_read(&rx_ring, buf, n);
+    lwrb_skip(&rx_ring, end - n);
+
+    if (n > 0 && buf[n - 1] == '\r')
+        n--;
+    buf[n] = '\0';
+    return n;
+}
+
+bool uart_rx_set_baudrate(uint32_t baud)
+{
+    if (!rx_uart || baud == 0)
+        return false;
+
+    uint32_t start = HAL_GetTick();
+    /* Log TX runs its DMA outside HAL UART: wait for it separately */
+    while (rx_uart->gState != HAL_UART_STATE_READY || !logging_tx_idle()) {
+        if (HAL_GetTick() - start >= UART_RX_BAUD_TIMEOUT_MS)
+            return false;
+    }
+
+    HAL_UART_AbortReceive(rx_uart);
+
+    rx_uart->Init.BaudRate = baud;
+    rx_uart->Init.OverSampling = (baud > HAL_RCC_GetPCLK1Freq() / 16) ?
+                                 UART_OVERSAMPLING_8 : UART_OVERSAMPLING_16;
+    if (HAL_UART_Init(rx_uart) != HAL_OK)
+        return false;
+
+    return uart_rx_start();
+}
+
+void uart_rx_event_callback(UART_HandleTypeDef *huart, uint16_t pos)
+{
+    if (huart != rx_uart)
+        return;
+
+    uint32_t start = DWT->CYCCNT;
+    size_t last = rx_dma_pos;
+
+    switch (HAL_UARTEx_GetRxEventType(huart)) {
+    case HAL_UART_RXEVENT_HT:   rx_stats.events_half++; break;
+    case HAL_UART_RXEVENT_TC:   rx_stats.events_full++; break;
+    default:                    rx_stats.events_idle++; break;
+    }
+
+    if (pos != last) {
+        if (pos > last) {
+            uart_rx_push(&rx_dma_buf[last], pos - last);
+        } else {
+            /* DMA wrapped since the last event */
+            uart_rx_push(&rx_dma_buf[last], sizeof(rx_dma_buf) - last);
+            uart_rx_push(rx_dma_buf, pos);
+        }
+        rx_dma_pos = (pos == sizeof(rx_dma_buf)) ? 0 : pos;
+
+        size_t level = lwrb_get_full(&rx_ring);
+        if (level > rx_stats.level_max)
+            rx_stats.level_max = level;
+
+        if (rx_notify)
+            rx_notify(level);
+    }
+
+    uint32_t cycles = DWT->CYCCNT - start;
+    if (cycles > rx_stats.event_cycles_max)
+        rx_stats.event_cycles_max = cycles;
+}
+
+void uart_rx_error_callback(UART_HandleTypeDef *huart)
+{
+    if (huart != rx_uart)
+        return;
+
+    rx_stats.errors++;
+    if (huart->ErrorCode & HAL_UART_ERROR_ORE)
+        rx_stats.overruns++;
+
+    /* Overrun aborts the DMA reception; noise / framing errors do not */
+    if (huart->RxState == HAL_UART_STATE_READY && uart_rx_start())
+        rx_stats.restarts++;
+}
+
+const UartRxStats *uart_rx_stats(void)
+{
+    return &rx_stats;
+}
+
+void uart_rx_print_stats(void)
+{
+    if (!rx_uart)
+        return;
+
+    uint32_t now = HAL_GetTick();
+    uint32_t bytes = rx_stats.bytes;
+    uint32_t elapsed_ms = now - rx_window_tick;
+    uint32_t rate = elapsed_ms ? (uint32_t)((uint64_t)(bytes - rx_window_bytes) * 1000u / elapsed_ms) : 0;
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+    rx_window_bytes = bytes;
+    rx_window_tick = now;
+
+    log_printf("UART RX @ %lu baud: %lu B/s over %lu ms, %lu bytes total, %lu dropped\r\n",
+               (unsigned long)rx_uart->Init.BaudRate,
+               (unsigned long)rate,
+               (unsigned long)elapsed_ms,
+               (unsigned long)bytes,
+               (unsigned long)rx_stats.dropped);
+    log_printf("UART RX: events idle %lu half %lu full %lu, errors %lu (%lu overrun, %lu restarts)\r\n",
+               (unsigned long)rx_stats.events_idle,
+               (unsigned long)rx_stats.events_half,
+               (unsigned long)rx_stats.events_full,
+               (unsigned long)rx_stats.errors,
+               (unsigned long)rx_stats.overruns,
+               (unsigned long)rx_stats.restarts);
+    log_printf("UART RX: ring peak %lu of %u bytes, event max %lu us\r\n",
+               (unsigned long)rx_stats.level_max,
+               (unsigned)UART_RX_RING_SIZE,
+               (unsigned long)(rx_stats.event_cycles_max / cycles_per_us));
+}
+
+void uart_rx_benchmark_sweep(const uint32_t *bauds, size_t count, uint32_t window_ms)
+{
+    if (!rx_uart || !bauds)
+        return;
+
+    uint32_t restore = rx_uart->Init.BaudRate;
+
+    for (size_t i = 0; i < count; i++) {
+        /* Announced at the old rate: switching waits for TX to drain */
+        log_printf("UART RX sweep: %lu baud, %lu ms\r\n",
+                   (unsigned long)bauds[i], (unsigned long)window_ms);
+        if (!uart_rx_set_baudrate(bauds[i])) {
+            log_printf("UART RX sweep: %lu baud rejected\r\n", (unsigned long)bauds[i]);
+            continue;
+        }
+
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        memset(&rx_stats, 0, sizeof(rx_stats));
+        __set_PRIMASK(primask);
+        lwrb_skip(&rx_ring, lwrb_get_full(&rx_ring));
+        rx_window_bytes = 0;
+        rx_window_tick = HAL_GetTick();
+
+        while (HAL_GetTick() - rx_window_tick < window_ms)
+            lwrb_skip(&rx_ring, lwrb_get_full(&rx_ring));
+
+        uart_rx_print_stats();
+    }
+
+    log_printf("UART RX sweep: done, back to %lu baud\r\n", (unsigned long)restore);
+    uart_rx_set_baudrate(restore);
+}
@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include <util.h>
+#include <logging.h>
 // testing crc calculations
 #define BUFFER_SIZE  9
 static const uint8_t CRC16_DATA8[BUFFER_SIZE] = {0x4D, 0x3C, 0x2B, 0x1A,
@@ -21,12 +22,12 @@ uint8_t crc_test(){
 	  // Measure CPU CRC calculation time
 	  startTime = __HAL_TIM_GET_COUNTER(&htim3);
 
-	  printf("CRC Test\r\n");
+	  log_printf("CRC Test\r\n");
 	  uint16_t cpu_CRC = util_crc16((uint8_t*)CRC16_DATA8, BUFFER_SIZE);
 
 	  endTime = __HAL_TIM_GET_COUNTER(&htim3);
 	  duration = endTime - startTime;
-	  printf("CPU CRC: 0x%04x Duration: %lu us\r\n\r\n", cpu_CRC, duration);
+	  log_printf("CPU CRC: 0x%04x Duration: %lu us\r\n\r\n", cpu_CRC, (unsigned long)duration);
 
 
 	  // Reset Counter if needed
@@ -38,7 +39,7 @@ uint8_t crc_test(){
 	  uint16_t hw_CRC = util_hw_crc16((uint8_t*)CRC16_DATA8, BUFFER_SIZE);
 	  endTime = __HAL_TIM_GET_COUNTER(&htim3);
 	  duration = endTime - startTime;
-	  printf("HW CRC: 0x%04x Duration: %lu us\r\n\r\n", hw_CRC, duration);
+	  log_printf("HW CRC: 0x%04x Duration: %lu us\r\n\r\n", hw_CRC, (unsigned long)duration);
 
 	  return cpu_CRC == hw_CRC?0:1;
 }
@@ -82,9 +83,9 @@ const uint16_t crc16_tab[256] = {
 
 void printBuffer(const uint8_t* buffer, uint32_t size) {
     for (uint32_t i = 0; i < size; i++) {
-        printf("%02X ", buffer[i]); // Print each byte in hexadecimal format
+        log_printf("%02X ", buffer[i]); // Print each byte in hexadecimal format
     }
-    printf("\r\n\r\n"); // Print a newline character to separate the output
+    log_printf("\r\n\r\n"); // Print a newline character to separate the output
 }
 
 uint16_t util_crc16(const uint8_t* buf, uint32_t size) {
@@ -101,7 +102,7 @@ uint16_t util_crc16(const uint8_t* buf, uint32_t size) {
 uint16_t util_hw_crc16(uint8_t* buf, uint32_t size)
 {
 	uint32_t uwCRCValue = HAL_CRC_Accumulate(&hcrc, (uint32_t *)buf, size);
-	printf("uwCRCValue 0x%08lx\r\n", uwCRCValue);
+	log_printf("uwCRCValue 0x%08lx\r\n", (unsigned long)uwCRCValue);
 	return (uint16_t)uwCRCValue;
 }
 
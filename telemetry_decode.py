@@ -0,0 +1,294 @@
+#!/usr/bin/env python3
+"""
+Decoder for the binary stream on USART2: telemetry frames (telemetry.h),
+deferred log records (logging.h) and the ACK / STATUS / PVT_STATUS replies
+of the binary command protocol (cmd_bin.h).
+
+Packets are COBS encoded and 0x00 terminated; the decoded packet is
+type, seq, payload, CRC16 (CCITT, init 0xFFFF, little endian). Bytes that
+do not form a valid packet (printf text, line noise) are counted and
+skipped.
+
+Log records carry the address of their LogMsg; with --elf the format
+string is looked up in the firmware image and the record printed as
+log_printf would have, otherwise ID and raw arguments are shown.
+
+    python3 telemetry_decode.py /dev/ttyACM0 --baud 10000000
+    python3 telemetry_decode.py capture.bin --csv > telemetry.csv
+    python3 telemetry_decode.py capture.bin --elf build/Debug/StepperDEV.elf
+
+Reading a serial port needs pyserial, --elf needs pyelftools; files and
+stdin ('-') need neither.
+"""
+import argparse
+import re
+import struct
+import sys
+
+TYPE_ACK = 0x80
+TYPE_STATUS = 0x84
+TYPE_PVT_STATUS = 0x85
+TYPE_TELEMETRY = 0x90
+TYPE_LOG = 0x91
+
+PVT_STATES = {0: 'idle', 1: 'running', 2: 'underrun'}
+
+# (bit, name, struct format) in payload order
+FIELDS = [
+    (0x01, 'pos', '<i'),
+    (0x02, 'vel', '<i'),
+    (0x04, 'sg', '<H'),
+    (0x08, 'drv_status', '<I'),
+    (0x10, 'status', '<B'),
+    (0x20, 'age_us', '<H'),
+]
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(frame):
+    out = bytearray()
+    i = 0
+    while i < len(frame):
+        code = frame[i]
+        if code == 0 or i + code > len(frame):
+            return None
+        out += frame[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(frame):
+            out.append(0)
+    return bytes(out)
+
+
+def parse_telemetry(payload):
+    ts, axis_mask, fields = struct.unpack_from('<IIB', payload, 0)
+    off = 9
+    axes = []
+    for axis in range(32):
+        if not axis_mask & (1 << axis):
+            continue
+        values = {'axis': axis}
+        for bit, name, fmt in FIELDS:
+            if fields & bit:
+                (values[name],) = struct.unpack_from(fmt, payload, off)
+                off += struct.calcsize(fmt)
+        axes.append(values)
+    if off != len(payload):
+        raise ValueError('payload length %d, layout needs %d' % (len(payload), off))
+    return ts, axes
+
+
+# printf conversions the firmware's fmt.c supports
+CONVERSION = re.compile(r'%([-+ 0]*\d*)(?:l|h)?([diuxXcs%])')
+
+
+class ElfImage:
+    """Loaded sections of the firmware ELF, to resolve LOG record IDs"""
+
+    def __init__(self, path):
+        from elftools.elf.elffile import ELFFile  # pyelftools
+        self.sections = []
+        with open(path, 'rb') as f:
+            for sec in ELFFile(f).iter_sections():
+                if sec['sh_addr'] and sec['sh_type'] == 'SHT_PROGBITS':
+                    self.sections.append((sec['sh_addr'], sec.data()))
+
+    def read(self, addr, n):
+        for base, data in self.sections:
+            if base <= addr and addr + n <= base + len(data):
+                return data[addr - base:addr - base + n]
+        return None
+
+    def string(self, addr):
+        for base, data in self.sections:
+            if base <= addr < base + len(data):
+                end = data.find(b'\x00', addr - base)
+                return data[addr - base:end].decode('latin-1')
+        return None
+
+    def format(self, msg_id, args):
+        """The record as log_printf formats it, None if the ID is unknown"""
+        raw = self.read(msg_id, 4)
+        fmt = self.string(struct.unpack('<I', raw)[0]) if raw else None
+        if fmt is None:
+            return None
+        values = iter(args)
+
+        def convert(m):
+            flags, conv = m.groups()
+            if conv == '%':
+                return '%'
+            v = next(values, 0)
+            if conv in 'di':
+                v -= (v & 0x80000000) << 1
+            elif conv == 's':
+                v = self.string(v) or '?'
+            return ('%' + flags + conv) % v
+
+        return CONVERSION.sub(convert, fmt).rstrip('\r\n')
+
+
+class Decoder:
+    def __init__(self, csv_out, elf=None, core_hz=80000000):
+        self.csv = csv_out
+        self.elf = elf
+        self.core_hz = core_hz
+        self.log_records = 0
+        self.log_lost = 0
+        self.log_seq = None
+        self.buf = bytearray()
+        self.frames = 0
+        self.bad = 0
+        self.lost = 0
+        self.last_seq = None
+        self.first_ts = None
+        self.last_ts = None
+        self.header_done = False
+
+    def feed(self, data):
+        self.buf += data
+        while True:
+            end = self.buf.find(b'\x00')
+            if end < 0:
+                return
+            frame = bytes(self.buf[:end])
+            del self.buf[:end + 1]
+            if frame:
+                self.packet(frame)
+
+    def packet(self, frame):
+        # Text has no 0x00, so it sticks to the front of the next packet:
+        # take the longest tail that checks out.
+        for start in range(len(frame)):
+            pkt = cobs_decode(frame[start:])
+            if pkt is not None and len(pkt) >= 4 and \
+                    crc16(pkt[:-2]) == struct.unpack('<H', pkt[-2:])[0]:
+                break
+        else:
+            self.bad += 1
+            return
+        if start:
+            self.bad += 1
+        ptype, seq, payload = pkt[0], pkt[1], pkt[2:-2]
+
+        if ptype == TYPE_TELEMETRY:
+            try:
+                ts, axes = parse_telemetry(payload)
+            except (ValueError, struct.error):
+                self.bad += 1
+                return
+            if self.last_seq is not None:
+                self.lost += (seq - self.last_seq - 1) & 0xFF
+            self.last_seq = seq
+            self.frames += 1
+            if self.first_ts is None:
+                self.first_ts = ts
+            self.last_ts = ts
+            self.emit(seq, ts, axes)
+        elif ptype == TYPE_LOG:
+            self.log(seq, payload)
+        elif ptype == TYPE_ACK:
+            last, count, errors, err, err_seq = struct.unpack('<5B', payload)
+            print('ACK seq %u: %u packets, %u errors (last %u at seq %u)'
+                  % (last, count, errors, err, err_seq), file=sys.stderr)
+        elif ptype == TYPE_STATUS:
+            axis, pos, target, flags = struct.unpack('<BiiB', payload)
+            print('STATUS seq %u axis %u: pos %d target %d %s'
+                  % (seq, axis, pos, target, 'reached' if flags & 1 else 'moving'),
+                  file=sys.stderr)
+        elif ptype == TYPE_PVT_STATUS:
+            state, level, free, segments, underruns, starved = struct.unpack('<BHHIII', payload)
+            print('PVT seq %u: %s, %u queued %u free, %u segments, %u underruns (%u ticks starved)'
+                  % (seq, PVT_STATES.get(state, state), level, free, segments, underruns, starved),
+                  file=sys.stderr)
+
+    def log(self, seq, payload):
+        if len(payload) < 8 or len(payload) % 4:
+            self.bad += 1
+            return
+        if self.log_seq is not None:
+            self.log_lost += (seq - self.log_seq - 1) & 0xFF
+        self.log_seq = seq
+        self.log_records += 1
+
+        msg_id, cycles, *args = struct.unpack('<%dI' % (len(payload) // 4), payload)
+        text = self.elf.format(msg_id, args) if self.elf else None
+        if text is None:
+            text = 'id 0x%08x args %s' % (msg_id, ' '.join('0x%08x' % a for a in args))
+        # DWT cycles, wrapping every 2^32 / core_hz seconds
+        print('LOG %10.6f %s' % (cycles / self.core_hz, text), file=sys.stderr)
+
+    def emit(self, seq, ts, axes):
+        if self.csv:
+            if not self.header_done:
+                cols = ['seq', 'timestamp_us']
+                for a in axes:
+                    cols += ['%s%d' % (k, a['axis']) for k in a if k != 'axis']
+                print(','.join(cols))
+                self.header_done = True
+            row = [str(seq), str(ts)]
+            for a in axes:
+                row += [str(v) for k, v in a.items() if k != 'axis']
+            print(','.join(row))
+        else:
+            parts = ['%10.6f' % (ts / 1e6)]
+            for a in axes:
+                parts.append('ax%d ' % a['axis'] +
+                             ' '.join('%s=%s' % (k, v) for k, v in a.items() if k != 'axis'))
+            print('  '.join(parts))
+
+    def summary(self):
+        rate = 0.0
+        if self.frames > 1 and self.last_ts != self.first_ts:
+            rate = (self.frames - 1) * 1e6 / ((self.last_ts - self.first_ts) & 0xFFFFFFFF)
+        print('%d frames (%.1f Hz), %d lost by seq, %d bad packets'
+              % (self.frames, rate, self.lost, self.bad), file=sys.stderr)
+        if self.log_records:
+            print('%d log records, %d lost by seq' % (self.log_records, self.log_lost),
+                  file=sys.stderr)
+
+
+def open_source(path, baud):
+    if path == '-':
+        return sys.stdin.buffer
+    if path.startswith('/dev/') or path.upper().startswith('COM'):
+        import serial  # pyserial
+        return serial.Serial(path, baud, timeout=0.1)
+    return open(path, 'rb')
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    ap.add_argument('source', help="serial port, capture file or '-' for stdin")
+    ap.add_argument('--baud', type=int, default=115200)
+    ap.add_argument('--csv', action='store_true', help='CSV rows instead of text')
+    ap.add_argument('--elf', help='firmware ELF to resolve log message IDs')
+    ap.add_argument('--core-hz', type=int, default=80000000,
+                    help='SystemCoreClock, for log timestamps (default 80 MHz)')
+    args = ap.parse_args()
+
+    dec = Decoder(args.csv, ElfImage(args.elf) if args.elf else None, args.core_hz)
+    src = open_source(args.source, args.baud)
+    try:
+        while True:
+            data = src.read(4096)
+            if not data:
+                if hasattr(src, 'in_waiting'):
+                    continue
+                break
+            dec.feed(data)
+    except KeyboardInterrupt:
+        pass
+    dec.summary()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,50 @@
+/*
+ * host.h — force-included into every firmware source built by the host tests
+ *
+ * The real device headers provide the types; the core peripherals and
+ * intrinsics the firmware touches directly are redirected to host state.
+ */
+
+#ifndef HOST_H
+#define HOST_H
+
+#include "main.h"
+
+/* Cycle counter: advanced by the tests, not by the code under test */
+#undef DWT
+#define DWT (&host_dwt)
+extern DWT_Type host_dwt;
+
+/* Event / barrier intrinsics */
+#undef __SEV
+#undef __WFE
+#undef __DSB
+#undef __ISB
+#undef __DMB
+#define __SEV()             ((void)0)
+#define __WFE()             host_wfe()
+#define __DSB()             __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __ISB()             ((void)0)
+#define __DMB()             __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/* Interrupt masking: thread mode, interrupts enabled */
+#define __get_IPSR()        0u
+#define __get_PRIMASK()     0u
+#define __set_PRIMASK(x)    ((void)(x))
+#define __disable_irq()     ((void)0)
+#define __enable_irq()      ((void)0)
+
+/* Exclusive monitor, one reservation per thread */
+#define __LDREXW(p)         host_ldrexw(p)
+#define __STREXW(v, p)      host_strexw((v), (p))
+#define __CLREX()           host_clrex()
+
+void host_wfe(void);
+uint32_t host_ldrexw(volatile uint32_t *addr);
+uint32_t host_strexw(uint32_t value, volatile uint32_t *addr);
+void host_clrex(void);
+
+/* Advance DWT->CYCCNT by a number of microseconds at SystemCoreClock */
+void host_advance_us(uint32_t us);
+
+#endif /* HOST_H */
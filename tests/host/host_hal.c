@@ -0,0 +1,172 @@
+/*
+ * host_hal.c — HAL, CMSIS and logging stand-ins for the host tests
+ */
+
+#include "host.h"
+#include "host_test.h"
+#include "logging.h"
+
+#include <sched.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+DWT_Type host_dwt;
+uint32_t SystemCoreClock = 80000000u;
+
+HostSpiHook host_spi_hook;
+bool host_verbose;
+int host_failures;
+
+static uint32_t host_tick_ms;
+
+/* --------------------------------------------------------------------------
+ *  Core
+ * -------------------------------------------------------------------------- */
+
+void host_advance_us(uint32_t us)
+{
+    static uint32_t frac_us;
+
+    host_dwt.CYCCNT += us * (SystemCoreClock / 1000000u);
+    frac_us += us;
+    host_tick_ms += frac_us / 1000u;
+    frac_us %= 1000u;
+}
+
+/* Nothing else runs while the test sleeps: let one millisecond pass */
+void host_wfe(void)
+{
+    host_advance_us(1000u);
+}
+
+static _Thread_local volatile uint32_t *host_ex_addr;
+static _Thread_local uint32_t host_ex_value;
+static _Thread_local uint32_t host_ex_count;
+uint32_t host_ex_preempt;
+
+uint32_t host_ldrexw(volatile uint32_t *addr)
+{
+    host_ex_addr = addr;
+    host_ex_value = atomic_load((_Atomic uint32_t *)addr);
+
+    /* Give the CPU away inside the exclusive window, as an interrupt would */
+    if (host_ex_preempt && ++host_ex_count % host_ex_preempt == 0)
+        sched_yield();
+    return host_ex_value;
+}
+
+/* Fails if the word changed since the LDREX (or no reservation is held) */
+uint32_t host_strexw(uint32_t value, volatile uint32_t *addr)
+{
+    uint32_t expected = host_ex_value;
+
+    if (addr != host_ex_addr)
+        return 1u;
+    host_ex_addr = NULL;
+    return atomic_compare_exchange_strong((_Atomic uint32_t *)addr, &expected, value) ? 0u : 1u;
+}
+
+void host_clrex(void)
+{
+    host_ex_addr = NULL;
+}
+
+/* --------------------------------------------------------------------------
+ *  HAL
+ * -------------------------------------------------------------------------- */
+
+uint32_t HAL_GetTick(void)
+{
+    return host_tick_ms;
+}
+
+void HAL_Delay(uint32_t delay)
+{
+    host_advance_us(delay * 1000u);
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state)
+{
+    (void)port;
+    (void)pin;
+    (void)state;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, uint16_t pin)
+{
+    (void)port;
+    (void)pin;
+    return GPIO_PIN_RESET;
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, const uint8_t *tx, uint8_t *rx,
+                                          uint16_t size, uint32_t timeout)
+{
+    (void)timeout;
+
+    memset(rx, 0, size);
+    if (host_spi_hook)
+        host_spi_hook(hspi, tx, rx, size);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_IT(SPI_HandleTypeDef *hspi, const uint8_t *tx, uint8_t *rx,
+                                             uint16_t size)
+{
+    return HAL_SPI_TransmitReceive(hspi, tx, rx, size, 0);
+}
+
+HAL_SPI_StateTypeDef HAL_SPI_GetState(const SPI_HandleTypeDef *hspi)
+{
+    (void)hspi;
+    return HAL_SPI_STATE_READY;
+}
+
+/* Peripherals util.c refers to (its CRC self-test and unique ID) */
+TIM_HandleTypeDef htim3;
+CRC_HandleTypeDef hcrc;
+
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef *htim)
+{
+    (void)htim;
+    return HAL_OK;
+}
+
+uint32_t HAL_CRC_Accumulate(CRC_HandleTypeDef *hcrc_, uint32_t pBuffer[], uint32_t BufferLength)
+{
+    (void)hcrc_;
+    (void)pBuffer;
+    (void)BufferLength;
+    return 0;
+}
+
+uint32_t HAL_GetUIDw0(void) { return 0; }
+uint32_t HAL_GetUIDw1(void) { return 0; }
+uint32_t HAL_GetUIDw2(void) { return 0; }
+
+/* --------------------------------------------------------------------------
+ *  Logging (weak: tests that link logging.c get the real one)
+ * -------------------------------------------------------------------------- */
+
+__attribute__((weak)) int log_printf(const char *format, ...)
+{
+    va_list ap;
+    int n;
+
+    if (!host_verbose)
+        return 0;
+
+    va_start(ap, format);
+    n = vprintf(format, ap);
+    va_end(ap);
+    return n;
+}
+
+__attribute__((weak)) bool log_deferred(const LogMsg *msg, const uint32_t *args)
+{
+    (void)msg;
+    (void)args;
+    return true;
+}
@@ -0,0 +1,38 @@
+/*
+ * host_test.h — minimal check macros and hooks for the host tests
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "main.h"
+
+/* Called for every blocking SPI frame; rx is zeroed beforehand */
+typedef void (*HostSpiHook)(SPI_HandleTypeDef *hspi, const uint8_t *tx, uint8_t *rx, uint16_t size);
+
+extern HostSpiHook host_spi_hook;
+extern bool host_verbose;      /* Pass log_printf output through */
+extern uint32_t host_ex_preempt;    /* Yield inside every Nth LDREX window, 0 = never */
+
+extern int host_failures;
+
+#define CHECK(cond, ...)                                                    \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                     \
+            printf(__VA_ARGS__);                                            \
+            printf("\n");                                                   \
+            host_failures++;                                                \
+        }                                                                   \
+    } while (0)
+
+/* Exit status for main() after printing a one-line verdict */
+#define HOST_TEST_RESULT(name)                                              \
+    (printf("%s: %s\n", (name), host_failures ? "FAIL" : "ok"),             \
+     host_failures ? 1 : 0)
+
+#endif /* HOST_TEST_H */
@@ -0,0 +1,700 @@
+/*
+ * test_cmd_bin.c — binary command protocol over a stand-in RX ring
+ *
+ * Frames go through the real consumer API semantics (linear block, peek,
+ * skip) over a small lwrb ring, so they wrap; replies are captured from
+ * logging_tx_send_frame, COBS decoded and CRC checked, and commands drive
+ * two simulated TMC5240s.
+ *
+ * - Every command and its reply, with its effect on the axes
+ * - Errors: CRC, bad COBS, unknown type, bad arguments, sequence gaps,
+ *   each reported once in the batched ACK
+ * - Frames that straddle the ring wrap and overlong frames, whole and
+ *   streamed in fragments across polls
+ * - PVT streaming: points, ring full, level replies and the unprompted
+ *   underrun report
+ * - Fuzzing: corrupted frames in random fragments must never consume past
+ *   the ring, and the next good frame must always execute
+ * - Throughput of the decode path (dry run)
+ */
+
+#include "host_test.h"
+#include "cmd_bin.h"
+#include "lwrb.h"
+#include "tmc5240_driver.h"
+#include "tmc5240_sim.h"
+#include "util.h"
+
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#define AXES            2
+#define RX_RING_SIZE    300u        /* Bytes; small so frames wrap */
+#define TX_SIZE         (1u << 16)
+#define REPLIES_MAX     512u
+#define FUZZ_CASES      20000u
+#define BENCH_RUNS      200000u
+
+static Tmc5240Sim sim[AXES];
+static TMC5240_Context ctx[AXES];
+static Stepper axes[AXES];
+static StepperGroup group;
+static CmdBin cmd;
+
+/* ============================================================================
+ *  UART RX stand-in and reply capture
+ * ========================================================================== */
+
+static uint8_t rx_data[RX_RING_SIZE + 1];
+static lwrb_t rx_ring;
+static uint32_t frames;             /* Frames consumed, from cmd_bin_poll */
+
+size_t uart_rx_available(void)
+{
+    return lwrb_get_full(&rx_ring);
+}
+
+size_t uart_rx_linear(const uint8_t **data)
+{
+    *data = (const uint8_t *)lwrb_get_linear_block_read_address(&rx_ring);
+    return lwrb_get_linear_block_read_length(&rx_ring);
+}
+
+size_t uart_rx_peek(size_t skip, void *buf, size_t len)
+{
+    return lwrb_peek(&rx_ring, skip, buf, len);
+}
+
+void uart_rx_skip(size_t len)
+{
+    CHECK(len <= lwrb_get_full(&rx_ring), "skipped %zu of %zu queued bytes",
+          len, lwrb_get_full(&rx_ring));
+    lwrb_skip(&rx_ring, len);
+}
+
+int log_vprintf(const char *fmt, va_list ap)
+{
+    (void)fmt;
+    (void)ap;
+    return 0;
+}
+
+static uint8_t tx[TX_SIZE];
+static size_t tx_len;
+
+bool logging_tx_send_frame(const void *data, size_t len)
+{
+    if (tx_len + len > sizeof(tx))
+        return false;
+    memcpy(tx + tx_len, data, len);
+    tx_len += len;
+    return true;
+}
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t seq;
+    uint8_t payload[CMD_BIN_PAYLOAD_MAX];
+    size_t len;
+} Reply;
+
+static Reply replies[REPLIES_MAX];
+static uint32_t reply_count;
+static uint32_t reply_bad;          /* Captured frames that do not decode */
+
+static size_t cobs_decode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t r = 0, w = 0;
+
+    while (r < len) {
+        uint8_t code = in[r++];
+
+        if (code == 0 || r + code - 1u > len)
+            return 0;
+        for (uint8_t i = 1; i < code; i++)
+            out[w++] = in[r++];
+        if (code != 0xFF && r < len)
+            out[w++] = 0;
+    }
+    return w;
+}
+
+/* Split the captured TX bytes into replies, dropping them from the capture */
+static void collect(void)
+{
+    size_t start = 0;
+
+    reply_count = 0;
+    reply_bad = 0;
+    for (size_t i = 0; i < tx_len; i++) {
+        uint8_t pkt[CMD_BIN_PAYLOAD_MAX + 8];
+
+        if (tx[i] != 0)
+            continue;
+
+        size_t n = (i - start <= sizeof(pkt)) ? cobs_decode(tx + start, i - start, pkt) : 0;
+        start = i + 1;
+
+        if (n < 4 || util_crc16(pkt, (uint32_t)(n - 2)) != (uint16_t)(pkt[n - 2] | (pkt[n - 1] << 8))) {
+            reply_bad++;
+            continue;
+        }
+        if (reply_count < REPLIES_MAX) {
+            Reply *r = &replies[reply_count++];
+            r->type = pkt[0];
+            r->seq = pkt[1];
+            r->len = n - 4;
+            memcpy(r->payload, pkt + 2, r->len);
+        }
+    }
+    CHECK(start == tx_len, "%zu captured bytes without a delimiter", tx_len - start);
+    tx_len = 0;
+}
+
+static int32_t get_i32(const uint8_t *p)
+{
+    return (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                     ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static void put_i32(uint8_t *p, int32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)((uint32_t)v >> 8);
+    p[2] = (uint8_t)((uint32_t)v >> 16);
+    p[3] = (uint8_t)((uint32_t)v >> 24);
+}
+
+/* Empty ring starting `offset` bytes in, interpreter and capture reset */
+static void rx_reset(size_t offset)
+{
+    lwrb_init(&rx_ring, rx_data, sizeof(rx_data));
+    lwrb_advance(&rx_ring, offset % sizeof(rx_data));
+    lwrb_skip(&rx_ring, offset % sizeof(rx_data));
+    cmd_bin_init(&cmd, &group);
+    tx_len = 0;
+    reply_count = 0;
+    frames = 0;
+}
+
+static uint32_t rng = 1;
+
+static uint32_t rand_u32(void)
+{
+    rng = rng * 1664525u + 1013904223u;
+    return rng >> 8;
+}
+
+/*
+ * Deliver len bytes in fragments of 1..max_frag bytes as far as the ring
+ * takes them, polling after each. Returns false if the interpreter stops
+ * consuming a full ring.
+ */
+static bool rx_feed(const uint8_t *data, size_t len, size_t max_frag)
+{
+    while (len > 0) {
+        size_t n = 1u + rand_u32() % max_frag;
+        if (n > len)
+            n = len;
+        n = lwrb_write(&rx_ring, data, n);
+        data += n;
+        len -= n;
+
+        size_t before = uart_rx_available();
+        frames += cmd_bin_poll(&cmd);
+        if (n == 0 && uart_rx_available() == before)
+            return false;
+    }
+    frames += cmd_bin_poll(&cmd);
+    return true;
+}
+
+/* Encode one packet and deliver it whole; replies are collected */
+static void send(uint8_t type, uint8_t seq, const uint8_t *payload, size_t len)
+{
+    uint8_t frame[CMD_BIN_FRAME_MAX + 1];
+    size_t n = cmd_bin_encode(type, seq, payload, len, frame, sizeof(frame));
+
+    CHECK(n > 0, "type 0x%02x: %zu B payload does not encode", type, len);
+    rx_feed(frame, n, RX_RING_SIZE);
+    collect();
+}
+
+/* The last reply of the given type, NULL if there is none */
+static const Reply *reply_of(uint8_t type)
+{
+    for (uint32_t i = reply_count; i > 0; i--)
+        if (replies[i - 1].type == type)
+            return &replies[i - 1];
+    return NULL;
+}
+
+/* One ACK covering `count` packets up to `seq` with `errors` errors, the last `err` */
+static void expect_ack(const char *what, uint8_t seq, uint8_t count, uint8_t errors, CmdBinError err)
+{
+    const Reply *a = reply_of(CMD_BIN_ACK);
+
+    CHECK(a && a->len == 5, "%s: no ACK", what);
+    if (!a || a->len != 5)
+        return;
+    CHECK(a->payload[0] == seq && a->payload[1] == count && a->payload[2] == errors &&
+          a->payload[3] == (uint8_t)err,
+          "%s: ACK seq %u count %u errors %u last %u, expected %u %u %u %u", what,
+          a->payload[0], a->payload[1], a->payload[2], a->payload[3], seq, count, errors, err);
+}
+
+static void setup(void)
+{
+    tmc5240_sim_attach(sim, AXES);
+
+    stepper_group_init(&group);
+    for (uint8_t i = 0; i < AXES; i++) {
+        ctx[i] = (TMC5240_Context){
+            .icID = i,
+            .hspi = &sim[i].hspi,
+            .cs_port = GPIOA,
+            .cs_pin = (uint16_t)(1u << i),
+            .vmax = 0x2710,
+            .amax = 0x0F8D,
+            .dmax = 0x0F8D,
+        };
+        stepper_init(&axes[i], i, &TMC5240_Driver, &ctx[i]);
+        stepper_group_add(&group, &axes[i]);
+    }
+    stepper_group_enable(&group, true);
+    rx_reset(0);
+}
+
+/* ============================================================================
+ *  Commands and errors
+ * ========================================================================== */
+
+static void test_commands(void)
+{
+    uint8_t p[CMD_BIN_PAYLOAD_MAX];
+
+    setup();
+
+    p[0] = 1;
+    put_i32(p + 1, -123456);
+    send(CMD_BIN_MOVE, 0, p, 5);
+    expect_ack("move", 0, 1, 0, CMD_BIN_OK);
+    CHECK(reply_count == 1, "move: %lu replies", (unsigned long)reply_count);
+    CHECK(sim[1].reg[TMC5240_XTARGET] == -123456, "move target %ld",
+          (long)sim[1].reg[TMC5240_XTARGET]);
+
+    put_i32(p, 300);
+    put_i32(p + 4, -400);
+    send(CMD_BIN_GROUP_MOVE, 1, p, 8);
+    expect_ack("group move", 1, 1, 0, CMD_BIN_OK);
+    CHECK(sim[0].reg[TMC5240_XTARGET] == 300 && sim[1].reg[TMC5240_XTARGET] == -400,
+          "group move targets %ld / %ld", (long)sim[0].reg[TMC5240_XTARGET],
+          (long)sim[1].reg[TMC5240_XTARGET]);
+
+    host_advance_us(2000000u);
+    tmc5240_sim_run();
+
+    /* Answered after the ACK of everything before it */
+    p[0] = 0;
+    send(CMD_BIN_QUERY, 2, p, 1);
+    CHECK(reply_count == 2 && replies[0].type == CMD_BIN_ACK && replies[1].type == CMD_BIN_STATUS,
+          "query: %lu replies, first 0x%02x", (unsigned long)reply_count, replies[0].type);
+    const Reply *st = reply_of(CMD_BIN_STATUS);
+    CHECK(st && st->seq == 2 && st->len == 10 && st->payload[0] == 0 &&
+          get_i32(st->payload + 1) == 300 && get_i32(st->payload + 5) == 300 &&
+          st->payload[9] == CMD_BIN_STATUS_REACHED, "status reply wrong");
+
+    /* Out-of-range velocities saturate in the driver */
+    p[0] = 0;
+    put_i32(p + 1, INT32_MIN);
+    send(CMD_BIN_VELOCITY, 3, p, 5);
+    expect_ack("velocity", 3, 1, 0, CMD_BIN_OK);
+    CHECK(ctx[0].shadow_vmax == TMC5240_MAX_VELOCITY && ctx[0].shadow_rampmode == TMC5240_MODE_VELNEG,
+          "INT32_MIN velocity: VMAX %lu RAMPMODE %u", (unsigned long)ctx[0].shadow_vmax,
+          ctx[0].shadow_rampmode);
+    put_i32(p + 1, 0);
+    send(CMD_BIN_VELOCITY, 4, p, 5);
+
+    /* Errors: each reported in the ACK with the seq it happened at */
+    p[0] = AXES;
+    send(CMD_BIN_MOVE, 5, p, 5);
+    expect_ack("bad axis", 5, 1, 1, CMD_BIN_ERR_ARGS);
+    send(CMD_BIN_MOVE, 6, p, 4);
+    expect_ack("short payload", 6, 1, 1, CMD_BIN_ERR_ARGS);
+    send(CMD_BIN_GROUP_MOVE, 7, p, 4);
+    expect_ack("group move size", 7, 1, 1, CMD_BIN_ERR_ARGS);
+    send(0x7F, 8, p, 0);
+    expect_ack("unknown type", 8, 1, 1, CMD_BIN_ERR_TYPE);
+
+    CHECK(cmd.stats.packets == 5 && cmd.stats.bad_args == 3 && cmd.stats.unknown == 1,
+          "stats: %lu ok, %lu args, %lu unknown", (unsigned long)cmd.stats.packets,
+          (unsigned long)cmd.stats.bad_args, (unsigned long)cmd.stats.unknown);
+}
+
+static void test_errors(void)
+{
+    uint8_t frame[CMD_BIN_FRAME_MAX + 1];
+    uint8_t p[5] = { 0 };
+    size_t n;
+
+    setup();
+
+    /* CRC: a payload byte changed on the wire; reported at the expected seq */
+    put_i32(p + 1, 1000);
+    n = cmd_bin_encode(CMD_BIN_MOVE, 0, p, 5, frame, sizeof(frame));
+    frame[4] ^= 0x10;
+    rx_feed(frame, n, RX_RING_SIZE);
+    collect();
+    expect_ack("crc", 0, 0, 1, CMD_BIN_ERR_CRC);
+    CHECK(cmd.stats.crc_errors == 1 && sim[0].reg[TMC5240_XTARGET] == 0,
+          "crc: %lu errors, target %ld", (unsigned long)cmd.stats.crc_errors,
+          (long)sim[0].reg[TMC5240_XTARGET]);
+
+    /* COBS code running past the delimiter, and a frame too short for a CRC */
+    static const uint8_t bad[] = { 0x09, 0x01, 0x02, 0x00, 0x02, 0x01, 0x00 };
+    rx_feed(bad, sizeof(bad), RX_RING_SIZE);
+    collect();
+    expect_ack("framing", 0, 0, 2, CMD_BIN_ERR_FRAME);
+    CHECK(cmd.stats.frame_errors == 2, "%lu frame errors", (unsigned long)cmd.stats.frame_errors);
+
+    /* Sequence gap: 0, 1, then 5 (2..4 lost); the packet itself runs */
+    send(CMD_BIN_MOVE, 0, p, 5);
+    send(CMD_BIN_MOVE, 1, p, 5);
+    put_i32(p + 1, 777);
+    send(CMD_BIN_MOVE, 5, p, 5);
+    expect_ack("seq gap", 5, 1, 1, CMD_BIN_ERR_SEQ);
+    CHECK(replies[0].payload[4] == 5, "seq gap reported at seq %u", replies[0].payload[4]);
+    CHECK(cmd.stats.seq_gaps == 3 && sim[0].reg[TMC5240_XTARGET] == 777,
+          "seq gap: %lu lost, target %ld", (unsigned long)cmd.stats.seq_gaps,
+          (long)sim[0].reg[TMC5240_XTARGET]);
+
+    /* Pipelined packets are acknowledged in batches */
+    uint8_t stream[40 * 12];
+    size_t len = 0;
+    for (uint8_t i = 0; i < 40; i++)
+        len += cmd_bin_encode(CMD_BIN_MOVE, (uint8_t)(6 + i), p, 5, stream + len, sizeof(stream) - len);
+    rx_feed(stream, len, RX_RING_SIZE);
+    collect();
+    uint32_t covered = 0;
+    for (uint32_t i = 0; i < reply_count; i++) {
+        CHECK(replies[i].type == CMD_BIN_ACK && replies[i].payload[1] <= CMD_BIN_ACK_BATCH,
+              "batch reply %lu: type 0x%02x, %u packets", (unsigned long)i, replies[i].type,
+              replies[i].payload[1]);
+        covered += replies[i].payload[1];
+    }
+    CHECK(covered == 40 && reply_count >= 40 / CMD_BIN_ACK_BATCH && reply_count < 40,
+          "40 packets in %lu ACKs covering %lu", (unsigned long)reply_count, (unsigned long)covered);
+    CHECK(replies[reply_count - 1].payload[0] == 45, "last ACK at seq %u",
+          replies[reply_count - 1].payload[0]);
+}
+
+/* ============================================================================
+ *  Wrapped and overlong frames
+ * ========================================================================== */
+
+static void test_wrap_overlong(void)
+{
+    uint8_t frame[CMD_BIN_FRAME_MAX + 1];
+    uint8_t p[8];
+    uint32_t wrapped = 0;
+
+    /* A group move placed at every offset across the wrap */
+    put_i32(p, 4321);
+    put_i32(p + 4, -8765);
+    size_t n = cmd_bin_encode(CMD_BIN_GROUP_MOVE, 0, p, 8, frame, sizeof(frame));
+
+    setup();
+    for (size_t off = sizeof(rx_data) - n - 2; off <= sizeof(rx_data) + 1; off++) {
+        rx_reset(off);
+        sim[0].reg[TMC5240_XTARGET] = 0;
+        rx_feed(frame, n, RX_RING_SIZE);
+        collect();
+        wrapped += cmd.stats.linearized;
+        CHECK(frames == 1 && sim[0].reg[TMC5240_XTARGET] == 4321 &&
+              sim[1].reg[TMC5240_XTARGET] == -8765, "offset %zu: %lu frames, targets %ld / %ld",
+              off, (unsigned long)frames, (long)sim[0].reg[TMC5240_XTARGET],
+              (long)sim[1].reg[TMC5240_XTARGET]);
+        expect_ack("wrapped", 0, 1, 0, CMD_BIN_OK);
+    }
+    CHECK(wrapped == n - 1, "%lu of %zu offsets copied across the wrap", (unsigned long)wrapped, n - 1);
+
+    /* Overlong, whole and in fragments, at offsets across the wrap: dropped
+       without executing anything, the next frame runs */
+    static uint8_t stream[3 * CMD_BIN_FRAME_MAX];
+    size_t junk = CMD_BIN_FRAME_MAX + 40;
+    memset(stream, 0x01, junk);
+    stream[junk] = 0;
+    p[0] = 0;
+    put_i32(p + 1, 99);
+    size_t len = junk + 1 + cmd_bin_encode(CMD_BIN_MOVE, 1, p, 5, stream + junk + 1,
+                                           sizeof(stream) - junk - 1);
+
+    for (uint32_t trial = 0; trial < 64; trial++) {
+        rx_reset(trial * 41u % sizeof(rx_data));
+        sim[0].reg[TMC5240_XTARGET] = 0;
+        rx_feed(stream, len, (trial & 1) ? 7 : RX_RING_SIZE);
+        collect();
+        if (cmd.stats.overlong != 1 || frames != 1 || sim[0].reg[TMC5240_XTARGET] != 99 ||
+            cmd.stats.frame_errors != 0) {
+            CHECK(false, "overlong trial %lu: %lu overlong, %lu frames, %lu frame errors, target %ld",
+                  (unsigned long)trial, (unsigned long)cmd.stats.overlong, (unsigned long)frames,
+                  (unsigned long)cmd.stats.frame_errors, (long)sim[0].reg[TMC5240_XTARGET]);
+            break;
+        }
+    }
+}
+
+/* ============================================================================
+ *  PVT streaming
+ * ========================================================================== */
+
+static void test_pvt(void)
+{
+    static StepperPvt pvt;
+    uint8_t p[4 + 8 * AXES];
+    uint8_t seq = 0;
+
+    setup();
+
+    /* Without a playback instance PVT packets are refused */
+    send(CMD_BIN_PVT_QUERY, seq++, p, 0);
+    expect_ack("no pvt", 0, 1, 1, CMD_BIN_ERR_ARGS);
+
+    CHECK(stepper_pvt_init(&pvt, &group, AXES, 1000u, 0), "pvt init rejected");
+    cmd_bin_attach_pvt(&cmd, &pvt);
+
+    /* Points at rest 10 steps apart: fill the ring, one more is BUSY */
+    uint32_t accepted = 0;
+    for (uint32_t i = 0; i <= STEPPER_PVT_DEPTH; i++) {
+        put_i32(p, 10000);
+        for (uint8_t a = 0; a < AXES; a++) {
+            put_i32(p + 4 + 8 * a, (int32_t)(10 * (i + 1)));
+            put_i32(p + 8 + 8 * a, 0);
+        }
+        send(CMD_BIN_PVT_POINT, seq++, p, sizeof(p));
+        const Reply *a = reply_of(CMD_BIN_ACK);
+        if (a && a->payload[2] == 0)
+            accepted++;
+        else if (i == STEPPER_PVT_DEPTH)
+            expect_ack("ring full", (uint8_t)(seq - 1), 1, 1, CMD_BIN_ERR_BUSY);
+    }
+    CHECK(accepted == STEPPER_PVT_DEPTH, "%lu points accepted", (unsigned long)accepted);
+
+    /* Wrong size and a segment the interpolation cannot play */
+    send(CMD_BIN_PVT_POINT, seq++, p, sizeof(p) - 1);
+    expect_ack("pvt size", (uint8_t)(seq - 1), 1, 1, CMD_BIN_ERR_ARGS);
+
+    send(CMD_BIN_PVT_QUERY, seq++, p, 0);
+    const Reply *st = reply_of(CMD_BIN_PVT_STATUS);
+    CHECK(st && st->len == 17 && st->payload[0] == STEPPER_PVT_IDLE &&
+          (st->payload[1] | (st->payload[2] << 8)) == STEPPER_PVT_DEPTH &&
+          (st->payload[3] | (st->payload[4] << 8)) == 0, "pvt status before start wrong");
+
+    stepper_pvt_stop(&pvt);
+    put_i32(p, 1);
+    put_i32(p + 4, 1000);
+    send(CMD_BIN_PVT_POINT, seq++, p, sizeof(p));
+    expect_ack("pvt speed", (uint8_t)(seq - 1), 1, 1, CMD_BIN_ERR_ARGS);
+
+    /* A moving point, then nothing: playback underruns and says so */
+    put_i32(p, 20000);
+    for (uint8_t a = 0; a < AXES; a++) {
+        put_i32(p + 4 + 8 * a, 100);
+        put_i32(p + 8 + 8 * a, 5000);
+    }
+    send(CMD_BIN_PVT_POINT, seq++, p, sizeof(p));
+    uint8_t run = 1;
+    send(CMD_BIN_PVT_RUN, seq++, &run, 1);
+    expect_ack("pvt run", (uint8_t)(seq - 1), 1, 0, CMD_BIN_OK);
+
+    for (uint32_t t = 0; t < 40 && pvt.state != STEPPER_PVT_UNDERRUN; t++) {
+        host_advance_us(1000u);
+        tmc5240_sim_run();
+        stepper_pvt_tick_irq(&pvt);
+        stepper_pvt_service(&pvt);
+    }
+    CHECK(pvt.state == STEPPER_PVT_UNDERRUN, "no underrun");
+
+    frames += cmd_bin_poll(&cmd);
+    collect();
+    st = reply_of(CMD_BIN_PVT_STATUS);
+    CHECK(reply_count == 1 && st && st->payload[0] == STEPPER_PVT_UNDERRUN && get_i32(st->payload + 9) == 1,
+          "underrun report: %lu replies", (unsigned long)reply_count);
+    frames += cmd_bin_poll(&cmd);
+    collect();
+    CHECK(reply_count == 0, "underrun reported %lu more times", (unsigned long)reply_count);
+
+    run = 0;
+    send(CMD_BIN_PVT_RUN, seq++, &run, 1);
+    CHECK(pvt.state == STEPPER_PVT_IDLE, "pvt stop ignored");
+}
+
+/* ============================================================================
+ *  Fuzzing
+ * ========================================================================== */
+
+/* A valid frame, then random edits to its encoded bytes (no delimiter) */
+static size_t fuzz_frame(uint8_t *buf, size_t max)
+{
+    uint8_t p[CMD_BIN_PAYLOAD_MAX];
+    static const uint8_t types[] = {
+        CMD_BIN_MOVE, CMD_BIN_VELOCITY, CMD_BIN_GROUP_MOVE, CMD_BIN_QUERY, 0x7F
+    };
+    size_t plen = rand_u32() % 12;
+
+    for (size_t i = 0; i < plen; i++)
+        p[i] = (uint8_t)rand_u32();
+    if (plen)
+        p[0] %= AXES + 1;
+
+    size_t len = cmd_bin_encode(types[rand_u32() % sizeof(types)], (uint8_t)rand_u32(),
+                                p, plen, buf, max) - 1;
+
+    for (uint32_t edits = rand_u32() % 4; edits > 0; edits--) {
+        size_t at = rand_u32() % (len + 1);
+        uint8_t ch = (uint8_t)(1u + rand_u32() % 255u);
+
+        switch (rand_u32() % 4) {
+        case 0:
+            if (at < len)
+                buf[at] = ch;
+            break;
+        case 1:
+            if (len < max) {
+                memmove(buf + at + 1, buf + at, len - at);
+                buf[at] = ch;
+                len++;
+            }
+            break;
+        case 2:
+            if (at < len) {
+                memmove(buf + at, buf + at + 1, len - at - 1);
+                len--;
+            }
+            break;
+        default:
+            len = at;
+            break;
+        }
+    }
+    return len;
+}
+
+static void test_fuzz(void)
+{
+    uint8_t buf[2 * CMD_BIN_FRAME_MAX];
+    uint8_t sentinel[CMD_BIN_FRAME_MAX + 1];
+    uint32_t recovered = 0;
+
+    setup();
+    rng = 0x2468ace;
+
+    for (uint32_t n = 0; n < FUZZ_CASES; n++) {
+        size_t max_frag = 1u + rand_u32() % 64u;
+        size_t len;
+
+        /* Mostly damaged frames; sometimes a run of junk past the frame limit */
+        if (rand_u32() % 16 == 0) {
+            len = CMD_BIN_FRAME_MAX + 1u + rand_u32() % CMD_BIN_FRAME_MAX;
+            for (size_t i = 0; i < len; i++)
+                buf[i] = (uint8_t)(1u + rand_u32() % 255u);
+        } else {
+            len = fuzz_frame(buf, sizeof(buf) - 1);
+        }
+        buf[len++] = 0;
+
+        uint8_t q = 0;
+        size_t sn = cmd_bin_encode(CMD_BIN_QUERY, (uint8_t)n, &q, 1, sentinel, sizeof(sentinel));
+
+        bool fed = rx_feed(buf, len, max_frag) && rx_feed(sentinel, sn, max_frag);
+        collect();
+
+        const Reply *st = reply_of(CMD_BIN_STATUS);
+        bool ok = fed && reply_bad == 0 && st && st->seq == (uint8_t)n;
+        recovered += ok;
+        if (!ok) {
+            CHECK(false, "case %lu: fed %d, %lu replies, %lu bad", (unsigned long)n, fed,
+                  (unsigned long)reply_count, (unsigned long)reply_bad);
+            break;
+        }
+    }
+
+    printf("  %lu cases: %lu recovered, %lu ok, %lu CRC, %lu frame, %lu unknown, %lu bad args, "
+           "%lu overlong, %lu wrapped\n",
+           (unsigned long)FUZZ_CASES, (unsigned long)recovered, (unsigned long)cmd.stats.packets,
+           (unsigned long)cmd.stats.crc_errors, (unsigned long)cmd.stats.frame_errors,
+           (unsigned long)cmd.stats.unknown, (unsigned long)cmd.stats.bad_args,
+           (unsigned long)cmd.stats.overlong, (unsigned long)cmd.stats.linearized);
+
+    CHECK(recovered == FUZZ_CASES, "%lu of %lu cases resynced", (unsigned long)recovered,
+          (unsigned long)FUZZ_CASES);
+    CHECK(cmd.stats.crc_errors > 0 && cmd.stats.frame_errors > 0 && cmd.stats.overlong > 0 &&
+          cmd.stats.linearized > 0, "fuzzing missed the CRC, framing, overlong or wrap paths");
+}
+
+/* ============================================================================
+ *  Throughput
+ * ========================================================================== */
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_decode(void)
+{
+    uint8_t frame[CMD_BIN_FRAME_MAX + 1];
+    uint8_t work[CMD_BIN_FRAME_MAX + 1];
+    uint8_t p[CMD_BIN_PAYLOAD_MAX] = { 0 };
+    static const struct { const char *name; uint8_t type; size_t len; } cases[] = {
+        { "move",       CMD_BIN_MOVE,       5 },
+        { "group_move", CMD_BIN_GROUP_MOVE, 4 * AXES },
+        { "query",      CMD_BIN_QUERY,      1 },
+    };
+
+    setup();
+    cmd.dry_run = true;
+    put_i32(p + 1, -123456);
+
+    for (size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+        size_t n = cmd_bin_encode(cases[k].type, 17, p, cases[k].len, frame, sizeof(frame));
+        double start = now_ns();
+
+        for (uint32_t r = 0; r < BENCH_RUNS; r++) {
+            memcpy(work, frame, n);         /* Decoding is destructive */
+            cmd.synced = false;
+            cmd_bin_execute(&cmd, work, n - 1);
+        }
+
+        double avg = (now_ns() - start) / BENCH_RUNS;
+        printf("  %-10s %2zu B: %4.0f ns (%9.0f cmd/s)\n", cases[k].name, n, avg, 1e9 / avg);
+    }
+
+    cmd.dry_run = false;
+    CHECK(cmd.stats.packets == 3 * BENCH_RUNS, "%lu of %lu dry-run packets ok",
+          (unsigned long)cmd.stats.packets, (unsigned long)(3 * BENCH_RUNS));
+    collect();
+    CHECK(reply_count == 0, "dry run replied");
+}
+
+int main(void)
+{
+    printf("Commands\n");
+    test_commands();
+    printf("Errors\n");
+    test_errors();
+    printf("Wrapped and overlong frames\n");
+    test_wrap_overlong();
+    printf("PVT streaming\n");
+    test_pvt();
+    printf("Fuzzing\n");
+    test_fuzz();
+    printf("Throughput (host, dry run)\n");
+    bench_decode();
+    return HOST_TEST_RESULT("test_cmd_bin");
+}
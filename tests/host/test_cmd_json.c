@@ -0,0 +1,614 @@
+/*
+ * test_cmd_json.c — JSON command interpreter over a stand-in RX ring
+ *
+ * The interpreter runs on the real consumer API semantics (linear block,
+ * peek, skip) over a small lwrb ring, so commands wrap; replies are
+ * captured from log_vprintf and commands drive two simulated TMC5240s.
+ *
+ * - Every command and error reply, with its effect on the axes
+ * - Fuzzing: mutated and random lines, streamed in random fragments,
+ *   must never consume past the ring, must get one well-formed reply per
+ *   command, and a long blank pad must always resync the interpreter
+ * - Throughput and worst-case cost of typical and adversarial lines
+ * - Fragmented delivery: a command stream cut into 1..7 byte pieces must
+ *   give the same replies as whole delivery, the token budget must reject
+ *   a flood before its line ends, and the resumable scan is timed against
+ *   re-parsing from the first byte on every fragment
+ */
+
+#include "host_test.h"
+#include "cmd_json.h"
+#include "fmt.h"
+#include "lwrb.h"
+#include "tmc5240_driver.h"
+#include "tmc5240_sim.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define AXES            2
+#define RX_RING_SIZE    300u        /* Bytes; small so commands wrap */
+#define OUT_SIZE        (1u << 20)
+#define FUZZ_CASES      20000u
+#define BENCH_RUNS      20000u
+#define FRAG_TRIALS     500u
+
+static Tmc5240Sim sim[AXES];
+static TMC5240_Context ctx[AXES];
+static Stepper axes[AXES];
+static StepperGroup group;
+static CmdJson cmd;
+
+/* ============================================================================
+ *  UART RX stand-in and reply capture
+ * ========================================================================== */
+
+static uint8_t rx_data[RX_RING_SIZE + 1];
+static lwrb_t rx_ring;
+static uint32_t lines;              /* Commands consumed, from cmd_json_poll */
+
+size_t uart_rx_available(void)
+{
+    return lwrb_get_full(&rx_ring);
+}
+
+size_t uart_rx_linear(const uint8_t **data)
+{
+    *data = (const uint8_t *)lwrb_get_linear_block_read_address(&rx_ring);
+    return lwrb_get_linear_block_read_length(&rx_ring);
+}
+
+size_t uart_rx_peek(size_t skip, void *buf, size_t len)
+{
+    return lwrb_peek(&rx_ring, skip, buf, len);
+}
+
+void uart_rx_skip(size_t len)
+{
+    CHECK(len <= lwrb_get_full(&rx_ring), "skipped %zu of %zu queued bytes",
+          len, lwrb_get_full(&rx_ring));
+    lwrb_skip(&rx_ring, len);
+}
+
+static char out[OUT_SIZE];
+static size_t out_len;
+
+static void out_put(void *ctx_, const char *s, size_t len)
+{
+    (void)ctx_;
+    if (out_len + len < sizeof(out)) {
+        memcpy(out + out_len, s, len);
+        out_len += len;
+        out[out_len] = '\0';
+    }
+}
+
+int log_vprintf(const char *fmt, va_list ap)
+{
+    return (int)fmt_vformat(out_put, NULL, fmt, ap);
+}
+
+/* Empty ring starting `offset` bytes in, interpreter and replies reset */
+static void rx_reset(size_t offset)
+{
+    lwrb_init(&rx_ring, rx_data, sizeof(rx_data));
+    lwrb_advance(&rx_ring, offset % RX_RING_SIZE);
+    lwrb_skip(&rx_ring, offset % RX_RING_SIZE);
+    cmd_json_init(&cmd, &group);
+    out_len = 0;
+    out[0] = '\0';
+    lines = 0;
+}
+
+static uint32_t rng = 1;
+
+static uint32_t rand_u32(void)
+{
+    rng = rng * 1664525u + 1013904223u;
+    return rng >> 8;
+}
+
+/*
+ * Deliver len bytes in fragments of 1..max_frag bytes as far as the ring
+ * takes them, polling after each. Returns false if the interpreter stops
+ * consuming a full ring.
+ */
+static bool rx_feed(const char *data, size_t len, size_t max_frag)
+{
+    while (len > 0) {
+        size_t n = 1u + rand_u32() % max_frag;
+        if (n > len)
+            n = len;
+        n = lwrb_write(&rx_ring, data, n);
+        data += n;
+        len -= n;
+
+        size_t before = uart_rx_available();
+        lines += cmd_json_poll(&cmd);
+        if (n == 0 && uart_rx_available() == before)
+            return false;
+    }
+    lines += cmd_json_poll(&cmd);
+    return true;
+}
+
+static bool rx_feed_str(const char *s)
+{
+    return rx_feed(s, strlen(s), RX_RING_SIZE);
+}
+
+static void setup(void)
+{
+    tmc5240_sim_attach(sim, AXES);
+
+    stepper_group_init(&group);
+    for (uint8_t i = 0; i < AXES; i++) {
+        ctx[i] = (TMC5240_Context){
+            .icID = i,
+            .hspi = &sim[i].hspi,
+            .cs_port = GPIOA,
+            .cs_pin = (uint16_t)(1u << i),
+            .vmax = 0x2710,
+            .amax = 0x0F8D,
+            .dmax = 0x0F8D,
+        };
+        stepper_init(&axes[i], i, &TMC5240_Driver, &ctx[i]);
+        stepper_group_add(&group, &axes[i]);
+    }
+    stepper_group_enable(&group, true);
+    rx_reset(0);
+}
+
+/* ============================================================================
+ *  Commands
+ * ========================================================================== */
+
+static void expect(const char *line, const char *reply)
+{
+    out_len = 0;
+    out[0] = '\0';
+    rx_feed_str(line);
+    CHECK(strcmp(out, reply) == 0, "%s -> \"%s\", expected \"%s\"", line, out, reply);
+}
+
+static void test_commands(void)
+{
+    setup();
+
+    expect("{\"cmd\":\"group_move\",\"pos\":[300,-400],\"id\":1}\n", "{\"id\":1,\"ok\":true}\r\n");
+    CHECK(sim[0].reg[TMC5240_XTARGET] == 300 && sim[1].reg[TMC5240_XTARGET] == -400,
+          "group_move targets %ld / %ld", (long)sim[0].reg[TMC5240_XTARGET],
+          (long)sim[1].reg[TMC5240_XTARGET]);
+
+    host_advance_us(2000000u);
+    tmc5240_sim_run();
+
+    expect("{\"id\":2,\"cmd\":\"move\",\"axis\":1,\"pos\":-123456}\r\n", "{\"id\":2,\"ok\":true}\r\n");
+    CHECK(sim[1].reg[TMC5240_XTARGET] == -123456, "move target %ld",
+          (long)sim[1].reg[TMC5240_XTARGET]);
+
+    expect("{\"cmd\":\"profile\",\"axis\":0,\"vmax\":40000,\"amax\":80000}\n", "{\"ok\":true}\r\n");
+    CHECK(ctx[0].vmax == tmc5240_vmax_from_sps(40000.0f) &&
+          ctx[0].amax == tmc5240_amax_from_sps2(80000.0f) && ctx[0].dmax == 0x0F8D,
+          "profile set vmax %lu amax %lu dmax %lu", (unsigned long)ctx[0].vmax,
+          (unsigned long)ctx[0].amax, (unsigned long)ctx[0].dmax);
+
+    /* The driver saturates VMAX; a driver without profiles refuses it */
+    uint32_t vmax = ctx[0].vmax;
+    expect("{\"cmd\":\"profile\",\"axis\":0,\"vmax\":2147483647}\n", "{\"ok\":true}\r\n");
+    CHECK(ctx[0].vmax == TMC5240_MAX_VELOCITY, "profile vmax %lu", (unsigned long)ctx[0].vmax);
+    ctx[0].vmax = vmax;
+
+    static StepperDriver no_profile;
+    no_profile = TMC5240_Driver;
+    no_profile.caps &= ~STEPPER_CAP_PROFILE;
+    axes[0].driver = &no_profile;
+    expect("{\"cmd\":\"profile\",\"axis\":0,\"vmax\":1000}\n", "{\"ok\":false,\"err\":\"args\"}\r\n");
+    axes[0].driver = &TMC5240_Driver;
+    CHECK(ctx[0].vmax == vmax, "refused profile changed vmax to %lu", (unsigned long)ctx[0].vmax);
+
+    expect("{\"cmd\":\"status\",\"axis\":0,\"id\":3}\n",
+           "{\"id\":3,\"ok\":true,\"pos\":300,\"target\":300,\"moving\":false}\r\n");
+
+    /* Errors */
+    expect("{\"cmd\":\"jump\",\"id\":4}\n", "{\"id\":4,\"ok\":false,\"err\":\"cmd\"}\r\n");
+    expect("{\"cmd\":\"move\",\"axis\":2,\"pos\":1}\n", "{\"ok\":false,\"err\":\"args\"}\r\n");
+    expect("{\"cmd\":\"move\",\"axis\":0,\"pos\":2147483648}\n", "{\"ok\":false,\"err\":\"args\"}\r\n");
+    expect("{\"cmd\":\"group_move\",\"pos\":[1]}\n", "{\"ok\":false,\"err\":\"args\"}\r\n");
+    expect("{\"cmd\":\"profile\",\"axis\":0,\"vmax\":-1}\n", "{\"ok\":false,\"err\":\"args\"}\r\n");
+    expect("{\"cmd\":\"move\",]} and the rest of the line\n", "{\"ok\":false,\"err\":\"parse\"}\r\n");
+    expect("[1,2]\n", "{\"ok\":false,\"err\":\"parse\"}\r\n");
+
+    /* Blank lines are skipped without a reply */
+    expect("\r\n\n  \n", "");
+
+    /* Overlong: dropped without a reply, nothing past the cut runs */
+    char longline[CMD_JSON_LINE_MAX + 64];
+    memset(longline, 'a', CMD_JSON_LINE_MAX);
+    memcpy(longline, "{\"pad\":\"", 8);
+    strcpy(longline + CMD_JSON_LINE_MAX, " {\"cmd\":\"status\",\"axis\":0}\n");
+    expect(longline, "");
+    CHECK(cmd.stats.overlong == 1, "%lu overlong lines", (unsigned long)cmd.stats.overlong);
+
+    CHECK(cmd.stats.commands == 5 && cmd.stats.unknown == 1 && cmd.stats.bad_args == 5 &&
+          cmd.stats.parse_errors == 2, "stats: %lu ok, %lu unknown, %lu args, %lu parse",
+          (unsigned long)cmd.stats.commands, (unsigned long)cmd.stats.unknown,
+          (unsigned long)cmd.stats.bad_args, (unsigned long)cmd.stats.parse_errors);
+}
+
+/* ============================================================================
+ *  Fuzzing
+ * ========================================================================== */
+
+static const char *const seeds[] = {
+    "{\"cmd\":\"move\",\"axis\":0,\"pos\":-1200,\"id\":17}",
+    "{\"cmd\":\"group_move\",\"pos\":[1200,-400]}",
+    "{\"cmd\":\"group_move\",\"pos\":50}",
+    "{\"cmd\":\"profile\",\"axis\":1,\"vmax\":40000,\"amax\":80000,\"dmax\":80000}",
+    "{\"cmd\":\"status\",\"axis\":1,\"pad\":\"\\u0041\\\"\\\\\"}",
+    "{\"a\":{\"b\":[true,false,null,{\"c\":-0.5e3}]},\"cmd\":\"status\",\"axis\":0}",
+};
+
+/* A seed with random byte edits, or random JSON-ish bytes; no '\n' */
+static size_t fuzz_line(char *buf, size_t max)
+{
+    static const char alphabet[] = "{}[]\":,\\ -0123456789eE.+truefalsnu\r\t\x01\xff";
+    size_t len;
+
+    if (rand_u32() % 8 == 0) {
+        len = rand_u32() % max;
+        for (size_t i = 0; i < len; i++)
+            buf[i] = alphabet[rand_u32() % (sizeof(alphabet) - 1)];
+    } else {
+        const char *s = seeds[rand_u32() % (sizeof(seeds) / sizeof(seeds[0]))];
+        len = strlen(s);
+        memcpy(buf, s, len);
+
+        for (uint32_t edits = 1 + rand_u32() % 4; edits > 0; edits--) {
+            size_t at = rand_u32() % (len + 1);
+            char ch = alphabet[rand_u32() % (sizeof(alphabet) - 1)];
+
+            switch (rand_u32() % 4) {
+            case 0:                                 /* Replace */
+                if (at < len)
+                    buf[at] = ch;
+                break;
+            case 1:                                 /* Insert */
+                if (len < max) {
+                    memmove(buf + at + 1, buf + at, len - at);
+                    buf[at] = ch;
+                    len++;
+                }
+                break;
+            case 2:                                 /* Delete */
+                if (at < len) {
+                    memmove(buf + at, buf + at + 1, len - at - 1);
+                    len--;
+                }
+                break;
+            default:                                /* Truncate */
+                len = at;
+                break;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < len; i++)
+        if (buf[i] == '\n')
+            buf[i] = ' ';
+    return len;
+}
+
+/* Every reply line is one JSON object with "ok" */
+static bool replies_ok(uint32_t *count)
+{
+    const char *p = out;
+    const char *end;
+
+    *count = 0;
+    while ((end = strstr(p, "}\r\n")) != NULL) {
+        if (*p != '{' || !strstr(p, "\"ok\":") || strstr(p, "\"ok\":") > end)
+            return false;
+        (*count)++;
+        p = end + 3;
+    }
+    return *p == '\0';
+}
+
+static void test_fuzz(void)
+{
+    char line[CMD_JSON_LINE_MAX + 64];
+    char pad[CMD_JSON_LINE_MAX + 2];
+    char sentinel[64];
+    uint32_t recovered = 0;
+    uint32_t total_lines = 0;
+
+    setup();
+    rng = 0x1234567u;
+
+    /* Longer than any command: an open string or object turns overlong */
+    memset(pad, ' ', CMD_JSON_LINE_MAX);
+    pad[CMD_JSON_LINE_MAX] = '\n';
+    pad[CMD_JSON_LINE_MAX + 1] = '\0';
+
+    for (uint32_t n = 0; n < FUZZ_CASES; n++) {
+        size_t max_frag = 1u + rand_u32() % 64u;
+        size_t len = fuzz_line(line, sizeof(line) - 1);
+        uint32_t replies;
+
+        line[len++] = '\n';
+        out_len = 0;
+        out[0] = '\0';
+        lines = 0;
+
+        bool fed = rx_feed(line, len, max_frag) && rx_feed(pad, CMD_JSON_LINE_MAX + 1, max_frag);
+        fmt_snprintf(sentinel, sizeof(sentinel), "{\"cmd\":\"status\",\"axis\":0,\"id\":%lu}\n",
+                     (unsigned long)n);
+        fed = fed && rx_feed(sentinel, strlen(sentinel), max_frag);
+
+        char want[32];
+        fmt_snprintf(want, sizeof(want), "{\"id\":%lu,\"ok\":true", (unsigned long)n);
+        bool ok = fed && strstr(out, want) != NULL;
+        recovered += ok;
+        total_lines += lines;
+
+        if (!fed || !ok || !replies_ok(&replies) || replies != lines) {
+            CHECK(false, "case %lu \"%.*s\": fed %d, %lu lines, replies \"%s\"",
+                  (unsigned long)n, (int)len - 1, line, fed, (unsigned long)lines, out);
+            break;
+        }
+    }
+
+    uint32_t counted = cmd.stats.commands + cmd.stats.parse_errors + cmd.stats.unknown +
+                       cmd.stats.bad_args;
+
+    printf("  %lu cases: %lu recovered, %lu commands, %lu parse errors (%lu over the token "
+           "budget), %lu unknown, %lu bad args, %lu overlong, %lu wrapped\n",
+           (unsigned long)FUZZ_CASES, (unsigned long)recovered, (unsigned long)cmd.stats.commands,
+           (unsigned long)cmd.stats.parse_errors, (unsigned long)cmd.stats.token_overflows,
+           (unsigned long)cmd.stats.unknown, (unsigned long)cmd.stats.bad_args,
+           (unsigned long)cmd.stats.overlong, (unsigned long)cmd.stats.linearized);
+
+    CHECK(recovered == FUZZ_CASES, "%lu of %lu cases resynced", (unsigned long)recovered,
+          (unsigned long)FUZZ_CASES);
+    CHECK(counted == total_lines, "stats count %lu commands, poll returned %lu",
+          (unsigned long)counted, (unsigned long)total_lines);
+    CHECK(cmd.stats.overlong > 0 && cmd.stats.linearized > 0 && cmd.stats.parse_errors > 0,
+          "fuzzing missed the overlong, wrap or error paths");
+}
+
+/* ============================================================================
+ *  Throughput
+ * ========================================================================== */
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_commands(void)
+{
+    static const char *const cases[] = {
+        "{\"cmd\":\"move\",\"axis\":0,\"pos\":-123456,\"id\":17}",
+        "{\"cmd\":\"group_move\",\"pos\":[1200,-400],\"id\":18}",
+        "{\"cmd\":\"profile\",\"axis\":1,\"vmax\":40000,\"amax\":80000,\"dmax\":80000}",
+        "{\"cmd\":\"status\",\"axis\":0}",
+        /* Adversarial */
+        "{\"pad\":\"\\u0041\\u0042\\\"\\\\\\/\\b\\f\\n\\r\\t\\u0043\\u0044\\u0045\\u0046\\u0047\\u0048\\u0049"
+            "\\u004a\\u004b\\u004c\\u004d\\u004e\\u004f\\u0050\\u0051\\u0052\\u0053\\u0054\",\"cmd\":\"status\",\"axis\":0}",
+        "{\"x\":[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31,32]}",
+        "{\"cmd\":\"move\",\"axis\":0,\"pos\":99999999999999999999}",
+        "{\"cmd\":\"status\",\"axis\":0,\"a\":{\"b\":{\"c\":{\"d\":{\"e\":{\"f\":{\"g\":1}}}}}}}",
+        "[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]",
+        "{\"cmd\":\"move\",\"axis\":0,\"pos\":1",
+    };
+    static const char *const names[] = {
+        "move", "group_move", "profile", "status",
+        "escapes", "token flood", "int overflow", "nesting", "deep array", "truncated",
+    };
+
+    setup();
+    cmd.dry_run = true;
+
+    for (size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+        size_t len = strlen(cases[k]);
+        double worst = 0.0;
+        double start = now_ns();
+
+        for (uint32_t r = 0; r < BENCH_RUNS; r++) {
+            double t0 = now_ns();
+            cmd_json_execute(&cmd, cases[k], len);
+            double t = now_ns() - t0;
+            if (t > worst)
+                worst = t;
+        }
+
+        double avg = (now_ns() - start) / BENCH_RUNS;
+        printf("  %-13s %3zu B: %5.0f ns (%8.0f cmd/s), worst %6.0f ns\n",
+               names[k], len, avg, 1e9 / avg, worst);
+    }
+
+    cmd.dry_run = false;
+    CHECK(out_len == 0, "dry run replied");
+}
+
+/* ============================================================================
+ *  Fragmented delivery
+ * ========================================================================== */
+
+static void test_fragments(void)
+{
+    static const char *const msgs[] = {
+        "{\"cmd\":\"move\",\"axis\":0,\"pos\":-123456,\"id\":17}\r\n",
+        "{\"cmd\":\"group_move\",\"pos\":[1200,-400],\"id\":18}\n",
+        "{\"cmd\":\"status\",\"axis\":1,\"id\":7,\"s\":\"x\\u00e9\\\"q\"}\r\n",
+        "{\"cmd\":\"profile\",\"axis\":1,\"vmax\":40000,\"amax\":80000,\"dmax\":80000}\n",
+        "{\"x\":[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31,32]}\n",
+        "{\"cmd\":\"move\",]}\n",
+        "\r\n\n",
+        "hello\n",
+        "  {\"cmd\":\"nope\"}{\"cmd\":\"status\",\"axis\":0}\n",
+    };
+    static char stream[1u << 14];
+    static char ref[OUT_SIZE];
+    size_t len = 0;
+    size_t ref_len;
+    CmdJsonStats ref_stats;
+    uint32_t resumed = 0;
+    uint32_t linearized = 0;
+
+    rng = 12345u;
+    for (uint32_t i = 0; i < 200; i++) {
+        const char *m = msgs[rand_u32() % (sizeof(msgs) / sizeof(msgs[0]))];
+        memcpy(stream + len, m, strlen(m));
+        len += strlen(m);
+    }
+
+    /* Reference: as much as the ring takes at once */
+    setup();
+    rx_feed(stream, len, RX_RING_SIZE);
+    memcpy(ref, out, out_len + 1);
+    ref_len = out_len;
+    ref_stats = cmd.stats;
+
+    for (uint32_t trial = 0; trial < FRAG_TRIALS; trial++) {
+        setup();
+        rx_reset(trial * 37u);
+        rx_feed(stream, len, 7);
+        resumed += cmd.stats.resumed;
+        linearized += cmd.stats.linearized;
+
+        if (out_len != ref_len || memcmp(out, ref, ref_len) != 0 ||
+            cmd.stats.commands != ref_stats.commands ||
+            cmd.stats.parse_errors != ref_stats.parse_errors ||
+            cmd.stats.token_overflows != ref_stats.token_overflows ||
+            cmd.stats.unknown != ref_stats.unknown || cmd.stats.bad_args != ref_stats.bad_args) {
+            CHECK(false, "trial %lu: %zu reply bytes vs %zu whole, %lu vs %lu commands",
+                  (unsigned long)trial, out_len, ref_len, (unsigned long)cmd.stats.commands,
+                  (unsigned long)ref_stats.commands);
+            break;
+        }
+    }
+
+    printf("  %zu B stream, %lu commands, %lu errors: %lu trials in 1..7 B fragments match, "
+           "%lu resumed scans, %lu wrapped per trial\n",
+           len, (unsigned long)ref_stats.commands,
+           (unsigned long)(ref_stats.parse_errors + ref_stats.unknown + ref_stats.bad_args),
+           (unsigned long)FRAG_TRIALS, (unsigned long)(resumed / FRAG_TRIALS),
+           (unsigned long)(linearized / FRAG_TRIALS));
+    CHECK(resumed > 0 && linearized > 0, "fragments never resumed or wrapped");
+}
+
+static void test_token_budget(void)
+{
+    char flood[4 * CMD_JSON_TOKENS + 16];
+    size_t n = 0;
+
+    setup();
+
+    /* More values than tokens, no end yet: rejected before the line ends */
+    n += (size_t)fmt_snprintf(flood, sizeof(flood), "{\"x\":[");
+    for (uint32_t i = 0; i < CMD_JSON_TOKENS; i++)
+        n += (size_t)fmt_snprintf(flood + n, sizeof(flood) - n, "%lu,", (unsigned long)i % 10);
+    rx_feed(flood, n, 3);
+    CHECK(strcmp(out, "{\"ok\":false,\"err\":\"parse\"}\r\n") == 0 && cmd.stats.token_overflows == 1,
+          "token flood: \"%s\", %lu overflows", out, (unsigned long)cmd.stats.token_overflows);
+
+    /* The rest of its line is skipped, the next line runs */
+    expect("5,6]}\n{\"cmd\":\"status\",\"axis\":0,\"id\":1}\n",
+           "{\"id\":1,\"ok\":true,\"pos\":0,\"target\":0,\"moving\":false}\r\n");
+
+    /* Nesting deeper than the pool */
+    memset(flood, '[', CMD_JSON_TOKENS + 1);
+    flood[CMD_JSON_TOKENS + 1] = '\0';
+    expect(flood, "{\"ok\":false,\"err\":\"parse\"}\r\n");
+    CHECK(cmd.stats.token_overflows == 2, "%lu overflows", (unsigned long)cmd.stats.token_overflows);
+}
+
+static void bench_fragments(void)
+{
+    static const char *const cases[] = {
+        "{\"cmd\":\"move\",\"axis\":0,\"pos\":-123456,\"id\":17}",
+        "{\"cmd\":\"profile\",\"axis\":1,\"vmax\":40000,\"amax\":80000,\"dmax\":80000}",
+        "{\"cmd\":\"status\",\"axis\":0,\"pad\":\"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA"
+            "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA\"}",
+    };
+    static const size_t frag_max[] = { 1, 4, 16, 64 };
+    jsmntok_t tok[CMD_JSON_TOKENS];
+    const uint32_t runs = 20000;
+
+    for (size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+        const char *js = cases[k];
+        size_t len = strlen(js);
+        jsmn_parser p;
+
+        jsmn_init(&p, NULL);
+        int whole = jsmn_parse(&p, js, len, tok, CMD_JSON_TOKENS, NULL);
+
+        for (size_t f = 0; f < sizeof(frag_max) / sizeof(frag_max[0]); f++) {
+            uint32_t frags = 0;
+            int res = 0;
+            double start;
+
+            /* Resumable: each fragment is scanned once */
+            rng = 1;
+            start = now_ns();
+            for (uint32_t r = 0; r < runs; r++) {
+                size_t have = 0;
+
+                jsmn_init_stream(&p);
+                res = JSMN_ERROR_PART;
+                while (have < len && res == JSMN_ERROR_PART) {
+                    have += 1u + rand_u32() % frag_max[f];
+                    if (have > len)
+                        have = len;
+                    res = jsmn_parse(&p, js, have, tok, CMD_JSON_TOKENS, NULL);
+                    frags++;
+                }
+            }
+            double stream_ns = (now_ns() - start) / runs;
+
+            /* Same fragments, parsed again from the first byte each time */
+            rng = 1;
+            start = now_ns();
+            for (uint32_t r = 0; r < runs; r++) {
+                size_t have = 0;
+
+                while (have < len) {
+                    have += 1u + rand_u32() % frag_max[f];
+                    if (have > len)
+                        have = len;
+                    jsmn_init(&p, NULL);
+                    jsmn_parse(&p, js, have, tok, CMD_JSON_TOKENS, NULL);
+                }
+            }
+            double reparse_ns = (now_ns() - start) / runs;
+
+            printf("  %3zu B in 1..%-2zu B fragments (%3lu): resumable %6.0f ns, re-parse %7.0f ns, x%.1f\n",
+                   len, frag_max[f], (unsigned long)(frags / runs), stream_ns, reparse_ns,
+                   reparse_ns / stream_ns);
+            CHECK(res == whole, "%zu B in 1..%zu B fragments: %d tokens, %d whole",
+                  len, frag_max[f], res, whole);
+        }
+    }
+}
+
+int main(void)
+{
+    printf("Commands\n");
+    test_commands();
+    printf("Fuzzing\n");
+    test_fuzz();
+    printf("Throughput (host, dry run)\n");
+    bench_commands();
+    printf("Fragmented delivery\n");
+    test_fragments();
+    test_token_budget();
+    bench_fragments();
+    return HOST_TEST_RESULT("test_cmd_json");
+}
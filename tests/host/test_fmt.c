@@ -0,0 +1,61 @@
+/*
+ * test_fmt.c — fmt_snprintf against the C library for every format the
+ * firmware uses, plus truncation and measuring (put == NULL)
+ */
+
+#include "host_test.h"
+#include "fmt.h"
+
+#include <string.h>
+
+#define SAME(...)                                                           \
+    do {                                                                    \
+        char want_[128], got_[128];                                         \
+        int nw_ = snprintf(want_, sizeof(want_), __VA_ARGS__);              \
+        int ng_ = fmt_snprintf(got_, sizeof(got_), __VA_ARGS__);            \
+        CHECK(nw_ == ng_ && strcmp(want_, got_) == 0,                       \
+              "libc \"%s\" (%d), fmt \"%s\" (%d)", want_, nw_, got_, ng_);  \
+    } while (0)
+
+static size_t measure(const char *format, ...)
+{
+    va_list ap;
+    size_t n;
+
+    va_start(ap, format);
+    n = fmt_vformat(NULL, NULL, format, ap);
+    va_end(ap);
+    return n;
+}
+
+int main(void)
+{
+    SAME("%lu %ld %08lX %-14s| %u", 4000000000ul, -2147483647L - 1, 0xBEEFul, "GCONF", 7u);
+    SAME("%5lu|%6ld|%08lu|%3u|%04x|%03lu|%d|%c|%-6s|%2u|%02X|%6lu|%08lx",
+         42ul, -42L, 123ul, 5u, 0xabu, 7ul, -1, 'Z', "ab", 3u, 0xfu, 1234567ul, 0xdeadbeeful);
+    SAME("100%% done %s", "ok");
+    SAME("%-13s|%-12s|", "x", "abcdefghijklmnop");
+    SAME("%lu.%03lu Hz", 12ul, 5ul);
+    SAME("%-5d|%05d|%5d", -3, -3, -3);
+
+    /* Sign flags */
+    SAME("(%+ld us)", 1234L);
+    SAME("(%+ld us)", -1234L);
+    SAME("(%+ld us)", 0L);
+    SAME("%+6d|%+06d|%-+6d|", 42, 42, 42);
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"     /* ' ' beside '+' is meant */
+    SAME("% d|% d|% 5d|%+ d|% +d", 7, -7, 7, 7, 7);
+#pragma GCC diagnostic pop
+    SAME("%+d", -2147483647 - 1);
+
+    /* Output is cut at the buffer, the return value is not */
+    char small[8];
+    int n = fmt_snprintf(small, sizeof(small), "%s", "0123456789");
+    CHECK(n == 10 && strcmp(small, "0123456") == 0, "truncated to \"%s\", returned %d", small, n);
+
+    CHECK(measure("Axis %lu: pos %+ld\r\n", 3ul, 250L) == strlen("Axis 3: pos +250\r\n"),
+          "measured length");
+
+    return HOST_TEST_RESULT("test_fmt");
+}
@@ -0,0 +1,184 @@
+/*
+ * test_gear.c — electronic gearing on simulated TMC5240s
+ *
+ * A master runs a full ramp while two slaves follow at +1 and -1/2. The
+ * gear is updated at 1, 2 and 5 kHz; foreign frames to the master between
+ * updates (as the DIAG0 service or telemetry issue them) must not leak
+ * into the sampled velocity.
+ *
+ * Two errors are measured against the simulated master:
+ * - command error: the geared master position vs. the XTARGET the slave
+ *   holds, just before each update; this is what the update rate buys
+ *   (about |v| * period)
+ * - following error: the slave's XACTUAL vs. the geared master position;
+ *   on top of the command error, a position-mode slave trails its target
+ *   by its braking distance v^2 / (2 * DMAX), whatever the update rate
+ *
+ * Ratios that gear the master past the VMAX register limit must saturate
+ * the slave VMAX instead of wrapping it.
+ */
+
+#include "host_test.h"
+#include "stepper_gear.h"
+#include "tmc5240_driver.h"
+#include "tmc5240_sim.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define AXES            3
+#define MASTER_TARGET   20000
+#define FOREIGN_EVERY   7       /* Updates between foreign master frames */
+
+static Tmc5240Sim sim[AXES];
+static TMC5240_Context ctx[AXES];
+static Stepper axes[AXES];
+static StepperGroup group;
+
+static void setup(void)
+{
+    tmc5240_sim_attach(sim, AXES);
+
+    stepper_group_init(&group);
+    for (uint8_t i = 0; i < AXES; i++) {
+        ctx[i] = (TMC5240_Context){
+            .icID = i,
+            .hspi = &sim[i].hspi,
+            .cs_port = GPIOA,
+            .cs_pin = (uint16_t)(1u << i),
+            .vmax = 0x2710,
+            .amax = 0x0F8D,
+            .dmax = 0x0F8D,
+            .tvmax = 1,         /* Retargeted every update: no peak hold */
+        };
+        stepper_init(&axes[i], i, &TMC5240_Driver, &ctx[i]);
+        stepper_group_add(&group, &axes[i]);
+    }
+    stepper_group_enable(&group, true);
+}
+
+static void run(uint32_t rate_hz, bool foreign)
+{
+    static const int32_t ratios[AXES] = { 0, STEPPER_GEAR_RATIO_ONE, -STEPPER_GEAR_RATIO_ONE / 2 };
+    StepperGear gear;
+    uint32_t period_us = 1000000u / rate_hz;
+    double v_err_max = 0.0;
+    double cmd_max = 0.0;
+    double track_max = 0.0;
+    double track_total = 0.0;
+    uint32_t samples = 0;
+
+    setup();
+    stepper_gear_start(&gear, &group, 0, ratios);
+    stepper_gear_measure(&gear, true);
+    stepper_move_to_position(&axes[0], MASTER_TARGET);
+
+    /* Velocity can change by AMAX * period between sample and use */
+    double v_tol = tmc5240_sps2_from_amax(ctx[0].amax) * period_us * 1e-6 + 2.0;
+
+    for (uint32_t n = 0; n < 4u * rate_hz; n++) {
+        host_advance_us(period_us);
+
+        if (foreign && n % FOREIGN_EVERY == 0)
+            tmc5240_readRegister(0, TMC5240_RAMPSTAT, false);
+
+        tmc5240_sim_run();
+        double v_master = tmc5240_sim_velocity(&sim[0]);
+
+        for (uint8_t i = 1; gear.stats.updates && i < AXES; i++) {
+            double ideal = gear.slave_origin[i] +
+                           (double)ratios[i] / STEPPER_GEAR_RATIO_ONE *
+                           (tmc5240_sim_xactual(&sim[0]) - gear.master_origin[i]);
+            double err = fabs(gear.slave_target[i] - ideal);
+            if (err > cmd_max)
+                cmd_max = err;
+        }
+
+        stepper_gear_update(&gear);
+
+        /* master_v answers a request made one update ago (or just now) */
+        double v_err = fabs(tmc5240_sps_from_vmax(gear.master_v) - v_master);
+        if (v_err > v_err_max)
+            v_err_max = v_err;
+
+        for (uint8_t i = 1; i < AXES; i++) {
+            double ideal = gear.slave_origin[i] +
+                           (double)ratios[i] / STEPPER_GEAR_RATIO_ONE *
+                           (tmc5240_sim_xactual(&sim[0]) - gear.master_origin[i]);
+            double err = fabs(tmc5240_sim_xactual(&sim[i]) - ideal);
+            if (err > track_max)
+                track_max = err;
+            track_total += err;
+            samples++;
+        }
+    }
+
+    stepper_gear_stop(&gear);
+    host_advance_us(1000000u);
+    tmc5240_sim_run();
+
+    /* Geared master top speed and the braking distance the slave trails by */
+    double v_top = tmc5240_sps_from_vmax((int32_t)ctx[0].vmax);
+    double cmd_tol = v_top * period_us * 1e-6 + 1.0;
+    double brake = v_top * v_top / (2.0 * tmc5240_sps2_from_amax(ctx[1].dmax));
+
+    printf("  %4lu Hz%-17s command error max %5.2f steps, following error max %5.1f mean %5.2f steps, "
+           "v error max %3.0f sps, %lu re-primes\n",
+           (unsigned long)rate_hz, foreign ? " + foreign frames" : "", cmd_max,
+           track_max, track_total / samples, v_err_max, (unsigned long)gear.stats.reprimes);
+
+    CHECK(v_err_max <= v_tol, "%lu Hz: sampled master velocity off by %.0f steps/s",
+          (unsigned long)rate_hz, v_err_max);
+    CHECK(foreign ? gear.stats.reprimes > 0 : gear.stats.reprimes == 0,
+          "%lu re-primes", (unsigned long)gear.stats.reprimes);
+    CHECK(tmc5240_sim_xactual(&sim[1]) == MASTER_TARGET, "slave 1 ended at %ld",
+          (long)tmc5240_sim_xactual(&sim[1]));
+    CHECK(tmc5240_sim_xactual(&sim[2]) == -MASTER_TARGET / 2, "slave 2 ended at %ld",
+          (long)tmc5240_sim_xactual(&sim[2]));
+    CHECK(cmd_max <= cmd_tol, "%lu Hz: command error %.2f steps over %.2f",
+          (unsigned long)rate_hz, cmd_max, cmd_tol);
+    CHECK(track_max <= brake + cmd_tol + 1.0, "%lu Hz: following error %.1f steps over %.1f",
+          (unsigned long)rate_hz, track_max, brake + cmd_tol + 1.0);
+}
+
+/* Slave VMAX stays within the register at extreme ratios */
+static void run_overspeed(void)
+{
+    static const int32_t ratios[AXES] = { 0, 2000 * STEPPER_GEAR_RATIO_ONE, INT32_MIN };
+    StepperGear gear;
+    uint32_t vmax_max[AXES] = { 0 };
+
+    setup();
+    stepper_gear_start(&gear, &group, 0, ratios);
+    stepper_move_to_position(&axes[0], MASTER_TARGET);
+
+    for (uint32_t n = 0; n < 2000u; n++) {
+        host_advance_us(1000u);
+        tmc5240_sim_run();
+        stepper_gear_update(&gear);
+        for (uint8_t i = 1; i < AXES; i++) {
+            if (ctx[i].shadow_vmax > vmax_max[i])
+                vmax_max[i] = ctx[i].shadow_vmax;
+        }
+    }
+    stepper_gear_stop(&gear);
+
+    printf("  overspeed: slave VMAX max %lu / %lu\n",
+           (unsigned long)vmax_max[1], (unsigned long)vmax_max[2]);
+    for (uint8_t i = 1; i < AXES; i++) {
+        CHECK(vmax_max[i] == TMC5240_MAX_VELOCITY, "slave %u VMAX peaked at %lu, limit %lu",
+              i, (unsigned long)vmax_max[i], (unsigned long)TMC5240_MAX_VELOCITY);
+    }
+}
+
+int main(void)
+{
+    static const uint32_t rates[] = { 1000, 2000, 5000 };
+
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        run(rates[r], false);
+        run(rates[r], true);
+    }
+    run_overspeed();
+    return HOST_TEST_RESULT("test_gear");
+}
@@ -0,0 +1,418 @@
+/*
+ * test_group_move.c — coordinated group moves (stepper_group_move_to_positions)
+ *
+ * STEP/DIR axes: Bresenham keeps every axis within one step of the ideal
+ * straight line and all of them finish on the same tick, from zero and
+ * from a non-zero start. TMC5240 axes: the scaled ramps predict the same
+ * arrival time, zero-delta axes keep their ramp, and plain group moves
+ * restore the nominal ramp. Synced moves: the registers the solver picks
+ * re-predict to its duration and spread. Mixed groups: the step period
+ * and the smart ramps stretch to one duration, whichever side is slower,
+ * and a smart axis that cannot fit its ramp refuses the move untouched.
+ * Velocity commands saturate at the VMAX register limit, INT32_MIN
+ * included.
+ */
+
+#include "host_test.h"
+#include "stepper.h"
+#include "tmc5240_driver.h"
+
+#include <stdlib.h>
+
+#define AXES            3
+#define US_PER_STEP     100u
+#define TICK_LIMIT      100000u
+
+/* ============================================================================
+ *  Virtual STEP/DIR axes
+ * ========================================================================== */
+
+static int32_t axis_pos[AXES];
+static bool axis_dir[AXES];
+static uint32_t axis_done_tick[AXES];
+static uint32_t tick;
+
+static void virt_enable(Stepper *s, bool en)
+{
+    (void)s;
+    (void)en;
+}
+
+static void virt_dir(Stepper *s, bool dir)
+{
+    axis_dir[s->stepper_id] = dir;
+}
+
+static void virt_step(Stepper *s)
+{
+    axis_pos[s->stepper_id] += axis_dir[s->stepper_id] ? 1 : -1;
+}
+
+static void virt_done(Stepper *s)
+{
+    axis_done_tick[s->stepper_id] = tick;
+}
+
+static const StepperDriver virt_driver = {
+    .caps       = STEPPER_CAP_STEP_DIR,
+    .set_enable = virt_enable,
+    .set_dir    = virt_dir,
+    .step_pulse = virt_step,
+};
+
+/*
+ * Run one straight-line move to completion. Returns the largest distance,
+ * in steps, of any axis from the ideal line through start and target.
+ */
+static double run_line(StepperGroup *g, const int32_t *target)
+{
+    int32_t start[AXES];
+    uint32_t major = 0;
+    uint8_t major_axis = 0;
+    double worst = 0.0;
+
+    for (uint8_t i = 0; i < AXES; i++) {
+        start[i] = axis_pos[i];
+        axis_done_tick[i] = 0;
+        uint32_t d = (uint32_t)abs(target[i] - start[i]);
+        if (d > major) {
+            major = d;
+            major_axis = i;
+        }
+    }
+
+    tick = 0;
+    CHECK(stepper_group_move_to_positions(g, target), "move rejected");
+
+    while (g->busy_mask && tick < TICK_LIMIT) {
+        tick++;
+        stepper_group_update(g, US_PER_STEP);
+
+        double progress = (double)abs(axis_pos[major_axis] - start[major_axis]) / major;
+        for (uint8_t i = 0; i < AXES; i++) {
+            double ideal = start[i] + progress * (target[i] - start[i]);
+            double dev = axis_pos[i] - ideal;
+            if (dev < 0)
+                dev = -dev;
+            if (dev > worst)
+                worst = dev;
+        }
+    }
+
+    CHECK(tick < TICK_LIMIT, "group still busy after %u ticks", TICK_LIMIT);
+
+    uint32_t first = UINT32_MAX;
+    uint32_t last = 0;
+    for (uint8_t i = 0; i < AXES; i++) {
+        CHECK(axis_pos[i] == target[i], "axis %u at %ld, target %ld",
+              i, (long)axis_pos[i], (long)target[i]);
+        CHECK(!g->steppers[i]->busy && !g->steppers[i]->interpolated,
+              "axis %u left busy", i);
+        if (target[i] == start[i])
+            continue;
+        if (axis_done_tick[i] < first)
+            first = axis_done_tick[i];
+        if (axis_done_tick[i] > last)
+            last = axis_done_tick[i];
+    }
+
+    CHECK(last - first == 0, "arrival spread %lu ticks", (unsigned long)(last - first));
+    printf("  line to (%ld, %ld, %ld): %lu ticks, spread %lu, max deviation %.2f steps\n",
+           (long)target[0], (long)target[1], (long)target[2], (unsigned long)tick,
+           (unsigned long)(last - first), worst);
+    return worst;
+}
+
+static void test_step_dir_lines(void)
+{
+    static Stepper axes[AXES];
+    static StepperGroup g;
+    static const int32_t moves[][AXES] = {
+        { 1000,   400, -250 },
+        { -300,   900,    0 },     /* Non-zero start, one axis holds */
+        { -299,  -977,  331 },
+        { 2000,  2000, 2000 },
+    };
+
+    stepper_group_init(&g);
+    for (uint8_t i = 0; i < AXES; i++) {
+        axis_pos[i] = 0;
+        stepper_init(&axes[i], i, &virt_driver, NULL);
+        stepper_set_speed(&axes[i], US_PER_STEP);
+        stepper_set_done_callback(&axes[i], virt_done);
+        stepper_group_add(&g, &axes[i]);
+    }
+    stepper_group_enable(&g, true);
+
+    for (size_t m = 0; m < sizeof(moves) / sizeof(moves[0]); m++) {
+        double dev = run_line(&g, moves[m]);
+        CHECK(dev <= 1.0, "path deviation %.2f steps", dev);
+    }
+}
+
+/* ============================================================================
+ *  TMC5240 axes (register writes captured by the driver shadow)
+ * ========================================================================== */
+
+static SPI_HandleTypeDef spi_bus[AXES];
+static TMC5240_Context tmc_ctx[AXES];
+
+static uint32_t scaled_arrival_us(const TMC5240_Context *ctx, uint32_t distance)
+{
+    TMC5240_Ramp r;
+
+    tmc5240_ramp_nominal(ctx, &r);
+    r.vmax = ctx->shadow_vmax;
+    r.amax = ctx->shadow_amax;
+    r.dmax = ctx->shadow_dmax;
+    return tmc5240_ramp_time_us(&r, distance);
+}
+
+static void test_smart_scaling(void)
+{
+    static Stepper axes[AXES];
+    static StepperGroup g;
+    static const int32_t target[AXES] = { 51200, 12800, 0 };
+
+    stepper_group_init(&g);
+    for (uint8_t i = 0; i < AXES; i++) {
+        tmc_ctx[i] = (TMC5240_Context){
+            .icID = i,
+            .hspi = &spi_bus[i],
+            .cs_port = GPIOA,
+            .cs_pin = (uint16_t)(1u << i),
+            .vmax = 0x2710,
+            .amax = 0x0F8D,
+            .dmax = 0x0F8D,
+        };
+        stepper_init(&axes[i], i, &TMC5240_Driver, &tmc_ctx[i]);
+        stepper_group_add(&g, &axes[i]);
+    }
+    stepper_group_enable(&g, true);
+
+    CHECK(stepper_group_move_to_positions(&g, target), "move rejected");
+
+    uint32_t t0 = scaled_arrival_us(&tmc_ctx[0], (uint32_t)target[0]);
+    uint32_t t1 = scaled_arrival_us(&tmc_ctx[1], (uint32_t)target[1]);
+    uint32_t spread = (t0 > t1) ? t0 - t1 : t1 - t0;
+
+    printf("  scaled ramps: %lu us / %lu us, spread %lu us\n",
+           (unsigned long)t0, (unsigned long)t1, (unsigned long)spread);
+    CHECK(spread * 100u <= t0, "scaled arrival spread %lu us of %lu us",
+          (unsigned long)spread, (unsigned long)t0);
+    CHECK(tmc_ctx[2].ramp_scale == STEPPER_RAMP_SCALE_ONE,
+          "zero-delta axis rescaled to %lu", (unsigned long)tmc_ctx[2].ramp_scale);
+
+    stepper_group_move_to(&g, 0);
+    for (uint8_t i = 0; i < AXES; i++) {
+        CHECK(tmc_ctx[i].ramp_scale == STEPPER_RAMP_SCALE_ONE,
+              "axis %u keeps ramp scale %lu after a group move",
+              i, (unsigned long)tmc_ctx[i].ramp_scale);
+        CHECK(tmc_ctx[i].shadow_vmax == tmc_ctx[i].vmax,
+              "axis %u VMAX %lu after a group move", i, (unsigned long)tmc_ctx[i].shadow_vmax);
+    }
+}
+
+/* Every axis of a synced move, re-predicted from the registers it was given */
+static void test_synced(void)
+{
+    static Stepper axes[AXES];
+    static StepperGroup g;
+    static const int32_t target[AXES] = { 40000, 1234, -9000 };
+    const uint32_t tolerance_us = 1000u;
+
+    stepper_group_init(&g);
+    for (uint8_t i = 0; i < AXES; i++) {
+        tmc_ctx[i] = (TMC5240_Context){
+            .icID = i,
+            .hspi = &spi_bus[i],
+            .cs_port = GPIOA,
+            .cs_pin = (uint16_t)(1u << i),
+            .vmax = 0x2710,
+            .amax = 0x0F8D,
+            .dmax = 0x0F8D,
+            .tzerowait = 1000,
+        };
+        stepper_init(&axes[i], i, &TMC5240_Driver, &tmc_ctx[i]);
+        stepper_group_add(&g, &axes[i]);
+    }
+    stepper_group_enable(&g, true);
+
+    bool within = stepper_group_move_synced(&g, target, tolerance_us);
+    uint32_t t_min = UINT32_MAX;
+    uint32_t t_max = 0;
+
+    for (uint8_t i = 0; i < AXES; i++) {
+        TMC5240_Context *ctx = &tmc_ctx[i];
+        TMC5240_Ramp r;
+
+        tmc5240_ramp_nominal(ctx, &r);
+        r.vmax = ctx->shadow_vmax;
+        r.amax = ctx->shadow_amax;
+        r.dmax = ctx->shadow_dmax;
+        r.tzerowait = 0;
+
+        uint32_t t = tmc5240_ramp_time_us(&r, (uint32_t)abs(target[i]));
+        printf("  axis %u: VMAX %5lu AMAX %4lu DMAX %4lu -> %lu us\n", i,
+               (unsigned long)r.vmax, (unsigned long)r.amax, (unsigned long)r.dmax,
+               (unsigned long)t);
+        if (t < t_min) t_min = t;
+        if (t > t_max) t_max = t;
+    }
+
+    printf("  predicted %lu us, spread %lu us (solver %lu us)\n",
+           (unsigned long)g.sync_duration_us, (unsigned long)(t_max - t_min),
+           (unsigned long)g.sync_spread_us);
+    CHECK(within, "solver spread %lu us over %lu us", (unsigned long)g.sync_spread_us,
+          (unsigned long)tolerance_us);
+    CHECK(t_max - t_min == g.sync_spread_us, "solver spread %lu us, registers give %lu us",
+          (unsigned long)g.sync_spread_us, (unsigned long)(t_max - t_min));
+    CHECK(t_max == g.sync_duration_us, "slowest axis %lu us, predicted %lu us",
+          (unsigned long)t_max, (unsigned long)g.sync_duration_us);
+
+    /* A member that cannot fit its ramp refuses the move untouched */
+    static StepperDriver untimed;
+    untimed = TMC5240_Driver;
+    untimed.caps &= ~STEPPER_CAP_TIMED_RAMP;
+    axes[AXES - 1].driver = &untimed;
+    static const int32_t back[AXES] = { 0, 0, 0 };
+    int32_t xtarget = tmc_ctx[0].shadow_xtarget;
+    CHECK(!stepper_group_move_synced(&g, back, tolerance_us) &&
+          tmc_ctx[0].shadow_xtarget == xtarget, "synced move without STEPPER_CAP_TIMED_RAMP");
+    axes[AXES - 1].driver = &TMC5240_Driver;
+}
+
+/* Two TMC5240 axes and one STEP/DIR axis (id AXES - 1) in one group */
+static void test_mixed(void)
+{
+    static Stepper axes[AXES];
+    static StepperGroup g;
+    static const int32_t moves[][AXES] = {
+        {  2000,   500, 5000 },      /* STEP/DIR pass is the longer */
+        { 42000, 30500, 5100 },      /* Smart ramps are the longer */
+    };
+    const uint32_t tolerance_us = 1000u;
+    const uint8_t sd = AXES - 1;
+
+    stepper_group_init(&g);
+    for (uint8_t i = 0; i < sd; i++) {
+        tmc_ctx[i] = (TMC5240_Context){
+            .icID = i,
+            .hspi = &spi_bus[i],
+            .cs_port = GPIOA,
+            .cs_pin = (uint16_t)(1u << i),
+            .vmax = 0x2710,
+            .amax = 0x0F8D,
+            .dmax = 0x0F8D,
+        };
+        stepper_init(&axes[i], i, &TMC5240_Driver, &tmc_ctx[i]);
+        stepper_group_add(&g, &axes[i]);
+    }
+    axis_pos[sd] = 0;
+    stepper_init(&axes[sd], sd, &virt_driver, NULL);
+    stepper_set_speed(&axes[sd], US_PER_STEP);
+    stepper_group_add(&g, &axes[sd]);
+    stepper_group_enable(&g, true);
+
+    for (size_t m = 0; m < sizeof(moves) / sizeof(moves[0]); m++) {
+        const int32_t *target = moves[m];
+        int32_t from[AXES];
+
+        /* As the group reads them (no chip behind the bus: XACTUAL 0) */
+        for (uint8_t i = 0; i < AXES; i++)
+            from[i] = stepper_get_position(&axes[i]);
+
+        CHECK(stepper_group_move_to_positions(&g, target), "mixed move rejected");
+
+        uint32_t duration = g.interp_us_per_step * g.interp_major;
+        CHECK(g.interp_us_per_step >= US_PER_STEP, "step period cut to %lu us",
+              (unsigned long)g.interp_us_per_step);
+
+        for (uint8_t i = 0; i < sd; i++) {
+            uint32_t t = scaled_arrival_us(&tmc_ctx[i], (uint32_t)abs(target[i] - from[i]));
+            uint32_t off = (t > duration) ? t - duration : duration - t;
+            printf("  move %zu axis %u: %lu us vs %lu us STEP/DIR\n", m, i,
+                   (unsigned long)t, (unsigned long)duration);
+            CHECK(off <= tolerance_us, "move %zu: axis %u arrives %lu us off the STEP/DIR axis",
+                  m, i, (unsigned long)off);
+        }
+
+        /* The Bresenham pass takes the duration it was stretched to */
+        uint32_t elapsed = 0;
+        while (g.interp_active && elapsed < TICK_LIMIT * US_PER_STEP * 100u) {
+            stepper_group_update(&g, US_PER_STEP);
+            elapsed += US_PER_STEP;
+        }
+        CHECK(axis_pos[sd] == target[sd], "move %zu: STEP/DIR axis at %ld", m, (long)axis_pos[sd]);
+        CHECK(elapsed + US_PER_STEP >= duration && elapsed <= duration + US_PER_STEP,
+              "move %zu: STEP/DIR pass %lu us, expected %lu us", m, (unsigned long)elapsed,
+              (unsigned long)duration);
+    }
+
+    /* A smart axis that cannot fit its ramp refuses the move untouched */
+    static StepperDriver untimed;
+    untimed = TMC5240_Driver;
+    untimed.caps &= ~STEPPER_CAP_TIMED_RAMP;
+    axes[1].driver = &untimed;
+    static const int32_t back[AXES] = { 100, 100, 0 };
+    int32_t xtarget = tmc_ctx[0].shadow_xtarget;
+    CHECK(!stepper_group_move_to_positions(&g, back) && tmc_ctx[0].shadow_xtarget == xtarget &&
+          !axes[sd].busy && axis_pos[sd] == moves[1][sd],
+          "mixed move without STEPPER_CAP_TIMED_RAMP");
+    axes[1].driver = &TMC5240_Driver;
+}
+
+/* Out-of-range velocities saturate at TMC5240_MAX_VELOCITY with the right sign */
+static void test_velocity_clamp(void)
+{
+    static Stepper axis;
+
+    tmc_ctx[0] = (TMC5240_Context){
+        .icID = 0,
+        .hspi = &spi_bus[0],
+        .cs_port = GPIOA,
+        .cs_pin = GPIO_PIN_0,
+        .vmax = 0x2710,
+        .amax = 0x0F8D,
+        .dmax = 0x0F8D,
+    };
+    stepper_init(&axis, 0, &TMC5240_Driver, &tmc_ctx[0]);
+    stepper_enable(&axis, true);
+
+    static const struct { int32_t sps; uint32_t vmax; uint8_t mode; } cases[] = {
+        { 10000,     13422,                TMC5240_MODE_VELPOS },
+        { -10000,    13422,                TMC5240_MODE_VELNEG },
+        { 6000000,   8053064,              TMC5240_MODE_VELPOS },
+        { 7000000,   TMC5240_MAX_VELOCITY, TMC5240_MODE_VELPOS },
+        { INT32_MAX, TMC5240_MAX_VELOCITY, TMC5240_MODE_VELPOS },
+        { INT32_MIN, TMC5240_MAX_VELOCITY, TMC5240_MODE_VELNEG },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        stepper_set_velocity(&axis, cases[i].sps);
+        CHECK(tmc_ctx[0].shadow_vmax == cases[i].vmax, "%ld steps/s: VMAX %lu, expected %lu",
+              (long)cases[i].sps, (unsigned long)tmc_ctx[0].shadow_vmax,
+              (unsigned long)cases[i].vmax);
+        CHECK(tmc_ctx[0].shadow_rampmode == cases[i].mode, "%ld steps/s: RAMPMODE %u",
+              (long)cases[i].sps, tmc_ctx[0].shadow_rampmode);
+    }
+
+    CHECK(stepper_set_ramp_limits(&axis, UINT32_MAX, 10000), "ramp limits rejected");
+    CHECK(tmc_ctx[0].shadow_vmax == TMC5240_MAX_VELOCITY, "ramp limit VMAX %lu",
+          (unsigned long)tmc_ctx[0].shadow_vmax);
+}
+
+int main(void)
+{
+    printf("STEP/DIR straight lines\n");
+    test_step_dir_lines();
+    printf("TMC5240 ramp scaling\n");
+    test_smart_scaling();
+    printf("TMC5240 synced move\n");
+    test_synced();
+    printf("Mixed TMC5240 / STEP/DIR group\n");
+    test_mixed();
+    printf("TMC5240 velocity limits\n");
+    test_velocity_clamp();
+    return HOST_TEST_RESULT("test_group_move");
+}
@@ -0,0 +1,210 @@
+/*
+ * test_group_scale.c — stepper group cost at 2, 8, 16 and 32 axes
+ *
+ * Virtual STEP/DIR axes with event support, no hardware access. Times
+ * group move dispatch, stepper_group_update per tick while the move runs
+ * and on an idle group, where the busy mask should make it nearly free
+ * whatever the size.
+ *
+ * Idle members are skipped by the update but their events are not: a
+ * stall or limit latched on an axis at rest must still reach its limit
+ * callback on the next update, in any position of the group.
+ */
+
+#include "host_test.h"
+#include "stepper.h"
+
+#include <time.h>
+
+#define IDLE_RUNS       100000u
+#define MOVE_RUNS       200u
+#define TICK_LIMIT      100000u
+
+/* Idle update of 32 axes against 2: both should be a mask test */
+#define IDLE_SCALE_MAX  4.0
+
+static int32_t axis_pos[STEPPER_GROUP_MAX];
+static bool axis_dir[STEPPER_GROUP_MAX];
+static uint32_t axis_events[STEPPER_GROUP_MAX];
+static uint32_t limit_calls[STEPPER_GROUP_MAX];
+
+/* ============================================================================
+ *  Virtual axes
+ * ========================================================================== */
+
+static void virt_enable(Stepper *s, bool en)
+{
+    (void)s;
+    (void)en;
+}
+
+static void virt_dir(Stepper *s, bool dir)
+{
+    axis_dir[s->stepper_id] = dir;
+}
+
+static void virt_step(Stepper *s)
+{
+    axis_pos[s->stepper_id] += axis_dir[s->stepper_id] ? 1 : -1;
+}
+
+static void virt_enable_events(Stepper *s, bool en)
+{
+    (void)s;
+    (void)en;
+}
+
+static uint32_t virt_read_events(Stepper *s)
+{
+    uint32_t ev = axis_events[s->stepper_id];
+
+    axis_events[s->stepper_id] = 0;
+    return ev;
+}
+
+static void virt_limit(Stepper *s, void *sw)
+{
+    (void)sw;
+    limit_calls[s->stepper_id]++;
+}
+
+static const StepperDriver virt_driver = {
+    .caps          = STEPPER_CAP_STEP_DIR | STEPPER_CAP_EVENTS,
+    .set_enable    = virt_enable,
+    .set_dir       = virt_dir,
+    .step_pulse    = virt_step,
+    .enable_events = virt_enable_events,
+    .read_events   = virt_read_events,
+};
+
+static Stepper axes[STEPPER_GROUP_MAX];
+static StepperGroup group;
+
+/* n axes; with events, completion of axis 0 would wait for a DONE event */
+static void setup(uint8_t n, bool events)
+{
+    stepper_group_init(&group);
+    for (uint8_t i = 0; i < n; i++) {
+        stepper_init(&axes[i], i, &virt_driver, NULL);
+        stepper_enable(&axes[i], true);
+        stepper_set_speed(&axes[i], 1);
+        stepper_enable_events(&axes[i], events && i > 0);
+        Stepper_enableLimits(&axes[i]);
+        axes[i].limit_cb = virt_limit;
+        stepper_group_add(&group, &axes[i]);
+        axis_pos[i] = 0;
+        axis_events[i] = 0;
+        limit_calls[i] = 0;
+    }
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* ============================================================================
+ *  Events on idle members
+ * ========================================================================== */
+
+static void test_idle_events(void)
+{
+    setup(STEPPER_GROUP_MAX, true);
+
+    /* One axis moving, the rest idle: each idle one stalls in turn */
+    stepper_move_to_position(&axes[0], 1000);
+
+    for (uint8_t i = 1; i < STEPPER_GROUP_MAX; i++) {
+        axis_events[i] = STEPPER_EVT_STALL;
+        stepper_handle_event_irq(&axes[i], DWT->CYCCNT);
+        stepper_group_update(&group, 1);
+
+        CHECK(limit_calls[i] == 1 && axes[i].limit_hit, "idle axis %u: %lu limit calls", i,
+              (unsigned long)limit_calls[i]);
+        CHECK(!axes[i].event_pending, "idle axis %u: event left pending", i);
+        Stepper_enableLimits(&axes[i]);
+    }
+
+    CHECK(group.busy_mask == 1u, "busy mask 0x%08lx", (unsigned long)group.busy_mask);
+    CHECK(limit_calls[0] == 0, "moving axis saw %lu limit calls", (unsigned long)limit_calls[0]);
+
+    /* Whole group at rest: the event is still serviced */
+    while (stepper_group_update(&group, 1))
+        ;
+    axis_events[STEPPER_GROUP_MAX - 1] = STEPPER_EVT_LIMIT_R;
+    stepper_handle_event_irq(&axes[STEPPER_GROUP_MAX - 1], DWT->CYCCNT);
+    stepper_group_update(&group, 1);
+    CHECK(axis_pos[0] == 1000, "moving axis ended at %ld", (long)axis_pos[0]);
+    CHECK(limit_calls[STEPPER_GROUP_MAX - 1] == 2, "idle group: limit not serviced");
+    CHECK(group.event_mask == 0, "event mask 0x%08lx left", (unsigned long)group.event_mask);
+}
+
+/* ============================================================================
+ *  Scaling
+ * ========================================================================== */
+
+static void bench_scaling(void)
+{
+    static const uint8_t sizes[] = { 2, 8, 16, 32 };
+    int32_t targets[STEPPER_GROUP_MAX];
+    double idle_ns[sizeof(sizes)] = { 0 };
+
+    for (uint32_t k = 0; k < sizeof(sizes); k++) {
+        uint8_t n = sizes[k];
+        if (n > STEPPER_GROUP_MAX)
+            break;
+
+        setup(n, false);
+
+        /* Dispatch: alternate between two targets so every run moves */
+        double move_ns = 0.0;
+        for (uint32_t r = 0; r < MOVE_RUNS; r++) {
+            for (uint8_t i = 0; i < n; i++)
+                targets[i] = (r & 1) ? 0 : 1000 + 37 * i;
+
+            double start = now_ns();
+            stepper_group_move_to_positions(&group, targets);
+            move_ns += now_ns() - start;
+
+            for (uint32_t t = 0; stepper_group_update(&group, 1) && t < TICK_LIMIT; t++)
+                ;
+        }
+
+        uint32_t updates = 0;
+        for (uint8_t i = 0; i < n; i++)
+            targets[i] = 3000 + 37 * i;
+        stepper_group_move_to_positions(&group, targets);
+
+        double start = now_ns();
+        while (stepper_group_update(&group, 1) && updates < TICK_LIMIT)
+            updates++;
+        double update_ns = now_ns() - start;
+
+        CHECK(group.busy_mask == 0 && !group.interp_active, "%u axes: move did not finish", n);
+        for (uint8_t i = 0; i < n; i++)
+            CHECK(axis_pos[i] == targets[i], "%u axes: axis %u at %ld", n, i, (long)axis_pos[i]);
+
+        start = now_ns();
+        for (uint32_t r = 0; r < IDLE_RUNS; r++)
+            stepper_group_update(&group, 1);
+        idle_ns[k] = (now_ns() - start) / IDLE_RUNS;
+
+        printf("  %2u axes: move %6.0f ns, update %5.1f ns/tick, idle %4.1f ns\n", n,
+               move_ns / MOVE_RUNS, updates ? update_ns / updates : 0.0, idle_ns[k]);
+    }
+
+    CHECK(idle_ns[3] <= IDLE_SCALE_MAX * idle_ns[0] + 5.0,
+          "idle update grows with the group: %.1f ns at 32 axes vs %.1f at 2", idle_ns[3], idle_ns[0]);
+}
+
+int main(void)
+{
+    printf("Events on idle members\n");
+    test_idle_events();
+    printf("Group scaling (host)\n");
+    bench_scaling();
+    return HOST_TEST_RESULT("test_group_scale");
+}
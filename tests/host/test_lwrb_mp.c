@@ -0,0 +1,164 @@
+/*
+ * test_lwrb_mp.c — lwrb_mp under producer contention
+ *
+ * Several threads reserve, fill and commit numbered messages into one
+ * ring while the main thread consumes it, once with the plain lwrb read
+ * API and once the way the TX DMA does (linear blocks running on into
+ * the mirror). Producers yield between reserve and commit, so commits
+ * come out of order and publishing is left to the last one open; they
+ * are also switched out inside LDREX/STREX windows, so claims and commits
+ * lose races and retry. Every message must arrive whole and in order per
+ * producer.
+ */
+
+#include "host_test.h"
+#include "lwrb_mp.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#define PRODUCERS       4
+#define MESSAGES        20000       /* Per producer */
+#define RING_SIZE       2048u
+#define MIRROR          512u
+#define MSG_MAX         48u
+#define PREEMPT_EVERY   5u          /* LDREX windows, see host_ex_preempt */
+
+static uint8_t ring_data[RING_SIZE + MIRROR];
+static lwrb_t ring;
+static lwrb_mp_t mp;
+static volatile bool stop;          /* Consumer found a bad message */
+
+/* "<id:seq:payload>", the payload length varies with seq */
+static size_t make_msg(char *buf, int id, int seq)
+{
+    return (size_t)snprintf(buf, MSG_MAX, "<%d:%d:%.*s>", id, seq, seq % 17,
+                            "abcdefghijklmnopq");
+}
+
+static void *producer(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    char msg[MSG_MAX];
+
+    for (int seq = 0; seq < MESSAGES && !stop; seq++) {
+        size_t n = make_msg(msg, id, seq);
+        lwrb_mp_res_t res;
+
+        while (!lwrb_mp_reserve(&mp, n, &res)) {
+            if (stop)
+                return NULL;
+            sched_yield();
+        }
+
+        memcpy(res.ptr[0], msg, res.part[0]);
+        if ((seq & 3) == 0)
+            sched_yield();          /* Hold the reservation open */
+        if (res.part[1] > 0)
+            memcpy(res.ptr[1], msg + res.part[0], res.part[1]);
+        lwrb_mp_commit(&mp, &res);
+    }
+    return NULL;
+}
+
+/* Consumed bytes in; returns false on the first bad message */
+typedef struct
+{
+    char buf[256];
+    size_t len;
+    int next[PRODUCERS];
+    long messages;
+} Checker;
+
+static bool check_messages(Checker *c)
+{
+    char *p = c->buf;
+    char *end = c->buf + c->len;
+    char *close;
+
+    while ((close = memchr(p, '>', (size_t)(end - p))) != NULL) {
+        char want[MSG_MAX];
+        int id = p[1] - '0';
+        size_t len = (size_t)(close - p) + 1;
+
+        if (p[0] != '<' || id < 0 || id >= PRODUCERS ||
+            make_msg(want, id, c->next[id]) != len || memcmp(p, want, len) != 0) {
+            CHECK(false, "message %ld corrupt: \"%.*s\"", c->messages, (int)len, p);
+            return false;
+        }
+        c->next[id]++;
+        c->messages++;
+        p = close + 1;
+    }
+
+    c->len = (size_t)(end - p);
+    memmove(c->buf, p, c->len);
+    return true;
+}
+
+static void run(bool dma)
+{
+    pthread_t threads[PRODUCERS];
+    Checker c = { 0 };
+
+    host_ex_preempt = PREEMPT_EVERY;
+    stop = false;
+    lwrb_init(&ring, ring_data, RING_SIZE);
+    lwrb_mp_init(&mp, &ring);
+    if (dma)
+        lwrb_mp_set_mirror(&mp, MIRROR);
+
+    for (int i = 0; i < PRODUCERS; i++)
+        pthread_create(&threads[i], NULL, producer, (void *)(intptr_t)i);
+
+    while (c.messages < (long)PRODUCERS * MESSAGES) {
+        size_t room = sizeof(c.buf) - c.len;
+        size_t n;
+
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (dma) {
+            /* One linear block from r, past the wrap into the mirror */
+            size_t full = lwrb_get_full(&ring);
+            size_t linear = RING_SIZE + MIRROR - ring.r;
+
+            n = (full < linear) ? full : linear;
+            if (n > room)
+                n = room;
+            memcpy(c.buf + c.len, &ring_data[ring.r], n);
+            lwrb_skip(&ring, n);
+        } else {
+            n = lwrb_read(&ring, c.buf + c.len, room);
+        }
+
+        if (n == 0) {
+            sched_yield();
+            continue;
+        }
+        c.len += n;
+        if (!check_messages(&c)) {
+            stop = true;
+            break;
+        }
+    }
+
+    for (int i = 0; i < PRODUCERS; i++)
+        pthread_join(threads[i], NULL);
+
+    printf("  %-6s %ld messages, %lu retries, %lu deferred commits, %lu full, open max %lu\n",
+           dma ? "mirror" : "plain", c.messages, (unsigned long)mp.retries,
+           (unsigned long)mp.deferred, (unsigned long)mp.full, (unsigned long)mp.open_max);
+
+    CHECK(c.messages == (long)PRODUCERS * MESSAGES, "%ld of %d messages",
+          c.messages, PRODUCERS * MESSAGES);
+    CHECK(c.len == 0 && lwrb_get_full(&ring) == 0, "bytes left over");
+    CHECK(mp.open_max > 1 && mp.deferred > 0, "reservations never overlapped");
+    CHECK(mp.retries > 0, "no STREX ever failed");
+}
+
+int main(void)
+{
+    run(false);
+    run(true);
+    return HOST_TEST_RESULT("test_lwrb_mp");
+}
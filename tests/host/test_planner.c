@@ -0,0 +1,232 @@
+/*
+ * test_planner.c — look-ahead planner on simulated TMC5240s
+ *
+ * A two-axis path with a straight run split into several segments and a
+ * few corners is executed at a 1 kHz update rate. Collinear vertices
+ * must be crossed near the feed, corners slowed for, and the path must
+ * end exactly on its last target. Groups with members that cannot run
+ * velocity segments are refused. The append cost is measured on the host
+ * together with the SPI frames each velocity command takes.
+ */
+
+#include "host_test.h"
+#include "stepper_planner.h"
+#include "tmc5240_driver.h"
+#include "tmc5240_sim.h"
+
+#include <math.h>
+#include <time.h>
+
+#define AXES            2
+#define FEED            20000.0f    /* steps/s */
+#define ACCEL           200000.0f   /* steps/s^2 per axis */
+#define JUNCTION_DEV    20.0f       /* steps */
+#define UPDATE_US       1000u
+#define TIME_LIMIT_US   10000000u
+#define CORNER_MISS     100.0       /* steps, closest approach to a vertex */
+#define BENCH_SEGMENTS  200000u
+
+static Tmc5240Sim sim[AXES];
+static TMC5240_Context ctx[AXES];
+static Stepper axes[AXES];
+static StepperGroup group;
+
+static const float accel[AXES] = { ACCEL, ACCEL };
+
+static void setup(void)
+{
+    tmc5240_sim_attach(sim, AXES);
+
+    stepper_group_init(&group);
+    for (uint8_t i = 0; i < AXES; i++) {
+        ctx[i] = (TMC5240_Context){
+            .icID = i,
+            .hspi = &sim[i].hspi,
+            .cs_port = GPIOA,
+            .cs_pin = (uint16_t)(1u << i),
+            .vmax = 0x2710,
+            .amax = 0x0F8D,
+            .dmax = 0x0F8D,
+        };
+        stepper_init(&axes[i], i, &TMC5240_Driver, &ctx[i]);
+        stepper_group_add(&group, &axes[i]);
+    }
+    stepper_group_enable(&group, true);
+}
+
+/* ============================================================================
+ *  Group validation
+ * ========================================================================== */
+
+static void stepdir_noop(Stepper *s)
+{
+    (void)s;
+}
+
+static void stepdir_enable(Stepper *s, bool en)
+{
+    (void)s;
+    (void)en;
+}
+
+static const StepperDriver stepdir_driver = {
+    .caps       = STEPPER_CAP_STEP_DIR,
+    .set_enable = stepdir_enable,
+    .step_pulse = stepdir_noop,
+};
+
+static void test_reject_step_dir(void)
+{
+    static Stepper mixed[AXES];
+    static StepperGroup g;
+    StepperPlanner p;
+
+    setup();
+    stepper_group_init(&g);
+    stepper_init(&mixed[0], 0, &TMC5240_Driver, &ctx[0]);
+    stepper_init(&mixed[1], 1, &stepdir_driver, NULL);
+    stepper_group_add(&g, &mixed[0]);
+    stepper_group_add(&g, &mixed[1]);
+
+    CHECK(!stepper_planner_init(&p, &g, accel, JUNCTION_DEV),
+          "group with a STEP/DIR member accepted");
+    CHECK(stepper_planner_init(&p, &group, accel, JUNCTION_DEV),
+          "TMC5240 group refused");
+}
+
+/* ============================================================================
+ *  Path execution
+ * ========================================================================== */
+
+static void test_path(void)
+{
+    /* Straight run in three pieces, a 90 degree corner, a 135 degree turn */
+    static const int32_t path[][AXES] = {
+        {  4000,     0 },
+        {  8000,     0 },
+        { 12000,     0 },
+        { 12000,  6000 },
+        {  6000,   500 },
+    };
+    static const size_t count = sizeof(path) / sizeof(path[0]);
+    StepperPlanner p;
+    float v_vertex[sizeof(path) / sizeof(path[0])] = { 0 };
+    double miss[sizeof(path) / sizeof(path[0])];
+    size_t next = 0;
+    uint32_t t = 0;
+
+    setup();
+    CHECK(stepper_planner_init(&p, &group, accel, JUNCTION_DEV), "planner refused the group");
+    for (size_t i = 0; i < count; i++) {
+        miss[i] = INFINITY;
+        CHECK(stepper_planner_append(&p, path[i], FEED), "segment %zu refused", i);
+    }
+
+    while (stepper_planner_update(&p) && t < TIME_LIMIT_US) {
+        host_advance_us(UPDATE_US);
+        tmc5240_sim_run();
+        t += UPDATE_US;
+
+        /*
+         * Path speed at the closest approach to each vertex; a corner is
+         * cut by up to the distance the turn takes
+         */
+        if (next < count) {
+            double d = hypot(tmc5240_sim_xactual(&sim[0]) - path[next][0],
+                             tmc5240_sim_xactual(&sim[1]) - path[next][1]);
+            if (d <= miss[next]) {
+                miss[next] = d;
+                v_vertex[next] = (float)hypot(tmc5240_sim_velocity(&sim[0]),
+                                              tmc5240_sim_velocity(&sim[1]));
+            } else if (miss[next] < CORNER_MISS) {
+                next++;
+            }
+        }
+    }
+
+    host_advance_us(100000u);
+    tmc5240_sim_run();
+
+    if (next < count && miss[next] < CORNER_MISS)
+        next++;                     /* Last vertex: the path stops on it */
+
+    printf("  path done in %.3f s, vertex speeds", t * 1e-6);
+    for (size_t i = 0; i < count; i++)
+        printf(" %.0f", v_vertex[i]);
+    printf(" steps/s, missed by");
+    for (size_t i = 0; i < count; i++)
+        printf(" %.0f", miss[i]);
+    printf(" steps\n");
+
+    CHECK(t < TIME_LIMIT_US, "planner still running after %u us", TIME_LIMIT_US);
+    CHECK(next == count, "passed %zu of %zu vertices within %.0f steps", next, count, CORNER_MISS);
+    CHECK(v_vertex[0] > 0.9f * FEED && v_vertex[1] > 0.9f * FEED,
+          "collinear vertices crossed at %.0f / %.0f steps/s", v_vertex[0], v_vertex[1]);
+    CHECK(v_vertex[2] < 0.5f * FEED && v_vertex[3] < 0.5f * FEED,
+          "corners taken at %.0f / %.0f steps/s", v_vertex[2], v_vertex[3]);
+    for (uint8_t i = 0; i < AXES; i++)
+        CHECK(tmc5240_sim_xactual(&sim[i]) == path[count - 1][i], "axis %u ended at %ld, target %ld",
+              i, (long)tmc5240_sim_xactual(&sim[i]), (long)path[count - 1][i]);
+    CHECK(ctx[0].ramp_scale == 0, "planner ramp left marked nominal");
+
+    /* The next plain move restores the nominal ramp */
+    stepper_move_to_position(&axes[0], 0);
+    CHECK(ctx[0].shadow_vmax == ctx[0].vmax && ctx[0].shadow_amax == ctx[0].amax &&
+          ctx[0].shadow_dmax == ctx[0].dmax, "nominal ramp not restored");
+}
+
+/* ============================================================================
+ *  Throughput
+ * ========================================================================== */
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_append(void)
+{
+    StepperPlanner p;
+    int32_t target[AXES] = { 0, 0 };
+    uint32_t appended = 0;
+
+    setup();
+    stepper_planner_init(&p, &group, accel, JUNCTION_DEV);
+
+    /* Zig-zag segments, the ring emptied whenever it fills */
+    double start = now_s();
+    for (uint32_t n = 0; n < BENCH_SEGMENTS; n++) {
+        target[0] += 400;
+        target[1] += (n & 1) ? -300 : 300;
+        if (!stepper_planner_append(&p, target, FEED)) {
+            p.tail = p.head;
+            p.planned = p.head;
+            stepper_planner_append(&p, target, FEED);
+        }
+        appended++;
+    }
+    double elapsed = now_s() - start;
+
+    /* SPI cost of one velocity command on every axis */
+    uint32_t frames = sim[0].frames + sim[1].frames;
+    stepper_planner_update(&p);
+    frames = sim[0].frames + sim[1].frames - frames;
+
+    printf("  append: %.0f ns/segment (host), %.0f segments/s; segment start %lu SPI frames\n",
+           elapsed * 1e9 / appended, appended / elapsed, (unsigned long)frames);
+    CHECK(appended == BENCH_SEGMENTS, "benchmark appended %lu", (unsigned long)appended);
+}
+
+int main(void)
+{
+    printf("Group validation\n");
+    test_reject_step_dir();
+    printf("Path execution\n");
+    test_path();
+    printf("Throughput\n");
+    bench_append();
+    return HOST_TEST_RESULT("test_planner");
+}
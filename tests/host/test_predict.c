@@ -0,0 +1,186 @@
+/*
+ * test_predict.c — ramp model predictor against a simulated TMC5240
+ *
+ * One axis runs a sequence of moves: a long move reaching VMAX, a short
+ * triangular one, a retarget that reverses mid-move, a move under
+ * explicit ramp limits and velocity mode up, down and to rest. DMAX is
+ * twice AMAX so the model has to pick the right rate for each phase.
+ * The moves are then repeated on the full six-point ramp, every band at
+ * its own rate, a start and stop speed and a TVMAX hold on short moves.
+ *
+ * The position is queried at 10 kHz. Every prediction must lie within
+ * the bound it reports, and the bound must hold with re-syncs rare
+ * enough to cut SPI traffic by an order of magnitude against reading
+ * XACTUAL on every query.
+ */
+
+#include "host_test.h"
+#include "stepper_predict.h"
+#include "tmc5240_driver.h"
+#include "tmc5240_sim.h"
+
+#include <math.h>
+
+#define QUERY_US        100u
+#define TOLERANCE       8.0f        /* steps */
+#define CLOCK_TOL       0.02f
+#define CHECK_EVERY     997u        /* Queries between stepper_predict_check() */
+
+static Tmc5240Sim sim;
+static TMC5240_Context ctx;
+static Stepper axis;
+static StepperPredictor pred;
+
+static uint32_t queries;
+static double err_max;
+static double bound_max;
+
+static const TMC5240_Context trapezoid = {
+    .vmax = 0x4E20,
+    .amax = 0x0F8D,
+    .dmax = 0x1F1A,
+};
+
+/* VSTART -> A1 -> V1 -> A2 -> V2 -> AMAX -> VMAX, DMAX -> D2 -> D1 -> VSTOP */
+static const TMC5240_Context six_point = {
+    .vstart = 0x0200,
+    .a1 = 0x2000,
+    .v1 = 0x1000,
+    .a2 = 0x1800,
+    .v2 = 0x3000,
+    .vmax = 0x4E20,
+    .amax = 0x0F8D,
+    .dmax = 0x1F1A,
+    .d2 = 0x1400,
+    .d1 = 0x2800,
+    .vstop = 0x0300,
+    .tvmax = 0x01E8,            /* 20 ms */
+};
+
+static uint32_t frames;
+
+static void setup(const TMC5240_Context *ramp)
+{
+    frames += sim.frames;
+    tmc5240_sim_attach(&sim, 1);
+
+    ctx = *ramp;
+    ctx.icID = 0;
+    ctx.hspi = &sim.hspi;
+    ctx.cs_port = GPIOA;
+    ctx.cs_pin = GPIO_PIN_0;
+    stepper_init(&axis, 0, &TMC5240_Driver, &ctx);
+    stepper_enable(&axis, true);
+
+    /* Stats run across both ramps */
+    StepperPredictStats stats = pred.stats;
+    stepper_predict_init(&pred, &axis, TOLERANCE, CLOCK_TOL);
+    pred.stats = stats;
+}
+
+/* Query for duration_us, comparing every prediction with the chip */
+static void run(const char *what, uint32_t duration_us)
+{
+    uint32_t syncs = pred.stats.syncs;
+    uint32_t n0 = queries;
+    double worst = 0.0;
+    double excess = -INFINITY;      /* Largest error - bound */
+    float run_bound_max = 0.0f;
+
+    for (uint32_t t = 0; t < duration_us; t += QUERY_US) {
+        float bound;
+
+        host_advance_us(QUERY_US);
+        int32_t x = stepper_predict_position(&pred, &bound);
+        tmc5240_sim_run();
+
+        /* The chip position is rounded too: half a step either way */
+        double err = fabs((double)x - tmc5240_sim_xactual(&sim));
+        if (err > worst)
+            worst = err;
+        if (err - bound > excess)
+            excess = err - bound;
+        if (bound > run_bound_max)
+            run_bound_max = bound;
+
+        if (++queries % CHECK_EVERY == 0)
+            stepper_predict_check(&pred);
+    }
+
+    if (worst > err_max)
+        err_max = worst;
+    if (run_bound_max > bound_max)
+        bound_max = run_bound_max;
+    printf("  %-24s %5lu queries, %3lu syncs, error max %4.1f steps\n", what,
+           (unsigned long)(queries - n0), (unsigned long)(pred.stats.syncs - syncs), worst);
+
+    CHECK(excess <= 0.5, "%s: error %.1f steps over the bound", what, excess);
+    CHECK(run_bound_max <= TOLERANCE, "%s: bound %.1f over the tolerance", what, run_bound_max);
+}
+
+int main(void)
+{
+    setup(&trapezoid);
+
+    stepper_move_to_position(&axis, 40000);
+    run("long move", 3500000u);
+    CHECK(tmc5240_sim_xactual(&sim) == 40000, "long move ended at %ld",
+          (long)tmc5240_sim_xactual(&sim));
+
+    stepper_move_to_position(&axis, 40500);
+    run("short move", 400000u);
+
+    stepper_move_to_position(&axis, -20000);
+    run("retarget: outward", 1200000u);
+    stepper_move_to_position(&axis, 10000);
+    run("retarget: reversed", 3000000u);
+
+    stepper_move_to_limited(&axis, 0, 4000, 10000);
+    run("ramp limits", 3500000u);
+
+    stepper_set_velocity(&axis, 12000);
+    run("velocity up", 1000000u);
+    stepper_set_velocity(&axis, -5000);
+    run("velocity reversed", 1500000u);
+    stepper_set_velocity(&axis, 0);
+    run("velocity to rest", 500000u);
+
+    setup(&six_point);
+
+    stepper_move_to_position(&axis, 40000);
+    run("six-point: long move", 3500000u);
+    CHECK(tmc5240_sim_xactual(&sim) == 40000, "six-point long move ended at %ld",
+          (long)tmc5240_sim_xactual(&sim));
+
+    stepper_move_to_position(&axis, 41500);
+    run("six-point: short move", 400000u);
+    CHECK(tmc5240_sim_xactual(&sim) == 41500, "six-point short move ended at %ld",
+          (long)tmc5240_sim_xactual(&sim));
+
+    stepper_move_to_position(&axis, 41503);
+    run("six-point: creep", 200000u);
+    CHECK(tmc5240_sim_xactual(&sim) == 41503, "creep ended at %ld", (long)tmc5240_sim_xactual(&sim));
+
+    stepper_move_to_position(&axis, -20000);
+    run("six-point: outward", 1200000u);
+    stepper_move_to_position(&axis, 10000);
+    run("six-point: reversed", 3000000u);
+
+    /* Plain polling takes a pipelined XACTUAL read, two frames, per query */
+    frames += sim.frames;
+    stepper_predict_print_stats(&pred);
+    printf("  %lu queries, %lu syncs (%.1f queries/sync), %.2f SPI frames/query vs 2 polling, "
+           "bound max %.1f steps\n",
+           (unsigned long)queries, (unsigned long)pred.stats.syncs,
+           (double)queries / pred.stats.syncs, (double)frames / queries, bound_max);
+
+    CHECK(pred.stats.violations == 0, "%lu of %lu checks outside the bound (max error %.1f, bound %.1f)",
+          (unsigned long)pred.stats.violations, (unsigned long)pred.stats.checks,
+          pred.stats.error_max, pred.stats.bound_at_error_max);
+    CHECK(pred.stats.checks > 0, "no checks ran");
+    CHECK(queries >= 10u * pred.stats.syncs, "only %.1f queries per sync",
+          (double)queries / pred.stats.syncs);
+    CHECK(err_max <= TOLERANCE, "error %.1f steps over the tolerance", err_max);
+
+    return HOST_TEST_RESULT("test_predict");
+}
@@ -0,0 +1,204 @@
+/*
+ * test_pvt.c — PVT playback on simulated TMC5240s
+ *
+ * Two axes trace a 1:2 Lissajous figure, at rest at both ends, streamed as
+ * PVT points with the ring topped up as it drains. Ticks are latched as
+ * by the timer callback and run by stepper_pvt_service(). Playback must end on the last point and track the curve
+ * within a few steps. A stall in the stream mid-trajectory must be
+ * reported as an underrun and resume cleanly.
+ *
+ * Points that the fixed-point interpolation cannot play (zero or overlong
+ * segments, velocities or segment speeds past the driver limit) must be
+ * refused at push time, and a refused point must not become the start of
+ * the next segment.
+ */
+
+#include "host_test.h"
+#include "stepper_pvt.h"
+#include "tmc5240_driver.h"
+#include "tmc5240_sim.h"
+
+#include <math.h>
+
+#define AXES            2
+#define TICK_US         1000u
+#define KP              50
+#define RADIUS          2000.0
+#define OMEGA           (2.0 * M_PI)        /* rad/s: one period per second */
+#define POINT_US        10000u
+#define POINTS          200u                /* Two periods */
+#define STALL_AT        120u                /* Points pushed before the stream stalls */
+#define STALL_US        (STEPPER_PVT_DEPTH * POINT_US + 100000u)
+#define TRACK_TOL       4                   /* steps */
+
+static Tmc5240Sim sim[AXES];
+static TMC5240_Context ctx[AXES];
+static Stepper axes[AXES];
+static StepperGroup group;
+
+static void setup(void)
+{
+    tmc5240_sim_attach(sim, AXES);
+
+    stepper_group_init(&group);
+    for (uint8_t i = 0; i < AXES; i++) {
+        ctx[i] = (TMC5240_Context){
+            .icID = i,
+            .hspi = &sim[i].hspi,
+            .cs_port = GPIOA,
+            .cs_pin = (uint16_t)(1u << i),
+            .vmax = 0x4E20,
+            .amax = 0x0F8D,
+            .dmax = 0x0F8D,
+        };
+        stepper_init(&axes[i], i, &TMC5240_Driver, &ctx[i]);
+        stepper_group_add(&group, &axes[i]);
+    }
+    stepper_group_enable(&group, true);
+}
+
+/* Point n of the figure: starts and ends at rest on (0, 0) */
+static StepperPvtPoint figure_point(uint32_t n)
+{
+    double t = (double)n * POINT_US * 1e-6;
+    StepperPvtPoint p = { .duration_us = POINT_US };
+
+    p.position[0] = (int32_t)lround(RADIUS * (1.0 - cos(OMEGA * t)));
+    p.position[1] = (int32_t)lround(RADIUS * (1.0 - cos(2.0 * OMEGA * t)) / 2.0);
+    p.velocity[0] = (int32_t)lround(RADIUS * OMEGA * sin(OMEGA * t));
+    p.velocity[1] = (int32_t)lround(RADIUS * OMEGA * sin(2.0 * OMEGA * t));
+    if (n == POINTS)
+        p.velocity[0] = p.velocity[1] = 0;
+    return p;
+}
+
+static void test_validation(void)
+{
+    static StepperPvt pvt;
+    const int32_t v_limit = (int32_t)TMC5240_MAX_SPS;
+    StepperPvtPoint p = { .duration_us = 1000 };
+
+    setup();
+    CHECK(stepper_pvt_init(&pvt, &group, AXES, TICK_US, 0), "init rejected");
+
+    p.duration_us = 0;
+    CHECK(!stepper_pvt_push(&pvt, &p), "zero duration accepted");
+    p.duration_us = STEPPER_PVT_SEGMENT_MAX_US + 1u;
+    CHECK(!stepper_pvt_push(&pvt, &p), "overlong segment accepted");
+
+    p.duration_us = 1000;
+    p.velocity[1] = v_limit + 1;
+    CHECK(!stepper_pvt_push(&pvt, &p), "velocity over the limit accepted");
+    p.velocity[1] = INT32_MIN;
+    CHECK(!stepper_pvt_push(&pvt, &p), "INT32_MIN velocity accepted");
+    p.velocity[1] = -v_limit;
+    CHECK(stepper_pvt_push(&pvt, &p), "velocity at the limit refused");
+    p.velocity[1] = 0;
+
+    /* |dp| / T against the last accepted point */
+    p.duration_us = 1;
+    p.position[0] = 7;
+    CHECK(!stepper_pvt_push(&pvt, &p), "7 steps in 1 us accepted");
+    p.position[0] = 6;
+    CHECK(stepper_pvt_push(&pvt, &p), "6 steps in 1 us refused");
+
+    p.duration_us = STEPPER_PVT_SEGMENT_MAX_US;
+    p.position[0] = 6 + v_limit + 1;
+    CHECK(!stepper_pvt_push(&pvt, &p), "segment speed over the limit accepted");
+    p.position[0] = INT32_MAX;
+    p.position[1] = INT32_MIN;
+    CHECK(!stepper_pvt_push(&pvt, &p), "full-range jump accepted");
+    p.position[0] = 6 + v_limit;
+    p.position[1] = 0;
+    CHECK(stepper_pvt_push(&pvt, &p), "segment at the limit refused");
+
+    printf("  %lu accepted, %lu refused, %u queued\n", (unsigned long)pvt.stats.pushed,
+           (unsigned long)pvt.stats.rejected, stepper_pvt_level(&pvt));
+    CHECK(pvt.stats.pushed == 3 && pvt.stats.rejected == 7, "%lu accepted, %lu refused",
+          (unsigned long)pvt.stats.pushed, (unsigned long)pvt.stats.rejected);
+    CHECK(stepper_pvt_level(&pvt) == 3, "%u points queued", stepper_pvt_level(&pvt));
+
+    stepper_pvt_stop(&pvt);
+    CHECK(stepper_pvt_level(&pvt) == 0, "stop left %u points", stepper_pvt_level(&pvt));
+}
+
+/* Push figure points while there is room; returns the next point index */
+static uint32_t feed(StepperPvt *pvt, uint32_t next, uint32_t last)
+{
+    while (next <= last && stepper_pvt_free(pvt) > 0) {
+        StepperPvtPoint p = figure_point(next);
+        CHECK(stepper_pvt_push(pvt, &p), "point %lu refused", (unsigned long)next);
+        next++;
+    }
+    return next;
+}
+
+static void test_playback(void)
+{
+    static StepperPvt pvt;
+    uint32_t next = 1;
+    uint32_t stall_left = STALL_US;
+    uint32_t ticks = 0;
+    bool stalled = false;
+    int32_t error_before_stall = -1;
+
+    setup();
+    CHECK(stepper_pvt_init(&pvt, &group, AXES, TICK_US, KP), "init rejected");
+
+    next = feed(&pvt, next, STALL_AT);
+    stepper_pvt_start(&pvt);
+
+    for (;;) {
+        host_advance_us(TICK_US);
+        tmc5240_sim_run();
+        stepper_pvt_tick_irq(&pvt);
+        if (!stepper_pvt_service(&pvt))
+            break;
+        if (++ticks > 2u * POINTS * POINT_US / TICK_US) {
+            CHECK(false, "playback still running after %lu ticks", (unsigned long)ticks);
+            break;
+        }
+
+        /* Stream stalls once, long enough for the ring to run dry */
+        if (next > STALL_AT && stall_left) {
+            if (error_before_stall < 0)
+                error_before_stall = pvt.stats.error_max;
+            stall_left = (stall_left > TICK_US) ? stall_left - TICK_US : 0;
+            stalled = stalled || pvt.state == STEPPER_PVT_UNDERRUN;
+            continue;
+        }
+        next = feed(&pvt, next, (next <= STALL_AT) ? STALL_AT : POINTS);
+    }
+
+    host_advance_us(200000u);
+    tmc5240_sim_run();
+
+    stepper_pvt_print_stats(&pvt);
+    StepperPvtPoint end = figure_point(POINTS);
+    printf("  %lu segments, %lu underruns, tracking error max %ld steps (%ld with the stall), "
+           "ended at (%ld, %ld)\n",
+           (unsigned long)pvt.stats.segments, (unsigned long)pvt.stats.underruns,
+           (long)error_before_stall, (long)pvt.stats.error_max,
+           (long)tmc5240_sim_xactual(&sim[0]), (long)tmc5240_sim_xactual(&sim[1]));
+
+    CHECK(pvt.state == STEPPER_PVT_IDLE, "playback did not finish");
+    CHECK(pvt.stats.ticks_missed == 0, "%lu ticks missed", (unsigned long)pvt.stats.ticks_missed);
+    CHECK(pvt.stats.segments == POINTS, "%lu of %u segments played",
+          (unsigned long)pvt.stats.segments, POINTS);
+    CHECK(stalled && pvt.stats.underruns == 1, "%lu underruns", (unsigned long)pvt.stats.underruns);
+    CHECK(error_before_stall >= 0 && error_before_stall <= TRACK_TOL, "tracking error %ld steps",
+          (long)error_before_stall);
+    for (uint8_t i = 0; i < AXES; i++) {
+        int32_t err = tmc5240_sim_xactual(&sim[i]) - end.position[i];
+        CHECK(err >= -TRACK_TOL && err <= TRACK_TOL, "axis %u ended %ld steps off", i, (long)err);
+    }
+}
+
+int main(void)
+{
+    printf("PVT point validation\n");
+    test_validation();
+    printf("PVT playback\n");
+    test_playback();
+    return HOST_TEST_RESULT("test_pvt");
+}
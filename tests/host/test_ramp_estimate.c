@@ -0,0 +1,201 @@
+/*
+ * test_ramp_estimate.c — tmc5240_ramp_time_us against a simulated ramp
+ *
+ * The estimator is closed-form integer math; the reference integrates the
+ * ramp generator in small time steps with the same bands (VSTART, A1/V1,
+ * A2/V2, AMAX/VMAX, DMAX, D2, D1, VSTOP), the TVMAX plateau and TZEROWAIT.
+ * stepper_estimate_move_time() must reach the model through the driver's
+ * move_time op, and give up on a smart driver without one.
+ *
+ * The arrival bound poll_motion() reports (no completion poll before it)
+ * must never exceed the modelled arrival, on ramps where VSTART, A1 or A2
+ * beat AMAX.
+ */
+
+#include "host_test.h"
+#include "stepper.h"
+#include "tmc5240_driver.h"
+#include "tmc5240_sim.h"
+
+#define SIM_DT_S        2e-6
+#define SIM_LIMIT_S     20.0
+#define ERR_LIMIT       0.015       /* Relative, covers ramp clock quantization */
+
+static const double fclk = TMC5240_FCLK_HZ;
+
+/* Register units to steps/s and steps/s^2 */
+static double sps(uint32_t v)  { return v * fclk / 16777216.0; }
+static double sps2(uint32_t a) { return a * fclk * fclk / 2199023255552.0; }
+
+static double decel_at(const TMC5240_Ramp *r, double v, double *band_end)
+{
+    if (v > sps(r->v2) && v > sps(r->v1)) {
+        *band_end = sps(r->v2 > r->v1 ? r->v2 : r->v1);
+        return sps2(r->dmax);
+    }
+    if (v > sps(r->v1)) {
+        *band_end = sps(r->v1);
+        return sps2(r->d2);
+    }
+    *band_end = sps(r->vstop);
+    return sps2(r->d1);
+}
+
+static double accel_at(const TMC5240_Ramp *r, double v)
+{
+    if (v < sps(r->v1))
+        return sps2(r->a1);
+    if (v < sps(r->v2))
+        return sps2(r->a2);
+    return sps2(r->amax);
+}
+
+/* Distance needed to brake from v to VSTOP */
+static double braking_distance(const TMC5240_Ramp *r, double v)
+{
+    double d = 0.0;
+    double vstop = sps(r->vstop);
+
+    while (v > vstop + 1e-9) {
+        double end;
+        double a = decel_at(r, v, &end);
+        if (end < vstop)
+            end = vstop;
+        d += (v * v - end * end) / (2.0 * a);
+        v = end;
+    }
+    return d;
+}
+
+/* Move duration in us, or a negative value past SIM_LIMIT_S */
+static double simulate_us(const TMC5240_Ramp *r, double distance)
+{
+    enum { ACCEL, PLATEAU, CRUISE, DECEL } phase = ACCEL;
+    double tvmax_s = r->tvmax * 512.0 / fclk;
+    double vmax = sps(r->vmax);
+    double x = 0.0;
+    double v = sps(r->vstart);
+    double t = 0.0;
+    double plateau = 0.0;
+
+    for (;;) {
+        double rem = distance - x;
+        double brake = braking_distance(r, v);
+
+        if (phase == ACCEL) {
+            if (brake + v * tvmax_s >= rem)
+                phase = (v < vmax - 1e-6 && r->tvmax) ? PLATEAU : DECEL;
+            else if (v >= vmax)
+                phase = CRUISE;
+        }
+        if (phase == CRUISE && brake >= rem)
+            phase = DECEL;
+
+        double a = 0.0;
+        double end;
+        if (phase == ACCEL) {
+            a = accel_at(r, v);
+        } else if (phase == PLATEAU) {
+            plateau += SIM_DT_S;
+            if (plateau >= tvmax_s)
+                phase = DECEL;
+        } else if (phase == DECEL) {
+            a = -decel_at(r, v, &end);
+        }
+
+        double nv = v + a * SIM_DT_S;
+        if (phase == ACCEL && nv > vmax)
+            nv = vmax;
+        x += 0.5 * (v + nv) * SIM_DT_S;
+        v = nv;
+        t += SIM_DT_S;
+
+        if (x >= distance || (phase == DECEL && v <= sps(r->vstop)))
+            break;
+        if (t > SIM_LIMIT_S)
+            return -1.0;
+    }
+
+    return t * 1e6 + r->tzerowait * 512.0 / fclk * 1e6;
+}
+
+int main(void)
+{
+    static const TMC5240_Ramp ramps[] = {
+        /* vstart  a1     v1     a2    v2     amax  vmax    dmax  d2    d1    vstop tvmax tzerowait */
+        { 0,       0,     0,     0,    0,     3981, 10000,  3981, 10,   10,   10,   3981, 0    },
+        { 0,       0,     0,     0,    0,     3981, 10000,  3981, 10,   10,   10,   0,    0    },
+        { 500,     8000,  20000, 3000, 60000, 1000, 150000, 1500, 2500, 9000, 600,  200,  1000 },
+        { 0,       2000,  5000,  0,    0,     500,  40000,  700,  10,   3000, 10,   0,    0    },
+    };
+    static const uint32_t distances[] = { 10, 100, 500, 2000, 5000, 20000, 100000, 1000000 };
+    double worst = 0.0;
+
+    for (size_t i = 0; i < sizeof(ramps) / sizeof(ramps[0]); i++) {
+        for (size_t j = 0; j < sizeof(distances) / sizeof(distances[0]); j++) {
+            uint32_t est = tmc5240_ramp_time_us(&ramps[i], distances[j]);
+            double sim = simulate_us(&ramps[i], distances[j]);
+
+            if (sim < 0.0)
+                continue;
+
+            double err = (est - sim) / sim;
+            printf("  ramp %zu d=%7lu est %10lu us sim %12.1f us err %+.2f%%\n", i,
+                   (unsigned long)distances[j], (unsigned long)est, sim, err * 100.0);
+            if (err < 0.0)
+                err = -err;
+            if (err > worst)
+                worst = err;
+            CHECK(err <= ERR_LIMIT, "ramp %zu, %lu steps: %.2f%% off", i,
+                  (unsigned long)distances[j], err * 100.0);
+        }
+    }
+
+    printf("  worst %.2f%%\n", worst * 100.0);
+
+    /* The generic estimate through the driver op, at the context's ramp */
+    const TMC5240_Ramp *r = &ramps[2];
+    TMC5240_Context ctx = {
+        .vstart = r->vstart, .a1 = r->a1, .v1 = r->v1, .a2 = r->a2, .v2 = r->v2,
+        .amax = r->amax, .vmax = r->vmax, .dmax = r->dmax, .d2 = r->d2, .d1 = r->d1,
+        .vstop = r->vstop, .tvmax = r->tvmax, .tzerowait = r->tzerowait,
+    };
+    Stepper axis = { .driver = &TMC5240_Driver, .hw_context = &ctx };
+    uint32_t est = stepper_estimate_move_time(&axis, 100, -1900);
+    CHECK(est == tmc5240_ramp_time_us(r, 2000), "stepper estimate %lu us, model %lu us",
+          (unsigned long)est, (unsigned long)tmc5240_ramp_time_us(r, 2000));
+
+    StepperDriver no_model = TMC5240_Driver;
+    no_model.caps &= ~STEPPER_CAP_MOVE_TIME;
+    axis.driver = &no_model;
+    CHECK(stepper_estimate_move_time(&axis, 0, 2000) == UINT32_MAX,
+          "estimate without STEPPER_CAP_MOVE_TIME");
+
+    /* Arrival bound from rest against the model, TZEROWAIT aside */
+    static Tmc5240Sim sim;
+    tmc5240_sim_attach(&sim, 1);
+    for (size_t i = 0; i < sizeof(ramps) / sizeof(ramps[0]); i++) {
+        const TMC5240_Ramp *n = &ramps[i];
+
+        for (size_t j = 0; j < sizeof(distances) / sizeof(distances[0]); j++) {
+            ctx = (TMC5240_Context){
+                .hspi = &sim.hspi, .cs_port = GPIOA, .cs_pin = GPIO_PIN_0,
+                .vstart = n->vstart, .a1 = n->a1, .v1 = n->v1, .a2 = n->a2, .v2 = n->v2,
+                .amax = n->amax, .vmax = n->vmax, .dmax = n->dmax, .d2 = n->d2, .d1 = n->d1,
+                .vstop = n->vstop, .tvmax = n->tvmax,
+            };
+            stepper_init(&axis, 0, &TMC5240_Driver, &ctx);
+            stepper_move_to_position(&axis, (int32_t)distances[j]);
+
+            uint32_t quiet_us = 0;
+            TMC5240_Ramp arrival = *n;
+            arrival.tzerowait = 0;
+            uint32_t t = tmc5240_ramp_time_us(&arrival, distances[j]);
+
+            CHECK(!TMC5240_Driver.poll_motion(&axis, &quiet_us) && quiet_us <= t,
+                  "ramp %zu, %lu steps: no poll for %lu us, arrival at %lu us", i,
+                  (unsigned long)distances[j], (unsigned long)quiet_us, (unsigned long)t);
+        }
+    }
+    return HOST_TEST_RESULT("test_ramp_estimate");
+}
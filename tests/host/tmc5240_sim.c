@@ -0,0 +1,297 @@
+/*
+ * tmc5240_sim.c — TMC5240 emulation for the host tests
+ */
+
+#include "tmc5240_sim.h"
+#include "tmc5240_driver.h"
+
+#include <math.h>
+#include <string.h>
+
+#define SIM_STEP_S      5e-6
+
+static Tmc5240Sim *sim_table;
+static uint8_t sim_count;
+
+/* ============================================================================
+ *  Internal Helpers
+ * ========================================================================== */
+
+static double sim_sps(uint32_t v)  { return v * (double)TMC5240_FCLK_HZ / 16777216.0; }
+static double sim_sps2(uint32_t a) { return a * (double)TMC5240_FCLK_HZ * TMC5240_FCLK_HZ / 2199023255552.0; }
+
+/* Ramp registers in steps/s, steps/s^2 and seconds */
+typedef struct
+{
+    double vstart, a1, v1, a2, v2, amax, vmax, dmax, d2, d1, vstop, tvmax;
+} SimRamp;
+
+static void sim_ramp(const Tmc5240Sim *s, SimRamp *r)
+{
+    r->vstart = sim_sps((uint32_t)s->reg[TMC5240_VSTART]);
+    r->a1     = sim_sps2((uint32_t)s->reg[TMC5240_A1]);
+    r->v1     = sim_sps((uint32_t)s->reg[TMC5240_V1]);
+    r->a2     = sim_sps2((uint32_t)s->reg[TMC5240_A2]);
+    r->v2     = sim_sps((uint32_t)s->reg[TMC5240_V2]);
+    r->amax   = sim_sps2((uint32_t)s->reg[TMC5240_AMAX]);
+    r->vmax   = sim_sps((uint32_t)s->reg[TMC5240_VMAX]);
+    r->dmax   = sim_sps2((uint32_t)s->reg[TMC5240_DMAX]);
+    r->d2     = sim_sps2((uint32_t)s->reg[TMC5240_D2]);
+    r->d1     = sim_sps2((uint32_t)s->reg[TMC5240_D1]);
+    r->vstop  = sim_sps((uint32_t)s->reg[TMC5240_VSTOP]);
+    r->tvmax  = (uint32_t)s->reg[TMC5240_TVMAX] * 512.0 / TMC5240_FCLK_HZ;
+}
+
+/* A1 below V1, A2 below V2, AMAX above */
+static double sim_accel(const SimRamp *r, double v)
+{
+    if (v < r->v1)
+        return r->a1;
+    if (v < r->v2)
+        return r->a2;
+    return r->amax;
+}
+
+/* DMAX above V1 and V2, D2 down to V1, D1 below; *end = lower edge */
+static double sim_decel(const SimRamp *r, double v, double *end)
+{
+    if (v > r->v2 && v > r->v1) {
+        *end = fmax(r->v1, r->v2);
+        return r->dmax;
+    }
+    if (v > r->v1) {
+        *end = r->v1;
+        return r->d2;
+    }
+    *end = 0.0;
+    return r->d1;
+}
+
+/* Distance to slow from v down to VSTOP */
+static double sim_brake(const SimRamp *r, double v)
+{
+    double dist = 0.0;
+
+    while (v > r->vstop) {
+        double end;
+        double d = sim_decel(r, v, &end);
+
+        if (d <= 0.0)
+            return INFINITY;
+        if (end < r->vstop)
+            end = r->vstop;
+        dist += (v * v - end * end) / (2.0 * d);
+        v = end;
+    }
+    return dist;
+}
+
+/* Velocity mode: AMAX both ways, no start/stop speeds */
+static double sim_velocity_dv(const Tmc5240Sim *s, const SimRamp *r, double want, double dt)
+{
+    double dv = want - s->v;
+    double lim = r->amax * dt;
+
+    return (dv > lim) ? lim : (dv < -lim) ? -lim : dv;
+}
+
+/*
+ * Position mode: the six-point ramp. Starts at VSTART, accelerates through
+ * the A1 / A2 / AMAX bands, holds a peak below VMAX for TVMAX, brakes
+ * through DMAX / D2 / D1 and stops from VSTOP on the target.
+ */
+static double sim_position_dv(Tmc5240Sim *s, const SimRamp *r, double dt)
+{
+    double d = (double)s->reg[TMC5240_XTARGET] - s->x;
+    double dir = (d >= 0.0) ? 1.0 : -1.0;
+    double left = fabs(d);
+    double u = s->v * dir;          /* Speed toward the target */
+    double end;
+
+    if (u < 0.0) {
+        /* Moving away: slow down, the stop from VSTOP is immediate */
+        double a = sim_decel(r, -u, &end);
+        if (-u <= r->vstop)
+            return -s->v;
+        return dir * fmin(a * dt, -u);
+    }
+
+    if (u == 0.0 && r->vstart > 0.0)
+        return dir * fmin(r->vstart, r->vmax);
+
+    if (s->braking || sim_brake(r, u) >= left) {
+        /*
+         * Brake at exactly the rate that ends on the target (the band's
+         * deceleration up to the step delay), creep in at VSTOP
+         */
+        s->braking = true;
+        if (u <= r->vstop)
+            return 0.0;
+        double a = sim_decel(r, u, &end) * sim_brake(r, u) / left;
+        return -dir * fmin(a * dt, u - fmax(end, r->vstop));
+    }
+
+    if (u > r->vmax)
+        return -dir * fmin(sim_decel(r, u, &end) * dt, u - r->vmax);
+
+    if (s->peaked || u == r->vmax)
+        return 0.0;
+
+    /* Peak reached once TVMAX at this speed plus braking fills the distance */
+    if (r->tvmax > 0.0 && sim_brake(r, u) + u * r->tvmax >= left) {
+        s->peaked = true;
+        return 0.0;
+    }
+    return dir * fmin(sim_accel(r, u) * dt, r->vmax - u);
+}
+
+static void sim_step(Tmc5240Sim *s, double dt)
+{
+    uint8_t mode = (uint8_t)s->reg[TMC5240_RAMPMODE];
+    SimRamp r;
+    double dv;
+
+    sim_ramp(s, &r);
+
+    if (mode == TMC5240_MODE_VELPOS) {
+        dv = sim_velocity_dv(s, &r, r.vmax, dt);
+    } else if (mode == TMC5240_MODE_VELNEG) {
+        dv = sim_velocity_dv(s, &r, -r.vmax, dt);
+    } else if (mode == TMC5240_MODE_HOLD) {
+        dv = 0.0;
+    } else {
+        double d = (double)s->reg[TMC5240_XTARGET] - s->x;
+
+        /* Stopped within the last microsteps: settle on the target */
+        if (fabs(d) < 0.5 && fabs(s->v) <= fmax(r.vstop, r.dmax * dt)) {
+            s->x = (double)s->reg[TMC5240_XTARGET];
+            s->v = 0.0;
+            s->peaked = false;
+            s->braking = false;
+            return;
+        }
+        dv = sim_position_dv(s, &r, dt);
+    }
+
+    double before = (double)s->reg[TMC5240_XTARGET] - s->x;
+
+    s->x += (s->v + 0.5 * dv) * dt;
+    s->v += dv;
+
+    /* The braking parabola ends on the target: stop there */
+    if (mode == TMC5240_MODE_POSITION &&
+        before * ((double)s->reg[TMC5240_XTARGET] - s->x) <= 0.0) {
+        s->x = (double)s->reg[TMC5240_XTARGET];
+        s->v = 0.0;
+        s->peaked = false;
+        s->braking = false;
+    }
+}
+
+static void sim_advance(Tmc5240Sim *s, uint32_t now)
+{
+    double cycles_per_s = (double)SystemCoreClock;
+    double t = (double)(uint32_t)(now - s->last_cycles) / cycles_per_s;
+
+    s->last_cycles = now;
+    while (t > 0.0) {
+        double dt = (t < SIM_STEP_S) ? t : SIM_STEP_S;
+        sim_step(s, dt);
+        t -= dt;
+    }
+}
+
+static int32_t sim_read(const Tmc5240Sim *s, uint8_t addr)
+{
+    switch (addr) {
+    case TMC5240_XACTUAL:
+        return tmc5240_sim_xactual(s);
+    case TMC5240_VACTUAL:
+        return (int32_t)lround(s->v * 16777216.0 / TMC5240_FCLK_HZ) & 0x00FFFFFF;
+    case TMC5240_RAMPSTAT:
+        return s->reg[TMC5240_RAMPSTAT];
+    default:
+        return s->reg[addr];
+    }
+}
+
+static uint8_t sim_status(const Tmc5240Sim *s)
+{
+    uint8_t st = 0;
+
+    if (s->v == 0.0)
+        st |= TMC5240_SPI_STATUS_STANDSTILL_MASK;
+    if (s->reg[TMC5240_RAMPMODE] == TMC5240_MODE_POSITION && s->v == 0.0 &&
+        tmc5240_sim_xactual(s) == s->reg[TMC5240_XTARGET])
+        st |= TMC5240_SPI_STATUS_POSITION_REACHED_MASK;
+    return st;
+}
+
+static void sim_frame(SPI_HandleTypeDef *hspi, const uint8_t *tx, uint8_t *rx, uint16_t size)
+{
+    Tmc5240Sim *s = NULL;
+
+    for (uint8_t i = 0; i < sim_count; i++)
+        if (&sim_table[i].hspi == hspi)
+            s = &sim_table[i];
+    if (!s || size < 5)
+        return;
+
+    sim_advance(s, DWT->CYCCNT);
+    s->frames++;
+
+    uint8_t addr = tx[0] & TMC5240_ADDRESS_MASK;
+    int32_t value = ((int32_t)tx[1] << 24) | ((int32_t)tx[2] << 16) |
+                    ((int32_t)tx[3] <<  8) | ((int32_t)tx[4]);
+
+    rx[0] = sim_status(s);
+    rx[1] = (uint8_t)(s->reply >> 24);
+    rx[2] = (uint8_t)(s->reply >> 16);
+    rx[3] = (uint8_t)(s->reply >> 8);
+    rx[4] = (uint8_t)s->reply;
+
+    if (tx[0] & TMC5240_WRITE_BIT) {
+        if (addr == TMC5240_XACTUAL)
+            s->x = value;
+        else if (addr == TMC5240_RAMPSTAT)
+            s->reg[addr] &= ~value;             /* Write 1 to clear */
+        else
+            s->reg[addr] = value;
+        s->peaked = false;                      /* New command: replan */
+        s->braking = false;
+        s->reply = 0;
+    } else {
+        s->reply = sim_read(s, addr);
+    }
+}
+
+/* ============================================================================
+ *  Public API
+ * ========================================================================== */
+
+void tmc5240_sim_attach(Tmc5240Sim *sims, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        memset(&sims[i], 0, sizeof(sims[i]));
+        sims[i].last_cycles = DWT->CYCCNT;
+    }
+    sim_table = sims;
+    sim_count = count;
+    host_spi_hook = sim_frame;
+}
+
+void tmc5240_sim_run(void)
+{
+    for (uint8_t i = 0; i < sim_count; i++)
+        sim_advance(&sim_table[i], DWT->CYCCNT);
+}
+
+int32_t tmc5240_sim_xactual(const Tmc5240Sim *sim)
+{
+    return (int32_t)lround(sim->x);
+}
+
+double tmc5240_sim_velocity(const Tmc5240Sim *sim)
+{
+    return sim->v;
+}
@@ -0,0 +1,39 @@
+/*
+ * tmc5240_sim.h — TMC5240 register file and ramp generator behind the
+ * host SPI stub
+ *
+ * Each simulated chip owns one SPI handle. Frames behave like the real
+ * interface: writes land immediately, a read request is latched at its
+ * own frame and returned by the next one, and the status byte carries
+ * the ramp flags. Motion is integrated lazily up to DWT->CYCCNT.
+ */
+
+#ifndef TMC5240_SIM_H
+#define TMC5240_SIM_H
+
+#include "host_test.h"
+
+typedef struct
+{
+    SPI_HandleTypeDef hspi;
+    int32_t reg[128];           /* Last written values */
+    double x;                   /* Position, steps */
+    double v;                   /* Velocity, steps/s */
+    bool peaked;                /* Holding the peak for TVMAX */
+    bool braking;               /* On the final deceleration */
+    uint32_t last_cycles;       /* DWT cycle of the last integration */
+    int32_t reply;              /* Latched answer to the pending read */
+    uint32_t frames;
+} Tmc5240Sim;
+
+/* Route host SPI frames to count chips (also resets them) */
+void tmc5240_sim_attach(Tmc5240Sim *sims, uint8_t count);
+
+/* Integrate every attached chip up to DWT->CYCCNT */
+void tmc5240_sim_run(void);
+
+/* Current XACTUAL / velocity in steps/s */
+int32_t tmc5240_sim_xactual(const Tmc5240Sim *sim);
+double tmc5240_sim_velocity(const Tmc5240Sim *sim);
+
+#endif /* TMC5240_SIM_H */
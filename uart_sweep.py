@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""
+Host side of uart_rx_benchmark_sweep() (uart_rx.h): streams to USART2 at
+every rate the firmware announces and compares what was sent with what
+the firmware counted.
+
+Build with -DUART_RX_SWEEP=ON and start this before resetting the board.
+For each "UART RX sweep: <baud> baud, <ms> ms" line the port follows to
+the new rate. The script streams for most of the window and then reads
+the three stats lines. Paced streaming (--load below 1) leaves idle gaps
+between chunks, so the idle-line events fire as they would between
+commands.
+
+    python3 uart_sweep.py /dev/ttyACM0
+    python3 uart_sweep.py /dev/ttyACM0 --load 0.5
+
+Needs pyserial.
+"""
+import argparse
+import re
+import sys
+import time
+
+ANNOUNCE = re.compile(r'UART RX sweep: (\d+) baud, (\d+) ms')
+DONE = re.compile(r'UART RX sweep: done')
+TOTAL = re.compile(r'UART RX @ (\d+) baud: (\d+) B/s over (\d+) ms, (\d+) bytes total, (\d+) dropped')
+CHUNK = 64
+
+
+def read_line(port, timeout):
+    end = time.monotonic() + timeout
+    line = b''
+    while time.monotonic() < end:
+        c = port.read(1)
+        if not c:
+            continue
+        if c == b'\n':
+            return line.decode('ascii', 'replace').strip()
+        line += c
+    return None
+
+
+def stream(port, baud, seconds, load):
+    """Send a counting pattern for `seconds`; returns bytes written"""
+    chunk = bytes(i & 0x7F for i in range(CHUNK))
+    chunk_s = CHUNK * 10.0 / baud
+    sent = 0
+    start = time.monotonic()
+    while time.monotonic() - start < seconds:
+        port.write(chunk)
+        sent += CHUNK
+        if load < 1.0:
+            time.sleep(chunk_s * (1.0 / load - 1.0))
+    port.flush()
+    return sent
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    ap.add_argument('port', help='serial port of USART2')
+    ap.add_argument('--baud', type=int, default=115200, help='rate the firmware boots at')
+    ap.add_argument('--load', type=float, default=1.0, help='fraction of the line rate to stream')
+    args = ap.parse_args()
+
+    import serial  # pyserial
+    port = serial.Serial(args.port, args.baud, timeout=0.05)
+    results = []
+
+    while True:
+        line = read_line(port, 30.0)
+        if line is None:
+            sys.exit('no announcement from the firmware')
+        if DONE.search(line):
+            break
+        m = ANNOUNCE.search(line)
+        if not m:
+            continue
+
+        baud, window_ms = int(m.group(1)), int(m.group(2))
+        port.baudrate = baud
+        sent = stream(port, baud, window_ms * 0.8e-3, args.load)
+
+        stats = []
+        while len(stats) < 3:
+            line = read_line(port, window_ms * 1e-3 + 2.0)
+            if line is None:
+                break
+            if line.startswith('UART RX'):
+                stats.append(line)
+        for s in stats:
+            print(s)
+
+        m = TOTAL.search(stats[0]) if stats else None
+        got = int(m.group(4)) if m else 0
+        dropped = int(m.group(5)) if m else 0
+        lost = sent - got - dropped
+        results.append((baud, sent, got, dropped, lost))
+        print(f'{baud:>9} baud: sent {sent} B, received {got}, dropped {dropped}, lost on the line {lost}')
+
+    print('\n     baud       sent   received  dropped     lost')
+    for baud, sent, got, dropped, lost in results:
+        print(f'{baud:>9} {sent:>10} {got:>10} {dropped:>8} {lost:>8}')
+
+
+if __name__ == '__main__':
+    main()